@@ -494,3 +494,27 @@ void divmod10(uint32_t in, uint32_t &div, uint8_t &mod)
     : "r"(in), "r"(&mod), "r"(&div)
     : "r0", "r26", "r27", "r31", "r31");
 }
+
+uint16_t isqrt32(uint32_t n)
+{
+  // bit-by-bit square root, one bit of the root per iteration (16 iterations, no multiplication)
+  uint32_t root{ 0 };
+  uint32_t place{ 1UL << 30 };
+
+  while (place > n)
+  {
+    place >>= 2;
+  }
+
+  while (place)
+  {
+    if (n >= root + place)
+    {
+      n -= root + place;
+      root += place << 1;
+    }
+    root >>= 1;
+    place >>= 2;
+  }
+  return root;
+}
@@ -26,4 +26,119 @@ extern unsigned int divu3(unsigned int n) __attribute__((noinline));
 
 extern void divmod10(uint32_t in, uint32_t &div, uint8_t &mod) __attribute__((noinline));
 
+extern uint16_t isqrt32(uint32_t n) __attribute__((noinline));
+
+/**
+ * @brief Upper 32 bits of the 64-bit product a * b
+ * @details Built from four 16x16 multiplications, much faster than a 64-bit product on AVR.
+ *
+ * @param a First factor
+ * @param b Second factor
+ * @return uint32_t (a * b) >> 32
+ */
+inline uint32_t mulhi(const uint32_t a, const uint32_t b)
+{
+  const uint16_t aL{ static_cast< uint16_t >(a) };
+  const uint16_t aH{ static_cast< uint16_t >(a >> 16) };
+  const uint16_t bL{ static_cast< uint16_t >(b) };
+  const uint16_t bH{ static_cast< uint16_t >(b >> 16) };
+
+  const uint32_t ll{ static_cast< uint32_t >(aL) * bL };
+  const uint32_t lh{ static_cast< uint32_t >(aL) * bH };
+  const uint32_t hl{ static_cast< uint32_t >(aH) * bL };
+  const uint32_t hh{ static_cast< uint32_t >(aH) * bH };
+
+  const uint32_t mid{ (ll >> 16) + (lh & 0xFFFFU) + (hl & 0xFFFFU) };
+
+  return hh + (lh >> 16) + (hl >> 16) + (mid >> 16);
+}
+
+/**
+ * @brief Multiply a signed value by a fraction in [0, 1[, rounding toward zero
+ *
+ * @param value The value
+ * @param fraction The fraction, x 2^32
+ * @return int32_t value * fraction / 2^32
+ */
+inline int32_t multiplyByFraction(const int32_t value, const uint32_t fraction)
+{
+  const bool bNegative{ value < 0 };
+  const uint32_t absValue{ bNegative ? -static_cast< uint32_t >(value) : static_cast< uint32_t >(value) };
+  const uint32_t result{ mulhi(absValue, fraction) };
+
+  return bNegative ? -static_cast< int32_t >(result) : static_cast< int32_t >(result);
+}
+
+/**
+ * @brief Square root of a value, times a fixed-point scale
+ * @details The value is first normalised by an even shift, so that the root keeps 16 significant
+ *          bits whatever the magnitude of the value. No float maths at all.
+ *
+ * @param value The value
+ * @param scale_q16 The scale, x 2^16
+ * @return uint32_t sqrt(value) * scale_q16 / 2^16, rounded toward zero
+ */
+inline uint32_t scaledSqrt(uint32_t value, const uint32_t scale_q16)
+{
+  if (!value)
+  {
+    return 0;
+  }
+
+  uint8_t shift{ 0 };
+  while (value < (1UL << 30))
+  {
+    value <<= 2;
+    ++shift;
+  }
+
+  return mulhi(static_cast< uint32_t >(isqrt32(value)) << 16, scale_q16) >> shift;
+}
+
+/**
+ * @brief Compile-time table of reciprocals for small divisors in [MIN..MAX]
+ * @details Each entry is ceil(2^32 / n). A division by any n of the range becomes the upper
+ *          32 bits of a 32x32 product, built from four 16x16 multiplications (~4x faster than
+ *          a 32-bit division on AVR). For |value| < 2^32 / MAX, the result is exact.
+ *          Outside the range, a regular division is performed.
+ *
+ * @tparam MIN Lowest divisor of the table
+ * @tparam MAX Highest divisor of the table
+ */
+template< uint8_t MIN, uint8_t MAX >
+class ReciprocalTable
+{
+  static_assert(MIN >= 2, "The reciprocal must fit in 32 bits");
+  static_assert(MAX >= MIN, "Wrong range");
+
+public:
+  constexpr ReciprocalTable()
+  {
+    for (uint8_t n = MIN; n <= MAX; ++n)
+    {
+      _rg[n - MIN] = static_cast< uint32_t >(((1ULL << 32) + n - 1) / n);
+    }
+  }
+
+  /**
+   * @brief Divide a signed value by n, rounding toward zero as the '/' operator does
+   *
+   * @param value The dividend
+   * @param n The divisor
+   * @return int32_t value / n
+   */
+  int32_t divide(const int32_t value, const uint8_t n) const
+  {
+    if (n < MIN || n > MAX)
+    {
+      return value / n;  // fallback, should rarely happen
+    }
+
+    return multiplyByFraction(value, _rg[n - MIN]);
+  }
+
+private:
+  uint32_t _rg[MAX - MIN + 1]{};
+};
+
 #endif /* FASTDIVISION_H */
@@ -0,0 +1,289 @@
+/**
+ * @file adc_sequencer.h
+ * @author Frédéric Metrich (frederic.metrich@live.fr)
+ * @brief Compile-time schedule of the ADC channels
+ * @version 0.1
+ * @date 2024-05-21
+ *
+ * @details One sample set is made of the V and I channels of each phase, in this order:
+ *          V1, I1, V2, I2, ..., followed by the extra channels (see 'sensorExtra').
+ *
+ *          With ADC_SETTLING_DISCARDS, a discarded conversion of the same pin is inserted before each
+ *          voltage channel: D1, V1, I1, D2, V2, I2, ... At clk/64 and clk/32, the sample-and-hold
+ *          capacitor has less time to charge through the high impedance of the voltage dividers,
+ *          the first conversion after a change of the mux then still carries some of the previous channel.
+ *
+ *          When the ADC interrupt fires, the next conversion is already under way,
+ *          so the channel must be selected for the conversion after the next one (see hal.h).
+ *
+ *          The dispatch is unrolled at compile time: each slot costs one comparison and
+ *          does exactly what a hand-written 'case' would do, with constant channel,
+ *          constant next index and constant phase number.
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef ADC_SEQUENCER_H
+#define ADC_SEQUENCER_H
+
+#include <Arduino.h>
+
+#include "hal.h"
+#include "processing.h"
+
+/** Type of the sampled channel */
+enum class ChannelTypes : uint8_t
+{
+  VOLTAGE, /**< voltage of one phase */
+  CURRENT, /**< current of one phase */
+  EXTRA,   /**< extra channel */
+  DISCARD  /**< conversion discarded for the settling of the mux */
+};
+
+/**
+ * @brief One slot of the schedule
+ *
+ */
+struct ChannelSlot
+{
+  ChannelTypes type{ ChannelTypes::VOLTAGE }; /**< type of the channel */
+  uint8_t index{ 0 };                         /**< phase number, or index in 'sensorExtra' */
+  uint8_t pin{ 0 };                           /**< analog input */
+  uint8_t column{ 0 };                        /**< position of the channel in a sample set (V1, I1, V2, I2, ..., extra channels) */
+};
+
+/**
+ * @brief Schedule of the ADC channels of one sample set
+ *
+ * @tparam P # of phases
+ * @tparam E # of extra channels
+ * @tparam D true to insert a discarded conversion before each voltage channel
+ */
+template< uint8_t P, uint8_t E, bool D >
+class _AdcSchedule
+{
+public:
+  constexpr _AdcSchedule()
+  {
+    uint8_t slot{ 0 };
+
+    for (uint8_t phase = 0; phase != P; ++phase)
+    {
+      if constexpr (D)
+      {
+        _slots[slot++] = { ChannelTypes::DISCARD, phase, sensorV[phase], static_cast< uint8_t >(2 * phase) };
+      }
+      _slots[slot++] = { ChannelTypes::VOLTAGE, phase, sensorV[phase], static_cast< uint8_t >(2 * phase) };
+      _slots[slot++] = { ChannelTypes::CURRENT, phase, sensorI[phase], static_cast< uint8_t >(2 * phase + 1) };
+    }
+    for (uint8_t extra = 0; extra != E; ++extra)
+    {
+      _slots[slot++] = { ChannelTypes::EXTRA, extra, sensorExtra[extra], static_cast< uint8_t >(2 * P + extra) };
+    }
+  }
+
+  /**
+   * @brief Get one slot
+   *
+   * @param i index of the slot [0..size[
+   * @return constexpr ChannelSlot the slot
+   */
+  constexpr ChannelSlot operator[](const uint8_t i) const
+  {
+    return _slots[i];
+  }
+
+  /**
+   * @brief Get the channel to be selected when the slot 'i' has been converted
+   *
+   * @param i index of the slot [0..size[
+   * @return constexpr uint8_t analog pin of the slot 'i + 2'
+   */
+  constexpr uint8_t lookAheadPin(const uint8_t i) const
+  {
+    return _slots[(i + 2) % size].pin;
+  }
+
+  static constexpr uint8_t size{ (D ? 3 : 2) * P + E }; /**< # of slots */
+  static constexpr uint8_t channels{ 2 * P + E };       /**< # of channels of a sample set */
+
+private:
+  ChannelSlot _slots[size]{};
+};
+
+inline constexpr _AdcSchedule< NO_OF_PHASES, NO_OF_EXTRA_CHANNELS, ADC_SETTLING_DISCARDS > adcSchedule; /**< the schedule of the ADC channels */
+
+static_assert(adcSchedule.size == NO_OF_ADC_CONVERSIONS, "The schedule must cover all ADC conversions");
+static_assert(adcSchedule.channels == NO_OF_ADC_CHANNELS, "The schedule must cover all ADC channels");
+static_assert(adcSchedule.size >= 2, "The look-ahead needs at least 2 channels");
+
+/**
+ * @brief Process the sample of slot 'I'
+ *
+ * @tparam I The slot of the sample
+ * @param rawSample The raw sample
+ *
+ * @ingroup TimeCritical
+ */
+template< uint8_t I >
+inline void processSlotSample(const int16_t rawSample) __attribute__((always_inline));
+
+template< uint8_t I >
+inline void processSlotSample(const int16_t rawSample)
+{
+  constexpr ChannelSlot slot{ adcSchedule[I] };
+
+  if constexpr (ChannelTypes::VOLTAGE == slot.type)
+  {
+    processVoltageRawSample< slot.index >(rawSample);
+  }
+  else if constexpr (ChannelTypes::CURRENT == slot.type)
+  {
+    processCurrentRawSample< slot.index >(rawSample);
+  }
+  else if constexpr (ChannelTypes::EXTRA == slot.type)
+  {
+    processExtraRawSample(slot.index, rawSample);
+  }
+}
+
+/**
+ * @brief Sums of the conversions of each slot, for the oversampling (see ADC_OVERSAMPLING_BITS)
+ *
+ */
+struct AdcDecimator
+{
+  uint16_t sum[adcSchedule.size]{}; /**< sum of the conversions of each slot, up to 64 x 1023 */
+  uint8_t count{ 0 };               /**< # of complete sample sets summed so far */
+};
+
+inline AdcDecimator adcDecimator; /**< owned by the ADC ISR */
+
+/**
+ * @brief Oversample and decimate the sample of slot 'I'
+ * @details The conversions of ADC_OVERSAMPLING_RATIO consecutive sample sets are summed for each slot.
+ *          The decimated sample (sum >> ADC_OVERSAMPLING_BITS) is processed with the last set,
+ *          so that the slots are still processed in the order of the schedule.
+ *          Without oversampling, the sample is processed right away. A discarded conversion is not even summed.
+ *
+ * @tparam I The slot of the sample
+ * @param rawSample The raw sample
+ *
+ * @ingroup TimeCritical
+ */
+template< uint8_t I >
+inline void decimateSlotSample(const int16_t rawSample) __attribute__((always_inline));
+
+template< uint8_t I >
+inline void decimateSlotSample(const int16_t rawSample)
+{
+  if constexpr (1 == ADC_OVERSAMPLING_RATIO)
+  {
+    processSlotSample< I >(rawSample);
+  }
+  else if constexpr (ChannelTypes::DISCARD == adcSchedule[I].type)
+  {
+    // nothing to sum, and the last slot is never a discarded one
+  }
+  else
+  {
+    auto &sum{ adcDecimator.sum[I] };
+
+    sum += rawSample;
+    if (ADC_OVERSAMPLING_RATIO - 1 == adcDecimator.count)
+    {
+      processSlotSample< I >(sum >> ADC_OVERSAMPLING_BITS);
+      sum = 0;
+    }
+
+    if constexpr (I + 1 == adcSchedule.size)
+    {
+      adcDecimator.count = (adcDecimator.count + 1) & (ADC_OVERSAMPLING_RATIO - 1);
+    }
+  }
+}
+
+/**
+ * @brief Dispatch the sample of slot 'index' to its processing function
+ *
+ * @tparam I First slot to be checked
+ * @param index The slot of the sample, updated with the next slot
+ * @param rawSample The raw sample
+ *
+ * @ingroup TimeCritical
+ */
+template< uint8_t I = 0 >
+inline void dispatchSlotSample(uint8_t &index, const int16_t rawSample) __attribute__((always_inline));
+
+template< uint8_t I >
+inline void dispatchSlotSample(uint8_t &index, const int16_t rawSample)
+{
+  if constexpr (I < adcSchedule.size)
+  {
+    if (I != index)
+    {
+      dispatchSlotSample< I + 1 >(index, rawSample);
+      return;
+    }
+
+    halAdcSelect(adcSchedule.lookAheadPin(I));      // the conversion of slot I + 1 is already under way
+    index = (I + 1 == adcSchedule.size) ? 0 : I + 1;  // next slot
+
+    decimateSlotSample< I >(rawSample);
+  }
+  else
+  {
+    index = 0;  // to prevent lockup (should never get here)
+  }
+}
+
+/**
+ * @brief Process one complete sample set, all slots in a row
+ *
+ * @tparam I First slot to be processed
+ * @param sampleSet The raw samples of all channels (V1, I1, V2, I2, ..., extra channels), without the discarded conversions
+ *
+ * @ingroup TimeCritical
+ */
+template< uint8_t I = 0 >
+inline void processAdcSampleSet(const int16_t *sampleSet) __attribute__((always_inline));
+
+template< uint8_t I >
+inline void processAdcSampleSet(const int16_t *sampleSet)
+{
+  if constexpr (I < adcSchedule.size)
+  {
+    if constexpr (ChannelTypes::DISCARD != adcSchedule[I].type)
+    {
+      decimateSlotSample< I >(sampleSet[adcSchedule[I].column]);
+    }
+    processAdcSampleSet< I + 1 >(sampleSet);
+  }
+}
+
+/**
+ * @brief Dispatch the sample of slot 'index' to its processing function, called by the ADC ISR
+ * @details Defined in processing.cpp, so that the handlers of each phase are instantiated there.
+ *
+ * @param index The slot of the sample, updated with the next slot
+ * @param rawSample The raw sample
+ *
+ * @ingroup TimeCritical
+ */
+void dispatchAdcSample(uint8_t &index, int16_t rawSample);
+
+/**
+ * @brief Process a block of sample sets
+ * @details For a target where the samples are gathered without any interrupt (DMA), e.g. one block
+ *          per half mains cycle. The samples go through exactly the same processing as from the ADC ISR,
+ *          in the same order, without the dispatch on the slot index.
+ *          On the ATmega328P, the samples are processed one by one from the ADC ISR (see dispatchAdcSample).
+ *          Defined in processing.cpp, as dispatchAdcSample().
+ *
+ * @param samples The raw samples, interleaved in the order of the channels (V1, I1, V2, I2, ..., extra channels)
+ * @param noOfSampleSets The number of complete sample sets of the block (raw sets, before any decimation)
+ */
+void processAdcBlock(const int16_t *samples, uint16_t noOfSampleSets);
+
+#endif  // ADC_SEQUENCER_H
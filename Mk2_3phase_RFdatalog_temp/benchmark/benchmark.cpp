@@ -0,0 +1,217 @@
+/**
+ * @file benchmark.cpp
+ * @author Frédéric Metrich (frederic.metrich@live.fr)
+ * @brief Cycle-accurate benchmark of the TimeCritical functions (env:benchmark)
+ * @version 0.1
+ * @date 2024-05-14
+ *
+ * @details Each function is timed in isolation with Timer1 running at CPU clock, interrupts
+ *          disabled, over NO_OF_RUNS calls with inputs taken from a synthetic mains waveform.
+ *          The cost of the measurement itself is subtracted.
+ *
+ *          The results are printed as a table, followed by one machine-readable line:
+ *            BENCH {"name":[min,avg,max],...}
+ *          (in CPU cycles), so that a script can compare them with a reference.
+ *
+ *          Runs on the Uno as well as under simavr.
+ *
+ * @note processing.cpp is included here (and excluded from the build of this env) since most
+ *       of the TimeCritical functions are always_inline and cannot be called from another unit.
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include <Arduino.h>
+
+#include "../processing.cpp"
+
+namespace
+{
+inline constexpr uint16_t NO_OF_RUNS{ 256 }; /**< number of calls for each function */
+
+/**
+ * @brief Statistics of one function, in CPU cycles
+ *
+ */
+struct BenchResult
+{
+  uint16_t minCycles{ UINT16_MAX }; /**< fastest call */
+  uint16_t maxCycles{ 0 };          /**< slowest call */
+  uint32_t sumCycles{ 0 };          /**< sum of all calls */
+};
+
+uint16_t overhead{ 0 }; /**< cost of an empty measurement */
+
+/**
+ * @brief Raw ADC value of the synthetic waveform (~32 sample sets per mains cycle)
+ *
+ * @param idx Index of the sample
+ * @return int16_t The raw sample
+ */
+int16_t syntheticSample(const uint16_t idx)
+{
+  return static_cast< int16_t >(512 + 400 * sin(idx * (2 * PI / 32)));
+}
+
+/**
+ * @brief Time one call
+ *
+ * @tparam F Type of the callable
+ * @param f The callable, taking the index of the run
+ * @param idx Index of the run
+ * @return uint16_t Duration in CPU cycles, overhead included
+ */
+template< typename F >
+uint16_t timeOneCall(F &&f, const uint16_t idx)
+{
+  uint16_t start;
+  uint16_t stop;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    start = TCNT1;
+    f(idx);
+    stop = TCNT1;
+  }
+
+  return stop - start;
+}
+
+/**
+ * @brief Time a function over all runs
+ *
+ * @tparam F Type of the callable
+ * @param f The callable, taking the index of the run
+ * @return BenchResult The statistics
+ */
+template< typename F >
+BenchResult bench(F &&f)
+{
+  BenchResult result;
+
+  for (uint16_t idx = 0; idx < NO_OF_RUNS; ++idx)
+  {
+    const uint16_t elapsed{ timeOneCall(f, idx) };
+    const uint16_t cycles{ static_cast< uint16_t >(elapsed > overhead ? elapsed - overhead : 0) };
+
+    if (cycles < result.minCycles)
+    {
+      result.minCycles = cycles;
+    }
+    if (cycles > result.maxCycles)
+    {
+      result.maxCycles = cycles;
+    }
+    result.sumCycles += cycles;
+  }
+
+  return result;
+}
+
+/**
+ * @brief One entry of the benchmark
+ *
+ */
+struct BenchEntry
+{
+  const __FlashStringHelper *name; /**< name of the function */
+  BenchResult result;              /**< statistics */
+};
+
+/**
+ * @brief Print one row of the table
+ *
+ * @param entry The entry
+ */
+void printRow(const BenchEntry &entry)
+{
+  Serial.print(entry.name);
+  for (uint8_t i = strlen_P(reinterpret_cast< const char * >(entry.name)); i < 26; ++i)
+  {
+    Serial.print(' ');
+  }
+  Serial.print(entry.result.minCycles);
+  Serial.print('\t');
+  Serial.print(entry.result.sumCycles / NO_OF_RUNS);
+  Serial.print('\t');
+  Serial.println(entry.result.maxCycles);
+}
+}  // namespace
+
+void setup()
+{
+  Serial.begin(9600);
+
+  initializeIsrProfiler();  // Timer1 at CPU clock
+  initializeProcessing();
+  ADCSRA = 0;  // the ADC ISR must not interfere with the measurements
+
+  overhead = UINT16_MAX;
+  for (uint16_t idx = 0; idx < NO_OF_RUNS; ++idx)
+  {
+    const uint16_t elapsed{ timeOneCall([](uint16_t) {}, idx) };
+    if (elapsed < overhead)
+    {
+      overhead = elapsed;
+    }
+  }
+
+  const BenchEntry entries[]{
+    { F("processPolarity"), bench([](const uint16_t idx) {
+        processPolarity(idx % NO_OF_PHASES, syntheticSample(idx));
+      }) },
+    { F("confirmPolarity"), bench([](const uint16_t idx) {
+        confirmPolarity(idx % NO_OF_PHASES);
+      }) },
+    { F("processCurrentRawSample"), bench([](const uint16_t idx) {
+        processCurrentRawSample< 0 >(syntheticSample(idx + 8));
+      }) },
+    { F("processVoltage"), bench([](const uint16_t idx) {
+        processVoltage(idx % NO_OF_PHASES);
+      }) },
+    { F("processStartNewCycle"), bench([](const uint16_t) {
+        processStartNewCycle();
+      }) },
+    { F("updatePortsStates"), bench([](const uint16_t) {
+        updatePortsStates();
+      }) },
+    { F("updatePhysicalLoadStates"), bench([](const uint16_t) {
+        updatePhysicalLoadStates();
+      }) },
+  };
+
+  Serial.print(F("TimeCritical benchmark, "));
+  Serial.print(NO_OF_RUNS);
+  Serial.print(F(" runs, overhead "));
+  Serial.print(overhead);
+  Serial.println(F(" cycles"));
+  Serial.println(F("function                  min\tavg\tmax"));
+  for (const auto &entry : entries)
+  {
+    printRow(entry);
+  }
+
+  Serial.print(F("BENCH {"));
+  for (uint8_t i = 0; i < sizeof(entries) / sizeof(entries[0]); ++i)
+  {
+    if (i)
+    {
+      Serial.print(',');
+    }
+    Serial.print('"');
+    Serial.print(entries[i].name);
+    Serial.print(F("\":["));
+    Serial.print(entries[i].result.minCycles);
+    Serial.print(',');
+    Serial.print(entries[i].result.sumCycles / NO_OF_RUNS);
+    Serial.print(',');
+    Serial.print(entries[i].result.maxCycles);
+    Serial.print(']');
+  }
+  Serial.println('}');
+}
+
+void loop()
+{
+}
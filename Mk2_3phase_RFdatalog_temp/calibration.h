@@ -40,6 +40,9 @@ inline constexpr float f_powerCal[NO_OF_PHASES]{ 0.05000F, 0.05000F, 0.05000F };
 //    With f_phaseCal = 0, the previous sample is used
 //    With f_phaseCal = 0.5, the mid-point (average) value in used
 //
+// The value 1 costs nothing, 0 and 1/2^k (0.5, 0.25, ...) cost a shift, any other value
+// in [0..2] costs an integer multiply per sample. The resolution is 1/256.
+//
 // NB. Any tool which determines the optimal value of f_phaseCal must have a similar
 // scheme for taking sample values as does this sketch.
 //
@@ -49,9 +52,26 @@ inline constexpr float f_phaseCal{ 1 }; /**< Nominal values only */
 // similar to the actual range of volts, the optimal value for this cal factor is likely to be
 // close to unity.
 inline constexpr float f_voltageCal[NO_OF_PHASES]{ 0.8151F, 0.8184F, 0.8195F }; /**< compared with Sentron PAC 4200 */
+//
+// The current conversion rate, for Irms, is then deduced from f_powerCal = f_voltageCal x current cal.
+//
+/**
+ * @brief Get the current calibration of a phase
+ *
+ * @param phase the phase number [0..NO_OF_PHASES[
+ * @return constexpr float Amperes per ADC-step
+ */
+inline constexpr float currentCal(const uint8_t phase)
+{
+  return f_powerCal[phase] / f_voltageCal[phase];
+}
 
+// lpf_gain and alpha set the extra LPF which offsets the behaviour of the CTs as a HPF.
+// Both are turned into integers at compile time: alpha is rounded to the nearest 1/2^k,
+// lpf_gain has a resolution of 1/256.
+//
 inline constexpr float lpf_gain{ 0 }; /**< setting this to 0 disables this extra processing */
-inline constexpr float alpha{ 0.002 };
+inline constexpr float alpha{ 0.002 }; /**< rounded to the nearest power-of-two fraction, ie 1/512 */
 //--------------------------------------------------------------------------------------------------
 
 #endif  // CALIBRATION_H
\ No newline at end of file
@@ -22,6 +22,7 @@
 #define ENABLE_DEBUG /**< enable this line to include debugging print statements */
 #define SERIALPRINT  /**< include 'human-friendly' print statement for commissioning - comment this line to exclude. */
 //#define SERIALOUT /**< Uncomment if a wired serial connection is used */
+//#define SERIALBINARY /**< Uncomment to send the datalogs as compact binary frames (see utils_frame.h) */
 //--------------------------------------------------------------------------------------------------
 
 #include "config_system.h"
@@ -45,13 +46,55 @@ inline constexpr bool OVERRIDE_PIN_PRESENT{ true };                     /**< man
 #else
 inline constexpr bool EMONESP_CONTROL{ false };
 inline constexpr bool DIVERSION_PIN_PRESENT{ false };                   /**< set it to 'true' if you want to control diversion ON/OFF */
+#ifdef NATIVE_TEST_FEATURES
+inline constexpr RotationModes PRIORITY_ROTATION{ RotationModes::AUTO }; /**< for the native tests only (env:native_test_features) */
+#else
 inline constexpr RotationModes PRIORITY_ROTATION{ RotationModes::OFF }; /**< set it to 'OFF/AUTO/PIN' if you want manual/automatic rotation of priorities */
+#endif
 inline constexpr bool OVERRIDE_PIN_PRESENT{ false };                    /**< set it to 'true' if there's a override pin */
 #endif
 
 inline constexpr bool WATCHDOG_PIN_PRESENT{ false }; /**< set it to 'true' if there's a watch led */
 inline constexpr bool RELAY_DIVERSION{ false };      /**< set it to 'true' if a relay is used for diversion */
 inline constexpr bool DUAL_TARIFF{ false };          /**< set it to 'true' if there's a dual tariff each day AND the router is connected to the billing meter */
+inline constexpr bool RTC_PRESENT{ false };          /**< set it to 'true' if there's a DS3231 real-time clock, to schedule the dual tariff and the rotation by the time of the day (see utils_rtc.h) */
+inline constexpr bool RAW_SAMPLES_CAPTURE{ false };  /**< set it to 'true' to allow raw-sample dumps, triggered by sending 'C' through the Serial */
+inline constexpr bool MULTI_LOAD_SWITCHING{ false }; /**< set it to 'true' to switch several loads at once, according to 'loadRatedPower' */
+inline constexpr bool BEST_FIT_LOADS{ false };       /**< set it to 'true' to pick the load which best fits the surplus, according to 'loadRatedPower' */
+inline constexpr bool LOAD_POWER_LEARNING{ false };  /**< set it to 'true' to learn the actual power of each load, and skip the failed ones */
+inline constexpr bool THERMOSTAT_DETECTION{ false }; /**< set it to 'true' to detect the loads whose thermostat opens while ON (needs LOAD_POWER_LEARNING) */
+inline constexpr bool COORDINATED_DIVERSION{ false }; /**< set it to 'true' to let the relays take over the surplus diverted by the triacs, according to 'loadRatedPower' */
+inline constexpr bool ENERGY_COUNTERS{ false };       /**< set it to 'true' to keep the imported/exported/diverted energy in EEPROM, according to 'loadRatedPower' */
+inline constexpr bool RUNTIME_PARAMETERS{ false };    /**< set it to 'true' to set the calibration and the export rate through the Serial, stored in EEPROM */
+inline constexpr bool AUTO_CALIBRATION{ false };      /**< set it to 'true' to calibrate a phase through the Serial by switching a load of known power, 'loadPhase' gives its phase (needs RUNTIME_PARAMETERS) */
+inline constexpr bool SERIAL_CONTROL{ false };        /**< set it to 'true' to rotate the priorities, override the loads and stop the diversion through the Serial, in place of the pins */
+inline constexpr bool MODBUS_SLAVE{ false };          /**< set it to 'true' to answer as a Modbus RTU slave on the Serial, in place of the text outputs */
+inline constexpr bool TRANSITION_LOG{ false };        /**< set it to 'true' to log each load transition with its mains cycle, reason and bucket level */
+inline constexpr bool PER_PHASE_BUCKETS{ false };     /**< set it to 'true' to control the loads of each phase from the energy of this phase only, according to 'loadPhase' (no netting between phases) */
+inline constexpr bool HARDWARE_WATCHDOG{ false };     /**< set it to 'true' to reset the router when the ISR stops producing mains cycles (the resets are counted in EEPROM) */
+inline constexpr bool EQUALISED_ROTATION{ false };    /**< set it to 'true' to order the loads by increasing diverted energy since the last rotation, instead of a cyclic rotation, according to 'loadRatedPower' */
+inline constexpr bool TEMPERATURE_TARGETS{ false };   /**< set it to 'true' to leave a load out of the diversion once its sensor has reached its target, according to 'loadTemperatureTargets' */
+inline constexpr bool LOAD_STATISTICS{ false };       /**< set it to 'true' to keep the switch-on count and the histograms of the ON/OFF run lengths of each load, printed by sending 'H' through the Serial */
+inline constexpr bool WIRING_CHECK{ false };          /**< set it to 'true' to detect a missing voltage reference, a missing or reversed CT from the datalogs, according to 'loadPhase' */
+inline constexpr bool PWM_OUTPUT{ false };            /**< set it to 'true' to drive a variable-power load (e.g. through a PWM to 0-10 V converter) with the PWM of 'pwmOutputPin', proportionally to the surplus */
+#ifdef NATIVE_TEST_FEATURES
+inline constexpr bool OVERVOLTAGE_BOOST{ true }; /**< for the native tests only (env:native_test_features) */
+inline constexpr bool METER_PULSE_INPUT{ true }; /**< for the native tests only (env:native_test_features) */
+#else
+inline constexpr bool OVERVOLTAGE_BOOST{ false };                 /**< set it to 'true' to divert harder on a phase whose voltage exceeds OVERVOLTAGE_LIMIT_IN_VOLTS, to keep the inverter from tripping */
+inline constexpr bool METER_PULSE_INPUT{ false };                 /**< set it to 'true' to count the pulses of the utility meter on 'meterPulsePin', and print the metered power next to the measured one */
+#endif
+inline constexpr bool METER_CALIBRATION_TRIM{ false };            /**< set it to 'true' to slowly trim the power calibration to the utility meter (needs METER_PULSE_INPUT and RUNTIME_PARAMETERS) */
+
+inline constexpr uint8_t SATURATED_LOAD_PERIOD_IN_MINUTES{ 30 }; /**< a load without any power drawn is skipped during this period */
+inline constexpr uint8_t ENERGY_FLUSH_PERIOD_IN_MINUTES{ 60 };   /**< the energy counters are written to EEPROM at this period */
+inline constexpr uint8_t MODBUS_SLAVE_ADDRESS{ 1 };               /**< address of the router on the Modbus [1..247] */
+inline constexpr uint8_t FAST_STREAM_PERIOD_IN_MAINS_CYCLES{ 0 }; /**< with SERIALBINARY, stream the power of each phase and the bucket level every 1 (20 ms) or 5 (100 ms) mains cycles, 0 to disable */
+inline constexpr uint8_t PWM_OUTPUT_SLEW_RATE{ 4 };               /**< largest change of the PWM duty per mains cycle [1..255], 4 goes from 0 to 100 % in ~1.3 s @ 50 Hz */
+inline constexpr uint16_t OVERVOLTAGE_LIMIT_IN_VOLTS{ 253 };      /**< Vrms of a mains cycle above which the diversion of the phase is boosted (EN 50160: 230 V + 10 %) */
+inline constexpr uint8_t OVERVOLTAGE_HYSTERESIS_IN_VOLTS{ 3 };    /**< the boost stops once the Vrms of a mains cycle is this much below the limit */
+inline constexpr int16_t OVERVOLTAGE_BOOST_IN_WATTS{ 300 };       /**< extra surplus seen on a phase in overvoltage, ie its required export is lowered by this much */
+inline constexpr uint16_t METER_PULSES_PER_KWH{ 1000 };          /**< pulses of the utility meter per kWh, as printed on its front (imp/kWh) */
 
 // ----------- Pinout assignments -----------
 //
@@ -73,6 +116,9 @@ inline constexpr bool DUAL_TARIFF{ false };          /**< set it to 'true' if th
 
 inline constexpr uint8_t physicalLoadPin[NO_OF_DUMPLOADS]{ 5, 7 };         /**< for 3-phase PCB, Load #1/#2/#3 (Rev 2 PCB) */
 inline constexpr uint8_t loadPrioritiesAtStartup[NO_OF_DUMPLOADS]{ 0, 1 }; /**< load priorities and states at startup */
+inline constexpr LoadModes loadModes[NO_OF_DUMPLOADS]{ LoadModes::ON_OFF, LoadModes::ON_OFF }; /**< control mode of each physical load */
+inline constexpr uint16_t loadRatedPower[NO_OF_DUMPLOADS]{ 3000, 3000 };                     /**< nominal power of each physical load in W */
+inline constexpr uint8_t loadPhase[NO_OF_DUMPLOADS]{ 0, 1 };                                /**< phase of each physical load [0..NO_OF_PHASES[, for PER_PHASE_BUCKETS, WIRING_CHECK and AUTO_CALIBRATION */
 
 // Set the value to 0xff when the pin is not needed (feature deactivated)
 inline constexpr uint8_t dualTariffPin{ 0xff }; /**< for 3-phase PCB, off-peak trigger */
@@ -80,14 +126,26 @@ inline constexpr uint8_t diversionPin{ 0xff };  /**< if LOW, set diversion on st
 inline constexpr uint8_t rotationPin{ 0xff };   /**< if LOW, trigger a load priority rotation */
 inline constexpr uint8_t forcePin{ 0xff };      /**< for 3-phase PCB, force pin */
 inline constexpr uint8_t watchDogPin{ 0xff };   /**< watch dog LED */
+inline constexpr uint8_t rtcSdaPin{ 0xff };     /**< SDA of the real-time clock (software I2C, A4/A5 are used by the ADC) */
+inline constexpr uint8_t rtcSclPin{ 0xff };     /**< SCL of the real-time clock (software I2C, A4/A5 are used by the ADC) */
+inline constexpr uint8_t pwmOutputPin{ 0xff };  /**< PWM output for a variable-power load, D3 only (Timer2, OC2B) */
+#ifdef NATIVE_TEST_FEATURES
+inline constexpr uint8_t meterPulsePin{ 3 }; /**< for the native tests only (env:native_test_features) */
+#else
+inline constexpr uint8_t meterPulsePin{ 0xff }; /**< S0 or LED-sensor pulse output of the utility meter, D2 (INT0) or D3 (INT1) only, D3 with the RF module */
+#endif
 
 inline constexpr RelayEngine relays{ { { 0xff, 1000, 200, 1, 1 } } }; /**< config for relay diversion, see class definition for defaults and advanced options */
 
 inline constexpr uint8_t ul_OFF_PEAK_DURATION{ 8 };                        /**< Duration of the off-peak period in hours */
 inline constexpr pairForceLoad rg_ForceLoad[NO_OF_DUMPLOADS]{ { -3, 2 } }; /**< force config for load #1 ONLY for dual tariff */
+inline constexpr TimeOfDay OFF_PEAK_START{ 22, 0 };                        /**< start of the off-peak period, with RTC_PRESENT in place of the dual tariff pin */
+inline constexpr TimeOfDay ROTATION_TIME{ 22, 0 };                         /**< daily rotation of the load priorities, with RTC_PRESENT and PRIORITY_ROTATION == AUTO */
 
 inline constexpr int16_t iTemperatureThreshold{ 100 }; /**< the temperature threshold to stop overriding in °C */
 
+inline constexpr TemperatureTarget loadTemperatureTargets[NO_OF_DUMPLOADS]{ { 0, 60, 5 }, { 1, 60, 5 } }; /**< sensor, target and hysteresis in °C of each load, for TEMPERATURE_TARGETS */
+
 inline constexpr TemperatureSensing temperatureSensing{ 0xff,
                                                         { { 0x28, 0xBE, 0x41, 0x6B, 0x09, 0x00, 0x00, 0xA4 },
                                                           { 0x28, 0xED, 0x5B, 0x6A, 0x09, 0x00, 0x00, 0x9D },
@@ -112,6 +170,14 @@ inline constexpr int nodeID{ 10 };        /**<  RFM12B node ID */
 inline constexpr int networkGroup{ 210 }; /**< wireless network group - needs to be same for all nodes */
 inline constexpr int UNO{ 1 };            /**< for when the processor contains the UNO bootloader. */
 
+inline constexpr bool RF_PACKED_PAYLOAD{ false };   /**< set it to 'true' to send a compact delta-encoded payload (see utils_rf.h), the receiver must unpack it */
+inline constexpr uint8_t RF_KEYFRAME_PERIOD{ 12 }; /**< with RF_PACKED_PAYLOAD, a full keyframe is sent every N datalogs */
+
+inline constexpr RouterRoles ROUTER_ROLE{ RouterRoles::STANDALONE }; /**< set it to 'MASTER/SECONDARY' when several routers share the same supply point (see utils_coordination.h) */
+inline constexpr uint8_t masterNodeID{ 10 };                         /**< RF node ID of the master router, for RouterRoles::SECONDARY */
+
+#else
+inline constexpr RouterRoles ROUTER_ROLE{ RouterRoles::STANDALONE }; /**< the coordination of several routers needs the RF */
 #endif  // RF_PRESENT
 
 #endif  // CONFIG_H
@@ -18,6 +18,10 @@
 
 inline constexpr uint8_t NO_OF_PHASES{ 3 }; /**< number of phases of the main supply. */
 
+inline constexpr uint8_t NO_OF_EXTRA_CHANNELS{ 0 };                                              /**< number of extra analog inputs sampled after the phases (see 'sensorExtra') */
+inline constexpr uint8_t NO_OF_ADC_CHANNELS{ 2 * NO_OF_PHASES + NO_OF_EXTRA_CHANNELS };          /**< number of ADC conversions per sample set */
+inline constexpr uint8_t EXTRA_CHANNELS_SIZE{ NO_OF_EXTRA_CHANNELS ? NO_OF_EXTRA_CHANNELS : 1 }; /**< size of the arrays of the extra channels, one unused entry without any (no zero-length array) */
+
 //--------------------------------------------------------------------------------------------------
 // for users with zero-export profile, this value will be negative
 inline constexpr int16_t REQUIRED_EXPORT_IN_WATTS{ 20 }; /**< when set to a negative value, this acts as a PV generator */
@@ -26,8 +30,65 @@ inline constexpr int16_t REQUIRED_EXPORT_IN_WATTS{ 20 }; /**< when set to a nega
 // other system constants, should match most of installations
 inline constexpr uint8_t SUPPLY_FREQUENCY{ 50 }; /**< number of cycles/s of the grid power supply */
 
+/** Trigger source of the ADC conversions */
+enum class AdcTriggerModes : uint8_t
+{
+  FREE_RUNNING, /**< free-running at clk/ADC_PRESCALER, one conversion every ~104 µs @ clk/128 */
+  TIMER1        /**< Timer1 compare-match B, at an exact rate set by SAMPLE_SETS_PER_MAINS_CYCLE */
+};
+
+inline constexpr AdcTriggerModes ADC_TRIGGER_MODE{ AdcTriggerModes::FREE_RUNNING }; /**< trigger source of the ADC (Timer1 is then no longer available for profiling) */
+inline constexpr uint8_t SAMPLE_SETS_PER_MAINS_CYCLE{ 30 };                          /**< with AdcTriggerModes::TIMER1 only, 30 max @ 50 Hz */
+
+inline constexpr uint8_t ADC_PRESCALER{ 128 };        /**< ADC clock = clk/128 (10 bits), clk/64 or clk/32 double or quadruple the sample rate, with ~9 and ~8 effective bits */
+inline constexpr bool ADC_SETTLING_DISCARDS{ false }; /**< set it to 'true' to insert one discarded conversion before each voltage channel, for the settling of the mux at clk/64 or clk/32 */
+
+inline constexpr uint8_t NO_OF_ADC_CONVERSIONS{ NO_OF_ADC_CHANNELS + (ADC_SETTLING_DISCARDS ? NO_OF_PHASES : 0) }; /**< number of ADC conversions per sample set, including the discarded ones */
+
+inline constexpr uint8_t ADC_OVERSAMPLING_BITS{ 0 };                                  /**< extra bits of resolution, each sample is decimated from 4^n conversions (needs a faster ADC, 3 max) */
+inline constexpr uint8_t ADC_OVERSAMPLING_RATIO{ 1U << (2 * ADC_OVERSAMPLING_BITS) }; /**< # of conversions per decimated sample */
+inline constexpr uint8_t ADC_RESOLUTION_BITS{ 10 + ADC_OVERSAMPLING_BITS };           /**< effective resolution of the decimated samples */
+
+inline constexpr uint16_t ADC_TIMER_PERIOD{ (2 * F_CPU + SUPPLY_FREQUENCY * SAMPLE_SETS_PER_MAINS_CYCLE * NO_OF_ADC_CONVERSIONS * ADC_OVERSAMPLING_RATIO) / (SUPPLY_FREQUENCY * SAMPLE_SETS_PER_MAINS_CYCLE * 2UL * NO_OF_ADC_CONVERSIONS * ADC_OVERSAMPLING_RATIO) }; /**< CPU cycles between 2 conversions, rounded */
+inline constexpr uint16_t ADC_CONVERSION_CYCLES{ 27U * ADC_PRESCALER / 2U };                                                                                                                                                                                           /**< CPU cycles of an auto-triggered conversion */
+
+inline constexpr uint16_t CPU_CYCLES_PER_CONVERSION{ ADC_TRIGGER_MODE == AdcTriggerModes::TIMER1 ? ADC_TIMER_PERIOD : 13U * ADC_PRESCALER };                /**< CPU cycles between 2 ADC interrupts */
+inline constexpr uint32_t CPU_CYCLES_PER_SAMPLE_SET{ static_cast< uint32_t >(CPU_CYCLES_PER_CONVERSION) * NO_OF_ADC_CONVERSIONS * ADC_OVERSAMPLING_RATIO }; /**< CPU cycles per (decimated) sample set */
+
+inline constexpr bool REACTIVE_POWER{ false }; /**< set it to 'true' for the apparent/reactive power and the power factor of each phase */
+
+inline constexpr bool HARMONIC_ANALYSIS{ false }; /**< set it to 'true' for the fundamental active/reactive power and the current THD of each phase */
+
+inline constexpr bool SOFTWARE_PLL{ false }; /**< set it to 'true' to start each mains cycle from a PLL locked to phase 0 */
+
+inline constexpr bool FREQUENCY_CORRECTION{ false }; /**< set it to 'true' to integrate the energy at the real mains frequency instead of SUPPLY_FREQUENCY */
+
 inline constexpr uint32_t WORKING_ZONE_IN_JOULES{ 3600UL }; /**< number of joule for 1Wh */
 
+inline constexpr bool FIXED_POINT_ENERGY_BUCKET{ false }; /**< set it to 'true' to use integer maths for the energy bucket (faster ISR) */
+
+inline constexpr uint8_t RAW_CAPTURE_SAMPLE_SETS{ 64 }; /**< size of the raw-sample capture buffer (2 mains cycles @ 50 Hz, 8 bytes each) */
+
+inline constexpr uint8_t FAST_STREAM_QUEUE_SIZE{ 4 }; /**< # of fast-stream records buffered between the ISR and loop(), the newer ones are dropped when full (power of 2) */
+
+inline constexpr uint8_t COORDINATION_PERIOD_IN_MAINS_CYCLES{ 25 }; /**< the master router publishes its diversion at this period (500 ms @ 50 Hz), a divider of the datalog period */
+inline constexpr uint16_t COORDINATION_TIMEOUT_MS{ 3000 };          /**< a secondary router without any message during this time diverts on its own */
+
+inline constexpr uint8_t TRANSITION_LOG_QUEUE_SIZE{ 8 }; /**< # of load transitions buffered between the ISR and loop(), the newer ones are dropped when full (power of 2) */
+
+inline constexpr bool ISR_LATENCY_MONITOR{ false }; /**< set it to 'true' to monitor the latency of the ADC ISR (uses Timer1) */
+inline constexpr bool ISR_STACK_MONITOR{ false };   /**< set it to 'true' to monitor the free stack at the entry of the ADC ISR and the nesting of the ISRs */
+
+inline constexpr uint16_t SERIAL_TX_QUEUE_SIZE{ 256 }; /**< size of the queue for the text output (power of 2, 256 max), a whole datalog line must fit */
+
+inline constexpr uint32_t SERIAL_BAUD_RATE{ 9600 }; /**< baud rate of the Serial, up to 115200 (57600 is more accurate @ 16 MHz) */
+inline constexpr bool POLLED_SERIAL_TX{ false };    /**< set it to 'true' to send the text/binary output by polling the UART from loop(), without any TX interrupt */
+
+inline constexpr uint16_t EEPROM_ENERGY_COUNTERS_ADDRESS{ 0 }; /**< start of the EEPROM area of the energy counters (see utils_energy.h) */
+inline constexpr uint16_t EEPROM_ENERGY_COUNTERS_SIZE{ 512 };  /**< size in bytes of the EEPROM area of the energy counters */
+inline constexpr uint16_t EEPROM_PARAMETERS_ADDRESS{ 512 };    /**< address of the runtime parameters in EEPROM (see utils_params.h) */
+inline constexpr uint16_t EEPROM_WATCHDOG_ADDRESS{ 1020 };     /**< address of the count of watchdog resets in EEPROM (see utils_watchdog.h) */
+
 inline constexpr uint8_t DATALOG_PERIOD_IN_SECONDS{ 5 }; /**< Period of datalogging in seconds */
 
 inline constexpr typename conditional< DATALOG_PERIOD_IN_SECONDS * SUPPLY_FREQUENCY >= UINT8_MAX, uint16_t, uint8_t >::type DATALOG_PERIOD_IN_MAINS_CYCLES{ DATALOG_PERIOD_IN_SECONDS * SUPPLY_FREQUENCY }; /**< Period of datalogging in cycles */
@@ -35,6 +96,8 @@ inline constexpr typename conditional< DATALOG_PERIOD_IN_SECONDS * SUPPLY_FREQUE
 // Computes inverse value at compile time to use '*' instead of '/'
 inline constexpr float invSUPPLY_FREQUENCY{ 1.0F / SUPPLY_FREQUENCY };
 inline constexpr float invDATALOG_PERIOD_IN_MAINS_CYCLES{ 1.0F / DATALOG_PERIOD_IN_MAINS_CYCLES };
+inline constexpr float SAMPLE_SETS_PER_SECOND{ static_cast< float >(F_CPU) / CPU_CYCLES_PER_SAMPLE_SET };                /**< sampling rate of each channel */
+inline constexpr float NOMINAL_SAMPLE_SETS_PER_MAINS_CYCLE{ SAMPLE_SETS_PER_SECOND / SUPPLY_FREQUENCY };                 /**< ie 32.05 @ 50 Hz when free-running */
 //--------------------------------------------------------------------------------------------------
 
 #endif  // CONFIG_SYSTEM_H
@@ -19,6 +19,9 @@ inline constexpr uint8_t CONVERT_TEMPERATURE{ 0x44 };
 inline constexpr uint8_t READ_SCRATCHPAD{ 0xBE };
 inline constexpr uint8_t WRITE_SCRATCH{ 0x4E };
 
+// OneWire ROM commands
+inline constexpr uint8_t MATCH_ROM{ 0x55 };
+
 inline constexpr int16_t OUTOFRANGE_TEMPERATURE{ 30200 }; /**< this value (302C) is sent if the sensor reports < -55C or > +125C */
 inline constexpr int16_t TEMP_RANGE_LOW{ -5500 };
 inline constexpr int16_t TEMP_RANGE_HIGH{ 12500 };
@@ -16,8 +16,8 @@
 
 /**
  * @brief Template class for Load-Overriding
- * @details The array is initialized at compile time so it can be read-only and
- *          the performance and code size are better
+ * @details The array is initialized at compile time from rg_ForceLoad,
+ *          and recomputed with RUNTIME_PARAMETERS (see utils_params.h).
  *
  * @tparam N # of loads
  * @tparam D
@@ -28,28 +28,38 @@ template< uint8_t N, uint8_t OffPeakDuration = 8 >
 class _rg_OffsetForce
 {
 public:
-  constexpr _rg_OffsetForce()
+  explicit constexpr _rg_OffsetForce(const pairForceLoad (&forceLoad)[N])
+  {
+    set(forceLoad);
+  }
+
+  /**
+   * @brief Calculate the offsets for force start and stop of each load
+   *
+   * @param forceLoad The force config of each load
+   */
+  constexpr void set(const pairForceLoad (&forceLoad)[N])
   {
     constexpr uint16_t uiPeakDurationInSec{ OffPeakDuration * 3600 };
-    // calculates offsets for force start and stop of each load
     for (uint8_t i = 0; i != N; ++i)
     {
-      const bool bOffsetInMinutes{ rg_ForceLoad[i].getStartOffset() > 24 || rg_ForceLoad[i].getStartOffset() < -24 };
-      const bool bDurationInMinutes{ rg_ForceLoad[i].getDuration() > 24 && UINT16_MAX != rg_ForceLoad[i].getDuration() };
+      const bool bOffsetInMinutes{ forceLoad[i].getStartOffset() > 24 || forceLoad[i].getStartOffset() < -24 };
+      const bool bDurationInMinutes{ forceLoad[i].getDuration() > 24 && UINT16_MAX != forceLoad[i].getDuration() };
 
-      _rg[i][0] = ((rg_ForceLoad[i].getStartOffset() >= 0) ? 0 : uiPeakDurationInSec) + rg_ForceLoad[i].getStartOffset() * (bOffsetInMinutes ? 60ul : 3600ul);
+      _rg[i][0] = ((forceLoad[i].getStartOffset() >= 0) ? 0 : uiPeakDurationInSec) + forceLoad[i].getStartOffset() * (bOffsetInMinutes ? 60ul : 3600ul);
       _rg[i][0] *= 1000ul;  // convert in milli-seconds
 
-      if (UINT8_MAX == rg_ForceLoad[i].getDuration())
+      if (UINT8_MAX == forceLoad[i].getDuration())
       {
-        _rg[i][1] = rg_ForceLoad[i].getDuration();
+        _rg[i][1] = forceLoad[i].getDuration();
       }
       else
       {
-        _rg[i][1] = _rg[i][0] + rg_ForceLoad[i].getDuration() * (bDurationInMinutes ? 60ul : 3600ul) * 1000ul;
+        _rg[i][1] = _rg[i][0] + forceLoad[i].getDuration() * (bDurationInMinutes ? 60ul : 3600ul) * 1000ul;
       }
     }
   }
+
   const auto (&operator[](uint8_t i) const)
   {
     return _rg[i];
@@ -61,14 +71,133 @@ private:
 
 inline uint32_t ul_TimeOffPeak; /**< 'timestamp' for start of off-peak period */
 
-inline constexpr auto rg_OffsetForce{ _rg_OffsetForce< NO_OF_DUMPLOADS, ul_OFF_PEAK_DURATION >() }; /**< start & stop offsets for each load */
+inline auto rg_OffsetForce{ _rg_OffsetForce< NO_OF_DUMPLOADS, ul_OFF_PEAK_DURATION >(rg_ForceLoad) }; /**< start & stop offsets for each load */
+
+inline constexpr uint32_t SECONDS_PER_DAY{ 86400UL }; /**< # of seconds in a day */
+
+/** Action of one entry of the daily schedule */
+enum class ScheduleActions : uint8_t
+{
+  OFF_PEAK_START, /**< start of the off-peak period */
+  PEAK_START,     /**< end of the off-peak period */
+  FORCE_START,    /**< start of the force window of a load */
+  FORCE_END,      /**< end of the force window of a load */
+  ROTATION        /**< rotation of the load priorities */
+};
+
+/**
+ * @brief One entry of the daily schedule
+ *
+ * @ingroup DualTariff
+ */
+struct ScheduleEntry
+{
+  uint32_t time{ 0 };                                       /**< second of the day [0..SECONDS_PER_DAY[ */
+  ScheduleActions action{ ScheduleActions::OFF_PEAK_START }; /**< action at this time */
+  uint8_t load{ 0 };                                        /**< load of the force window */
+};
+
+/**
+ * @brief Template class for the daily schedule of the real-time clock
+ * @details The tariff windows, the force windows of each load (see rg_ForceLoad) and the
+ *          rotation time are computed at compile time, sorted by time of the day.
+ *          With RUNTIME_PARAMETERS, the schedule is recomputed when the force windows change.
+ *          Only used with RTC_PRESENT (see utils_rtc.h).
+ *
+ * @tparam N # of loads
+ * @tparam OffPeakDuration Duration of the off-peak period in hours
+ *
+ * @ingroup DualTariff
+ */
+template< uint8_t N, uint8_t OffPeakDuration = 8 >
+class _DailySchedule
+{
+public:
+  static constexpr uint8_t size{ 2 * N + 3 }; /**< # of entries */
+
+  explicit constexpr _DailySchedule(const pairForceLoad (&forceLoad)[N])
+  {
+    set(forceLoad);
+  }
+
+  /**
+   * @brief Compute the schedule
+   *
+   * @param forceLoad The force config of each load
+   */
+  constexpr void set(const pairForceLoad (&forceLoad)[N])
+  {
+    constexpr int32_t offPeakStart{ static_cast< int32_t >(OFF_PEAK_START.getSeconds()) };
+    constexpr int32_t offPeakDuration{ OffPeakDuration * 3600L };
+
+    _count = 0;
+    append({ toTimeOfDay(offPeakStart), ScheduleActions::OFF_PEAK_START, 0 });
+    append({ toTimeOfDay(offPeakStart + offPeakDuration), ScheduleActions::PEAK_START, 0 });
+    append({ ROTATION_TIME.getSeconds(), ScheduleActions::ROTATION, 0 });
+
+    for (uint8_t i = 0; i != N; ++i)
+    {
+      const bool bOffsetInMinutes{ forceLoad[i].getStartOffset() > 24 || forceLoad[i].getStartOffset() < -24 };
+      const bool bDurationInMinutes{ forceLoad[i].getDuration() > 24 && UINT16_MAX != forceLoad[i].getDuration() };
+
+      // offsets from the start of the off-peak period, the window ends with the off-peak period at the latest
+      int32_t start{ ((forceLoad[i].getStartOffset() >= 0) ? 0 : offPeakDuration) + forceLoad[i].getStartOffset() * static_cast< int32_t >(bOffsetInMinutes ? 60 : 3600) };
+      int32_t end{ offPeakDuration };
+
+      if (UINT16_MAX != forceLoad[i].getDuration())
+      {
+        end = start + forceLoad[i].getDuration() * (bDurationInMinutes ? 60L : 3600L);
+        end = (end < offPeakDuration) ? end : offPeakDuration;
+      }
+      start = (start < end) ? start : end;
+
+      append({ toTimeOfDay(offPeakStart + start), ScheduleActions::FORCE_START, i });
+      append({ toTimeOfDay(offPeakStart + end), ScheduleActions::FORCE_END, i });
+    }
+  }
+
+  constexpr const ScheduleEntry &operator[](uint8_t i) const
+  {
+    return _entries[i];
+  }
+
+private:
+  static constexpr uint32_t toTimeOfDay(int32_t seconds)
+  {
+    seconds %= static_cast< int32_t >(SECONDS_PER_DAY);
+    return (seconds < 0) ? seconds + SECONDS_PER_DAY : seconds;
+  }
+
+  /**
+   * @brief Insert an entry after the ones with the same time (a window of zero duration stays closed)
+   *
+   * @param entry The entry
+   */
+  constexpr void append(const ScheduleEntry &entry)
+  {
+    uint8_t i{ _count++ };
+    while (i && _entries[i - 1].time > entry.time)
+    {
+      _entries[i] = _entries[i - 1];
+      --i;
+    }
+    _entries[i] = entry;
+  }
+
+  ScheduleEntry _entries[size]{};
+  uint8_t _count{ 0 };
+};
+
+inline auto dailySchedule{ _DailySchedule< NO_OF_DUMPLOADS, ul_OFF_PEAK_DURATION >(rg_ForceLoad) }; /**< daily schedule of the real-time clock */
 
 /**
  * @brief Print the settings for off-peak period
  *
+ * @param forceLoad The force config of each load in use
+ *
  * @ingroup DualTariff
  */
-inline void printDualTariffConfiguration()
+inline void printDualTariffConfiguration(const pairForceLoad (&forceLoad)[NO_OF_DUMPLOADS])
 {
   Serial.print(F("\tDuration of off-peak period is "));
   Serial.print(ul_OFF_PEAK_DURATION);
@@ -85,24 +214,24 @@ inline void printDualTariffConfiguration()
     Serial.println(F(":"));
 
     Serial.print(F("\t\tStart "));
-    if (rg_ForceLoad[i].getStartOffset() >= 0)
+    if (forceLoad[i].getStartOffset() >= 0)
     {
-      Serial.print(rg_ForceLoad[i].getStartOffset());
+      Serial.print(forceLoad[i].getStartOffset());
       Serial.print(F(" hours/minutes after begin of off-peak period "));
     }
     else
     {
-      Serial.print(-rg_ForceLoad[i].getStartOffset());
+      Serial.print(-forceLoad[i].getStartOffset());
       Serial.print(F(" hours/minutes before the end of off-peak period "));
     }
-    if (rg_ForceLoad[i].getDuration() == UINT16_MAX)
+    if (forceLoad[i].getDuration() == UINT16_MAX)
     {
       Serial.println(F("till the end of the period."));
     }
     else
     {
       Serial.print(F("for a duration of "));
-      Serial.print(rg_ForceLoad[i].getDuration());
+      Serial.print(forceLoad[i].getDuration());
       Serial.println(F(" hour/minute(s)."));
     }
     Serial.print(F("\t\tCalculated offset in seconds: "));
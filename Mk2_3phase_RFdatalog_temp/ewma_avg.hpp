@@ -59,6 +59,18 @@ constexpr uint8_t round_up_to_power_of_2(uint16_t v)
   return --next_pow_of_2;
 }
 
+/** Order of the average, the unused stages are compiled out */
+enum class EwmaOrders : uint8_t
+{
+  EMA = 1, /**< single EMA */
+  DEMA,    /**< double EMA, lower lag */
+  TEMA     /**< triple EMA, lowest lag */
+};
+
+inline constexpr integral_constant< EwmaOrders, EwmaOrders::EMA > SINGLE_EMA{};  /**< tag to select a single EMA (ie for RelayEngine) */
+inline constexpr integral_constant< EwmaOrders, EwmaOrders::DEMA > DOUBLE_EMA{}; /**< tag to select a double EMA (ie for RelayEngine) */
+inline constexpr integral_constant< EwmaOrders, EwmaOrders::TEMA > TRIPLE_EMA{}; /**< tag to select a triple EMA (ie for RelayEngine) */
+
 /**
  * @brief Exponentially Weighted Moving Average
  * 
@@ -70,28 +82,58 @@ constexpr uint8_t round_up_to_power_of_2(uint16_t v)
  * @note    Because of the 'sign extension', the sign is copied into lower bits.
  * 
  * @tparam A Smoothing factor
+ * @tparam O Highest order of the average which can be read
  * @param input Input value
  * @return long Output value
  */
-template< uint8_t A = 10 >
+template< uint16_t A = 10, EwmaOrders O = EwmaOrders::TEMA >
 class EWMA_average
 {
+  static_assert(A >= 4, "The smoothing factor must be at least 4");
+
 public:
   /**
-   * @brief Add a new value and actualize the EMA, DEMA and TEMA
+   * @brief Add a new value and actualize the EMA, DEMA and TEMA (up to the order O)
    * 
    * @param input The new value
    */
   void addValue(int32_t input)
   {
-    ema_raw = ema_raw - ema + input;
-    ema = ema_raw >> round_up_to_power_of_2(A);
+    raw[0] = raw[0] - ema[0] + input;
+    ema[0] = raw[0] >> round_up_to_power_of_2(A);
+
+    if constexpr (O >= EwmaOrders::DEMA)
+    {
+      raw[1] = raw[1] - ema[1] + ema[0];
+      ema[1] = raw[1] >> (round_up_to_power_of_2(A) - 1);
+    }
 
-    ema_ema_raw = ema_ema_raw - ema_ema + ema;
-    ema_ema = ema_ema_raw >> (round_up_to_power_of_2(A) - 1);
+    if constexpr (O >= EwmaOrders::TEMA)
+    {
+      raw[2] = raw[2] - ema[2] + ema[1];
+      ema[2] = raw[2] >> (round_up_to_power_of_2(A) - 2);
+    }
+  }
 
-    ema_ema_ema_raw = ema_ema_ema_raw - ema_ema_ema + ema_ema;
-    ema_ema_ema = ema_ema_ema_raw >> (round_up_to_power_of_2(A) - 2);
+  /**
+   * @brief Get the average of the order O
+   * 
+   * @return auto The EMA, DEMA or TEMA value
+   */
+  auto getAverage() const
+  {
+    if constexpr (EwmaOrders::EMA == O)
+    {
+      return getAverageS();
+    }
+    else if constexpr (EwmaOrders::DEMA == O)
+    {
+      return getAverageD();
+    }
+    else
+    {
+      return getAverageT();
+    }
   }
 
   /**
@@ -101,7 +143,7 @@ public:
    */
   auto getAverageS() const
   {
-    return ema;
+    return ema[0];
   }
 
   /**
@@ -111,7 +153,8 @@ public:
    */
   auto getAverageD() const
   {
-    return (ema << 1) - ema_ema;
+    static_assert(O >= EwmaOrders::DEMA, "The DEMA is not computed");
+    return (ema[0] << 1) - ema[1];
   }
 
   /**
@@ -121,16 +164,15 @@ public:
    */
   auto getAverageT() const
   {
-    return 3 * (ema - ema_ema) + ema_ema_ema;
+    static_assert(O >= EwmaOrders::TEMA, "The TEMA is not computed");
+    return 3 * (ema[0] - ema[1]) + ema[2];
   }
 
 private:
-  int32_t ema_ema_ema_raw{ 0 };
-  int32_t ema_ema_ema{ 0 };
-  int32_t ema_ema_raw{ 0 };
-  int32_t ema_ema{ 0 };
-  int32_t ema_raw{ 0 };
-  int32_t ema{ 0 };
+  static constexpr uint8_t STAGES{ static_cast< uint8_t >(O) }; /**< # of cascaded EMA */
+
+  int32_t raw[STAGES]{}; /**< unscaled value of each stage */
+  int32_t ema[STAGES]{}; /**< EMA, EMA of the EMA, ... */
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,308 @@
+/**
+ * @file fundamental.h
+ * @author Frédéric Metrich (frederic.metrich@live.fr)
+ * @brief Fundamental active/reactive power and current THD, per phase
+ * @version 0.1
+ * @date 2024-05-18
+ *
+ * @details A single-bin DFT at the mains frequency, synchronised to the +ve zero-crossings.
+ *          The sample index within the mains cycle is the index in a table of sines and cosines,
+ *          so that each sample costs a table look-up and a few 16x16 integer products.
+ *
+ *          To keep within the ISR budget, only one phase is analysed at a time:
+ *          the analysis starts at a +ve zero-crossing of that phase, ends at the next one,
+ *          then moves to the next phase. Each phase is thus analysed about once in 6 mains cycles.
+ *          A cycle shorter than the table is discarded.
+ *
+ *          For one cycle of N samples, with Xc = sum(x.cos) and Xs = sum(x.sin):
+ *            - fundamental active power   P1 = 2 / N² . (Vc.Ic + Vs.Is)
+ *            - fundamental reactive power Q1 = 2 / N² . (Vc.Is - Vs.Ic)
+ *            - fundamental current        I1² = 2 / N² . (Ic² + Is²)
+ *            - THD of the current         sqrt(Irms² - I1²) / I1, with the DC part removed from Irms
+ *
+ *          The ISR only accumulates integers, the results are computed in loop().
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef FUNDAMENTAL_H
+#define FUNDAMENTAL_H
+
+#include <Arduino.h>
+
+#include "config.h"
+
+inline constexpr uint8_t FUNDAMENTAL_TABLE_SHIFT{ 14 };  /**< Q-format of the sine table */
+inline constexpr uint8_t FUNDAMENTAL_SCALE_SHIFT{ 5 };   /**< the reduced samples are x32 (ADC steps) */
+inline constexpr uint8_t FUNDAMENTAL_PRODUCT_SHIFT{ 6 }; /**< headroom of the accumulated products over a datalog period */
+
+/**< samples per mains cycle used by the DFT */
+inline constexpr uint8_t FUNDAMENTAL_TABLE_SIZE{ static_cast< uint8_t >(NOMINAL_SAMPLE_SETS_PER_MAINS_CYCLE + 0.5F) };
+
+/**
+ * @brief Compile-time sine for the table
+ * @details Taylor series after reduction to [-PI/2, PI/2]
+ *
+ * @param x angle in radians, in [0, 2.PI[
+ * @return constexpr double sin(x)
+ */
+constexpr double _constexprSin(double x)
+{
+  constexpr double pi{ 3.14159265358979323846 };
+
+  if (x > pi)
+  {
+    return -_constexprSin(x - pi);
+  }
+  if (x > pi / 2)
+  {
+    x = pi - x;
+  }
+
+  const double x2{ x * x };
+  double term{ x };
+  double sum{ x };
+  for (uint8_t n = 1; n != 10; ++n)
+  {
+    term *= -x2 / ((2 * n) * (2 * n + 1));
+    sum += term;
+  }
+  return sum;
+}
+
+/**
+ * @brief Sine and cosine over one mains cycle, in Q14
+ *
+ * @tparam N number of samples per mains cycle
+ */
+template< uint8_t N >
+class _SineTable
+{
+public:
+  constexpr _SineTable()
+  {
+    constexpr double twoPi{ 2 * 3.14159265358979323846 };
+
+    for (uint8_t i = 0; i != N; ++i)
+    {
+      const double angle{ twoPi * i / N };
+      const double quadrature{ angle + twoPi / 4 };
+
+      _sin[i] = toFixedPoint(_constexprSin(angle));
+      _cos[i] = toFixedPoint(_constexprSin(quadrature < twoPi ? quadrature : quadrature - twoPi));
+    }
+  }
+
+  constexpr int16_t sin(uint8_t i) const
+  {
+    return _sin[i];
+  }
+  constexpr int16_t cos(uint8_t i) const
+  {
+    return _cos[i];
+  }
+
+private:
+  static constexpr int16_t toFixedPoint(const double value)
+  {
+    return static_cast< int16_t >(value * (1L << FUNDAMENTAL_TABLE_SHIFT) + (value < 0 ? -0.5 : 0.5));
+  }
+
+  int16_t _sin[N]{};
+  int16_t _cos[N]{};
+};
+
+/**
+ * @brief Integer sums of one phase over one datalog period
+ *
+ */
+struct FundamentalSums
+{
+  int32_t activePower{ 0 };    /**< sum of (Vc.Ic + Vs.Is) >> FUNDAMENTAL_PRODUCT_SHIFT */
+  int32_t reactivePower{ 0 };  /**< sum of (Vc.Is - Vs.Ic) >> FUNDAMENTAL_PRODUCT_SHIFT */
+  int32_t fundamentalI2{ 0 };  /**< sum of (Ic² + Is²) >> FUNDAMENTAL_PRODUCT_SHIFT */
+  int32_t sumI2{ 0 };          /**< sum of I² (ADC steps²) */
+  int32_t dcI2{ 0 };           /**< sum of (sum of I)² >> FUNDAMENTAL_PRODUCT_SHIFT, per cycle */
+  uint8_t cycles{ 0 };         /**< # of analysed cycles */
+};
+
+/**
+ * @brief Round-robin fundamental analysis of all phases
+ *
+ * @tparam N number of samples per mains cycle
+ */
+template< uint8_t N >
+class FundamentalAnalysis
+{
+public:
+  /**
+   * @brief Process one pair of samples
+   *
+   * @param phase the phase number [0..NO_OF_PHASES[
+   * @param filteredV voltage sample, DC removed (x256)
+   * @param filteredI current sample, DC removed (x256)
+   * @param index index of the sample since the last +ve zero-crossing
+   *
+   * @ingroup TimeCritical
+   */
+  void processSample(const uint8_t phase, const int32_t filteredV, const int32_t filteredI, const uint8_t index)
+  {
+    if ((phase != analysedPhase) || !bRunning || (index >= N))
+    {
+      return;
+    }
+
+    const int16_t v{ static_cast< int16_t >(filteredV >> 3) };  // reduce to 16-bits (now x32, or 2^5)
+    const int16_t i{ static_cast< int16_t >(filteredI >> 3) };  // reduce to 16-bits (now x32, or 2^5)
+    const int16_t c{ table.cos(index) };
+    const int16_t s{ table.sin(index) };
+
+    Vc += (static_cast< int32_t >(v) * c) >> FUNDAMENTAL_TABLE_SHIFT;
+    Vs += (static_cast< int32_t >(v) * s) >> FUNDAMENTAL_TABLE_SHIFT;
+    Ic += (static_cast< int32_t >(i) * c) >> FUNDAMENTAL_TABLE_SHIFT;
+    Is += (static_cast< int32_t >(i) * s) >> FUNDAMENTAL_TABLE_SHIFT;
+
+    sumI += i;
+    sumI2 += (static_cast< int32_t >(i) * i) >> (2 * FUNDAMENTAL_SCALE_SHIFT);
+  }
+
+  /**
+   * @brief Process the +ve zero-crossing of one phase
+   *
+   * @param phase the phase number [0..NO_OF_PHASES[
+   * @param samples number of samples of the cycle just completed
+   *
+   * @ingroup TimeCritical
+   */
+  void processCycleEnd(const uint8_t phase, const uint8_t samples)
+  {
+    if (phase != analysedPhase)
+    {
+      return;
+    }
+
+    if (!bRunning)
+    {
+      Vc = Vs = Ic = Is = sumI = sumI2 = 0;
+      bRunning = true;
+      return;
+    }
+
+    if (samples >= N)
+    {
+      const int16_t vc{ static_cast< int16_t >(Vc >> FUNDAMENTAL_SCALE_SHIFT) };
+      const int16_t vs{ static_cast< int16_t >(Vs >> FUNDAMENTAL_SCALE_SHIFT) };
+      const int16_t ic{ static_cast< int16_t >(Ic >> FUNDAMENTAL_SCALE_SHIFT) };
+      const int16_t is{ static_cast< int16_t >(Is >> FUNDAMENTAL_SCALE_SHIFT) };
+      const int16_t dc{ static_cast< int16_t >(sumI >> FUNDAMENTAL_SCALE_SHIFT) };
+
+      auto &sums{ workingSums[phase] };
+      sums.activePower += (static_cast< int32_t >(vc) * ic + static_cast< int32_t >(vs) * is) >> FUNDAMENTAL_PRODUCT_SHIFT;
+      sums.reactivePower += (static_cast< int32_t >(vc) * is - static_cast< int32_t >(vs) * ic) >> FUNDAMENTAL_PRODUCT_SHIFT;
+      sums.fundamentalI2 += (static_cast< int32_t >(ic) * ic + static_cast< int32_t >(is) * is) >> FUNDAMENTAL_PRODUCT_SHIFT;
+      sums.sumI2 += sumI2;
+      sums.dcI2 += (static_cast< int32_t >(dc) * dc) >> FUNDAMENTAL_PRODUCT_SHIFT;
+      ++sums.cycles;
+    }
+
+    bRunning = false;
+    if (++analysedPhase == NO_OF_PHASES)
+    {
+      analysedPhase = 0;
+    }
+  }
+
+  /**
+   * @brief Make a copy of the sums for loop() and reset them, at the end of each datalog period
+   *
+   * @ingroup TimeCritical
+   */
+  void copyAndReset()
+  {
+    uint8_t phase{ NO_OF_PHASES };
+    do
+    {
+      --phase;
+      copyOfSums[phase] = workingSums[phase];
+      workingSums[phase] = FundamentalSums{};
+    } while (phase);
+  }
+
+  /**
+   * @brief Get the fundamental active power of the last datalog period
+   *
+   * @param phase the phase number [0..NO_OF_PHASES[
+   * @param powerCal the power calibration of the phase
+   * @return float power in W, import = +ve
+   */
+  float get_activePower(const uint8_t phase, const float powerCal) const
+  {
+    return copyOfSums[phase].cycles ? -powerCal * toAdcSquared(copyOfSums[phase].activePower) / copyOfSums[phase].cycles : 0;
+  }
+
+  /**
+   * @brief Get the fundamental reactive power of the last datalog period
+   *
+   * @param phase the phase number [0..NO_OF_PHASES[
+   * @param powerCal the power calibration of the phase
+   * @return float reactive power in var, import = +ve
+   */
+  float get_reactivePower(const uint8_t phase, const float powerCal) const
+  {
+    return copyOfSums[phase].cycles ? -powerCal * toAdcSquared(copyOfSums[phase].reactivePower) / copyOfSums[phase].cycles : 0;
+  }
+
+  /**
+   * @brief Get the THD of the current of the last datalog period
+   *
+   * @param phase the phase number [0..NO_OF_PHASES[
+   * @return float THD in %, 0 if not available
+   */
+  float get_currentThd(const uint8_t phase) const
+  {
+    const auto &sums{ copyOfSums[phase] };
+
+    const float fundamental{ toAdcSquared(sums.fundamentalI2) };
+    if (fundamental <= 0)
+    {
+      return 0;
+    }
+
+    const float total{ (sums.sumI2 - static_cast< float >(sums.dcI2) * (1 << FUNDAMENTAL_PRODUCT_SHIFT) / N) / N };
+    const float harmonics{ total - fundamental };
+
+    return harmonics > 0 ? 100 * sqrt(harmonics / fundamental) : 0;
+  }
+
+private:
+  /**
+   * @brief Convert an accumulated product into ADC steps²
+   *
+   * @param value The accumulated product
+   * @return float value in ADC steps², still summed over all analysed cycles
+   */
+  static float toAdcSquared(const int32_t value)
+  {
+    return static_cast< float >(value) * (2.0F * (1 << FUNDAMENTAL_PRODUCT_SHIFT) / (static_cast< float >(N) * N));
+  }
+
+  static constexpr _SineTable< N > table{}; /**< sines and cosines over one mains cycle */
+
+  int32_t Vc{ 0 };    /**< sum of V.cos over the current cycle */
+  int32_t Vs{ 0 };    /**< sum of V.sin over the current cycle */
+  int32_t Ic{ 0 };    /**< sum of I.cos over the current cycle */
+  int32_t Is{ 0 };    /**< sum of I.sin over the current cycle */
+  int32_t sumI{ 0 };  /**< sum of I over the current cycle, for the DC part */
+  int32_t sumI2{ 0 }; /**< sum of I² over the current cycle */
+
+  uint8_t analysedPhase{ 0 }; /**< phase being analysed */
+  bool bRunning{ false };     /**< the analysis of the current cycle of analysedPhase is running */
+
+  FundamentalSums workingSums[NO_OF_PHASES]; /**< sums over the current datalog period */
+  FundamentalSums copyOfSums[NO_OF_PHASES];  /**< sums over the last datalog period, for loop() */
+};
+
+inline FundamentalAnalysis< FUNDAMENTAL_TABLE_SIZE > fundamentalAnalysis; /**< the one and only fundamental analysis */
+
+#endif  // FUNDAMENTAL_H
@@ -0,0 +1,64 @@
+/**
+ * @file hal.h
+ * @author Frédéric Metrich (frederic.metrich@live.fr)
+ * @brief Hardware abstraction layer, selection of the backend
+ * @version 0.1
+ * @date 2024-05-27
+ *
+ * @details Everything which touches the registers of the MCU is gathered in one backend:
+ *
+ *          - ADC:
+ *            - halAdcBegin()             : set up the sequence of conversions and start it
+ *            - halAdcSelect(pin)         : select the channel of the conversion after the next one
+ *            - halAdcRead()              : get the result of the last conversion
+ *            - halAdcAcknowledge()       : clear the trigger of the last conversion, if needed
+ *            - HAL_ADC_ISR               : the ISR called at the end of each conversion
+ *          - Output ports:
+ *            - setPinON(pin)/setPinOFF(pin)/togglePin(pin)/getPinState(pin) for one pin
+ *            - setPinsON(pins)/setPinsOFF(pins) for a bit mask of pins (bit n = pin n, pins 0..13)
+ *            - PinMasksTable/halWritePins(mask, values) for a set of pins on several ports, with the
+ *              masks of each port computed at compile time
+ *          - PWM output (see PWM_OUTPUT):
+ *            - halPwmBegin()             : set up the timer of the PWM output, duty 0
+ *            - halPwmWrite(duty)         : set the duty of the PWM output [0..255]
+ *          - Pulse input (see METER_PULSE_INPUT):
+ *            - halPulseInputBegin(pin, onPulse) : call onPulse() on each falling edge of the pin
+ *          - freeRam()                   : free RAM between the heap and the stack
+ *          - halStackPaint()             : paint the free RAM, at startup
+ *          - halStackUnused()            : free RAM never reached by the stack since it has been painted
+ *          - halMemoryBarrier()          : order the accesses to the queues/snapshots shared with loop()
+ *
+ *          The processing engine only uses these functions, so another MCU only needs its own
+ *          backend with the same functions. Only the AVR backend exists today (hal_avr.h),
+ *          also used by the native build through the register shims (see native/shims).
+ *
+ *          The processing engine (ADC ISR and processing.cpp) and loop() only share:
+ *          - the lock-free queues isrEvents, isrCommands and fastStreamRecords (see utils_events.h),
+ *          - the mains-cycle and datalog counters of isrSignals (see utils_events.h),
+ *          - the double-buffered snapshots datalogSnapshots and powerSnapshots (see processing.h),
+ *          - the raw-sample capture buffer (see utils_capture.h),
+ *          - the calibration, copied once by updateIsrCalibration(),
+ *          - a few status variables written by the ISR only (e.g. absenceOfDivertedEnergyCount).
+ *          On a dual-core MCU, the engine can thus run on one core and loop() (Serial, OneWire, RF,
+ *          Modbus, relays) on the other: the backend must then provide a hardware barrier in
+ *          halMemoryBarrier(), and a cross-core lock in place of the ATOMIC_BLOCK of updateIsrCalibration().
+ *
+ * @note The ISR profiler and latency monitor (isr_profile.h, isr_latency.h) read Timer1 directly,
+ *       they are AVR-only diagnostics.
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef HAL_H
+#define HAL_H
+
+#include <Arduino.h>
+
+#if defined(__AVR__) || defined(NATIVE_ARDUINO_H)  // the native shims emulate the registers of the ATmega328P
+#include "hal_avr.h"
+#else
+#error "No hardware abstraction backend for this MCU, please see hal.h"
+#endif
+
+#endif  // HAL_H
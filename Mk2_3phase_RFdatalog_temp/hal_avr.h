@@ -0,0 +1,259 @@
+/**
+ * @file hal_avr.h
+ * @author Frédéric Metrich (frederic.metrich@live.fr)
+ * @brief Hardware abstraction layer, ATmega328P backend
+ * @version 0.1
+ * @date 2024-05-27
+ *
+ * @details The ADC runs at clk/ADC_PRESCALER, free-running or triggered by Timer1 (see ADC_TRIGGER_MODE).
+ *          When its interrupt fires, the conversion of the next channel is already under way.
+ *          The output ports are in hal_avr_pins.h.
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef HAL_AVR_H
+#define HAL_AVR_H
+
+#include <Arduino.h>
+#include <util/atomic.h>
+
+#include "config_system.h"
+#include "hal_avr_pins.h"
+
+inline constexpr uint8_t STACK_PAINT_PATTERN{ 0xC5 }; /**< pattern of the free RAM, unlikely to be pushed on the stack */
+
+#define HAL_ADC_ISR ISR(ADC_vect) /**< the ISR called at the end of each conversion */
+
+#if defined(__DOXYGEN__)
+inline void halAdcSelect(const uint8_t pin);
+inline int16_t halAdcRead();
+inline void halAdcAcknowledge();
+
+inline void halMemoryBarrier();
+
+inline void halPwmWrite(const uint8_t duty);
+#else
+inline void halAdcSelect(const uint8_t pin) __attribute__((always_inline));
+inline int16_t halAdcRead() __attribute__((always_inline));
+inline void halAdcAcknowledge() __attribute__((always_inline));
+
+inline void halMemoryBarrier() __attribute__((always_inline));
+
+inline void halPwmWrite(const uint8_t duty) __attribute__((always_inline));
+#endif
+
+/**
+ * @brief Set up the ADC and start the conversions
+ * @details The interrupts must be enabled afterwards.
+ *
+ */
+inline void halAdcBegin()
+{
+  // First stop the ADC
+  ADCSRA &= ~bit(ADEN);
+
+  if constexpr (ADC_TRIGGER_MODE == AdcTriggerModes::TIMER1)
+  {
+    // Timer1 in CTC mode (TOP = OCR1A), no prescaler
+    TCCR1A = 0;
+    TCCR1B = bit(WGM12) | bit(CS10);
+    TIMSK1 = 0;
+    OCR1A = ADC_TIMER_PERIOD - 1;
+    OCR1B = ADC_TIMER_PERIOD - 1;  // compare-match B at TOP triggers each conversion
+
+    // Activate auto-trigger on Timer1 compare-match B
+    ADCSRB = bit(ADTS2) | bit(ADTS0);
+  }
+  else
+  {
+    // Activate free-running mode
+    ADCSRB = 0x00;
+  }
+
+  // Set the ADC's clock to system clock / ADC_PRESCALER
+  if constexpr (ADC_PRESCALER == 32)
+  {
+    ADCSRA |= bit(ADPS0) | bit(ADPS2);
+  }
+  else if constexpr (ADC_PRESCALER == 64)
+  {
+    ADCSRA |= bit(ADPS1) | bit(ADPS2);
+  }
+  else
+  {
+    ADCSRA |= bit(ADPS0) | bit(ADPS1) | bit(ADPS2);
+  }
+
+  ADCSRA |= bit(ADATE);  // set the Auto Trigger Enable bit in the ADCSRA register. In free-running
+  // mode, bits ADTS0-2 have not been set (i.e. they are all zero), the
+  // ADC's trigger source is set to "free running mode".
+
+  ADCSRA |= bit(ADIE);  // set the ADC interrupt enable bit. When this bit is written
+  // to one and the I-bit in SREG is set, the
+  // ADC Conversion Complete Interrupt is activated.
+
+  ADCSRA |= bit(ADEN);  // Enable the ADC
+
+  if constexpr (ADC_TRIGGER_MODE == AdcTriggerModes::FREE_RUNNING)
+  {
+    ADCSRA |= bit(ADSC);  // start ADC manually first time
+  }
+}
+
+/**
+ * @brief Select the channel of the conversion after the next one
+ *
+ * @param pin the analog pin [0..7]
+ *
+ * @ingroup TimeCritical
+ */
+inline void halAdcSelect(const uint8_t pin)
+{
+  ADMUX = bit(REFS0) + pin;
+}
+
+/**
+ * @brief Get the result of the last conversion
+ *
+ * @return int16_t the raw sample [0..1023]
+ *
+ * @ingroup TimeCritical
+ */
+inline int16_t halAdcRead()
+{
+  return ADC;
+}
+
+/**
+ * @brief Clear the trigger of the last conversion
+ * @details With Timer1, the trigger is the rising edge of the flag, it must be cleared.
+ *
+ * @ingroup TimeCritical
+ */
+inline void halAdcAcknowledge()
+{
+  if constexpr (ADC_TRIGGER_MODE == AdcTriggerModes::TIMER1)
+  {
+    TIFR1 = bit(OCF1B);
+  }
+}
+
+/**
+ * @brief Order the memory accesses on both sides of the barrier
+ * @details The ISR and loop() run on the same core, the compiler must only not reorder the accesses.
+ *
+ * @ingroup TimeCritical
+ */
+inline void halMemoryBarrier()
+{
+  __asm__ __volatile__("" ::: "memory");
+}
+
+/**
+ * @brief Set up Timer2 for the PWM output on OC2B (D3)
+ * @details Fast PWM, 8 bits, clk/32, ie 1953 Hz @ 16 MHz, within the input range of the usual
+ *          PWM to 0-10 V converters. OC2B stays disconnected (pin LOW) until the first duty.
+ *          The pin must be set as output beforehand.
+ *
+ */
+inline void halPwmBegin()
+{
+  TCCR2A = bit(WGM21) | bit(WGM20);  // fast PWM, TOP = 0xFF
+  TCCR2B = bit(CS21) | bit(CS20);    // clk/32
+  OCR2B = 0;
+}
+
+/**
+ * @brief Set the duty of the PWM output
+ * @details OCR2B is double-buffered, the new duty starts with the next PWM period.
+ *          In fast PWM mode, a duty of 0 still gives a one-tick spike each period,
+ *          so OC2B is then disconnected and the pin stays LOW.
+ *
+ * @param duty the duty [0..255], 255 is fully ON but one tick
+ *
+ * @ingroup TimeCritical
+ */
+inline void halPwmWrite(const uint8_t duty)
+{
+  OCR2B = duty;
+  if (duty)
+  {
+    TCCR2A |= bit(COM2B1);  // non-inverting
+  }
+  else
+  {
+    TCCR2A &= ~bit(COM2B1);
+  }
+}
+
+/**
+ * @brief Set up the pulse input of the utility meter
+ * @details An S0 output is an open collector, a LED sensor pulls its output LOW on each flash:
+ *          the pin gets its pull-up, and the external interrupt fires on the falling edge.
+ *          attachInterrupt() is used rather than INT0_vect/INT1_vect, so that the RF library
+ *          can still attach its own handler to the other pin.
+ *
+ * @param pin D2 (INT0) or D3 (INT1)
+ * @param onPulse the handler of each pulse, called with the interrupts disabled
+ */
+inline void halPulseInputBegin(const uint8_t pin, void (*onPulse)())
+{
+  pinMode(pin, INPUT_PULLUP);
+  attachInterrupt(digitalPinToInterrupt(pin), onPulse, FALLING);
+}
+
+/**
+ * @brief Get the available RAM during setup
+ *
+ * @return int The amount of free RAM
+ */
+inline int freeRam()
+{
+  extern int __heap_start, *__brkval;
+  int v;
+  return reinterpret_cast< intptr_t >(&v) - reinterpret_cast< intptr_t >(__brkval == 0 ? &__heap_start : __brkval);
+}
+
+/**
+ * @brief Paint the free RAM between the heap and the stack
+ * @details Called once at startup. A few bytes are kept under the current stack frame.
+ *
+ */
+inline void halStackPaint()
+{
+  extern int __heap_start, *__brkval;
+  uint8_t top;
+  uint8_t *p{ reinterpret_cast< uint8_t * >(__brkval == 0 ? &__heap_start : __brkval) };
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    while (p < &top - 16)
+    {
+      *p++ = STACK_PAINT_PATTERN;
+    }
+  }
+}
+
+/**
+ * @brief Get the free RAM which has never been reached by the stack since halStackPaint()
+ * @details Scans from the end of the heap up to the first byte no longer painted (< 1 ms for 1.5 KB).
+ *
+ * @return uint16_t The number of bytes still painted
+ */
+inline uint16_t halStackUnused()
+{
+  extern int __heap_start, *__brkval;
+  uint8_t top;
+  const uint8_t *p{ reinterpret_cast< const uint8_t * >(__brkval == 0 ? &__heap_start : __brkval) };
+  uint16_t count{ 0 };
+
+  while (p < &top && STACK_PAINT_PATTERN == *p++)
+  {
+    ++count;
+  }
+  return count;
+}
+
+#endif  // HAL_AVR_H
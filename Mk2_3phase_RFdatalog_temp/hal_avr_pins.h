@@ -0,0 +1,247 @@
+/**
+ * @file hal_avr_pins.h
+ * @author Frédéric Metrich (frederic.metrich@live.fr)
+ * @brief Hardware abstraction layer, ATmega328P backend of the output ports
+ * @version 0.1
+ * @date 2024-06-12
+ *
+ * @details Pins 0..7 are on PORTD, pins 8..13 on PORTB, pins 14..19 (A0..A5) on PORTC.
+ *          Nothing here depends on the configuration of the router, so that the dev sketches
+ *          share these helpers with it (see library.json).
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef HAL_AVR_PINS_H
+#define HAL_AVR_PINS_H
+
+#include <Arduino.h>
+
+/**
+ * @brief Bit masks of a set of pins, one per port
+ *
+ */
+struct PinMasks
+{
+  uint8_t portD{ 0 }; /**< pins 0..7 */
+  uint8_t portB{ 0 }; /**< pins 8..13 */
+  uint8_t portC{ 0 }; /**< pins 14..19 */
+
+  constexpr PinMasks &operator|=(const PinMasks &other)
+  {
+    portD |= other.portD;
+    portB |= other.portB;
+    portC |= other.portC;
+    return *this;
+  }
+};
+
+/**
+ * @brief Get the masks of one pin
+ *
+ * @param pin The pin [0..19]
+ * @return constexpr PinMasks The masks, only one bit set
+ */
+constexpr PinMasks halPinMasks(const uint8_t pin)
+{
+  PinMasks masks;
+
+  if (pin < 8)
+  {
+    masks.portD = 1U << pin;
+  }
+  else if (pin < 14)
+  {
+    masks.portB = 1U << (pin - 8);
+  }
+  else
+  {
+    masks.portC = 1U << (pin - 14);
+  }
+  return masks;
+}
+
+/**
+ * @brief Table of the masks of a set of pins, computed at compile time
+ *
+ * @tparam N Number of pins
+ */
+template< uint8_t N > struct PinMasksTable
+{
+  /**
+   * @brief Construct the table from an array of pins
+   *
+   * @param pins The pins [0..19]
+   */
+  constexpr explicit PinMasksTable(const uint8_t (&pins)[N])
+  {
+    for (uint8_t i = 0; i < N; ++i)
+    {
+      masks[i] = halPinMasks(pins[i]);
+      all |= masks[i];
+    }
+  }
+
+  PinMasks masks[N]{}; /**< masks of each pin */
+  PinMasks all{};      /**< masks of all the pins */
+};
+
+#if defined(__DOXYGEN__)
+inline void togglePin(const uint8_t pin);
+
+inline void setPinON(const uint8_t pin);
+inline void setPinsON(const uint16_t pins);
+
+inline void setPinOFF(const uint8_t pin);
+inline void setPinsOFF(const uint16_t pins);
+
+inline bool getPinState(const uint8_t pin);
+
+inline void halWritePins(const PinMasks &mask, const PinMasks &values);
+#else
+inline void togglePin(const uint8_t pin) __attribute__((always_inline));
+
+inline void setPinON(const uint8_t pin) __attribute__((always_inline));
+inline void setPinsON(const uint16_t pins) __attribute__((always_inline));
+
+inline void setPinOFF(const uint8_t pin) __attribute__((always_inline));
+inline void setPinsOFF(const uint16_t pins) __attribute__((always_inline));
+
+inline bool getPinState(const uint8_t pin) __attribute__((always_inline));
+
+inline void halWritePins(const PinMasks &mask, const PinMasks &values) __attribute__((always_inline));
+#endif
+
+/**
+ * @brief Toggle the specified pin
+ *
+ * @param pin pin to change [2..19]
+ */
+inline void togglePin(const uint8_t pin)
+{
+  if (pin < 8)
+  {
+    PIND = bit(pin);  // writing a one to PINx toggles the pin
+  }
+  else if (pin < 14)
+  {
+    PINB = bit(pin - 8);
+  }
+  else
+  {
+    PINC = bit(pin - 14);
+  }
+}
+
+/**
+ * @brief Set the Pin state to ON for the specified pin
+ *
+ * @param pin pin to change [2..19]
+ */
+inline void setPinON(const uint8_t pin)
+{
+  if (pin < 8)
+  {
+    PORTD |= bit(pin);
+  }
+  else if (pin < 14)
+  {
+    PORTB |= bit(pin - 8);
+  }
+  else
+  {
+    PORTC |= bit(pin - 14);
+  }
+}
+
+/**
+ * @brief Set the Pins state to ON
+ *
+ * @param pins The pins to change
+ */
+inline void setPinsON(const uint16_t pins)
+{
+  PORTD |= lowByte(pins);
+  PORTB |= highByte(pins);
+}
+
+/**
+ * @brief Set the Pin state to OFF for the specified pin
+ *
+ * @param pin pin to change [2..19]
+ */
+inline void setPinOFF(const uint8_t pin)
+{
+  if (pin < 8)
+  {
+    PORTD &= ~bit(pin);
+  }
+  else if (pin < 14)
+  {
+    PORTB &= ~bit(pin - 8);
+  }
+  else
+  {
+    PORTC &= ~bit(pin - 14);
+  }
+}
+
+/**
+ * @brief Set the Pins state to OFF
+ *
+ * @param pins The pins to change
+ */
+inline void setPinsOFF(const uint16_t pins)
+{
+  PORTD &= ~lowByte(pins);
+  PORTB &= ~highByte(pins);
+}
+
+/**
+ * @brief Get the Pin State
+ *
+ * @param pin The pin to read
+ * @return true if HIGH
+ * @return false if LOW
+ */
+inline bool getPinState(const uint8_t pin)
+{
+  if (pin < 8)
+  {
+    return (PIND >> pin) & 0x01;
+  }
+  if (pin < 14)
+  {
+    return (PINB >> (pin - 8)) & 0x01;
+  }
+  return (PINC >> (pin - 14)) & 0x01;
+}
+
+/**
+ * @brief Write the state of a set of pins, at most one read-modify-write per port
+ * @details With masks known at compile time, the ports without any of the pins are not touched
+ *          and no bit is shifted at run time.
+ *
+ * @param mask The pins to write
+ * @param values The pins to set ON among them, the others are set OFF
+ *
+ * @ingroup TimeCritical
+ */
+inline void halWritePins(const PinMasks &mask, const PinMasks &values)
+{
+  if (mask.portD)
+  {
+    PORTD = (PORTD & ~mask.portD) | values.portD;
+  }
+  if (mask.portB)
+  {
+    PORTB = (PORTB & ~mask.portB) | values.portB;
+  }
+  if (mask.portC)
+  {
+    PORTC = (PORTC & ~mask.portC) | values.portC;
+  }
+}
+
+#endif  // HAL_AVR_PINS_H
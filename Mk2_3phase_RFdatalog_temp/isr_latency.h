@@ -0,0 +1,258 @@
+/**
+ * @file isr_latency.h
+ * @author Frédéric Metrich (frederic.metrich@live.fr)
+ * @brief Latency monitor for the ADC ISR
+ * @version 0.1
+ * @date 2024-05-10
+ *
+ * @details When ISR_LATENCY_MONITOR is set, each entry of the ADC ISR is timestamped with Timer1,
+ *          and the gap with the previous entry is recorded. The ADC being free-running, this gap
+ *          is 104 µs (at clk/128) unless the ISR has been delayed (interrupts masked, other ISR running).
+ *
+ *          Subsystems known to mask the interrupts (OneWire, RF) mark themselves active with a
+ *          LatencySourceScope, so that each gap is attributed to the subsystem active when the
+ *          ISR was finally entered.
+ *
+ *          A gap longer than twice the nominal period means that at least one conversion has been
+ *          overwritten before being read, i.e. a sample has been missed.
+ *
+ *          When ISR_STACK_MONITOR is set, the instrumented ISRs (the ADC ISR) record the lowest free RAM
+ *          at their entry and how deeply they are nested. Together with the free stack measured from the
+ *          painting (see halStackUnused()), this shows how much the ISR itself adds on top of loop().
+ *
+ * @note Timer1 runs with a prescaler of 8 (0.5 µs, up to 32 ms), or without prescaler
+ *       (62.5 ns, up to 4 ms) when the ISR profiler is enabled as well.
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef ISR_LATENCY_H
+#define ISR_LATENCY_H
+
+#include <Arduino.h>
+#include <util/atomic.h>
+
+#include "config_system.h"
+#include "hal.h"
+#include "isr_profile.h"
+
+inline constexpr uint8_t TIMER1_TICKS_PER_US{ ISR_PROFILING ? 16 : 2 };             /**< Timer1 resolution */
+inline constexpr uint16_t NOMINAL_ISR_PERIOD_IN_TICKS{ CPU_CYCLES_PER_CONVERSION * TIMER1_TICKS_PER_US / (F_CPU / 1000000UL) }; /**< time between 2 ADC conversions */
+
+/** Subsystems which may delay the ADC ISR */
+enum class LatencySources : uint8_t
+{
+  NONE,    /**< no identified subsystem */
+  ONEWIRE, /**< OneWire bus (temperature sensing) */
+  RF,      /**< RFM12B module */
+  COUNT    /**< number of sources */
+};
+
+/**
+ * @brief Gap statistics for one source
+ *
+ */
+struct GapStatistics
+{
+  uint16_t maxGap{ 0 };   /**< longest gap in Timer1 ticks */
+  uint16_t overruns{ 0 }; /**< number of gaps longer than twice the nominal period */
+};
+
+inline volatile LatencySources activeLatencySource{ LatencySources::NONE };           /**< subsystem currently active */
+inline GapStatistics isrGapStatistics[static_cast< uint8_t >(LatencySources::COUNT)]; /**< written by the ISR only */
+inline uint16_t lastIsrEntry{ 0 };                                                    /**< Timer1 value at the last ISR entry */
+
+/**
+ * @brief Scope guard marking a subsystem as active
+ * @details Does strictly nothing when the monitor is disabled.
+ *
+ * @tparam S The subsystem
+ */
+template< LatencySources S >
+class LatencySourceScope
+{
+public:
+  LatencySourceScope()
+  {
+    if constexpr (ISR_LATENCY_MONITOR)
+    {
+      previous = activeLatencySource;
+      activeLatencySource = S;
+    }
+  }
+
+  ~LatencySourceScope()
+  {
+    if constexpr (ISR_LATENCY_MONITOR)
+    {
+      activeLatencySource = previous;
+    }
+  }
+
+  LatencySourceScope(const LatencySourceScope &) = delete;
+  LatencySourceScope &operator=(const LatencySourceScope &) = delete;
+
+private:
+  LatencySources previous{ LatencySources::NONE }; /**< enclosing subsystem */
+};
+
+/**
+ * @brief Stack statistics of the instrumented ISRs, since startup
+ *
+ */
+struct IsrStackStatistics
+{
+  uint16_t minFreeAtEntry{ UINT16_MAX }; /**< lowest free RAM at the entry of an instrumented ISR */
+  uint8_t nesting{ 0 };                  /**< instrumented ISRs currently running */
+  uint8_t maxNesting{ 0 };               /**< deepest nesting seen */
+};
+
+inline IsrStackStatistics isrStackStatistics; /**< written by the ISRs only */
+
+/**
+ * @brief Scope guard of an instrumented ISR
+ * @details To be declared at the start of the ISR. On the AVR, the ISRs do not nest unless one of them
+ *          re-enables the interrupts (ISR_NOBLOCK, sei()): a nesting above 1 is the sign of it.
+ *          The ISRs of the Arduino core and of the libraries are not instrumented.
+ *          Does strictly nothing when the monitor is disabled.
+ *
+ * @ingroup TimeCritical
+ */
+class IsrStackScope
+{
+public:
+  IsrStackScope() __attribute__((always_inline))
+  {
+    if constexpr (ISR_STACK_MONITOR)
+    {
+      auto &stats{ isrStackStatistics };
+
+      if (++stats.nesting > stats.maxNesting)
+      {
+        stats.maxNesting = stats.nesting;
+      }
+
+      const uint16_t room{ static_cast< uint16_t >(freeRam()) };  // the registers saved by the ISR included
+      if (room < stats.minFreeAtEntry)
+      {
+        stats.minFreeAtEntry = room;
+      }
+    }
+  }
+
+  ~IsrStackScope() __attribute__((always_inline))
+  {
+    if constexpr (ISR_STACK_MONITOR)
+    {
+      --isrStackStatistics.nesting;
+    }
+  }
+
+  IsrStackScope(const IsrStackScope &) = delete;
+  IsrStackScope &operator=(const IsrStackScope &) = delete;
+};
+
+/**
+ * @brief Record the gap since the previous ISR entry
+ * @details Must be called first thing in the ISR.
+ *
+ * @ingroup TimeCritical
+ */
+inline void recordIsrEntry()
+{
+  if constexpr (ISR_LATENCY_MONITOR)
+  {
+    const uint16_t now{ TCNT1 };
+    const uint16_t gap{ static_cast< uint16_t >(now - lastIsrEntry) };
+    lastIsrEntry = now;
+
+    auto &stats{ isrGapStatistics[static_cast< uint8_t >(activeLatencySource)] };
+    if (gap > stats.maxGap)
+    {
+      stats.maxGap = gap;
+    }
+    if (gap > 2 * NOMINAL_ISR_PERIOD_IN_TICKS && stats.overruns < UINT16_MAX)
+    {
+      ++stats.overruns;
+    }
+  }
+}
+
+/**
+ * @brief Let Timer1 count with a prescaler of 8, unless the ISR profiler already uses it
+ *
+ */
+inline void initializeIsrLatencyMonitor()
+{
+  if constexpr (ISR_LATENCY_MONITOR && !ISR_PROFILING)
+  {
+    TCCR1A = 0;
+    TCCR1B = bit(CS11);
+    TIMSK1 = 0;
+  }
+}
+
+/**
+ * @brief Print the statistics of the last datalog period and reset them
+ * @details Format: ", ISR max gap µs (idle/OneWire/RF) a/b/c, overruns x/y/z"
+ *
+ * @param out Where to print
+ */
+inline void printIsrLatency(Print &out)
+{
+  GapStatistics stats[static_cast< uint8_t >(LatencySources::COUNT)];
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    for (uint8_t i = 0; i < static_cast< uint8_t >(LatencySources::COUNT); ++i)
+    {
+      stats[i] = isrGapStatistics[i];
+      isrGapStatistics[i] = GapStatistics{};
+    }
+  }
+
+  out.print(F(", ISR max gap µs (idle/OneWire/RF) "));
+  for (uint8_t i = 0; i < static_cast< uint8_t >(LatencySources::COUNT); ++i)
+  {
+    if (i)
+    {
+      out.print(F("/"));
+    }
+    out.print(stats[i].maxGap / TIMER1_TICKS_PER_US);
+  }
+  out.print(F(", overruns "));
+  for (uint8_t i = 0; i < static_cast< uint8_t >(LatencySources::COUNT); ++i)
+  {
+    if (i)
+    {
+      out.print(F("/"));
+    }
+    out.print(stats[i].overruns);
+  }
+}
+
+/**
+ * @brief Print the stack statistics of the ISRs
+ * @details Format: ", ISR entry free stack x, nesting y". The free stack printed with the datalogs
+ *          being the lowest free RAM ever, x minus this free stack is an upper bound of the stack used
+ *          by the ISR itself, should the deepest point be reached inside the ISR.
+ *
+ * @param out Where to print
+ */
+inline void printIsrStack(Print &out)
+{
+  IsrStackStatistics stats;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    stats = isrStackStatistics;
+  }
+
+  out.print(F(", ISR entry free stack "));
+  out.print(stats.minFreeAtEntry);
+  out.print(F(", nesting "));
+  out.print(stats.maxNesting);
+}
+
+#endif  // ISR_LATENCY_H
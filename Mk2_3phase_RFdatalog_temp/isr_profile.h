@@ -0,0 +1,224 @@
+/**
+ * @file isr_profile.h
+ * @author Frédéric Metrich (frederic.metrich@live.fr)
+ * @brief Cycle-budget profiler for the ADC ISR
+ * @version 0.1
+ * @date 2024-05-02
+ *
+ * @details When built with ISR_PROFILE (see 'env:isr_profile'), Timer1 runs at CPU clock
+ *          without prescaler and each profiled stage records its duration in CPU cycles.
+ *          For each stage, min, max and a histogram are kept over one datalog period,
+ *          and the stages are printed in turn through the text output queue.
+ *
+ *          The ADC is free-running with a conversion every 104 µs, i.e. 1664 cycles @ 16 MHz.
+ *          This is the budget each ISR invocation must fit in.
+ *
+ * @note Timer1 is used exclusively by the profiler in this mode (PWM on pins 9 & 10 is not available).
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef ISR_PROFILE_H
+#define ISR_PROFILE_H
+
+#include <Arduino.h>
+#include <util/atomic.h>
+
+#include "config_system.h"
+
+#ifdef ISR_PROFILE
+inline constexpr bool ISR_PROFILING{ true }; /**< set it to 'true' to profile the ISR */
+#else
+inline constexpr bool ISR_PROFILING{ false }; /**< set it to 'true' to profile the ISR */
+#endif
+
+inline constexpr uint16_t ISR_CYCLE_BUDGET{ CPU_CYCLES_PER_CONVERSION }; /**< CPU cycles between 2 ADC conversions (1664, i.e. 104 µs @ 16 MHz and clk/128) */
+
+inline constexpr uint8_t NO_OF_HISTOGRAM_BUCKETS{ 8 }; /**< number of histogram buckets per stage */
+inline constexpr uint8_t HISTOGRAM_BUCKET_SHIFT{ 8 };  /**< width of each bucket: 2^8 = 256 cycles */
+
+/** Profiled stages of the ISR */
+enum class ProfiledStages : uint8_t
+{
+  VOLTAGE,         /**< processVoltageRawSample, including the nested stages */
+  CURRENT,         /**< processCurrentRawSample */
+  START_NEW_CYCLE, /**< processStartNewCycle */
+  DATALOGGING,     /**< processDataLogging */
+  COUNT            /**< number of profiled stages */
+};
+
+/**
+ * @brief Timing statistics of one profiled stage
+ *
+ */
+class StageStatistics
+{
+public:
+  /**
+   * @brief Record the duration of one run of the stage
+   *
+   * @param cycles Duration in CPU cycles
+   */
+  void record(const uint16_t cycles)
+  {
+    if (cycles < minCycles)
+    {
+      minCycles = cycles;
+    }
+    if (cycles > maxCycles)
+    {
+      maxCycles = cycles;
+    }
+
+    const uint8_t bucket{ static_cast< uint8_t >(cycles >> HISTOGRAM_BUCKET_SHIFT) };
+    auto &count{ histogram[bucket < NO_OF_HISTOGRAM_BUCKETS ? bucket : NO_OF_HISTOGRAM_BUCKETS - 1] };
+    if (count < UINT16_MAX)
+    {
+      ++count;
+    }
+  }
+
+  /**
+   * @brief Reset the statistics for the next period
+   *
+   */
+  void reset()
+  {
+    minCycles = UINT16_MAX;
+    maxCycles = 0;
+    for (auto &count : histogram)
+    {
+      count = 0;
+    }
+  }
+
+  /**
+   * @brief Print the statistics
+   * @details The histogram buckets are 2^HISTOGRAM_BUCKET_SHIFT cycles wide.
+   *
+   * @param out Where to print
+   */
+  void print(Print &out) const
+  {
+    if (UINT16_MAX == minCycles)
+    {
+      out.println(F("n/a"));
+      return;
+    }
+
+    out.print(F("min "));
+    out.print(minCycles);
+    out.print(F(", max "));
+    out.print(maxCycles);
+    out.print(F(", histogram"));
+    for (const auto count : histogram)
+    {
+      out.print(F(" "));
+      out.print(count);
+    }
+    out.println();
+  }
+
+  uint16_t minCycles{ UINT16_MAX };              /**< shortest run in cycles */
+  uint16_t maxCycles{ 0 };                       /**< longest run in cycles */
+  uint16_t histogram[NO_OF_HISTOGRAM_BUCKETS]{}; /**< saturating count of runs per bucket */
+};
+
+inline StageStatistics isrStageStatistics[static_cast< uint8_t >(ProfiledStages::COUNT)]; /**< written by the ISR only */
+
+/**
+ * @brief Scope guard measuring the duration of the enclosing block
+ * @details Does strictly nothing when profiling is disabled.
+ *
+ * @tparam S The profiled stage
+ *
+ * @ingroup TimeCritical
+ */
+template< ProfiledStages S >
+class ProfiledScope
+{
+public:
+  ProfiledScope()
+    : start{ ISR_PROFILING ? TCNT1 : static_cast< uint16_t >(0) }
+  {
+  }
+
+  ~ProfiledScope()
+  {
+    if constexpr (ISR_PROFILING)
+    {
+      isrStageStatistics[static_cast< uint8_t >(S)].record(TCNT1 - start);
+    }
+  }
+
+  ProfiledScope(const ProfiledScope &) = delete;
+  ProfiledScope &operator=(const ProfiledScope &) = delete;
+
+private:
+  const uint16_t start; /**< value of Timer1 on entry */
+};
+
+/**
+ * @brief Let Timer1 count CPU cycles (normal mode, no prescaler)
+ *
+ */
+inline void initializeIsrProfiler()
+{
+  TCCR1A = 0;
+  TCCR1B = bit(CS10);
+  TIMSK1 = 0;
+}
+
+/**
+ * @brief Print the statistics of one stage over the last datalog period and reset them all
+ * @details The statistics are copied inside a critical section so that
+ *          the ISR cannot modify them while they are printed.
+ *          The whole profile does not fit in the text output queue next to a datalog line,
+ *          so the stages are printed in turn, one per datalog period.
+ *          Format: "ISR profile <stage> (budget x): min a, max b, histogram c ..."
+ *
+ * @param out Where to print
+ */
+inline void printIsrProfile(Print &out)
+{
+  static uint8_t stage{ 0 };
+  StageStatistics stats;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    stats = isrStageStatistics[stage];
+    for (auto &stageStatistics : isrStageStatistics)
+    {
+      stageStatistics.reset();
+    }
+  }
+
+  out.print(F("ISR profile "));
+  switch (static_cast< ProfiledStages >(stage))
+  {
+    case ProfiledStages::VOLTAGE:
+      out.print(F("processVoltageRawSample"));
+      break;
+    case ProfiledStages::CURRENT:
+      out.print(F("processCurrentRawSample"));
+      break;
+    case ProfiledStages::START_NEW_CYCLE:
+      out.print(F("processStartNewCycle"));
+      break;
+    default:
+      out.print(F("processDataLogging"));
+      break;
+  }
+  out.print(F(" (budget "));
+  out.print(ISR_CYCLE_BUDGET);
+  out.print(F("): "));
+  stats.print(out);
+
+  if (++stage == static_cast< uint8_t >(ProfiledStages::COUNT))
+  {
+    stage = 0;
+  }
+}
+
+#endif  // ISR_PROFILE_H
@@ -0,0 +1,172 @@
+/**
+ * @file load_learning.h
+ * @author Frédéric Metrich (frederic.metrich@live.fr)
+ * @brief Online learning of the actual power of each load
+ * @version 0.1
+ * @date 2024-05-22
+ *
+ * @details When a single load is switched, the power balance of the mains cycle before the
+ *          transition is compared to the one of the second cycle after it (the first one is
+ *          still partly measured with the previous state on phases 2 and 3).
+ *          The difference is the actual power of the load, averaged with an EWMA.
+ *
+ *          A measurement below a quarter of the rated power means that the element is not
+ *          drawing any power (thermostat open, failed element, ...). The load is then skipped
+ *          for SATURATED_LOAD_PERIOD_IN_MINUTES before being tried again.
+ *
+ *          Until LOAD_LEARNING_MIN_SAMPLES measurements are available, the rated power is used.
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef LOAD_LEARNING_H
+#define LOAD_LEARNING_H
+
+#include <Arduino.h>
+
+#include "config.h"
+#include "ewma_avg.hpp"
+
+inline constexpr uint8_t LOAD_LEARNING_MIN_SAMPLES{ 4 };                                  /**< measurements before the learned power is used */
+inline constexpr uint16_t LOAD_RETRY_PERIOD_IN_SECONDS{ SATURATED_LOAD_PERIOD_IN_MINUTES * 60U }; /**< a failed load is tried again after this period */
+
+/**
+ * @brief Learned power of the loads
+ *
+ * @tparam N # of loads
+ */
+template< uint8_t N >
+class LoadPowerLearning
+{
+public:
+  /**
+   * @brief Start a measurement, when a single load has been switched
+   *
+   * @param load the physical load number [0..N[
+   * @param bOn true if the load has been switched ON
+   * @param balance the power balance of the last cycle in W, surplus is positive
+   *
+   * @ingroup TimeCritical
+   */
+  void start(const uint8_t load, const bool bOn, const int32_t balance)
+  {
+    measuredLoad = load;
+    bSwitchedOn = bOn;
+    balanceBefore = balance;
+    cyclesToGo = 2;
+  }
+
+  /**
+   * @brief Cancel the pending measurement, when several loads have been switched
+   *
+   * @ingroup TimeCritical
+   */
+  void abort()
+  {
+    cyclesToGo = 0;
+  }
+
+  /**
+   * @brief Proceed with the pending measurement, at the start of each mains cycle
+   *
+   * @param balance the power balance of the last cycle in W, surplus is positive
+   *
+   * @ingroup TimeCritical
+   */
+  void proceed(const int32_t balance)
+  {
+    if (++cycleCount == SUPPLY_FREQUENCY)
+    {
+      cycleCount = 0;
+
+      uint8_t load{ N };
+      do
+      {
+        --load;
+        if (retryCountdown[load])
+        {
+          --retryCountdown[load];
+        }
+      } while (load);
+    }
+
+    if (!cyclesToGo || --cyclesToGo)
+    {
+      return;
+    }
+
+    const int32_t measured{ bSwitchedOn ? balanceBefore - balance : balance - balanceBefore };
+
+    if (measured < (loadRatedPower[measuredLoad] >> 2))
+    {
+      bFailed[measuredLoad] = true;
+      retryCountdown[measuredLoad] = LOAD_RETRY_PERIOD_IN_SECONDS;
+      return;
+    }
+
+    bFailed[measuredLoad] = false;
+
+    // the first measurement seeds the average
+    uint8_t count{ samples[measuredLoad] ? uint8_t{ 1 } : uint8_t{ 32 } };
+    do
+    {
+      power[measuredLoad].addValue(measured);
+    } while (--count);
+
+    if (samples[measuredLoad] < LOAD_LEARNING_MIN_SAMPLES)
+    {
+      ++samples[measuredLoad];
+    }
+  }
+
+  /**
+   * @brief Check if a measurement is pending
+   *
+   * @return true if a measurement is pending
+   */
+  bool isPending() const
+  {
+    return cyclesToGo != 0;
+  }
+
+  /**
+   * @brief Check if a load must be skipped by the scheduler
+   *
+   * @param load the physical load number [0..N[
+   * @return true if the load has been seen failed, and is not yet to be tried again
+   */
+  bool isSkipped(const uint8_t load) const
+  {
+    return bFailed[load] && retryCountdown[load];
+  }
+
+  /**
+   * @brief Get the power of a load
+   *
+   * @param load the physical load number [0..N[
+   * @return int16_t the learned power in W, the rated power if not yet learned, 0 if failed
+   */
+  int16_t get_power(const uint8_t load) const
+  {
+    if (bFailed[load])
+    {
+      return 0;
+    }
+    return samples[load] < LOAD_LEARNING_MIN_SAMPLES ? loadRatedPower[load] : power[load].getAverageS();
+  }
+
+private:
+  EWMA_average< 8, EwmaOrders::EMA > power[N]; /**< learned power of each load */
+  uint16_t retryCountdown[N]{};                /**< seconds before a failed load is tried again */
+  uint8_t samples[N]{};                        /**< # of valid measurements of each load (saturated) */
+  bool bFailed[N]{};                           /**< the last measurement of the load was ~0 W */
+
+  int32_t balanceBefore{ 0 }; /**< power balance before the transition */
+  uint8_t measuredLoad{ 0 };  /**< load being measured */
+  uint8_t cyclesToGo{ 0 };    /**< cycles before the end of the measurement, 0 if none is pending */
+  bool bSwitchedOn{ false };  /**< the measured load has been switched ON */
+  uint8_t cycleCount{ 0 };    /**< mains cycles within the current second */
+};
+
+#endif  // LOAD_LEARNING_H
@@ -16,7 +16,8 @@ static_assert(__cplusplus >= 201703L, "See also : https://github.com/FredM67/PVR
 
 #include "config.h"
 
-// In this sketch, the ADC is free-running with a cycle time of ~104uS.
+// In this sketch, the ADC is free-running with a cycle time of ~104uS,
+// or triggered by Timer1 at an exact rate (see ADC_TRIGGER_MODE).
 
 //--------------------------------------------------------------------------------------------------
 #ifdef EMONESP
@@ -24,6 +25,13 @@ static_assert(__cplusplus >= 201703L, "See also : https://github.com/FredM67/PVR
 #undef SERIALOUT
 #endif
 
+#ifdef SERIALBINARY
+#undef EMONESP
+#undef SERIALPRINT  // Must not corrupt the binary frames with 'human-friendly' printout
+#undef SERIALOUT
+#undef ENABLE_DEBUG
+#endif
+
 #ifdef SERIALOUT
 #undef EMONESP
 #undef SERIALPRINT  // Must not corrupt serial output to emonHub with 'human-friendly' printout
@@ -31,11 +39,18 @@ static_assert(__cplusplus >= 201703L, "See also : https://github.com/FredM67/PVR
 #endif
 //--------------------------------------------------------------------------------------------------
 
+#include "adc_sequencer.h"
 #include "calibration.h"
+#include "hal.h"
+#include "isr_latency.h"
+#include "isr_profile.h"
 #include "processing.h"
 #include "types.h"
 #include "utils.h"
+#include "utils_coordination.h"
+#include "utils_ram.h"
 #include "utils_relay.h"
+#include "utils_tasks.h"
 #include "validation.h"
 
 // --------------  general global variables -----------------
@@ -74,59 +89,64 @@ static_assert(__cplusplus >= 201703L, "See also : https://github.com/FredM67/PVR
  *
  * @ingroup TimeCritical
  */
-ISR(ADC_vect)
+HAL_ADC_ISR
 {
   static uint8_t sample_index{ 0 };
-  int16_t rawSample;
 
-  switch (sample_index)
+  halAdcAcknowledge();
+
+  recordIsrEntry();
+
+  const IsrStackScope stackScope;  // see ISR_STACK_MONITOR
+
+  const int16_t rawSample{ halAdcRead() };  // store the ADC value (the conversion of the next channel is already under way)
+
+  dispatchAdcSample(sample_index, rawSample);  // see adc_sequencer.h
+}  // end of ISR
+
+uint8_t localOverrideMask{ 0 }; /**< loads forced by the pins or the dual tariff */
+
+bool bOffPeakPeriod{ false };           /**< state of on/off-peak period, updated every second */
+int16_t iCurrentTemperature_x100{ 0 }; /**< current temperature x 100 (default to 0 if deactivated) */
+
+uint32_t divertedEnergySinceRotation[NO_OF_DUMPLOADS]{}; /**< diverted energy of each load in J since the last rotation (see EQUALISED_ROTATION) */
+
+/**
+ * @brief Send the override to the ISR
+ * @details The loads forced through the Serial (see SERIAL_CONTROL and MODBUS_SLAVE) are added to the local ones.
+ *          The command is sent only when the mask changes, and again later if the queue was full.
+ *
+ */
+void sendOverride()
+{
+  static uint8_t sentMask{ 0 };
+  uint8_t mask{ localOverrideMask };
+
+  if constexpr (SERIAL_CONTROL)
   {
-    case 0:
-      rawSample = ADC;                  // store the ADC value (this one is for Voltage L1)
-      ADMUX = bit(REFS0) + sensorV[1];  // the conversion for I1 is already under way
-      ++sample_index;                   // increment the control flag
-      //
-      processVoltageRawSample(0, rawSample);
-      break;
-    case 1:
-      rawSample = ADC;                  // store the ADC value (this one is for Current L1)
-      ADMUX = bit(REFS0) + sensorI[1];  // the conversion for V2 is already under way
-      ++sample_index;                   // increment the control flag
-      //
-      processCurrentRawSample(0, rawSample);
-      break;
-    case 2:
-      rawSample = ADC;                  // store the ADC value (this one is for Voltage L2)
-      ADMUX = bit(REFS0) + sensorV[2];  // the conversion for I2 is already under way
-      ++sample_index;                   // increment the control flag
-      //
-      processVoltageRawSample(1, rawSample);
-      break;
-    case 3:
-      rawSample = ADC;                  // store the ADC value (this one is for Current L2)
-      ADMUX = bit(REFS0) + sensorI[2];  // the conversion for V3 is already under way
-      ++sample_index;                   // increment the control flag
-      //
-      processCurrentRawSample(1, rawSample);
-      break;
-    case 4:
-      rawSample = ADC;                  // store the ADC value (this one is for Voltage L3)
-      ADMUX = bit(REFS0) + sensorV[0];  // the conversion for I3 is already under way
-      ++sample_index;                   // increment the control flag
-      //
-      processVoltageRawSample(2, rawSample);
-      break;
-    case 5:
-      rawSample = ADC;                  // store the ADC value (this one is for Current L3)
-      ADMUX = bit(REFS0) + sensorI[0];  // the conversion for V1 is already under way
-      sample_index = 0;                 // reset the control flag
-      //
-      processCurrentRawSample(2, rawSample);
-      break;
-    default:
-      sample_index = 0;  // to prevent lockup (should never get here)
+    mask |= serialCommands.get_overrideMask();
   }
-}  // end of ISR
+  if constexpr (MODBUS_SLAVE)
+  {
+    mask |= modbusSlave.get_overrideMask();
+  }
+
+  if ((mask != sentMask) && isrCommands.push({ Commands::OVERRIDE, mask }))
+  {
+    sentMask = mask;
+  }
+}
+
+/**
+ * @brief Ask the ISR to force some loads to ON
+ *
+ * @param mask bit mask of the loads to be forced by the pins or the dual tariff
+ */
+void requestOverride(const uint8_t mask)
+{
+  localOverrideMask = mask;
+  sendOverride();
+}
 
 /**
  * @brief This function set all 3 loads to full power.
@@ -150,10 +170,7 @@ bool forceFullPower()
     previousState = pinState;
 #endif
 
-    for (auto &bOverrideLoad : b_overrideLoadOn)
-    {
-      bOverrideLoad = !pinState;
-    }
+    requestOverride(!pinState ? bit(NO_OF_DUMPLOADS) - 1 : 0);
 
     return !pinState;
   }
@@ -183,26 +200,66 @@ void checkDiversionOnOff()
     previousState = pinState;
 #endif
 
-    b_diversionOff = !pinState;
+    static bool sentState{ false };
+    const bool bDiversionOff{ !pinState };
+
+    if ((bDiversionOff != sentState) && isrCommands.push({ Commands::DIVERSION_OFF, bDiversionOff }))
+    {
+      sentState = bDiversionOff;
+    }
   }
 }
 
 /**
  * @brief Proceed load priority rotation
- * 
+ * @details The new priorities are printed once the ISR has rotated them (see Events::LOADS_ROTATED).
+ *
+ *          With EQUALISED_ROTATION, the loads are ordered by increasing diverted energy since the
+ *          last rotation: the load which got the least takes the highest priority. The loads with
+ *          the same energy keep the order of a cyclic rotation. The new order is handed to the ISR
+ *          in one piece (see requestedPriorities).
+ *
  */
 void proceedRotation()
 {
-  b_reOrderLoads = true;
-
-  // waits till the priorities have been rotated from inside the ISR
-  do
+  if constexpr (EQUALISED_ROTATION)
   {
-    delay(10);
-  } while (b_reOrderLoads);
+    uint8_t order[NO_OF_DUMPLOADS];
 
-  // prints the (new) load priorities
-  logLoadPriorities();
+    // cyclic rotation first, the last priority comes first
+    order[0] = loadPrioritiesAndState[NO_OF_DUMPLOADS - 1] & loadStateMask;
+    for (uint8_t i = 1; i < NO_OF_DUMPLOADS; ++i)
+    {
+      order[i] = loadPrioritiesAndState[i - 1] & loadStateMask;
+    }
+
+    // then stable sort by increasing energy
+    for (uint8_t i = 1; i < NO_OF_DUMPLOADS; ++i)
+    {
+      const auto load{ order[i] };
+      uint8_t j{ i };
+      while (j && divertedEnergySinceRotation[order[j - 1]] > divertedEnergySinceRotation[load])
+      {
+        order[j] = order[j - 1];
+        --j;
+      }
+      order[j] = load;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      memcpy(requestedPriorities, order, sizeof(order));
+    }
+
+    if (isrCommands.push({ Commands::SET_PRIORITIES, 0 }))
+    {
+      memset(divertedEnergySinceRotation, 0, sizeof(divertedEnergySinceRotation));
+    }
+  }
+  else
+  {
+    isrCommands.push({ Commands::ROTATE_LOADS, 0 });
+  }
 }
 
 /**
@@ -234,19 +291,21 @@ bool proceedLoadPrioritiesAndOverridingDualTariff(const int16_t currentTemperatu
   {
     const auto ulElapsedTime{ static_cast< uint32_t >(millis() - ul_TimeOffPeak) };
     const auto pinState{ getPinState(forcePin) };
+    uint8_t mask{ 0 };
 
     for (uint8_t i = 0; i < NO_OF_DUMPLOADS; ++i)
     {
       // for each load, if we're inside off-peak period and within the 'force period', trigger the ISR to turn the load ON
       if (!pinOffPeakState && !pinNewState && (ulElapsedTime >= rg_OffsetForce[i][0]) && (ulElapsedTime < rg_OffsetForce[i][1]))
       {
-        b_overrideLoadOn[i] = !pinState || (currentTemperature_x100 <= iTemperatureThreshold_x100);
+        mask |= (!pinState || (currentTemperature_x100 <= iTemperatureThreshold_x100)) ? bit(i) : 0;
       }
       else
       {
-        b_overrideLoadOn[i] = !pinState;
+        mask |= !pinState ? bit(i) : 0;
       }
     }
+    requestOverride(mask);
   }
   // end of off-peak period
   if (!pinOffPeakState && pinNewState)
@@ -259,6 +318,41 @@ bool proceedLoadPrioritiesAndOverridingDualTariff(const int16_t currentTemperatu
   return (LOW == pinOffPeakState);
 }
 
+/**
+ * @brief Proceed load overriding in combination with dual tariff, from the daily schedule
+ * @details The off-peak period and the force windows come from the real-time clock (see utils_rtc.h).
+ *
+ * @param currentTemperature_x100 current temperature x 100 (default to 0 if deactivated)
+ * @return true if off-peak period
+ * @return false if on-peak period
+ */
+bool proceedLoadPrioritiesAndOverridingSchedule(const int16_t currentTemperature_x100)
+{
+  constexpr int16_t iTemperatureThreshold_x100{ iTemperatureThreshold * 100 };
+  static bool bPreviousOffPeak{ false };
+  const bool bOffPeak{ dailyScheduler.is_offPeak() };
+  const bool bForced{ OVERRIDE_PIN_PRESENT && !getPinState(forcePin) };
+
+  if (bOffPeak != bPreviousOffPeak)
+  {
+    DBUGLN(bOffPeak ? F("Change to off-peak period!") : F("Change to peak period!"));
+    bPreviousOffPeak = bOffPeak;
+  }
+
+  uint8_t mask{ 0 };
+  if (bForced)
+  {
+    mask = bit(NO_OF_DUMPLOADS) - 1;
+  }
+  else if (currentTemperature_x100 <= iTemperatureThreshold_x100)
+  {
+    mask = dailyScheduler.get_forceMask();
+  }
+  requestOverride(mask);
+
+  return bOffPeak;
+}
+
 /**
  * @brief This function changes the value of the load priorities.
  * @details Since we don't have access to a clock, we detect the offPeak start from the main energy meter.
@@ -270,7 +364,11 @@ bool proceedLoadPrioritiesAndOverridingDualTariff(const int16_t currentTemperatu
  */
 bool proceedLoadPrioritiesAndOverriding(const int16_t currentTemperature_x100)
 {
-  if constexpr (DUAL_TARIFF)
+  if constexpr (DUAL_TARIFF && RTC_PRESENT)
+  {
+    return proceedLoadPrioritiesAndOverridingSchedule(currentTemperature_x100);
+  }
+  else if constexpr (DUAL_TARIFF)
   {
     return proceedLoadPrioritiesAndOverridingDualTariff(currentTemperature_x100);
   }
@@ -288,13 +386,11 @@ bool proceedLoadPrioritiesAndOverriding(const int16_t currentTemperature_x100)
     }
     pinRotationState = pinNewState;
   }
-  else if constexpr (PRIORITY_ROTATION == RotationModes::AUTO)
+  else if constexpr (PRIORITY_ROTATION == RotationModes::AUTO && !RTC_PRESENT)
   {
     if (ROTATION_AFTER_CYCLES < absenceOfDivertedEnergyCount)
     {
-      proceedRotation();
-
-      absenceOfDivertedEnergyCount = 0;
+      proceedRotation();  // the count is reset by the ISR
     }
   }
 
@@ -302,10 +398,7 @@ bool proceedLoadPrioritiesAndOverriding(const int16_t currentTemperature_x100)
   {
     const auto pinState{ getPinState(forcePin) };
 
-    for (auto &bOverrideLoad : b_overrideLoadOn)
-    {
-      bOverrideLoad = !pinState;
-    }
+    requestOverride(!pinState ? bit(NO_OF_DUMPLOADS) - 1 : 0);
   }
 
   return false;
@@ -319,14 +412,27 @@ bool proceedLoadPrioritiesAndOverriding(const int16_t currentTemperature_x100)
  */
 void setup()
 {
+  halStackPaint();  // before the deepest calls, to measure the stack usage (see utils_ram.h)
+
   delay(initialDelay);  // allows time to open the Serial Monitor
 
   DEBUG_PORT.begin(9600);
-  Serial.begin(9600);  // initialize Serial interface, Do NOT set greater than 9600
+  Serial.begin(SERIAL_BAUD_RATE);  // initialize Serial interface, see POLLED_SERIAL_TX above 9600
+
+  if constexpr (RUNTIME_PARAMETERS)
+  {
+    runtimeParameters.begin();
+  }
 
   // On start, always display config info in the serial monitor
   printConfiguration();
 
+  if constexpr (ISR_PROFILING)
+  {
+    initializeIsrProfiler();
+  }
+  initializeIsrLatencyMonitor();
+
   // initializes all loads to OFF at startup
   initializeProcessing();
 
@@ -334,6 +440,11 @@ void setup()
 
   logLoadPriorities();
 
+  if constexpr (ENERGY_COUNTERS)
+  {
+    energyCounters.begin();
+  }
+
   if constexpr (TEMP_SENSOR_PRESENT)
   {
     temperatureSensing.initTemperatureSensors();
@@ -341,96 +452,450 @@ void setup()
 
   DBUG(F(">>free RAM = "));
   DBUGLN(freeRam());  // a useful value to keep an eye on
+  printRamBudget();
   DBUGLN(F("----"));
+
+  if constexpr (HARDWARE_WATCHDOG)
+  {
+    hardwareWatchdog.begin();  // last, once the ISR is running
+  }
 }
 
 /**
- * @brief Main processor.
- * @details None of the workload in loop() is time-critical.
- *          All the processing of ADC data is done within the ISR.
+ * @brief Toggle the watchdog LED
  *
  */
-void loop()
+void toggleWatchdogLed()
+{
+  togglePin(watchDogPin);
+}
+
+/**
+ * @brief Count one second of the daily schedule, and rotate the priorities when due
+ *
+ */
+void proceedDailySchedule()
+{
+  if (dailyScheduler.proceed() && (PRIORITY_ROTATION == RotationModes::AUTO))
+  {
+    proceedRotation();
+  }
+}
+
+/**
+ * @brief Proceed with the override pin, the load priorities and the dual tariff
+ *
+ */
+void proceedOverriding()
+{
+  if (!forceFullPower())
+  {
+    bOffPeakPeriod = proceedLoadPrioritiesAndOverriding(iCurrentTemperature_x100);
+  }
+}
+
+/**
+ * @brief Count one second of the relay timers
+ * @details The relays are proceeded on each update of their average.
+ *
+ */
+void incRelayDurations()
+{
+  relays.inc_duration();
+}
+
+/** periodic tasks of loop(), the ones of each second are spread over the mains cycles */
+inline constexpr PeriodicTask periodicTasks[]{
+  { WATCHDOG_PIN_PRESENT ? SUPPLY_FREQUENCY : 0, 0, toggleWatchdogLed },
+  { RTC_PRESENT ? SUPPLY_FREQUENCY : 0, SUPPLY_FREQUENCY / 5, proceedDailySchedule },
+  { DIVERSION_PIN_PRESENT ? SUPPLY_FREQUENCY : 0, 2 * SUPPLY_FREQUENCY / 5, checkDiversionOnOff },
+  { SUPPLY_FREQUENCY, 3 * SUPPLY_FREQUENCY / 5, proceedOverriding },
+  { RELAY_DIVERSION ? SUPPLY_FREQUENCY : 0, 4 * SUPPLY_FREQUENCY / 5, incRelayDurations },
+};
+
+PeriodicTasks< sizeof(periodicTasks) / sizeof(periodicTasks[0]) > periodicTasksScheduler{ periodicTasks }; /**< scheduler of the periodic tasks */
+
+/**
+ * @brief Get the power of a load
+ *
+ * @param load the physical load number [0..NO_OF_DUMPLOADS[
+ * @return int16_t the learned power if available, the rated power otherwise
+ */
+int16_t loadPower(const uint8_t load)
+{
+  return LOAD_POWER_LEARNING ? datalogSnapshot.learnedLoadPower[load] : loadRatedPower[load];
+}
+
+/**
+ * @brief Get the power diverted by the triacs, to be seen as surplus by the relays
+ * @details With COORDINATED_DIVERSION, the relays are the coarse stage and the triacs the fine stage:
+ *          the surplus absorbed by the triacs is handed over to the relays, which switch ON
+ *          when they can take it, leaving the remainder to the triacs.
+ *
+ * @param countON number of mains cycles each load was ON during the period
+ * @param cycles number of mains cycles of the period
+ * @return int32_t the average diverted power in W
+ */
+int32_t triacDivertedPower(const uint16_t (&countON)[NO_OF_DUMPLOADS], const uint16_t cycles)
+{
+  int32_t energy{ 0 };
+  for (uint8_t i = 0; i < NO_OF_DUMPLOADS; ++i)
+  {
+    energy += static_cast< int32_t >(countON[i]) * loadPower(i);
+  }
+  return energy / cycles;
+}
+
+/**
+ * @brief Feed the relay engine with the power of the last second
+ * @details Only used when the sliding average of the relays is given in seconds (see PER_SECOND_POWER).
+ *
+ */
+void processPowerSnapshot()
+{
+  PowerSnapshot snapshot;
+  powerSnapshots.read(snapshot);
+
+  if (!snapshot.sampleSets)
+  {
+    return;
+  }
+
+  float power{ 0 };
+  for (uint8_t phase = 0; phase < NO_OF_PHASES; ++phase)
+  {
+    power -= snapshot.sumP_atSupplyPoint[phase] * getPowerCal(phase);
+  }
+
+  power /= snapshot.sampleSets;
+
+  if constexpr (COORDINATED_DIVERSION)
+  {
+    power -= triacDivertedPower(snapshot.countLoadON, SUPPLY_FREQUENCY);
+  }
+
+  relays.update_average(static_cast< int16_t >(power));
+}
+
+/**
+ * @brief Publish the surplus, the diversion and the headroom of the last coordination period
+ * @details Master router only (see utils_coordination.h). The headroom is the power of the loads
+ *          taking part in the diversion which were not ON during the whole period: the secondary
+ *          routers leave this surplus to the master.
+ *
+ */
+void processCoordinationSnapshot()
 {
-  static uint8_t perSecondTimer{ 0 };
-  static bool bOffPeak{ false };
-  static int16_t iTemperature_x100{ 0 };
+#ifdef RF_PRESENT
+  CoordinationSnapshot snapshot;
+  coordinationSnapshots.read(snapshot);
+
+  if (!snapshot.sampleSets)
+  {
+    return;
+  }
 
-  if (b_newMainsCycle)  // flag is set after every pair of ADC conversions
+  float surplus{ 0 };
+  for (uint8_t phase = 0; phase < NO_OF_PHASES; ++phase)
   {
-    b_newMainsCycle = false;  // reset the flag
-    ++perSecondTimer;
+    surplus += snapshot.sumP_atSupplyPoint[phase] * getPowerCal(phase);
+  }
+  surplus /= snapshot.sampleSets;
 
-    if (perSecondTimer >= SUPPLY_FREQUENCY)
+  int32_t headroom{ 0 };
+  for (uint8_t i = 0; i < NO_OF_DUMPLOADS; ++i)
+  {
+    if (snapshot.availableLoadsMask & bit(i))
     {
-      perSecondTimer = 0;
+      headroom += static_cast< int32_t >(COORDINATION_PERIOD_IN_MAINS_CYCLES - snapshot.countLoadON[i]) * loadPower(i);
+    }
+  }
+  headroom /= COORDINATION_PERIOD_IN_MAINS_CYCLES;
 
-      if constexpr (WATCHDOG_PIN_PRESENT)
-      {
-        togglePin(watchDogPin);
-      }
+  coordinationLink.publish(static_cast< int16_t >(surplus),
+                           static_cast< int16_t >(triacDivertedPower(snapshot.countLoadON, COORDINATION_PERIOD_IN_MAINS_CYCLES)),
+                           static_cast< int16_t >(headroom));
+#endif
+}
+
+/**
+ * @brief Add the energy of the last datalog period to the persistent counters
+ *
+ */
+void updateEnergyCounters()
+{
+  for (uint8_t phase = 0; phase < NO_OF_PHASES; ++phase)
+  {
+    energyCounters.addGrid(phase, static_cast< int32_t >(tx_data.power_L[phase]) * DATALOG_PERIOD_IN_SECONDS);
+  }
 
-      checkDiversionOnOff();
+  for (uint8_t i = 0; i < NO_OF_DUMPLOADS; ++i)
+  {
+    energyCounters.addDiverted(i, static_cast< int32_t >(datalogSnapshot.countLoadON[i]) * loadPower(i) / SUPPLY_FREQUENCY);
+  }
 
-      if (!forceFullPower())
-      {
-        bOffPeak = proceedLoadPrioritiesAndOverriding(iTemperature_x100);  // called every second
-      }
+  energyCounters.proceed();
+}
 
-      if constexpr (RELAY_DIVERSION)
-      {
-        relays.inc_duration();
-        relays.proceed_relays();
-      }
+/**
+ * @brief Leave the loads at their target temperature out of the diversion
+ * @details Each load with a target stops taking part once its sensor reaches the target,
+ *          and takes part again once the temperature has dropped by the hysteresis.
+ *          A load whose sensor cannot be read takes part (its own thermostat still protects it).
+ *          The ISR only gets the mask of the loads taking part, resent later if the queue was full.
+ *
+ */
+void proceedTemperatureTargets()
+{
+  static uint8_t enabledMask{ static_cast< uint8_t >(bit(NO_OF_DUMPLOADS) - 1) };
+  static uint8_t sentMask{ enabledMask };
+
+  for (uint8_t i = 0; i < NO_OF_DUMPLOADS; ++i)
+  {
+    const auto sensor{ loadTemperatureTargets[i].getSensor() };
+    if (0xff == sensor)
+    {
+      continue;
     }
+
+    const auto temperature{ tx_data.temperature_x100[sensor] };
+    if ((OUTOFRANGE_TEMPERATURE == temperature) || (DEVICE_DISCONNECTED_RAW == temperature))
+    {
+      enabledMask |= bit(i);
+    }
+    else if (temperature >= loadTemperatureTargets[i].getTarget_x100())
+    {
+      enabledMask &= ~bit(i);
+    }
+    else if (temperature <= loadTemperatureTargets[i].getRestart_x100())
+    {
+      enabledMask |= bit(i);
+    }
+  }
+
+  if ((enabledMask != sentMask) && isrCommands.push({ Commands::ENABLE_LOADS, enabledMask }))
+  {
+    sentMask = enabledMask;
   }
+}
+
+/**
+ * @brief Proceed with the datalog of the last period
+ * @details The data of the period are first copied from the ISR.
+ *
+ * @param bOffPeak state of on/off-peak period
+ */
+void processDatalog(const bool bOffPeak)
+{
+  datalogSnapshots.read(datalogSnapshot);
 
-  if (b_datalogEventPending)
+  tx_data.power = 0;
+  for (uint8_t phase = 0; phase < NO_OF_PHASES; ++phase)
   {
-    b_datalogEventPending = false;
+    tx_data.power_L[phase] = datalogSnapshot.sumP_atSupplyPoint[phase] / datalogSnapshot.sampleSetsDuringThisDatalogPeriod * getPowerCal(phase);
+    tx_data.power_L[phase] *= -1;
+
+    tx_data.power += tx_data.power_L[phase];
+
+    tx_data.Vrms_L_x100[phase] = static_cast< int32_t >(scaledSqrt(datalogSnapshot.sum_Vsquared[phase] / datalogSnapshot.sampleSetsDuringThisDatalogPeriod, getVoltageRmsScale(phase)));
+    tx_data.Irms_L_x100[phase] = static_cast< int32_t >(scaledSqrt(datalogSnapshot.sum_Isquared[phase] / datalogSnapshot.sampleSetsDuringThisDatalogPeriod, getCurrentRmsScale(phase)));
+
+    // average mains period over the complete cycles of the datalog period
+    tx_data.frequency_L_x100[phase] = datalogSnapshot.sampleSetsOfCompleteCycles[phase] ? static_cast< int16_t >(datalogSnapshot.completeCycles[phase] * (100.0F * SAMPLE_SETS_PER_SECOND) / datalogSnapshot.sampleSetsOfCompleteCycles[phase] + 0.5F) : 0;
+  }
 
-    tx_data.power = 0;
-    for (uint8_t phase = 0; phase < NO_OF_PHASES; ++phase)
+  if constexpr (AUTO_CALIBRATION)
+  {
+    autoCalibration.proceed();
+  }
+
+  if constexpr (ENERGY_COUNTERS)
+  {
+    updateEnergyCounters();
+  }
+
+  if constexpr (WIRING_CHECK)
+  {
+    int16_t divertedPower[NO_OF_PHASES]{};
+    for (uint8_t i = 0; i < NO_OF_DUMPLOADS; ++i)
     {
-      tx_data.power_L[phase] = copyOf_sumP_atSupplyPoint[phase] / copyOf_sampleSetsDuringThisDatalogPeriod * f_powerCal[phase];
-      tx_data.power_L[phase] *= -1;
+      divertedPower[loadPhase[i]] += static_cast< int32_t >(datalogSnapshot.countLoadON[i]) * loadPower(i) / DATALOG_PERIOD_IN_MAINS_CYCLES;
+    }
+    wiringCheck.proceed(divertedPower);
+  }
 
-      tx_data.power += tx_data.power_L[phase];
+  if constexpr (METER_PULSE_INPUT)
+  {
+    meterCheck.proceed();
+  }
 
-      if constexpr (DATALOG_PERIOD_IN_SECONDS > 10)
-      {
-        tx_data.Vrms_L_x100[phase] = static_cast< int32_t >((100 << 2) * f_voltageCal[phase] * sqrt(copyOf_sum_Vsquared[phase] / copyOf_sampleSetsDuringThisDatalogPeriod));
-      }
-      else
-      {
-        tx_data.Vrms_L_x100[phase] = static_cast< int32_t >(100 * f_voltageCal[phase] * sqrt(copyOf_sum_Vsquared[phase] / copyOf_sampleSetsDuringThisDatalogPeriod));
-      }
+  if constexpr (EQUALISED_ROTATION)
+  {
+    for (uint8_t i = 0; i < NO_OF_DUMPLOADS; ++i)
+    {
+      divertedEnergySinceRotation[i] += static_cast< uint32_t >(datalogSnapshot.countLoadON[i]) * loadPower(i) / SUPPLY_FREQUENCY;
     }
+  }
 
-    if constexpr (RELAY_DIVERSION)
+  if constexpr (RELAY_DIVERSION && !PER_SECOND_POWER)
+  {
+    if constexpr (COORDINATED_DIVERSION)
+    {
+      relays.update_average(tx_data.power - triacDivertedPower(datalogSnapshot.countLoadON, DATALOG_PERIOD_IN_MAINS_CYCLES));
+    }
+    else
     {
       relays.update_average(tx_data.power);
     }
+  }
 
-    if constexpr (TEMP_SENSOR_PRESENT)
+  if constexpr (TEMP_SENSOR_PRESENT)
+  {
+    uint8_t idx{ temperatureSensing.get_size() };
+    do
     {
-      uint8_t idx{ temperatureSensing.get_size() };
-      do
+      auto tmp = temperatureSensing.get_temperature(--idx);
+
+      // if read temperature is 85 and the delta with previous is greater than 5, skip the value
+      if (8500 == tmp && (abs(tmp - tx_data.temperature_x100[idx]) > 500))
       {
-        auto tmp = temperatureSensing.readTemperature(--idx);
+        tmp = DEVICE_DISCONNECTED_RAW;
+      }
 
-        // if read temperature is 85 and the delta with previous is greater than 5, skip the value
-        if (8500 == tmp && (abs(tmp - tx_data.temperature_x100[idx]) > 500))
-        {
-          tmp = DEVICE_DISCONNECTED_RAW;
-        }
+      tx_data.temperature_x100[idx] = tmp;
+    } while (idx);
 
-        tx_data.temperature_x100[idx] = tmp;
-      } while (idx);
+    temperatureSensing.startReading();  // read-out and new conversion, done step by step in loop()
 
-      temperatureSensing.requestTemperatures();  // for use next time around
+    if constexpr (TEMPERATURE_TARGETS)
+    {
+      proceedTemperatureTargets();
     }
+  }
+
+  if constexpr (MODBUS_SLAVE)
+  {
+    modbusSlave.update(bOffPeak);
+  }
+
+  sendResults(bOffPeak);
+
+  if constexpr (ISR_PROFILING)
+  {
+    printIsrProfile(serialTxQueue);
+  }
+}
 
-    sendResults(bOffPeak);
+/**
+ * @brief Proceed with one event from the ISR
+ *
+ * @param event The event
+ */
+void processEvent(const Event &event)
+{
+  switch (event.type)
+  {
+    case Events::POWER_READY:
+      if constexpr (PER_SECOND_POWER)
+      {
+        processPowerSnapshot();
+      }
+      break;
+    case Events::COORDINATION_READY:
+      if constexpr (COORDINATION_MASTER)
+      {
+        processCoordinationSnapshot();
+      }
+      break;
+    case Events::LOADS_ROTATED:
+      logLoadPriorities();  // prints the new load priorities
+      break;
+    case Events::LOAD_TRANSITION:
+      if constexpr (!TRANSITION_LOG)  // printed with its details by printLoadTransitions()
+      {
+        DBUG(F("Load #"));
+        DBUG((event.data & 0x7F) + 1);
+        DBUGLN((event.data & 0x80) ? F(" ON") : F(" OFF"));
+      }
+      break;
+    case Events::POLARITY_ANOMALY:
+      DBUG(F("Abnormal mains cycle on phase #"));
+      DBUGLN(event.data + 1);
+      break;
+  }
+}
+
+/**
+ * @brief Main processor.
+ * @details None of the workload in loop() is time-critical.
+ *          All the processing of ADC data is done within the ISR.
+ *
+ */
+void loop()
+{
+  if constexpr (SERIAL_COMMANDS)
+  {
+    serialCommands.proceed();
+  }
+  if constexpr (MODBUS_SLAVE)
+  {
+    modbusSlave.proceed();
+  }
+  if constexpr (SERIAL_CONTROL || MODBUS_SLAVE)
+  {
+    sendOverride();  // without waiting for the next second
+  }
+  if constexpr (RAW_SAMPLES_CAPTURE)
+  {
+    rawSamplesCapture.proceed(!SERIAL_COMMANDS);
+  }
+  if constexpr (TEMP_SENSOR_PRESENT)
+  {
+    temperatureSensing.proceed();
+  }
+#ifdef RF_PRESENT
+  coordinationLink.proceed();  // first, the RF datalog sender drops the received packets
+  rfSender.proceed(tx_data);
+#endif
+  serialTxQueue.proceed();
+  if (serialTxQueue.isEmpty())
+  {
+    frameStreamer.proceed();  // binary frames must not be interleaved with text
+  }
+  if constexpr (FAST_STREAM)
+  {
+    sendFastStreamFrame(bOffPeakPeriod);
+  }
+  if constexpr (TRANSITION_LOG)
+  {
+    printLoadTransitions();
+  }
+
+  uint16_t mainsCycles{ isrSignals.takeMainsCycles() };
+  if (mainsCycles)
+  {
+    if constexpr (HARDWARE_WATCHDOG)
+    {
+      hardwareWatchdog.notifyMainsCycle();
+    }
+    while (mainsCycles--)
+    {
+      periodicTasksScheduler.tick();
+    }
+  }
+  if (isrSignals.takeDatalog())
+  {
+    processDatalog(bOffPeakPeriod);
+  }
+
+  Event event;
+  while (isrEvents.pop(event))
+  {
+    processEvent(event);
+  }
+
+  if constexpr (HARDWARE_WATCHDOG)
+  {
+    hardwareWatchdog.proceed();
   }
 }  // end of loop()
@@ -0,0 +1,271 @@
+/**
+ * @file replay.cpp
+ * @author Frédéric Metrich (frederic.metrich@live.fr)
+ * @brief Replay of recorded raw samples through the processing engine (native build)
+ * @version 0.1
+ * @date 2024-05-12
+ *
+ * @details Build and run with:
+ *            pio run -e native
+ *            .pio/build/native/program [-r repeat] [-b sets] [capture.txt]
+ *
+ *          The input (a file or stdin) contains one sample set per line: NO_OF_ADC_CHANNELS raw ADC values
+ *          in the order V1 I1 V2 I2 V3 I3 (then the extra channels), separated by spaces, tabs or commas. Lines which
+ *          do not start with a number are ignored. This is the output of RawSamplesTool_6chan
+ *          once the graphics are stripped, and of 'extras/decode_frames.py' for raw captures.
+ *
+ *          Each sample is fed to the processing engine through the same dispatch as the ISR
+ *          (see adc_sequencer.h), the virtual time being advanced by 104 µs (at clk/128) per conversion.
+ *          A discarded conversion (ADC_SETTLING_DISCARDS) gets the value of the channel which follows it. With '-b',
+ *          the sample sets are fed by blocks of 'sets' through processAdcBlock(), as a DMA would. The main
+ *          loop is emulated as far as the processing engine is concerned: each datalog is
+ *          printed (CSV on stdout), and a summary is printed on stderr.
+ *
+ * @note 'int' is 32 bits on the host, whereas it is 16 bits on the Uno. The processing engine
+ *       uses fixed-width types, but expect tiny differences where implicit promotions apply.
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include <Arduino.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <stdio.h>
+#include <vector>
+
+#include "../adc_sequencer.h"
+#include "../calibration.h"
+#include "../fundamental.h"
+#include "../processing.h"
+#include "shims/native_time.h"
+
+namespace
+{
+inline constexpr unsigned long ADC_CONVERSION_TIME_US{ CPU_CYCLES_PER_CONVERSION / (F_CPU / 1000000UL) }; /**< 104 µs free-running at clk/128 */
+
+using SampleSet = std::array< int16_t, NO_OF_ADC_CHANNELS >; /**< V1 I1 V2 I2 V3 I3, then the extra channels */
+
+/**
+ * @brief Read all sample sets of a capture
+ *
+ * @param input The input stream
+ * @param sets The sample sets
+ */
+void readCapture(FILE *input, std::vector< SampleSet > &sets)
+{
+  char line[256];
+
+  while (fgets(line, sizeof(line), input))
+  {
+    SampleSet set;
+    char *pos{ line };
+    uint8_t idx{ 0 };
+
+    for (; idx < set.size(); ++idx)
+    {
+      while (*pos == ' ' || *pos == '\t' || *pos == ',')
+      {
+        ++pos;
+      }
+      char *end;
+      const long value{ strtol(pos, &end, 10) };
+      if (end == pos || value < 0 || value > 1023)
+      {
+        break;
+      }
+      set[idx] = static_cast< int16_t >(value);
+      pos = end;
+    }
+
+    if (idx == set.size())
+    {
+      sets.push_back(set);
+    }
+  }
+}
+
+/**
+ * @brief Print one datalog record, computed as in loop()
+ *
+ */
+void printDatalog()
+{
+  printf("%.3f", micros() * 1e-6);
+
+  int32_t power{ 0 };
+  for (uint8_t phase = 0; phase < NO_OF_PHASES; ++phase)
+  {
+    const int32_t power_L{ static_cast< int32_t >(-datalogSnapshot.sumP_atSupplyPoint[phase] / datalogSnapshot.sampleSetsDuringThisDatalogPeriod * f_powerCal[phase]) };
+    power += power_L;
+    printf(",%d", power_L);
+  }
+  printf(",%d", power);
+
+  for (uint8_t phase = 0; phase < NO_OF_PHASES; ++phase)
+  {
+    printf(",%.2f", f_voltageCal[phase] * sqrt(datalogSnapshot.sum_Vsquared[phase] / datalogSnapshot.sampleSetsDuringThisDatalogPeriod));
+  }
+
+  for (uint8_t phase = 0; phase < NO_OF_PHASES; ++phase)
+  {
+    printf(",%.2f", currentCal(phase) * sqrt(datalogSnapshot.sum_Isquared[phase] / datalogSnapshot.sampleSetsDuringThisDatalogPeriod));
+  }
+
+  for (uint8_t phase = 0; phase < NO_OF_PHASES; ++phase)
+  {
+    printf(",%.2f", datalogSnapshot.sampleSetsOfCompleteCycles[phase] ? datalogSnapshot.completeCycles[phase] * SAMPLE_SETS_PER_SECOND / datalogSnapshot.sampleSetsOfCompleteCycles[phase] : 0.0F);
+  }
+
+  if constexpr (HARMONIC_ANALYSIS)
+  {
+    for (uint8_t phase = 0; phase < NO_OF_PHASES; ++phase)
+    {
+      printf(",%.0f,%.0f,%.1f", fundamentalAnalysis.get_activePower(phase, f_powerCal[phase]), fundamentalAnalysis.get_reactivePower(phase, f_powerCal[phase]), fundamentalAnalysis.get_currentThd(phase));
+    }
+  }
+
+  if constexpr (LOAD_POWER_LEARNING)
+  {
+    for (uint8_t idx = 0; idx < NO_OF_DUMPLOADS; ++idx)
+    {
+      printf(",%d", datalogSnapshot.learnedLoadPower[idx]);
+    }
+  }
+
+  for (uint8_t idx = 0; idx < NO_OF_DUMPLOADS; ++idx)
+  {
+    printf(",%.1f", datalogSnapshot.countLoadON[idx] * 100.0F * invDATALOG_PERIOD_IN_MAINS_CYCLES);
+  }
+
+  printf(",%.1f,%u\n", datalogSnapshot.energyInBucket_main * f_energyBucketToJoules, datalogSnapshot.lowestNoOfSampleSetsPerMainsCycle);
+}
+}  // namespace
+
+int main(int argc, char *argv[])
+{
+  unsigned long repeat{ 1 };
+  size_t blockSize{ 0 };
+  FILE *input{ stdin };
+
+  for (int i = 1; i < argc; ++i)
+  {
+    if (!strcmp(argv[i], "-r") && i + 1 < argc)
+    {
+      repeat = strtoul(argv[++i], nullptr, 10);
+    }
+    else if (!strcmp(argv[i], "-b") && i + 1 < argc)
+    {
+      blockSize = strtoul(argv[++i], nullptr, 10);
+    }
+    else if (!(input = fopen(argv[i], "r")))
+    {
+      fprintf(stderr, "cannot open %s\n", argv[i]);
+      return 1;
+    }
+  }
+
+  std::vector< SampleSet > sets;
+  readCapture(input, sets);
+  if (sets.empty())
+  {
+    fprintf(stderr, "no sample sets found\n");
+    return 1;
+  }
+
+  if constexpr (RUNTIME_PARAMETERS)
+  {
+    updateIsrCalibration(f_powerCal, f_voltageCal, REQUIRED_EXPORT_IN_WATTS, outputMode);  // no EEPROM on the host, the defaults are used
+  }
+  initializeProcessing();
+
+  printf("time_s");
+  for (uint8_t phase = 0; phase < NO_OF_PHASES; ++phase)
+  {
+    printf(",P%u", phase + 1);
+  }
+  printf(",P");
+  for (uint8_t phase = 0; phase < NO_OF_PHASES; ++phase)
+  {
+    printf(",V%u", phase + 1);
+  }
+  for (uint8_t phase = 0; phase < NO_OF_PHASES; ++phase)
+  {
+    printf(",I%u", phase + 1);
+  }
+  for (uint8_t phase = 0; phase < NO_OF_PHASES; ++phase)
+  {
+    printf(",F%u", phase + 1);
+  }
+  if constexpr (HARMONIC_ANALYSIS)
+  {
+    for (uint8_t phase = 0; phase < NO_OF_PHASES; ++phase)
+    {
+      printf(",P1f%u,Q1f%u,THD%u_pct", phase + 1, phase + 1, phase + 1);
+    }
+  }
+  if constexpr (LOAD_POWER_LEARNING)
+  {
+    for (uint8_t idx = 0; idx < NO_OF_DUMPLOADS; ++idx)
+    {
+      printf(",PL%u_W", idx + 1);
+    }
+  }
+  for (uint8_t idx = 0; idx < NO_OF_DUMPLOADS; ++idx)
+  {
+    printf(",L%u_pct", idx + 1);
+  }
+  printf(",bucket_J,minSampleSets\n");
+
+  const auto wallStart{ std::chrono::steady_clock::now() };
+  unsigned long noOfDatalogs{ 0 };
+  unsigned long noOfMainsCycles{ 0 };
+  uint8_t sampleIndex{ 0 };
+
+  for (unsigned long loop = 0; loop < repeat; ++loop)
+  {
+    for (size_t first = 0; first < sets.size(); first += std::max< size_t >(blockSize, 1))
+    {
+      if (blockSize)
+      {
+        const size_t count{ std::min(blockSize, sets.size() - first) };
+        advanceMicros(ADC_CONVERSION_TIME_US * NO_OF_ADC_CONVERSIONS * count);
+        processAdcBlock(sets[first].data(), count);  // std::array has no padding, the sets are contiguous
+      }
+      else
+      {
+        for (uint8_t slot = 0; slot < adcSchedule.size; ++slot)
+        {
+          advanceMicros(ADC_CONVERSION_TIME_US);
+          ADC = sets[first][adcSchedule[slot].column];
+          dispatchAdcSample(sampleIndex, ADC);
+        }
+      }
+
+      noOfMainsCycles += isrSignals.takeMainsCycles();
+      if (isrSignals.takeDatalog())
+      {
+        datalogSnapshots.read(datalogSnapshot);
+        printDatalog();
+        ++noOfDatalogs;
+      }
+
+      Event event;
+      while (isrEvents.pop(event))
+      {
+        // the other events are not used by the replay
+      }
+    }
+  }
+
+  const std::chrono::duration< double > wallTime{ std::chrono::steady_clock::now() - wallStart };
+  const double simulatedTime{ micros() * 1e-6 };
+
+  fprintf(stderr, "%lu sample sets x %lu, %.1f s simulated in %.3f s (x%.0f), %lu mains cycles, %lu datalogs\n",
+          static_cast< unsigned long >(sets.size()), repeat, simulatedTime, wallTime.count(),
+          simulatedTime / wallTime.count(), noOfMainsCycles, noOfDatalogs);
+
+  return 0;
+}
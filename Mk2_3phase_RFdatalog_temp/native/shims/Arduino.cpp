@@ -0,0 +1,217 @@
+/**
+ * @file Arduino.cpp
+ * @author Frédéric Metrich (frederic.metrich@live.fr)
+ * @brief Thin Arduino shim for the native (host) build
+ * @version 0.1
+ * @date 2024-05-12
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include <Arduino.h>
+
+#include <stdio.h>
+
+#include "native_time.h"
+
+volatile uint8_t PORTB, PORTC, PORTD;
+volatile uint8_t PINB, PINC, PIND;
+volatile uint8_t DDRB, DDRC, DDRD;
+volatile uint8_t ADCSRA, ADCSRB, ADMUX, DIDR0;
+volatile uint8_t TCCR1A, TCCR1B, TIMSK1, TIFR1, SREG;
+volatile uint16_t ADC, TCNT1, OCR1A, OCR1B;
+volatile uint8_t TCCR2A, TCCR2B, OCR2B;
+volatile uint8_t UCSR0A, UDR0;
+volatile uint8_t MCUSR;
+
+void (*externalInterrupts[2])(){};
+
+HardwareSerial Serial;
+
+namespace
+{
+unsigned long virtualMicros{ 0 };
+
+/**
+ * @brief Get the port register of a pin, Uno mapping
+ *
+ */
+volatile uint8_t &portOf(const uint8_t pin)
+{
+  return pin < 8 ? PORTD : (pin < 14 ? PORTB : PORTC);
+}
+
+volatile uint8_t &ddrOf(const uint8_t pin)
+{
+  return pin < 8 ? DDRD : (pin < 14 ? DDRB : DDRC);
+}
+
+volatile uint8_t &pinsOf(const uint8_t pin)
+{
+  return pin < 8 ? PIND : (pin < 14 ? PINB : PINC);
+}
+
+uint8_t maskOf(const uint8_t pin)
+{
+  return bit(pin < 8 ? pin : (pin < 14 ? pin - 8 : pin - 14));
+}
+}  // namespace
+
+void advanceMicros(const unsigned long us)
+{
+  virtualMicros += us;
+}
+
+unsigned long millis()
+{
+  return virtualMicros / 1000;
+}
+
+unsigned long micros()
+{
+  return virtualMicros;
+}
+
+void delay(const unsigned long ms)
+{
+  advanceMicros(ms * 1000);
+}
+
+void delayMicroseconds(const unsigned int us)
+{
+  advanceMicros(us);
+}
+
+void pinMode(const uint8_t pin, const uint8_t mode)
+{
+  if (OUTPUT == mode)
+  {
+    ddrOf(pin) |= maskOf(pin);
+  }
+  else
+  {
+    ddrOf(pin) &= ~maskOf(pin);
+    if (INPUT_PULLUP == mode)
+    {
+      pinsOf(pin) |= maskOf(pin);  // nothing connected, the pull-up wins
+    }
+  }
+}
+
+void digitalWrite(const uint8_t pin, const uint8_t val)
+{
+  if (val)
+  {
+    portOf(pin) |= maskOf(pin);
+  }
+  else
+  {
+    portOf(pin) &= ~maskOf(pin);
+  }
+}
+
+int digitalRead(const uint8_t pin)
+{
+  const auto &reg{ (ddrOf(pin) & maskOf(pin)) ? portOf(pin) : pinsOf(pin) };
+  return (reg & maskOf(pin)) ? HIGH : LOW;
+}
+
+void attachInterrupt(const uint8_t interruptNum, void (*userFunc)(), int)
+{
+  if (interruptNum < 2)
+  {
+    externalInterrupts[interruptNum] = userFunc;
+  }
+}
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+  size_t n{ 0 };
+  while (size--)
+  {
+    n += write(*buffer++);
+  }
+  return n;
+}
+
+size_t Print::write(const char *str)
+{
+  return str ? write(reinterpret_cast< const uint8_t * >(str), strlen(str)) : 0;
+}
+
+size_t Print::print(const __FlashStringHelper *str)
+{
+  return write(reinterpret_cast< const char * >(str));
+}
+
+size_t Print::print(const char *str)
+{
+  return write(str);
+}
+
+size_t Print::print(const char c)
+{
+  return write(static_cast< uint8_t >(c));
+}
+
+size_t Print::print(const unsigned char n, const int base)
+{
+  return print(static_cast< unsigned long >(n), base);
+}
+
+size_t Print::print(const int n, const int base)
+{
+  return print(static_cast< long >(n), base);
+}
+
+size_t Print::print(const unsigned int n, const int base)
+{
+  return print(static_cast< unsigned long >(n), base);
+}
+
+size_t Print::print(const long n, const int base)
+{
+  char buf[24];
+  snprintf(buf, sizeof(buf), HEX == base ? "%lX" : "%ld", n);
+  return write(buf);
+}
+
+size_t Print::print(const unsigned long n, const int base)
+{
+  char buf[24];
+  snprintf(buf, sizeof(buf), HEX == base ? "%lX" : "%lu", n);
+  return write(buf);
+}
+
+size_t Print::print(const double n, const int digits)
+{
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.*f", digits, n);
+  return write(buf);
+}
+
+size_t Print::println()
+{
+  return write("\r\n");
+}
+
+int HardwareSerial::available()
+{
+  return 0;
+}
+
+int HardwareSerial::read()
+{
+  return -1;
+}
+
+int HardwareSerial::availableForWrite()
+{
+  return 64;
+}
+
+size_t HardwareSerial::write(const uint8_t c)
+{
+  return fputc(c, stdout) == EOF ? 0 : 1;
+}
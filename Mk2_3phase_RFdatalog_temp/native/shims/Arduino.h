@@ -0,0 +1,182 @@
+/**
+ * @file Arduino.h
+ * @author Frédéric Metrich (frederic.metrich@live.fr)
+ * @brief Thin Arduino shim for the native (host) build
+ * @version 0.1
+ * @date 2024-05-12
+ *
+ * @details Only what the processing engine needs is provided:
+ *            - the AVR registers are plain variables, so that utils_pins.h works unchanged
+ *              and the resulting pin states can be checked by the host program,
+ *            - the time is virtual and advanced by the host program (see native_time.h),
+ *            - the Serial writes to stdout.
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef NATIVE_ARDUINO_H
+#define NATIVE_ARDUINO_H
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 0x1
+#define LOW 0x0
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define FALLING 2
+
+#define digitalPinToInterrupt(p) ((p) == 2 ? 0 : ((p) == 3 ? 1 : -1))
+
+#define LED_BUILTIN 13
+
+#define DEC 10
+#define HEX 16
+#define BIN 2
+
+#define PI 3.1415926535897932384626433832795
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte(addr) (*reinterpret_cast< const uint8_t * >(addr))
+#define pgm_read_word(addr) (*reinterpret_cast< const uint16_t * >(addr))
+
+class __FlashStringHelper;
+#define F(string_literal) (reinterpret_cast< const __FlashStringHelper * >(string_literal))
+
+#define bit(b) (1UL << (b))
+#define lowByte(w) ((uint8_t)((w)&0xff))
+#define highByte(w) ((uint8_t)((w) >> 8))
+#define _BV(b) (1 << (b))
+
+#define ISR(vector) void vector()
+#define sei()
+#define cli()
+
+// AVR registers
+extern volatile uint8_t PORTB, PORTC, PORTD;
+extern volatile uint8_t PINB, PINC, PIND;
+extern volatile uint8_t DDRB, DDRC, DDRD;
+extern volatile uint8_t ADCSRA, ADCSRB, ADMUX, DIDR0;
+extern volatile uint8_t TCCR1A, TCCR1B, TIMSK1, TIFR1, SREG;
+extern volatile uint16_t ADC, TCNT1, OCR1A, OCR1B;
+extern volatile uint8_t TCCR2A, TCCR2B, OCR2B;
+extern volatile uint8_t UCSR0A, UDR0;
+extern volatile uint8_t MCUSR;
+
+enum : uint8_t
+{
+  ADPS0 = 0,
+  ADPS1 = 1,
+  ADPS2 = 2,
+  ADIE = 3,
+  ADIF = 4,
+  ADATE = 5,
+  ADSC = 6,
+  ADEN = 7,
+  ADTS0 = 0,
+  ADTS1 = 1,
+  ADTS2 = 2,
+  REFS0 = 6,
+  OCF1A = 1,
+  OCF1B = 2,
+  WGM12 = 3,
+  CS10 = 0,
+  CS11 = 1,
+  CS12 = 2,
+  WGM20 = 0,
+  WGM21 = 1,
+  COM2B1 = 5,
+  CS20 = 0,
+  CS21 = 1,
+  UDRE0 = 5,
+  WDRF = 3,
+};
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+
+void attachInterrupt(uint8_t interruptNum, void (*userFunc)(), int mode);
+extern void (*externalInterrupts[2])(); /**< handlers of INT0/INT1, to be called by the tests */
+
+/**
+ * @brief Minimal Print, formatting to a byte sink
+ *
+ */
+class Print
+{
+public:
+  virtual ~Print() = default;
+
+  virtual size_t write(uint8_t) = 0;
+  size_t write(const uint8_t *buffer, size_t size);
+  size_t write(const char *str);
+
+  size_t print(const __FlashStringHelper *str);
+  size_t print(const char *str);
+  size_t print(char c);
+  size_t print(unsigned char n, int base = DEC);
+  size_t print(int n, int base = DEC);
+  size_t print(unsigned int n, int base = DEC);
+  size_t print(long n, int base = DEC);
+  size_t print(unsigned long n, int base = DEC);
+  size_t print(double n, int digits = 2);
+
+  size_t println();
+  template< typename T >
+  size_t println(const T &value)
+  {
+    return print(value) + println();
+  }
+  template< typename T >
+  size_t println(const T &value, int format)
+  {
+    return print(value, format) + println();
+  }
+};
+
+/**
+ * @brief Serial writing to stdout, never blocking
+ *
+ */
+class HardwareSerial : public Print
+{
+public:
+  void begin(unsigned long) {}
+  int available();
+  int read();
+  int availableForWrite();
+  void flush() {}
+  size_t write(uint8_t c) override;
+  using Print::write;
+  explicit operator bool() const
+  {
+    return true;
+  }
+};
+
+extern HardwareSerial Serial;
+
+#define SERIAL_TX_BUFFER_SIZE 64
+
+#endif  // NATIVE_ARDUINO_H
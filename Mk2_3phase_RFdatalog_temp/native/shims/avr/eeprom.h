@@ -0,0 +1,47 @@
+/**
+ * @file eeprom.h
+ * @author Frédéric Metrich (frederic.metrich@live.fr)
+ * @brief Shim of avr-libc <avr/eeprom.h> for the native build, the EEPROM lives in RAM
+ * @version 0.1
+ * @date 2024-06-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef NATIVE_AVR_EEPROM_H
+#define NATIVE_AVR_EEPROM_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define E2END 0x3FF
+
+/**
+ * @brief Get the cells of the EEPROM, erased (0xFF) at the first call
+ *
+ */
+inline uint8_t *nativeEeprom()
+{
+  static uint8_t cells[E2END + 1];
+  static bool bErased{ false };
+
+  if (!bErased)
+  {
+    memset(cells, 0xFF, sizeof(cells));
+    bErased = true;
+  }
+  return cells;
+}
+
+inline void eeprom_read_block(void *dst, const void *src, const size_t n)
+{
+  memcpy(dst, nativeEeprom() + reinterpret_cast< uintptr_t >(src), n);
+}
+
+inline void eeprom_update_block(const void *src, void *dst, const size_t n)
+{
+  memcpy(nativeEeprom() + reinterpret_cast< uintptr_t >(dst), src, n);
+}
+
+#endif  // NATIVE_AVR_EEPROM_H
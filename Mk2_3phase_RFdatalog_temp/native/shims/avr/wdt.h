@@ -0,0 +1,60 @@
+/**
+ * @file wdt.h
+ * @author Frédéric Metrich (frederic.metrich@live.fr)
+ * @brief Shim of avr-libc <avr/wdt.h> for the native build
+ * @version 0.1
+ * @date 2024-06-14
+ *
+ * @details The watchdog does not reset the host program: it only records when it would have fired
+ *          (see nativeWdtExpired()), on the virtual time of the native build.
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef NATIVE_AVR_WDT_H
+#define NATIVE_AVR_WDT_H
+
+#include <Arduino.h>
+
+#define WDTO_15MS 0
+#define WDTO_30MS 1
+#define WDTO_60MS 2
+#define WDTO_120MS 3
+#define WDTO_250MS 4
+#define WDTO_500MS 5
+#define WDTO_1S 6
+#define WDTO_2S 7
+#define WDTO_4S 8
+#define WDTO_8S 9
+
+inline unsigned long nativeWdtTimeout{ 0 };   /**< timeout of the watchdog in ms, 0 when disabled */
+inline unsigned long nativeWdtLastReset{ 0 }; /**< time of the last kick in ms */
+
+inline void wdt_enable(const uint8_t value)
+{
+  nativeWdtTimeout = 16UL << value;
+  nativeWdtLastReset = millis();
+}
+
+inline void wdt_reset()
+{
+  nativeWdtLastReset = millis();
+}
+
+inline void wdt_disable()
+{
+  nativeWdtTimeout = 0;
+}
+
+/**
+ * @brief Check if the watchdog would have reset the MCU by now
+ *
+ * @return true if the watchdog is enabled and has not been kicked within its timeout
+ */
+inline bool nativeWdtExpired()
+{
+  return nativeWdtTimeout && (millis() - nativeWdtLastReset >= nativeWdtTimeout);
+}
+
+#endif  // NATIVE_AVR_WDT_H
@@ -0,0 +1,22 @@
+/**
+ * @file native_time.h
+ * @author Frédéric Metrich (frederic.metrich@live.fr)
+ * @brief Virtual time of the native build
+ * @version 0.1
+ * @date 2024-05-12
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef NATIVE_TIME_H
+#define NATIVE_TIME_H
+
+/**
+ * @brief Advance the virtual time returned by millis() and micros()
+ *
+ * @param us Number of µs
+ */
+void advanceMicros(unsigned long us);
+
+#endif  // NATIVE_TIME_H
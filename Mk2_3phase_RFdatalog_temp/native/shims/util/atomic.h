@@ -0,0 +1,19 @@
+/**
+ * @file atomic.h
+ * @author Frédéric Metrich (frederic.metrich@live.fr)
+ * @brief Shim of avr-libc <util/atomic.h> for the native build, the host program is single-threaded
+ * @version 0.1
+ * @date 2024-05-12
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef NATIVE_UTIL_ATOMIC_H
+#define NATIVE_UTIL_ATOMIC_H
+
+#define ATOMIC_RESTORESTATE
+#define ATOMIC_FORCEON
+#define ATOMIC_BLOCK(type) for (bool _done = false; !_done; _done = true)
+
+#endif  // NATIVE_UTIL_ATOMIC_H
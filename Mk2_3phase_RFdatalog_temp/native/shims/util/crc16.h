@@ -0,0 +1,43 @@
+/**
+ * @file crc16.h
+ * @author Frédéric Metrich (frederic.metrich@live.fr)
+ * @brief Shim of avr-libc <util/crc16.h> for the native build
+ * @version 0.1
+ * @date 2024-05-12
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef NATIVE_UTIL_CRC16_H
+#define NATIVE_UTIL_CRC16_H
+
+#include <stdint.h>
+
+/**
+ * @brief Same algorithm as the avr-libc version (CRC-16/MCRF4XX)
+ *
+ */
+inline uint16_t _crc_ccitt_update(uint16_t crc, uint8_t data)
+{
+  data ^= crc & 0xFF;
+  data ^= data << 4;
+
+  return ((static_cast< uint16_t >(data) << 8) | (crc >> 8)) ^ static_cast< uint8_t >(data >> 4) ^ (static_cast< uint16_t >(data) << 3);
+}
+
+/**
+ * @brief Same algorithm as the avr-libc version (CRC-16/ARC, polynomial 0xA001)
+ *
+ */
+inline uint16_t _crc16_update(uint16_t crc, const uint8_t data)
+{
+  crc ^= data;
+  for (uint8_t i = 0; i < 8; ++i)
+  {
+    crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : (crc >> 1);
+  }
+  return crc;
+}
+
+#endif  // NATIVE_UTIL_CRC16_H
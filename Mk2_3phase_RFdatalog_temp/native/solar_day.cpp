@@ -0,0 +1,514 @@
+/**
+ * @file solar_day.cpp
+ * @author Frédéric Metrich (frederic.metrich@live.fr)
+ * @brief Simulation of a solar day through the processing engine (native build)
+ * @version 0.1
+ * @date 2024-06-09
+ *
+ * @details Build and run with:
+ *            pio run -e solar_day
+ *            .pio/build/solar_day/program [-c compression] [-s seed] [-p peak] [-h household]
+ *
+ *          A whole day is simulated, the processing engine being fed through the same dispatch as the ISR
+ *          (see adc_sequencer.h), in closed loop:
+ *          - PV: a sine from SUNRISE to SUNSET, with 'peak' W at noon (balanced over the phases),
+ *            and clouds drawn from 'seed' (duration, depth, ramps of a few seconds),
+ *          - household: 'household' W, plus the appliances of 'appliances' (on their phase),
+ *          - dump loads: the loads of config.h, each one on a water heater whose thermostat opens
+ *            once the tank is hot, with its losses and the draw-offs of the morning and of the evening.
+ *
+ *          The engine sees the resulting current of each phase, computed once per mains cycle
+ *          from the state of its loads. The hourly balance is printed as CSV on stdout,
+ *          the summary of the day on stderr: imported/exported/diverted Wh, switch count of each load
+ *          and the self-consumption (share of the PV used on site).
+ *
+ *          The night (no PV, all loads OFF) is fast-forwarded, the engine only sees the daylight hours.
+ *          With '-c', each simulated second stands for 'compression' seconds of the day: the dynamics
+ *          of the engine are unchanged, the profiles just move faster. Good enough to compare
+ *          two builds on the same scenario (e.g. a sweep of a constant of the engine).
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include <Arduino.h>
+
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+
+#include "../adc_sequencer.h"
+#include "../calibration.h"
+#include "../processing.h"
+#include "shims/native_time.h"
+
+extern LoadStates physicalLoadState[NO_OF_DUMPLOADS];
+
+namespace
+{
+inline constexpr unsigned long ADC_CONVERSION_TIME_US{ CPU_CYCLES_PER_CONVERSION / (F_CPU / 1000000UL) }; /**< 104 µs free-running at clk/128 */
+
+inline constexpr uint32_t SECONDS_PER_DAY{ 24UL * 3600 };
+inline constexpr uint32_t SUNRISE{ 6UL * 3600 };  /**< start of the PV production */
+inline constexpr uint32_t SUNSET{ 20UL * 3600 };  /**< end of the PV production */
+inline constexpr float MAINS_VOLTAGE{ 230 };      /**< rms voltage of each phase */
+
+inline constexpr uint16_t SINE_TABLE_SIZE{ 1024 }; /**< entries of the sine table, one mains cycle */
+
+/**
+ * @brief An appliance of the household
+ *
+ */
+struct Appliance
+{
+  uint32_t start;    /**< second of the day */
+  uint16_t duration; /**< in seconds */
+  uint16_t power;    /**< in W */
+  uint8_t phase;     /**< phase of the appliance */
+};
+
+inline constexpr Appliance appliances[]{
+  { 7 * 3600 + 15 * 60, 180, 2000, 0 },   // kettle
+  { 10 * 3600, 5400, 800, 1 },            // washing machine (heating at the start below)
+  { 10 * 3600, 900, 2000, 1 },            // washing machine, heating
+  { 12 * 3600, 2400, 2500, 2 },           // oven
+  { 14 * 3600 + 30 * 60, 3600, 1200, 0 }, // dishwasher
+  { 19 * 3600, 3600, 2500, 2 },           // cooking
+};
+
+/**
+ * @brief Water heater of a dump load, with its thermostat
+ *
+ */
+struct WaterHeater
+{
+  static constexpr float CAPACITY_WH{ 6000 };  /**< from cold to the thermostat set point */
+  static constexpr float HYSTERESIS_WH{ 400 }; /**< the thermostat closes again below CAPACITY_WH - HYSTERESIS_WH */
+  static constexpr float LOSSES_W{ 60 };       /**< standing losses */
+
+  float storedWh{ CAPACITY_WH * 0.4F }; /**< energy of the tank */
+  bool bThermostatOpen{ false };        /**< the tank is hot */
+
+  /**
+   * @brief Add some energy, and update the thermostat
+   *
+   * @param wh the energy, heating - losses - draw-offs
+   */
+  void add(const float wh)
+  {
+    storedWh += wh;
+    if (storedWh < 0)
+    {
+      storedWh = 0;
+    }
+    if (storedWh >= CAPACITY_WH)
+    {
+      bThermostatOpen = true;
+    }
+    else if (storedWh <= CAPACITY_WH - HYSTERESIS_WH)
+    {
+      bThermostatOpen = false;
+    }
+  }
+};
+
+/**
+ * @brief Draw-off of hot water, as a power taken from the tanks
+ *
+ * @param second the second of the day
+ * @return float the power in W
+ */
+float drawOff(const uint32_t second)
+{
+  if (second >= 7 * 3600 && second < 7 * 3600 + 600)
+  {
+    return 9000;  // showers, 1.5 kWh
+  }
+  if (second >= 21 * 3600 && second < 21 * 3600 + 900)
+  {
+    return 8000;  // 2 kWh
+  }
+  return 0;
+}
+
+/**
+ * @brief Deterministic pseudo-random numbers
+ *
+ */
+class Random
+{
+public:
+  explicit Random(const uint32_t seed)
+    : state(seed)
+  {
+  }
+
+  /**
+   * @brief Draw a number
+   *
+   * @return float in [0..1[
+   */
+  float next()
+  {
+    state = state * 1103515245UL + 12345UL;
+    return ((state >> 8) & 0xFFFF) / 65536.0F;
+  }
+
+private:
+  uint32_t state;
+};
+
+/**
+ * @brief Clouds passing over the PV, drawn once per second
+ *
+ */
+class Clouds
+{
+public:
+  explicit Clouds(const uint32_t seed)
+    : random(seed)
+  {
+  }
+
+  /**
+   * @brief Get the transmission of the sky for the next second
+   *
+   * @return float 1 for a clear sky
+   */
+  float next()
+  {
+    if (!remaining)
+    {
+      if (random.next() < 0.004F)  // ~ one cloud every 4 minutes
+      {
+        remaining = 20 + static_cast< uint16_t >(random.next() * 280);
+        depth = 0.3F + random.next() * 0.5F;
+      }
+    }
+    else
+    {
+      --remaining;
+    }
+
+    // ramps of ~5 s
+    const float target{ remaining ? 1 - depth : 1 };
+    transmission += (target - transmission) * 0.2F;
+    return transmission;
+  }
+
+private:
+  Random random;
+  uint16_t remaining{ 0 };    /**< seconds of the current cloud */
+  float depth{ 0 };           /**< attenuation of the current cloud */
+  float transmission{ 1 };    /**< current transmission */
+};
+
+/**
+ * @brief Energy balance of an hour, or of the day
+ *
+ */
+struct Balance
+{
+  float pvWh{ 0 };        /**< PV production */
+  float householdWh{ 0 }; /**< household consumption, without the dump loads */
+  float importWh{ 0 };    /**< from the grid, net over the phases */
+  float exportWh{ 0 };    /**< to the grid, net over the phases */
+  float divertedWh{ 0 };  /**< into the dump loads */
+
+  void add(const Balance &other)
+  {
+    pvWh += other.pvWh;
+    householdWh += other.householdWh;
+    importWh += other.importWh;
+    exportWh += other.exportWh;
+    divertedWh += other.divertedWh;
+  }
+};
+
+int16_t sineTable[SINE_TABLE_SIZE]; /**< sin x 2^14 */
+
+/**
+ * @brief The simulated site
+ *
+ */
+class Site
+{
+public:
+  Site(const uint32_t seed, const float _peak, const float _household)
+    : clouds(seed), peak(_peak), household(_household)
+  {
+  }
+
+  /**
+   * @brief Compute the profiles for one second of the day
+   *
+   * @param second the second of the day
+   */
+  void updateProfiles(const uint32_t second)
+  {
+    const float sky{ clouds.next() };
+    pv = (second > SUNRISE && second < SUNSET) ? peak * sky * sinf(PI * (second - SUNRISE) / (SUNSET - SUNRISE)) : 0;
+
+    for (auto &power : householdOfPhase)
+    {
+      power = household / NO_OF_PHASES;
+    }
+    for (const auto &appliance : appliances)
+    {
+      if (second >= appliance.start && second < appliance.start + appliance.duration)
+      {
+        householdOfPhase[appliance.phase] += appliance.power;
+      }
+    }
+    losses = WaterHeater::LOSSES_W + drawOff(second);
+  }
+
+  /**
+   * @brief Check the night
+   *
+   * @return true without PV and with all the loads OFF
+   */
+  bool isIdle() const
+  {
+    for (const auto state : physicalLoadState)
+    {
+      if (LoadStates::LOAD_ON == state)
+      {
+        return false;
+      }
+    }
+    return pv <= 0;
+  }
+
+  /**
+   * @brief Compute the grid power of each phase for the next mains cycle, and account for it
+   *
+   * @param seconds the duration of the cycle in the day, in seconds
+   * @param balance where to account for
+   */
+  void proceedCycle(const float seconds, Balance &balance)
+  {
+    const float hours{ seconds / 3600 };
+    float total{ 0 };
+
+    for (uint8_t phase = 0; phase < NO_OF_PHASES; ++phase)
+    {
+      gridPower[phase] = householdOfPhase[phase] - pv / NO_OF_PHASES;
+    }
+
+    for (uint8_t i = 0; i < NO_OF_DUMPLOADS; ++i)
+    {
+      const bool bON{ LoadStates::LOAD_ON == physicalLoadState[i] };
+      if (bON != previousState[i])
+      {
+        previousState[i] = bON;
+        switches[i] += bON;
+      }
+
+      const float heating{ (bON && !heaters[i].bThermostatOpen) ? static_cast< float >(loadRatedPower[i]) : 0 };
+      gridPower[loadPhase[i]] += heating;
+      balance.divertedWh += heating * hours;
+      divertedWh[i] += heating * hours;
+
+      heaters[i].add((heating - losses) * hours);
+    }
+
+    for (uint8_t phase = 0; phase < NO_OF_PHASES; ++phase)
+    {
+      total += gridPower[phase];
+      balance.householdWh += householdOfPhase[phase] * hours;
+
+      // import = current in phase opposition with the voltage
+      const float amplitude{ -gridPower[phase] / MAINS_VOLTAGE * sqrtf(2) / currentCal(phase) };
+      currentAmplitude[phase] = static_cast< int16_t >(amplitude < -511 ? -511 : (amplitude > 511 ? 511 : amplitude));
+    }
+
+    balance.pvWh += pv * hours;
+    if (total > 0)
+    {
+      balance.importWh += total * hours;
+    }
+    else
+    {
+      balance.exportWh -= total * hours;
+    }
+  }
+
+  /**
+   * @brief Get the raw sample of a channel (V1 I1 V2 I2 V3 I3)
+   *
+   * @param channel the channel
+   * @param angle the angle of phase 0, in 1/SINE_TABLE_SIZE of a mains cycle
+   * @return int16_t the raw sample
+   */
+  int16_t sampleOf(const uint8_t channel, const uint16_t angle) const
+  {
+    const uint8_t phase{ static_cast< uint8_t >(channel / 2) };
+    const int32_t wave{ sineTable[(angle + SINE_TABLE_SIZE - phase * SINE_TABLE_SIZE / 3) % SINE_TABLE_SIZE] };
+
+    if (channel & 1)
+    {
+      return static_cast< int16_t >(512 + ((currentAmplitude[phase] * wave) >> 14));
+    }
+    return static_cast< int16_t >(512 + ((voltageAmplitude[phase] * wave) >> 14));
+  }
+
+  /**
+   * @brief Print the summary of the loads
+   *
+   */
+  void printLoads() const
+  {
+    for (uint8_t i = 0; i < NO_OF_DUMPLOADS; ++i)
+    {
+      fprintf(stderr, "load #%u: %.0f Wh diverted, %u switch-ons, tank at %.0f%%\n", i + 1, divertedWh[i], switches[i],
+              heaters[i].storedWh * 100 / WaterHeater::CAPACITY_WH);
+    }
+  }
+
+  void begin()
+  {
+    for (uint8_t phase = 0; phase < NO_OF_PHASES; ++phase)
+    {
+      voltageAmplitude[phase] = static_cast< int16_t >(MAINS_VOLTAGE * sqrtf(2) / f_voltageCal[phase]);
+    }
+  }
+
+private:
+  Clouds clouds;
+  float peak;                                 /**< PV at noon, clear sky */
+  float household;                            /**< base consumption */
+  float pv{ 0 };                              /**< current PV production */
+  float losses{ 0 };                          /**< losses and draw-offs of each tank */
+  float householdOfPhase[NO_OF_PHASES]{};     /**< current consumption of each phase */
+  float gridPower[NO_OF_PHASES]{};            /**< import of each phase in W */
+  int16_t voltageAmplitude[NO_OF_PHASES]{};   /**< peak of the voltage in ADC counts */
+  int16_t currentAmplitude[NO_OF_PHASES]{};   /**< peak of the current in ADC counts, +ve for an export */
+  WaterHeater heaters[NO_OF_DUMPLOADS];       /**< tank of each load */
+  bool previousState[NO_OF_DUMPLOADS]{};      /**< state of each load during the last cycle */
+  uint16_t switches[NO_OF_DUMPLOADS]{};       /**< switch-ons of each load */
+  float divertedWh[NO_OF_DUMPLOADS]{};        /**< diverted energy of each load */
+};
+}  // namespace
+
+int main(int argc, char *argv[])
+{
+  uint16_t compression{ 1 };
+  uint32_t seed{ 1 };
+  float peak{ 6000 };
+  float household{ 400 };
+
+  for (int i = 1; i + 1 < argc; i += 2)
+  {
+    if (!strcmp(argv[i], "-c"))
+    {
+      compression = static_cast< uint16_t >(strtoul(argv[i + 1], nullptr, 10));
+    }
+    else if (!strcmp(argv[i], "-s"))
+    {
+      seed = strtoul(argv[i + 1], nullptr, 10);
+    }
+    else if (!strcmp(argv[i], "-p"))
+    {
+      peak = strtof(argv[i + 1], nullptr);
+    }
+    else if (!strcmp(argv[i], "-h"))
+    {
+      household = strtof(argv[i + 1], nullptr);
+    }
+  }
+  if (!compression)
+  {
+    compression = 1;
+  }
+
+  for (uint16_t i = 0; i < SINE_TABLE_SIZE; ++i)
+  {
+    sineTable[i] = static_cast< int16_t >(lroundf(sinf(2 * PI * i / SINE_TABLE_SIZE) * 16384));
+  }
+
+  if constexpr (RUNTIME_PARAMETERS)
+  {
+    updateIsrCalibration(f_powerCal, f_voltageCal, REQUIRED_EXPORT_IN_WATTS, outputMode);  // no EEPROM on the host, the defaults are used
+  }
+  initializeProcessing();
+
+  Site site(seed, peak, household);
+  site.begin();
+
+  // the angle of the mains advances by SUPPLY_FREQUENCY x SINE_TABLE_SIZE / 10^6 per µs, in Q16
+  constexpr uint32_t ANGLE_STEP{ static_cast< uint32_t >(ADC_CONVERSION_TIME_US * SUPPLY_FREQUENCY * SINE_TABLE_SIZE * 65536ULL / 1000000UL) };
+  uint32_t angle{ 0 };
+  uint8_t sampleIndex{ 0 };
+
+  const float cycleSeconds{ static_cast< float >(compression) / SUPPLY_FREQUENCY };
+  const auto wallStart{ std::chrono::steady_clock::now() };
+  unsigned long simulatedSeconds{ 0 };
+
+  Balance day;
+  Balance hour;
+
+  printf("hour,pv_Wh,household_Wh,import_Wh,export_Wh,diverted_Wh\n");
+
+  for (uint32_t second = 0; second < SECONDS_PER_DAY; second += compression)
+  {
+    site.updateProfiles(second);
+
+    if (site.isIdle())
+    {
+      site.proceedCycle(compression, hour);  // one step for the whole interval, the engine stays idle
+    }
+    else
+    {
+      for (uint8_t cycle = 0; cycle < SUPPLY_FREQUENCY; ++cycle)
+      {
+        site.proceedCycle(cycleSeconds, hour);
+
+        bool bNewCycle{ false };
+        while (!bNewCycle)
+        {
+          for (uint8_t slot = 0; slot < adcSchedule.size; ++slot)
+          {
+            advanceMicros(ADC_CONVERSION_TIME_US);
+            angle += ANGLE_STEP;
+            ADC = site.sampleOf(adcSchedule[slot].column, (angle >> 16) % SINE_TABLE_SIZE);
+            dispatchAdcSample(sampleIndex, ADC);
+          }
+
+          if (isrSignals.takeMainsCycles())
+          {
+            bNewCycle = true;
+          }
+          if (isrSignals.takeDatalog())
+          {
+            datalogSnapshots.read(datalogSnapshot);
+          }
+
+          Event event;
+          while (isrEvents.pop(event))
+          {
+            // the other events are not used by the simulation
+          }
+        }
+      }
+      ++simulatedSeconds;
+    }
+
+    if ((second + compression) / 3600 != second / 3600)
+    {
+      printf("%u,%.0f,%.0f,%.0f,%.0f,%.0f\n", second / 3600, hour.pvWh, hour.householdWh, hour.importWh, hour.exportWh, hour.divertedWh);
+      day.add(hour);
+      hour = Balance{};
+    }
+  }
+
+  const std::chrono::duration< double > wallTime{ std::chrono::steady_clock::now() - wallStart };
+
+  fprintf(stderr, "PV %.0f Wh, household %.0f Wh, import %.0f Wh, export %.0f Wh, diverted %.0f Wh\n",
+          day.pvWh, day.householdWh, day.importWh, day.exportWh, day.divertedWh);
+  site.printLoads();
+  fprintf(stderr, "self-consumption %.1f%%, %lu s through the engine (x%u) in %.3f s\n",
+          day.pvWh > 0 ? (day.pvWh - day.exportWh) * 100 / day.pvWh : 0, simulatedSeconds, compression, wallTime.count());
+
+  return 0;
+}
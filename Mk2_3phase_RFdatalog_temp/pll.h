@@ -0,0 +1,211 @@
+/**
+ * @file pll.h
+ * @author Frédéric Metrich (frederic.metrich@live.fr)
+ * @brief Software PLL locked to the zero-crossings of phase 0
+ * @version 0.1
+ * @date 2024-05-16
+ *
+ * @details The time base is the sample set (one V sample of phase 0), in Q8 fixed-point.
+ *          With a faster ADC (see ADC_PRESCALER), the sample sets are shorter and the time base
+ *          drops to Q7 or Q6, so that the period still fits in 16 bits with the same resolution in µs.
+ *
+ *          On each sample set, the PLL advances its prediction of the position within the mains
+ *          cycle. When the voltage of phase 0 goes from -ve to +ve, the exact crossing time is
+ *          interpolated between the two samples. Once the crossing is confirmed by the polarity
+ *          persistence check, the error between the interpolated and the predicted crossing
+ *          feeds a proportional-integral loop filter which corrects the phase and the period.
+ *
+ *          Once locked, the PLL gives:
+ *            - the position of the next crossing, independent of the persistence delay,
+ *            - the mains period, and thus the mains frequency.
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef PLL_H
+#define PLL_H
+
+#include <Arduino.h>
+
+#include "config_system.h"
+
+inline constexpr uint8_t PLL_SHIFT{ NOMINAL_SAMPLE_SETS_PER_MAINS_CYCLE < 56 ? 8 : (NOMINAL_SAMPLE_SETS_PER_MAINS_CYCLE < 112 ? 7 : 6) }; /**< Q-format of the time base (Q8 @ clk/128, units of 1/2^PLL_SHIFT sample set) */
+inline constexpr uint8_t PLL_KP_SHIFT{ 2 };                                                                                               /**< proportional gain 1/4 */
+inline constexpr uint8_t PLL_KI_SHIFT{ 5 };                                                                                               /**< integral gain 1/32, damping ~0.7 */
+
+inline constexpr int16_t PLL_LOCK_THRESHOLD{ 1 << (PLL_SHIFT - 2) }; /**< max error to be considered as locked (1/4 sample set) */
+inline constexpr int16_t PLL_UNLOCK_THRESHOLD{ 1 << PLL_SHIFT };     /**< error loosing the lock (1 sample set) */
+inline constexpr uint8_t PLL_CYCLES_TO_LOCK{ 8 };                    /**< consecutive cycles below the lock threshold */
+
+inline constexpr uint8_t PLL_TRIGGER_OFFSET{ 4 }; /**< cycle start, in sample sets after the predicted crossing (just after its confirmation) */
+
+/**
+ * @brief Software PLL
+ *
+ * @ingroup TimeCritical
+ */
+class SoftwarePll
+{
+public:
+  /**
+   * @brief Advance the time base by one sample set
+   *
+   * @param previousV Previous voltage sample of phase 0, DC offset removed (x256)
+   * @param currentV Current voltage sample of phase 0, DC offset removed (x256)
+   * @return true When the trigger point of the new cycle has been reached (only when locked)
+   */
+  bool tick(const int32_t previousV, const int32_t currentV)
+  {
+    elapsed += 1 << PLL_SHIFT;
+
+    if (elapsed >= period)
+    {
+      elapsed -= period;  // the predicted crossing has been passed
+      bTriggered = false;
+    }
+
+    if (previousV <= 0 && currentV > 0)
+    {
+      pendingError = normalize(elapsed - interpolate(previousV, currentV));
+    }
+
+    if (!bTriggered && elapsed >= triggerPoint)
+    {
+      bTriggered = true;  // once per cycle, even if the phase is corrected backwards
+      return locked;
+    }
+    return false;
+  }
+
+  /**
+   * @brief Feed the loop filter with the last -ve to +ve crossing
+   * @details To be called once the +ve polarity of phase 0 has been confirmed.
+   *
+   */
+  void confirmCrossing()
+  {
+    const int16_t error{ pendingError };
+
+    elapsed -= error >> PLL_KP_SHIFT;
+    period += error >> PLL_KI_SHIFT;
+
+    if (period < MIN_PERIOD)
+    {
+      period = MIN_PERIOD;
+    }
+    else if (period > MAX_PERIOD)
+    {
+      period = MAX_PERIOD;
+    }
+
+    const int16_t absError{ error < 0 ? static_cast< int16_t >(-error) : error };
+    if (absError > PLL_UNLOCK_THRESHOLD)
+    {
+      locked = false;
+      lockCount = 0;
+    }
+    else if (absError < PLL_LOCK_THRESHOLD && !locked && ++lockCount >= PLL_CYCLES_TO_LOCK)
+    {
+      locked = true;
+    }
+  }
+
+  /**
+   * @brief Check if the PLL is locked
+   *
+   * @return true if locked
+   */
+  bool isLocked() const
+  {
+    return locked;
+  }
+
+  /**
+   * @brief Get the mains period
+   *
+   * @return uint16_t Period in 1/2^PLL_SHIFT sample set
+   */
+  uint16_t get_period() const
+  {
+    return period;
+  }
+
+  /**
+   * @brief Compute the mains frequency from a period (not time-critical)
+   *
+   * @param period_Q8 The period in 1/2^PLL_SHIFT sample set
+   * @return uint16_t Frequency in 1/100 Hz
+   */
+  static uint16_t toFrequency_x100(const uint16_t period_Q8)
+  {
+    return period_Q8 ? FREQUENCY_CONSTANT / period_Q8 : 0;
+  }
+
+private:
+  static constexpr uint32_t FREQUENCY_CONSTANT{ F_CPU * 100UL * (1UL << PLL_SHIFT) / CPU_CYCLES_PER_SAMPLE_SET }; /**< f x100 = K / period */
+
+  static constexpr int16_t NOMINAL_PERIOD{ static_cast< int16_t >(FREQUENCY_CONSTANT / (SUPPLY_FREQUENCY * 100UL)) }; /**< period @ SUPPLY_FREQUENCY */
+  static constexpr int16_t MIN_PERIOD{ NOMINAL_PERIOD - NOMINAL_PERIOD / 10 };                                        /**< -10% */
+  static constexpr int16_t MAX_PERIOD{ NOMINAL_PERIOD + NOMINAL_PERIOD / 10 };                                        /**< +10% */
+
+  static_assert(MAX_PERIOD < INT16_MAX / 2, "The time base of the PLL would overflow");
+
+  /**
+   * @brief Time elapsed since the crossing, between the 2 samples
+   *
+   * @param previousV Sample before the crossing (<= 0)
+   * @param currentV Sample after the crossing (> 0)
+   * @return int16_t Elapsed time in 1/2^PLL_SHIFT sample set
+   */
+  static int16_t interpolate(const int32_t previousV, const int32_t currentV)
+  {
+    // reduced to the ADC scale for a 16-bit division
+    uint16_t after{ static_cast< uint16_t >(currentV >> 8) };
+    const uint16_t span{ static_cast< uint16_t >((currentV - previousV) >> 8) };
+
+    if (!span)
+    {
+      return 1 << (PLL_SHIFT - 1);
+    }
+    if (after > span)
+    {
+      after = span;
+    }
+    if (after > UINT8_MAX)
+    {
+      return static_cast< int16_t >((static_cast< uint32_t >(after) << PLL_SHIFT) / span);
+    }
+    return static_cast< int16_t >((after << PLL_SHIFT) / span);
+  }
+
+  /**
+   * @brief Bring an error into [-period/2, period/2[
+   *
+   * @param error The error
+   * @return int16_t The normalized error
+   */
+  int16_t normalize(int16_t error) const
+  {
+    if (error >= (period >> 1))
+    {
+      error -= period;
+    }
+    else if (error < -(period >> 1))
+    {
+      error += period;
+    }
+    return error;
+  }
+
+  static constexpr int16_t triggerPoint{ PLL_TRIGGER_OFFSET << PLL_SHIFT }; /**< start of the cycle */
+
+  int16_t period{ NOMINAL_PERIOD }; /**< mains period */
+  int16_t elapsed{ 0 };             /**< position since the predicted crossing */
+  int16_t pendingError{ 0 };        /**< error of the last crossing, not confirmed yet */
+  uint8_t lockCount{ 0 };           /**< consecutive cycles below the lock threshold */
+  bool locked{ false };             /**< the PLL is locked */
+  bool bTriggered{ false };         /**< the trigger point of this cycle has been passed */
+};
+
+#endif  // PLL_H
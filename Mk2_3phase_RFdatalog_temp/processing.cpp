@@ -10,637 +10,2215 @@
  */
 
 #include <Arduino.h>
+#include <util/atomic.h>
 
+#include "adc_sequencer.h"
 #include "calibration.h"
+#include "FastDivision.h"
 #include "dualtariff.h"
+#include "fundamental.h"
+#include "isr_profile.h"
+#include "load_learning.h"
+#include "pll.h"
+#include "hal.h"
 #include "processing.h"
+#include "utils_loadstats.h"
 #include "utils_pins.h"
 
 // Define operating limits for the LP filters which identify DC offset in the voltage
 // sample streams. By limiting the output range, these filters always should start up
 // correctly.
-constexpr int32_t l_DCoffset_V_min{ (512L - 100L) * 256L }; /**< mid-point of ADC minus a working margin */
-constexpr int32_t l_DCoffset_V_max{ (512L + 100L) * 256L }; /**< mid-point of ADC plus a working margin */
-constexpr int16_t i_DCoffset_I_nom{ 512L };                 /**< nominal mid-point value of ADC @ x1 scale */
+constexpr int32_t l_DCoffset_V_min{ (512L - 100L) * 256L };          /**< mid-point of ADC minus a working margin */
+constexpr int32_t l_DCoffset_V_max{ (512L + 100L) * 256L };          /**< mid-point of ADC plus a working margin */
+constexpr int16_t i_DCoffset_I_nom{ 512L << ADC_OVERSAMPLING_BITS }; /**< nominal mid-point value of ADC @ x1 scale, at the effective resolution */
+constexpr uint8_t ADC_SAMPLE_SHIFT{ 18 - ADC_RESOLUTION_BITS };      /**< the samples are processed @ x256 of the 10-bit scale, whatever the oversampling */
 
-int32_t l_DCoffset_V[NO_OF_PHASES]; /**< <--- for LPF */
+constexpr uint8_t DC_OFFSET_FILTER_SHIFT{ 12 }; /**< gain of the LPF, ~1/128 of the mean offset of a cycle is fed back */
+constexpr uint8_t DC_OFFSET_BOOST_SHIFT{ 8 };   /**< boosted gain of the LPF, ~1/8, during the start-up or while the offset is large */
 
 /**< main energy bucket for 3-phase use, with units of Joules * SUPPLY_FREQUENCY */
-constexpr float f_capacityOfEnergyBucket_main{ static_cast< float >(WORKING_ZONE_IN_JOULES * SUPPLY_FREQUENCY) };
+constexpr energy_t capacityOfEnergyBucket_main{ toEnergyUnits(WORKING_ZONE_IN_JOULES * SUPPLY_FREQUENCY) };
 /**< for resetting flexible thresholds */
-constexpr float f_midPointOfEnergyBucket_main{ f_capacityOfEnergyBucket_main * 0.5F };
+constexpr energy_t midPointOfEnergyBucket_main{ toEnergyUnits(WORKING_ZONE_IN_JOULES * SUPPLY_FREQUENCY * 0.5F) };
 /**< threshold in anti-flicker mode - must not exceed 0.4 */
 constexpr float f_offsetOfEnergyThresholdsInAFmode{ 0.1F };
 
-constexpr OutputModes outputMode{ OutputModes::NORMAL }; /**< Output mode to be used */
+constexpr ControllerStrategies controllerStrategy{ ControllerStrategies::THRESHOLDS }; /**< Strategy of the energy controller */
 
 /**
  * @brief set default threshold at compile time so the variable can be read-only
+ * @details Also used at run time by updateIsrCalibration() when the output mode changes.
  *
+ * @param mode The output mode
  * @param lower True to set the lower threshold, false for higher
  * @return the corresponding threshold
  */
-constexpr auto initThreshold(const bool lower)
+constexpr energy_t initThreshold(const OutputModes mode, const bool lower)
 {
+  constexpr float f_capacity{ static_cast< float >(WORKING_ZONE_IN_JOULES * SUPPLY_FREQUENCY) };
+
   return lower
-           ? f_capacityOfEnergyBucket_main * (0.5F - ((OutputModes::ANTI_FLICKER == outputMode) ? f_offsetOfEnergyThresholdsInAFmode : 0.0F))
-           : f_capacityOfEnergyBucket_main * (0.5F + ((OutputModes::ANTI_FLICKER == outputMode) ? f_offsetOfEnergyThresholdsInAFmode : 0.0F));
+           ? toEnergyUnits(f_capacity * (0.5F - ((OutputModes::ANTI_FLICKER == mode) ? f_offsetOfEnergyThresholdsInAFmode : 0.0F)))
+           : toEnergyUnits(f_capacity * (0.5F + ((OutputModes::ANTI_FLICKER == mode) ? f_offsetOfEnergyThresholdsInAFmode : 0.0F)));
 }
 
-constexpr float f_lowerThreshold_default{ initThreshold(true) };  /**< lower default threshold set accordingly to the output mode */
-constexpr float f_upperThreshold_default{ initThreshold(false) }; /**< upper default threshold set accordingly to the output mode */
-
-float f_energyInBucket_main{ 0.0F }; /**< main energy bucket (over all phases) */
-float f_lowerEnergyThreshold;        /**< dynamic lower threshold */
-float f_upperEnergyThreshold;        /**< dynamic upper threshold */
-
-// for improved control of multiple loads
-bool b_recentTransition{ false };                 /**< a load state has been recently toggled */
-uint8_t postTransitionCount;                      /**< counts the number of cycle since last transition */
-constexpr uint8_t POST_TRANSITION_MAX_COUNT{ 3 }; /**< allows each transition to take effect */
-// constexpr uint8_t POST_TRANSITION_MAX_COUNT{50}; /**< for testing only */
-uint8_t activeLoad{ NO_OF_DUMPLOADS }; /**< current active load */
-
-int32_t l_sumP[NO_OF_PHASES];                /**< cumulative power per phase */
-int32_t l_sampleVminusDC[NO_OF_PHASES];      /**< current raw voltage sample filtered */
-int32_t l_cumVdeltasThisCycle[NO_OF_PHASES]; /**< for the LPF which determines DC offset (voltage) */
-int32_t l_sumP_atSupplyPoint[NO_OF_PHASES];  /**< for summation of 'real power' values during datalog period */
-int32_t l_sum_Vsquared[NO_OF_PHASES];        /**< for summation of V^2 values during datalog period */
+constexpr energy_t lowerThreshold_default{ initThreshold(outputMode, true) };  /**< lower default threshold set accordingly to the output mode */
+constexpr energy_t upperThreshold_default{ initThreshold(outputMode, false) }; /**< upper default threshold set accordingly to the output mode */
 
-uint8_t n_samplesDuringThisMainsCycle[NO_OF_PHASES]; /**< number of sample sets for each phase during each mains cycle */
-uint16_t i_sampleSetsDuringThisDatalogPeriod;        /**< number of sample sets during each datalogging period */
-
-remove_cv< remove_reference< decltype(DATALOG_PERIOD_IN_MAINS_CYCLES) >::type >::type n_cycleCountForDatalogging{ 0 }; /**< for counting how often datalog is updated */
-
-uint8_t n_lowestNoOfSampleSetsPerMainsCycle; /**< For a mechanism to check the integrity of this code structure */
-
-// For an enhanced polarity detection mechanism, which includes a persistence check
-Polarities polarityOfMostRecentSampleV[NO_OF_PHASES];    /**< for zero-crossing detection */
-Polarities polarityConfirmed[NO_OF_PHASES];              /**< for zero-crossing detection */
-Polarities polarityConfirmedOfLastSampleV[NO_OF_PHASES]; /**< for zero-crossing detection */
+constexpr energy_t requiredExportPerMainsCycle{ toEnergyUnits(REQUIRED_EXPORT_IN_WATTS) }; /**< energy scale is Joules x SUPPLY_FREQUENCY */
+constexpr energy_t requiredExportOfPhase{ requiredExportPerMainsCycle / NO_OF_PHASES };       /**< share of each phase, with PER_PHASE_BUCKETS */
 
-LoadStates physicalLoadState[NO_OF_DUMPLOADS]; /**< Physical state of the loads */
-uint16_t countLoadON[NO_OF_DUMPLOADS];         /**< Number of cycle the load was ON (over 1 datalog period) */
+constexpr energy_t overvoltageBoost{ toEnergyUnits(OVERVOLTAGE_BOOST_IN_WATTS) }; /**< extra energy per mains cycle of a phase in overvoltage (see OVERVOLTAGE_BOOST) */
 
-bool beyondStartUpPeriod{ false }; /**< start-up delay, allows things to settle */
+/**
+ * @brief Turn a voltage into a threshold of the mean V^2 per sample set, at the scale of 'sum_Vsquared'
+ *
+ * @param volts the voltage in V
+ * @param voltageCal the voltage calibration of the phase
+ * @return constexpr uint32_t (volts / voltageCal)^2, x1/16 for the long datalog periods
+ */
+constexpr uint32_t toOvervoltageThreshold(const float volts, const float voltageCal)
+{
+  return static_cast< uint32_t >((volts / voltageCal) * (volts / voltageCal) / (DATALOG_PERIOD_IN_SECONDS > 10 ? 16 : 1) + 0.5F);
+}
 
 /**
- * @brief Initializes the ports and load states for processing
+ * @brief Thresholds of the overvoltage boost of each phase, for the compile-time calibration
  *
  */
-void initializeProcessing()
+struct OvervoltageThresholds
 {
-  for (uint8_t i = 0; i < NO_OF_DUMPLOADS; ++i)
+  constexpr OvervoltageThresholds()
   {
-    loadPrioritiesAndState[i] = loadPrioritiesAtStartup[i];
-    pinMode(physicalLoadPin[i], OUTPUT);  // driver pin for Load #n
-    loadPrioritiesAndState[i] &= loadStateMask;
+    for (uint8_t phase = 0; phase < NO_OF_PHASES; ++phase)
+    {
+      limit[phase] = toOvervoltageThreshold(OVERVOLTAGE_LIMIT_IN_VOLTS, f_voltageCal[phase]);
+      release[phase] = toOvervoltageThreshold(OVERVOLTAGE_LIMIT_IN_VOLTS - OVERVOLTAGE_HYSTERESIS_IN_VOLTS, f_voltageCal[phase]);
+    }
   }
-  updatePhysicalLoadStates();  // allows the logical-to-physical mapping to be changed
 
-  updatePortsStates();  // updates output pin states
+  uint32_t limit[NO_OF_PHASES]{};   /**< the boost starts above this mean V^2 */
+  uint32_t release[NO_OF_PHASES]{}; /**< the boost stops below this mean V^2 */
+};
 
-  for (auto &DCoffset_V : l_DCoffset_V)
-  {
-    DCoffset_V = 512L * 256L;  // nominal mid-point value of ADC @ x256 scale
-  }
+constexpr OvervoltageThresholds overvoltageThresholds; /**< thresholds for the calibration of calibration.h */
 
-  for (auto &bOverrideLoad : b_overrideLoadOn)
+/**
+ * @brief Count the burst-fire loads at compile time
+ *
+ * @return the number of loads in LoadModes::BURST_FIRE
+ */
+constexpr uint8_t countBurstFireLoads()
+{
+  uint8_t count{ 0 };
+  for (const auto mode : loadModes)
   {
-    bOverrideLoad = false;
+    count += (LoadModes::BURST_FIRE == mode);
   }
+  return count;
+}
 
-  // First stop the ADC
-  bit_clear(ADCSRA, ADEN);
-
-  // Activate free-running mode
-  ADCSRB = 0x00;
-
-  // Set up the ADC to be free-running
-  bit_set(ADCSRA, ADPS0);  // Set the ADC's clock to system clock / 128
-  bit_set(ADCSRA, ADPS1);
-  bit_set(ADCSRA, ADPS2);
+constexpr uint8_t NO_OF_BURST_FIRE_LOADS{ countBurstFireLoads() };         /**< number of burst-fire loads */
+constexpr uint16_t BURST_FIRE_FULL_DEMAND{ NO_OF_BURST_FIRE_LOADS * 256U }; /**< demand with all burst-fire loads fully ON (256 per load) */
 
-  bit_set(ADCSRA, ADATE);  // set the Auto Trigger Enable bit in the ADCSRA register. Because
-  // bits ADTS0-2 have not been set (i.e. they are all zero), the
-  // ADC's trigger source is set to "free running mode".
+/**< gain from the energy bucket (whole units) to the demand of the burst-fire loads, Q32 */
+constexpr uint32_t burstFireGain{ static_cast< uint32_t >(BURST_FIRE_FULL_DEMAND * 4294967296.0 / (WORKING_ZONE_IN_JOULES * SUPPLY_FREQUENCY)) };
 
-  bit_set(ADCSRA, ADIE);  // set the ADC interrupt enable bit. When this bit is written
-  // to one and the I-bit in SREG is set, the
-  // ADC Conversion Complete Interrupt is activated.
+constexpr uint8_t PWM_OUTPUT_FULL_DUTY{ 255 }; /**< duty of the PWM output fully ON */
 
-  bit_set(ADCSRA, ADEN);  // Enable the ADC
+/**< gain from the energy bucket (whole units) to the duty of the PWM output, Q32 */
+constexpr uint32_t pwmOutputGain{ static_cast< uint32_t >(PWM_OUTPUT_FULL_DUTY * 4294967296.0 / (WORKING_ZONE_IN_JOULES * SUPPLY_FREQUENCY)) };
 
-  bit_set(ADCSRA, ADSC);  // start ADC manually first time
+/**
+ * @brief Check if the load at a given priority is a burst-fire load
+ *
+ * @param index the priority of the load [0..NO_OF_DUMPLOADS[
+ * @return true if the load is in LoadModes::BURST_FIRE
+ */
+inline bool isBurstFireLoad(const uint8_t index)
+{
+  return NO_OF_BURST_FIRE_LOADS && (LoadModes::BURST_FIRE == loadModes[loadPrioritiesAndState[index] & loadStateMask]);
+}
 
-  sei();  // Enable Global Interrupts
+/**
+ * @brief Pre-scale a power calibration for the fixed-point energy bucket
+ *
+ * @param powerCal the power calibration
+ * @return constexpr int32_t powerCal * 2^POWER_CAL_SHIFT, rounded
+ */
+constexpr int32_t toFixedPointPowerCal(const float powerCal)
+{
+  return static_cast< int32_t >(powerCal * (1UL << POWER_CAL_SHIFT) + 0.5F);
 }
 
 /**
- * @brief Initializes the optional pins
+ * @brief Power calibration pre-scaled for the fixed-point energy bucket
+ * @details Each value is f_powerCal[phase] * 2^POWER_CAL_SHIFT, rounded.
  *
+ * @tparam N # of phases
  */
-void initializeOptionalPins()
+template< uint8_t N >
+class _FixedPointPowerCal
 {
-  if constexpr (DUAL_TARIFF)
+public:
+  constexpr _FixedPointPowerCal()
   {
-    pinMode(dualTariffPin, INPUT_PULLUP);  // set as input & enable the internal pullup resistor
-    delay(100);                            // allow time to settle
-
-    ul_TimeOffPeak = millis();
+    for (uint8_t i = 0; i != N; ++i)
+    {
+      _cal[i] = toFixedPointPowerCal(f_powerCal[i]);
+    }
   }
-
-  if constexpr (OVERRIDE_PIN_PRESENT)
+  constexpr int32_t operator[](uint8_t i) const
   {
-    pinMode(forcePin, INPUT_PULLUP);  // set as input & enable the internal pullup resistor
-    delay(100);                       // allow time to settle
+    return _cal[i];
   }
 
-  if constexpr (PRIORITY_ROTATION == RotationModes::PIN)
-  {
-    pinMode(rotationPin, INPUT_PULLUP);  // set as input & enable the internal pullup resistor
-    delay(100);                          // allow time to settle
-  }
+private:
+  int32_t _cal[N]{};
+};
 
-  if constexpr (DIVERSION_PIN_PRESENT)
-  {
-    pinMode(diversionPin, INPUT_PULLUP);  // set as input & enable the internal pullup resistor
-    delay(100);                           // allow time to settle
-  }
+constexpr auto l_powerCal{ _FixedPointPowerCal< NO_OF_PHASES >() }; /**< pre-scaled power calibration */
 
-  if constexpr (RELAY_DIVERSION)
+/**
+ * @brief Calibration of the ISR, pre-scaled from the runtime parameters (see RUNTIME_PARAMETERS)
+ * @details Written by the main processor with the interrupts disabled, read by the ISR.
+ *
+ */
+struct IsrCalibration
+{
+  int32_t l_powerCal[NO_OF_PHASES];          /**< pre-scaled power calibration, for the fixed-point energy bucket */
+  float f_powerCal[NO_OF_PHASES];            /**< power calibration, divided by the nominal sample sets with FREQUENCY_CORRECTION */
+  energy_t requiredExportPerMainsCycle;      /**< energy scale is Joules x SUPPLY_FREQUENCY */
+  energy_t requiredExportOfPhase;            /**< share of each phase, with PER_PHASE_BUCKETS */
+  energy_t lowerThreshold;                   /**< lower default threshold of the output mode */
+  energy_t upperThreshold;                   /**< upper default threshold of the output mode */
+  uint32_t overvoltageLimit[NO_OF_PHASES];   /**< see OvervoltageThresholds */
+  uint32_t overvoltageRelease[NO_OF_PHASES]; /**< see OvervoltageThresholds */
+  OutputModes outputMode;                    /**< output mode, for the printout only */
+};
+
+IsrCalibration isrCalibration; /**< only used with RUNTIME_PARAMETERS */
+
+/**
+ * @brief Get the pre-scaled power calibration of a phase, for the fixed-point energy bucket
+ *
+ * @param phase the phase number [0..NO_OF_PHASES[
+ * @return int32_t the pre-scaled power calibration
+ *
+ * @ingroup TimeCritical
+ */
+inline int32_t fixedPointPowerCal(const uint8_t phase)
+{
+  if constexpr (RUNTIME_PARAMETERS)
   {
-    relays.initializePins();
+    return isrCalibration.l_powerCal[phase];
   }
-
-  if constexpr (WATCHDOG_PIN_PRESENT)
+  else
   {
-    pinMode(watchDogPin, OUTPUT);  // set as output
-    setPinOFF(watchDogPin);        // set to off
+    return l_powerCal[phase];
   }
 }
 
-#if !defined(__DOXYGEN__)
-void updatePortsStates() __attribute__((optimize("-O3")));
-#endif
 /**
- * @brief update the control ports for each of the physical loads
+ * @brief Get the power calibration of a phase, for the floating-point energy bucket
+ *
+ * @param phase the phase number [0..NO_OF_PHASES[
+ * @return float the power calibration, divided by the nominal sample sets with FREQUENCY_CORRECTION
  *
+ * @ingroup TimeCritical
  */
-void updatePortsStates()
+inline float floatPowerCal(const uint8_t phase)
 {
-  uint16_t pinsON{ 0 };
-  uint16_t pinsOFF{ 0 };
-
-  uint8_t i{ NO_OF_DUMPLOADS };
-
-  do
+  if constexpr (RUNTIME_PARAMETERS)
   {
-    --i;
-    // update the local load's state.
-    if (LoadStates::LOAD_OFF == physicalLoadState[i])
-    {
-      // setPinOFF(physicalLoadPin[i]);
-      pinsOFF |= bit(physicalLoadPin[i]);
-    }
-    else
-    {
-      ++countLoadON[i];
-      // setPinON(physicalLoadPin[i]);
-      pinsON |= bit(physicalLoadPin[i]);
-    }
-  } while (i);
-
-  setPinsOFF(pinsOFF);
-  setPinsON(pinsON);
+    return isrCalibration.f_powerCal[phase];
+  }
+  else if constexpr (FREQUENCY_CORRECTION)
+  {
+    return f_powerCal[phase] / NOMINAL_SAMPLE_SETS_PER_MAINS_CYCLE;
+  }
+  else
+  {
+    return f_powerCal[phase];
+  }
 }
 
 /**
- * @brief This function provides the link between the logical and physical loads.
- * @details The array, logicalLoadState[], contains the on/off state of all logical loads, with
- *          element 0 being for the one with the highest priority. The array,
- *          physicalLoadState[], contains the on/off state of all physical loads.
- *
- *          The lowest 7 bits of element is the load number as defined in 'physicalLoadState'.
- *          The highest bit of each 'loadPrioritiesAndState' determines if the load is ON or OFF.
- *          The order of each element in 'loadPrioritiesAndState' determines the load priority.
- *          'loadPrioritiesAndState[i] & loadStateMask' will extract the load number at position 'i'
- *          'loadPrioritiesAndState[i] & loadStateOnBit' will extract the load state at position 'i'
+ * @brief Get the required export
  *
- *          Any other mapping relationships could be configured here.
+ * @return energy_t the required export per mains cycle, energy scale is Joules x SUPPLY_FREQUENCY
  *
  * @ingroup TimeCritical
  */
-void updatePhysicalLoadStates()
+inline energy_t requiredExport()
 {
-  if constexpr (PRIORITY_ROTATION != RotationModes::OFF)
+  if constexpr (RUNTIME_PARAMETERS)
   {
-    if (b_reOrderLoads)
-    {
-      uint8_t i{ NO_OF_DUMPLOADS - 1 };
-      const auto temp{ loadPrioritiesAndState[i] };
-      do
-      {
-        loadPrioritiesAndState[i] = loadPrioritiesAndState[i - 1];
-        --i;
-      } while (i);
-      loadPrioritiesAndState[0] = temp;
-
-      b_reOrderLoads = false;
-    }
-
-    if constexpr (!DUAL_TARIFF)
-    {
-      if (0x00 == (loadPrioritiesAndState[0] & loadStateOnBit))
-      {
-        ++absenceOfDivertedEnergyCount;
-      }
-      else
-      {
-        absenceOfDivertedEnergyCount = 0;
-      }
-    }
+    return isrCalibration.requiredExportPerMainsCycle;
   }
-
-  const bool bDiversionOff{ b_diversionOff };
-  uint8_t idx{ NO_OF_DUMPLOADS };
-  do
+  else
   {
-    --idx;
-    const auto iLoad{ loadPrioritiesAndState[idx] & loadStateMask };
-    physicalLoadState[iLoad] = !bDiversionOff && (b_overrideLoadOn[iLoad] || (loadPrioritiesAndState[idx] & loadStateOnBit)) ? LoadStates::LOAD_ON : LoadStates::LOAD_OFF;
-  } while (idx);
+    return requiredExportPerMainsCycle;
+  }
 }
 
 /**
- * @brief Process with the polarity for the actual voltage sample for the specific phase
+ * @brief Get the share of each phase of the required export, with PER_PHASE_BUCKETS
  *
- * @param phase the phase number [0..NO_OF_PHASES[
- * @param rawSample the current sample for the specified phase
+ * @return energy_t the required export of a phase per mains cycle, energy scale is Joules x SUPPLY_FREQUENCY
  *
  * @ingroup TimeCritical
  */
-void processPolarity(const uint8_t phase, const int16_t rawSample)
+inline energy_t requiredExportPerPhase()
 {
-  // remove DC offset from each raw voltage sample by subtracting the accurate value
-  // as determined by its associated LP filter.
-  l_sampleVminusDC[phase] = (static_cast< int32_t >(rawSample) << 8) - l_DCoffset_V[phase];
-  polarityOfMostRecentSampleV[phase] = (l_sampleVminusDC[phase] > 0) ? Polarities::POSITIVE : Polarities::NEGATIVE;
+  if constexpr (RUNTIME_PARAMETERS)
+  {
+    return isrCalibration.requiredExportOfPhase;
+  }
+  else
+  {
+    return requiredExportOfPhase;
+  }
 }
 
 /**
- * @brief Process the calculation for the actual current raw sample for the specific phase
+ * @brief Get the threshold above which a phase is in overvoltage
  *
  * @param phase the phase number [0..NO_OF_PHASES[
- * @param rawSample the current sample for the specified phase
+ * @return uint32_t the mean V^2 per sample set, at the scale of 'sum_Vsquared'
  *
  * @ingroup TimeCritical
  */
-void processCurrentRawSample(const uint8_t phase, const int16_t rawSample)
+inline uint32_t overvoltageLimit(const uint8_t phase)
 {
-  // extra items for an LPF to improve the processing of data samples from CT1
-  static int32_t lpf_long[NO_OF_PHASES]{};  // new LPF, for offsetting the behaviour of CTx as a HPF
-
-  // remove most of the DC offset from the current sample (the precise value does not matter)
-  int32_t sampleIminusDC = (static_cast< int32_t >(rawSample - i_DCoffset_I_nom)) << 8;
-
-  // extra filtering to offset the HPF effect of CTx
-  const int32_t last_lpf_long{ lpf_long[phase] };
-  lpf_long[phase] += alpha * (sampleIminusDC - last_lpf_long);
-  sampleIminusDC += (lpf_gain * lpf_long[phase]);
-
-  // calculate the "real power" in this sample pair and add to the accumulated sum
-  const int32_t filtV_div4 = l_sampleVminusDC[phase] >> 2;  // reduce to 16-bits (now x64, or 2^6)
-  const int32_t filtI_div4 = sampleIminusDC >> 2;           // reduce to 16-bits (now x64, or 2^6)
-  int32_t instP = filtV_div4 * filtI_div4;                  // 32-bits (now x4096, or 2^12)
-  instP >>= 12;                                             // scaling is now x1, as for Mk2 (V_ADC x I_ADC)
-
-  l_sumP[phase] += instP;                // cumulative power, scaling as for Mk2 (V_ADC x I_ADC)
-  l_sumP_atSupplyPoint[phase] += instP;  // cumulative power, scaling as for Mk2 (V_ADC x I_ADC)
+  if constexpr (RUNTIME_PARAMETERS)
+  {
+    return isrCalibration.overvoltageLimit[phase];
+  }
+  else
+  {
+    return overvoltageThresholds.limit[phase];
+  }
 }
 
 /**
- * @brief This routine prevents a zero-crossing point from being declared until a certain number
- *        of consecutive samples in the 'other' half of the waveform have been encountered.
+ * @brief Get the threshold below which a phase leaves the overvoltage
  *
  * @param phase the phase number [0..NO_OF_PHASES[
+ * @return uint32_t the mean V^2 per sample set, at the scale of 'sum_Vsquared'
  *
  * @ingroup TimeCritical
  */
-void confirmPolarity(const uint8_t phase)
+inline uint32_t overvoltageRelease(const uint8_t phase)
 {
-  static uint8_t count[NO_OF_PHASES]{};
-
-  if (polarityOfMostRecentSampleV[phase] == polarityConfirmedOfLastSampleV[phase])
+  if constexpr (RUNTIME_PARAMETERS)
   {
-    count[phase] = 0;
-    return;
+    return isrCalibration.overvoltageRelease[phase];
   }
-
-  if (++count[phase] > PERSISTENCE_FOR_POLARITY_CHANGE)
+  else
   {
-    count[phase] = 0;
-    polarityConfirmed[phase] = polarityOfMostRecentSampleV[phase];
+    return overvoltageThresholds.release[phase];
   }
 }
 
 /**
- * @brief Process the calculation for the current voltage sample for the specific phase
+ * @brief Get the lower default threshold of the output mode
  *
- * @param phase the phase number [0..NO_OF_PHASES[
+ * @return energy_t the threshold, energy scale is Joules x SUPPLY_FREQUENCY
  *
  * @ingroup TimeCritical
  */
-void processVoltage(const uint8_t phase)
+inline energy_t lowerThresholdDefault()
 {
-  // for the Vrms calculation (for datalogging only)
-  const int32_t filtV_div4{ l_sampleVminusDC[phase] >> 2 };  // reduce to 16-bits (now x64, or 2^6)
-  int32_t inst_Vsquared{ filtV_div4 * filtV_div4 };          // 32-bits (now x4096, or 2^12)
-
-  if constexpr (DATALOG_PERIOD_IN_SECONDS > 10)
+  if constexpr (RUNTIME_PARAMETERS)
   {
-    inst_Vsquared >>= 16;  // scaling is now x1/16 (V_ADC x I_ADC)
+    return isrCalibration.lowerThreshold;
   }
   else
   {
-    inst_Vsquared >>= 12;  // scaling is now x1 (V_ADC x I_ADC)
+    return lowerThreshold_default;
   }
-
-  l_sum_Vsquared[phase] += inst_Vsquared;  // cumulative V^2 (V_ADC x I_ADC)
-  //
-  // store items for use during next loop
-  l_cumVdeltasThisCycle[phase] += l_sampleVminusDC[phase];           // for use with LP filter
-  polarityConfirmedOfLastSampleV[phase] = polarityConfirmed[phase];  // for identification of half cycle boundaries
-  ++n_samplesDuringThisMainsCycle[phase];                            // for real power calculations
 }
 
 /**
- * @brief Process the startup period for the router.
+ * @brief Get the upper default threshold of the output mode
  *
- * @param phase the phase number [0..NO_OF_PHASES[
+ * @return energy_t the threshold, energy scale is Joules x SUPPLY_FREQUENCY
  *
  * @ingroup TimeCritical
  */
-void processStartUp(const uint8_t phase)
+inline energy_t upperThresholdDefault()
 {
-  // wait until the DC-blocking filters have had time to settle
-  if (millis() <= (initialDelay + startUpPeriod))
+  if constexpr (RUNTIME_PARAMETERS)
   {
-    return;  // still settling, do nothing
+    return isrCalibration.upperThreshold;
+  }
+  else
+  {
+    return upperThreshold_default;
   }
-
-  // the DC-blocking filters have had time to settle
-  beyondStartUpPeriod = true;
-  l_sumP[phase] = 0;
-  l_sumP_atSupplyPoint[phase] = 0;
-  n_samplesDuringThisMainsCycle[phase] = 0;
-  i_sampleSetsDuringThisDatalogPeriod = 0;
-
-  n_lowestNoOfSampleSetsPerMainsCycle = UINT8_MAX;
-  // can't say "Go!" here 'cos we're in an ISR!
 }
 
 /**
- * @brief Process the case of high energy level, some action may be required.
+ * @brief Get the output mode
  *
- * @ingroup TimeCritical
+ * @return OutputModes the runtime mode with RUNTIME_PARAMETERS, outputMode otherwise
  */
-void proceedHighEnergyLevel()
+inline OutputModes currentOutputMode()
 {
-  bool bOK_toAddLoad{ true };
-  const auto tempLoad{ nextLogicalLoadToBeAdded() };
-
-  if (tempLoad >= NO_OF_DUMPLOADS)
+  if constexpr (RUNTIME_PARAMETERS)
   {
-    return;
+    return isrCalibration.outputMode;
   }
-
-  // a load which is now OFF has been identified for potentially being switched ON
-  if (b_recentTransition)
+  else
   {
-    // During the post-transition period, any increase in the energy level is noted.
-    f_upperEnergyThreshold = f_energyInBucket_main;
-
-    // the energy thresholds must remain within range
-    if (f_upperEnergyThreshold > f_capacityOfEnergyBucket_main)
-    {
-      f_upperEnergyThreshold = f_capacityOfEnergyBucket_main;
-    }
-
-    // Only the active load may be switched during this period. All other loads must
-    // wait until the recent transition has had sufficient opportunity to take effect.
-    bOK_toAddLoad = (tempLoad == activeLoad);
+    return outputMode;
   }
+}
 
-  if (bOK_toAddLoad)
+constexpr uint8_t PHASE_CAL_SHIFT{ 8 };                                                                  /**< Q-format of the fixed-point phase calibration */
+constexpr int16_t i_phaseCal{ static_cast< int16_t >(f_phaseCal * (1 << PHASE_CAL_SHIFT) + 0.5F) }; /**< f_phaseCal in Q8 */
+constexpr bool PHASE_CAL_INTERPOLATION{ i_phaseCal != (1 << PHASE_CAL_SHIFT) };                        /**< the voltage must be interpolated */
+
+/**
+ * @brief Get the shift equivalent to the phase calibration
+ *
+ * @return constexpr uint8_t k if f_phaseCal == 1 / 2^k, 0 otherwise
+ */
+constexpr uint8_t phaseCalFractionShift()
+{
+  for (uint8_t k = 1; k <= PHASE_CAL_SHIFT; ++k)
   {
-    loadPrioritiesAndState[tempLoad] |= loadStateOnBit;
-    activeLoad = tempLoad;
-    postTransitionCount = 0;
-    b_recentTransition = true;
+    if (i_phaseCal == (1 << (PHASE_CAL_SHIFT - k)))
+    {
+      return k;
+    }
   }
+  return 0;
 }
 
+constexpr uint8_t PHASE_CAL_FRACTION_SHIFT{ phaseCalFractionShift() }; /**< 0 if the phase calibration is not a power-of-two fraction */
+
 /**
- * @brief Process the case of low energy level, some action may be required.
+ * @brief Get the shift of the power-of-two fraction nearest to alpha
  *
- * @ingroup TimeCritical
+ * @return constexpr uint8_t k such as 1 / 2^k is the nearest to alpha
  */
-void proceedLowEnergyLevel()
+constexpr uint8_t lpfAlphaShift()
 {
+  uint8_t k{ 0 };
+  while ((k < 24) && (alpha * (1UL << k) < 0.7071F))  // geometric mid-point between 2 powers of two
+  {
+    ++k;
+  }
+  return k;
+}
+
+constexpr bool LPF_COMPENSATION{ lpf_gain != 0 };                                                      /**< the extra LPF for the CTs is enabled */
+constexpr uint8_t LPF_ALPHA_SHIFT{ lpfAlphaShift() };                                                 /**< alpha as a shift */
+constexpr uint8_t LPF_GAIN_SHIFT{ 8 };                                                                /**< Q-format of the fixed-point LPF gain */
+constexpr int16_t i_lpfGain{ static_cast< int16_t >(lpf_gain * (1 << LPF_GAIN_SHIFT) + (lpf_gain < 0 ? -0.5F : 0.5F)) }; /**< lpf_gain in Q8 */
+
+energy_t energyInBucket_main{ 0 }; /**< main energy bucket (over all phases) */
+energy_t lowerEnergyThreshold;     /**< dynamic lower threshold */
+energy_t upperEnergyThreshold;     /**< dynamic upper threshold */
+energy_t energyInBucket_lastCycle; /**< main energy bucket at the end of the last mains cycle, for its slope */
+
+energy_t energyInBucket_phase[NO_OF_PHASES];      /**< energy bucket of each phase, with PER_PHASE_BUCKETS */
+uint8_t postTransitionCountOfPhase[NO_OF_PHASES]; /**< cycles since the last transition of a load of each phase, with PER_PHASE_BUCKETS */
+
+// for improved control of multiple loads
+bool b_recentTransition{ false };                 /**< a load state has been recently toggled */
+uint8_t postTransitionCount;                      /**< counts the number of cycle since last transition */
+uint8_t activeLoad{ NO_OF_DUMPLOADS }; /**< current active load */
+
+constexpr uint8_t PREDICTION_HORIZON{ POST_TRANSITION_MAX_COUNT };                                                     /**< mains cycles for a decision to take effect */
+constexpr bool TRACK_BUCKET_SLOPE{ MULTI_LOAD_SWITCHING || BEST_FIT_LOADS || LOAD_POWER_LEARNING || (ControllerStrategies::PREDICTIVE == controllerStrategy) }; /**< the slope of the energy bucket is needed */
+static_assert(!PER_PHASE_BUCKETS || !(TRACK_BUCKET_SLOPE || NO_OF_BURST_FIRE_LOADS || PWM_OUTPUT), "******** PER_PHASE_BUCKETS only works with the THRESHOLDS controller and ON/OFF loads, without MULTI_LOAD_SWITCHING, BEST_FIT_LOADS, LOAD_POWER_LEARNING and PWM_OUTPUT ! Please check your config ! ********");
+energy_t bucketSlope{ 0 };                                                                                             /**< filtered change of the energy bucket per mains cycle */
+
+PhaseState phaseStates[NO_OF_PHASES]; /**< state of each phase, updated on each sample */
+
+int32_t l_sum_Vsquared_atLastCycle[NO_OF_PHASES]; /**< 'sum_Vsquared' at the end of the last mains cycle (see OVERVOLTAGE_BOOST) */
+int32_t l_sumExtra[EXTRA_CHANNELS_SIZE];      /**< for summation of the raw extra samples during datalog period */
+int32_t l_sumP_atLastSecond[NO_OF_PHASES];   /**< 'sumP_atSupplyPoint' at the end of the last second (see PER_SECOND_POWER) */
+int32_t l_sumP_atLastFastRecord[NO_OF_PHASES]; /**< 'sumP_atSupplyPoint' at the end of the last fast-stream period (see FAST_STREAM) */
+int32_t l_sumP_atLastCoordination[NO_OF_PHASES]; /**< 'sumP_atSupplyPoint' at the end of the last coordination period (see COORDINATION_MASTER) */
+
+int16_t i_historyV[NO_OF_PHASES][QUADRATURE_DELAY]; /**< the latest voltage samples (x32), for the quadrature power */
+uint8_t n_historyIndex{ 0 };                       /**< oldest entry of the voltage history, common to all phases */
+
+uint16_t i_sampleSetsOfCompleteCycles[NO_OF_PHASES]; /**< sample sets of all complete mains cycles during datalog period, for the frequency */
+uint16_t n_overvoltageCycles[NO_OF_PHASES];          /**< mains cycles with the diversion boosted during datalog period (see OVERVOLTAGE_BOOST) */
+uint8_t overvoltageMask{ 0 };                        /**< phases in overvoltage, one bit per phase */
+
+volatile uint16_t meterPulseCount{ 0 }; /**< pulses of the utility meter since the start (see METER_PULSE_INPUT) */
+uint16_t meterPulsesAtLastDatalog{ 0 };  /**< 'meterPulseCount' at the end of the last datalog period */
+remove_cv< remove_reference< decltype(DATALOG_PERIOD_IN_MAINS_CYCLES) >::type >::type n_completeCycles[NO_OF_PHASES]; /**< number of complete mains cycles during datalog period, for the frequency */
+
+/**< expected number of sample sets per mains cycle, ie 20ms / (104us * 6) = 32.05 @ 50 Hz when free-running */
+constexpr uint8_t EXPECTED_SAMPLE_SETS_PER_MAINS_CYCLE{ ADC_TRIGGER_MODE == AdcTriggerModes::TIMER1 ? SAMPLE_SETS_PER_MAINS_CYCLE : F_CPU / (SUPPLY_FREQUENCY * CPU_CYCLES_PER_SAMPLE_SET) };
+/**< reciprocals for the per-cycle averaging, covering the expected sample sets count +/- 4 */
+constexpr ReciprocalTable< EXPECTED_SAMPLE_SETS_PER_MAINS_CYCLE - 4, EXPECTED_SAMPLE_SETS_PER_MAINS_CYCLE + 4 > rg_sampleSetsReciprocal;
+/**< 2^32 / nominal sample sets per mains cycle, rounded up, to integrate the energy at the real mains frequency */
+constexpr uint32_t NOMINAL_SAMPLE_SETS_RECIPROCAL{ static_cast< uint32_t >(4294967296.0 / NOMINAL_SAMPLE_SETS_PER_MAINS_CYCLE) + 1 };
+uint16_t i_sampleSetsDuringThisDatalogPeriod;        /**< number of sample sets during each datalogging period */
+
+remove_cv< remove_reference< decltype(DATALOG_PERIOD_IN_MAINS_CYCLES) >::type >::type n_cycleCountForDatalogging{ 0 }; /**< for counting how often datalog is updated */
+uint8_t n_cycleCountForSecond{ 0 };                  /**< mains cycles within the current second (see PER_SECOND_POWER) */
+uint16_t i_sampleSetsAtLastSecond{ 0 };              /**< 'i_sampleSetsDuringThisDatalogPeriod' at the end of the last second */
+uint8_t n_cycleCountForFastStream{ 0 };               /**< mains cycles within the current fast-stream period (see FAST_STREAM) */
+uint16_t i_sampleSetsAtLastFastRecord{ 0 };           /**< 'i_sampleSetsDuringThisDatalogPeriod' at the end of the last fast-stream period */
+uint8_t fastStreamSequence{ 0 };                      /**< sequence number of the next fast-stream record */
+uint8_t n_cycleCountForCoordination{ 0 };             /**< mains cycles within the current coordination period (see COORDINATION_MASTER) */
+uint16_t i_sampleSetsAtLastCoordination{ 0 };         /**< 'i_sampleSetsDuringThisDatalogPeriod' at the end of the last coordination period */
+
+uint8_t n_lowestNoOfSampleSetsPerMainsCycle; /**< For a mechanism to check the integrity of this code structure */
+
+// For an enhanced polarity detection mechanism, which includes a persistence check,
+// the polarities of each phase are packed in one byte, updated without any branch
+constexpr uint8_t POLARITY_RECENT{ 0x01 };           /**< polarity of the most recent sample, 1 if positive */
+constexpr uint8_t POLARITY_CONFIRMED{ 0x02 };        /**< confirmed polarity */
+constexpr uint8_t POLARITY_LAST_CONFIRMED{ 0x04 };   /**< confirmed polarity of the previous sample */
+constexpr uint8_t POLARITY_COUNT_SHIFT{ 3 };         /**< position of the persistence counter */
+constexpr uint8_t POLARITY_COUNT_MASK{ 0x03 };       /**< persistence counter, after the shift */
+static_assert(PERSISTENCE_FOR_POLARITY_CHANGE < POLARITY_COUNT_MASK, "******** PERSISTENCE_FOR_POLARITY_CHANGE does not fit in the persistence counter ! ********");
+
+uint16_t burstFireAccumulator{ 0 }; /**< error diffusion of the partially-ON burst-fire load, in 1/256 of a mains cycle */
+
+uint8_t pwmOutputDuty{ 0 };       /**< duty of the PWM output during the current mains cycle (see PWM_OUTPUT) */
+uint32_t l_sumPwmOutputDuty{ 0 }; /**< sum of the duty of the PWM output over the datalog period */
+
+LoadStates physicalLoadState[NO_OF_DUMPLOADS];      /**< Physical state of the loads */
+uint16_t countLoadON[NO_OF_DUMPLOADS];              /**< Number of cycle the load was ON (over 1 datalog period) */
+uint16_t countLoadON_atLastSecond[NO_OF_DUMPLOADS]; /**< 'countLoadON' at the end of the last second (see PER_SECOND_POWER) */
+uint16_t countLoadON_atLastCoordination[NO_OF_DUMPLOADS]; /**< 'countLoadON' at the end of the last coordination period (see COORDINATION_MASTER) */
+
+bool beyondStartUpPeriod{ false }; /**< start-up delay, allows things to settle */
+int32_t l_cumVdeltasStartUp[NO_OF_PHASES]; /**< sum of the voltage samples over the current window, during the start-up */
+uint8_t n_startUpCycles[NO_OF_PHASES];      /**< mains cycles in the current window, during the start-up */
+uint8_t settledPhasesMask{ 0 };             /**< phases whose last window had a settled DC offset, one bit per phase */
+
+/**< largest sum of the voltage samples over a window for a settled LP filter, at x256 */
+constexpr int32_t l_settledCumVdeltas{ 256L * startUpDCoffsetTolerance * EXPECTED_SAMPLE_SETS_PER_MAINS_CYCLE * startUpSettledCycles };
+/**< sum of the voltage samples over a cycle above which the LP filter is boosted, at x256 (mean offset of 16 ADC counts) */
+constexpr int32_t l_largeCumVdeltas{ 256L * 16 * EXPECTED_SAMPLE_SETS_PER_MAINS_CYCLE };
+uint8_t primedPhasesMask{ 0 }; /**< phases whose LPF has seen a first complete cycle, one bit per phase */
+
+uint8_t overrideLoadsMask{ 0 }; /**< loads forced to ON, one bit per load (see Commands::OVERRIDE) */
+bool b_diversionOff{ false };   /**< the diversion is stopped (see Commands::DIVERSION_OFF) */
+uint8_t calibrationLoadsMask{ 0 }; /**< CALIBRATION_RUNNING | loads ON during the auto-calibration, 0 otherwise (see Commands::CALIBRATION) */
+uint8_t enabledLoadsMask{ static_cast< uint8_t >(bit(NO_OF_DUMPLOADS) - 1) }; /**< loads taking part in the diversion, one bit per load (see Commands::ENABLE_LOADS) */
+energy_t coordinationOffset{ 0 }; /**< surplus left to the master router per mains cycle, written by loop() (see COORDINATION_SECONDARY) */
+
+SoftwarePll pll;            /**< PLL locked to the zero-crossings of phase 0 */
+bool b_pllTrigger{ false }; /**< the PLL asks for the start of a new cycle */
+
+uint16_t n_mainsCycles{ 0 };                                       /**< free-running count of the mains cycles, for TRANSITION_LOG */
+TransitionReasons controllerReason{ TransitionReasons::THRESHOLD }; /**< reason of the decisions of the controller during this cycle, for TRANSITION_LOG */
+
+LoadPowerLearning< NO_OF_DUMPLOADS > loadPowerLearning; /**< learned power of each load */
+
+/**
+ * @brief Initializes the ports and load states for processing
+ *
+ */
+void initializeProcessing()
+{
+  for (uint8_t i = 0; i < NO_OF_DUMPLOADS; ++i)
+  {
+    loadPrioritiesAndState[i] = loadPrioritiesAtStartup[i];
+    pinMode(physicalLoadPin[i], OUTPUT);  // driver pin for Load #n
+    loadPrioritiesAndState[i] &= loadStateMask;
+  }
+  updatePhysicalLoadStates();  // allows the logical-to-physical mapping to be changed
+
+  updatePortsStates();  // updates output pin states
+
+  for (auto &state : phaseStates)
+  {
+    state.DCoffset_V = 512L * 256L;  // nominal mid-point value of ADC @ x256 scale
+  }
+
+  halAdcBegin();  // see hal.h
+
+  sei();  // Enable Global Interrupts
+}
+
+/**
+ * @brief Restart the ADC after its conversions have stopped
+ * @details Called by the watchdog supervisor of loop() (see utils_watchdog.h).
+ *          The slot index of the ISR is kept: only the first conversion after the restart
+ *          is taken from the wrong channel, the sequence is back in step from the next one.
+ *
+ */
+void restartAdc()
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    halAdcBegin();  // see hal.h
+  }
+}
+
+/**
+ * @brief Update the calibration of the ISR from the runtime parameters
+ * @details The values are pre-scaled here, so that the ISR does not do any extra work.
+ *          The thresholds of the output mode are recomputed here too, the ISR compares the
+ *          energy level against them as against the constexpr ones.
+ *          Only used with RUNTIME_PARAMETERS.
+ *
+ * @param powerCal the power calibration of each phase
+ * @param voltageCal the voltage calibration of each phase, for the thresholds of OVERVOLTAGE_BOOST
+ * @param requiredExportInWatts the required export in W
+ * @param mode the output mode, its thresholds are computed here once
+ */
+void updateIsrCalibration(const float (&powerCal)[NO_OF_PHASES], const float (&voltageCal)[NO_OF_PHASES], const int16_t requiredExportInWatts, const OutputModes mode)
+{
+  IsrCalibration calibration;
+
+  for (uint8_t phase = 0; phase != NO_OF_PHASES; ++phase)
+  {
+    calibration.l_powerCal[phase] = toFixedPointPowerCal(powerCal[phase]);
+    calibration.f_powerCal[phase] = FREQUENCY_CORRECTION ? powerCal[phase] / NOMINAL_SAMPLE_SETS_PER_MAINS_CYCLE : powerCal[phase];
+    calibration.overvoltageLimit[phase] = toOvervoltageThreshold(OVERVOLTAGE_LIMIT_IN_VOLTS, voltageCal[phase]);
+    calibration.overvoltageRelease[phase] = toOvervoltageThreshold(OVERVOLTAGE_LIMIT_IN_VOLTS - OVERVOLTAGE_HYSTERESIS_IN_VOLTS, voltageCal[phase]);
+  }
+  calibration.requiredExportPerMainsCycle = toEnergyUnits(requiredExportInWatts);
+  calibration.requiredExportOfPhase = calibration.requiredExportPerMainsCycle / NO_OF_PHASES;
+  calibration.lowerThreshold = initThreshold(mode, true);
+  calibration.upperThreshold = initThreshold(mode, false);
+  calibration.outputMode = mode;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    isrCalibration = calibration;
+  }
+}
+
+/**
+ * @brief Set the surplus left to the master router
+ * @details Called by loop() on each message of the master, and with 0 once the master is lost.
+ *          Only used with RouterRoles::SECONDARY (see utils_coordination.h).
+ *
+ * @param offsetInWatts the surplus the master can still absorb in W
+ */
+void setCoordinationOffset(const int16_t offsetInWatts)
+{
+  const energy_t offset{ toEnergyUnits(offsetInWatts) };
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    coordinationOffset = offset;
+  }
+}
+
+/**
+ * @brief Count one pulse of the utility meter
+ * @details Called by the external interrupt of 'meterPulsePin'. Instead of a timestamp per pulse,
+ *          the count is latched by the ADC ISR at the end of each datalog period (see processDataLogging()),
+ *          so that the pulses and the sums of the router cover the same mains cycles.
+ *
+ * @ingroup TimeCritical
+ */
+void onMeterPulse()
+{
+  ++meterPulseCount;
+}
+
+/**
+ * @brief Initializes the optional pins
+ *
+ */
+void initializeOptionalPins()
+{
+  if constexpr (DUAL_TARIFF && !RTC_PRESENT)
+  {
+    pinMode(dualTariffPin, INPUT_PULLUP);  // set as input & enable the internal pullup resistor
+    delay(100);                            // allow time to settle
+
+    ul_TimeOffPeak = millis();
+  }
+
+  if constexpr (OVERRIDE_PIN_PRESENT)
+  {
+    pinMode(forcePin, INPUT_PULLUP);  // set as input & enable the internal pullup resistor
+    delay(100);                       // allow time to settle
+  }
+
+  if constexpr (PRIORITY_ROTATION == RotationModes::PIN)
+  {
+    pinMode(rotationPin, INPUT_PULLUP);  // set as input & enable the internal pullup resistor
+    delay(100);                          // allow time to settle
+  }
+
+  if constexpr (DIVERSION_PIN_PRESENT)
+  {
+    pinMode(diversionPin, INPUT_PULLUP);  // set as input & enable the internal pullup resistor
+    delay(100);                           // allow time to settle
+  }
+
+  if constexpr (RELAY_DIVERSION)
+  {
+    relays.initializePins();
+  }
+
+  if constexpr (WATCHDOG_PIN_PRESENT)
+  {
+    pinMode(watchDogPin, OUTPUT);  // set as output
+    setPinOFF(watchDogPin);        // set to off
+  }
+
+  if constexpr (PWM_OUTPUT)
+  {
+    pinMode(pwmOutputPin, OUTPUT);  // set as output
+    setPinOFF(pwmOutputPin);        // set to off until the first duty
+    halPwmBegin();
+  }
+
+  if constexpr (METER_PULSE_INPUT)
+  {
+    halPulseInputBegin(meterPulsePin, onMeterPulse);
+  }
+}
+
+constexpr PinMasksTable< NO_OF_DUMPLOADS > loadPinMasks{ physicalLoadPin }; /**< masks of the load pins for each port */
+
+#if !defined(__DOXYGEN__)
+void updatePortsStates() __attribute__((optimize("-O3")));
+#endif
+/**
+ * @brief update the control ports for each of the physical loads
+ *
+ */
+void updatePortsStates()
+{
+  PinMasks pinsON;
+
+  uint8_t i{ NO_OF_DUMPLOADS };
+
+  do
+  {
+    --i;
+    // update the local load's state.
+    if (LoadStates::LOAD_OFF != physicalLoadState[i])
+    {
+      ++countLoadON[i];
+      pinsON |= loadPinMasks.masks[i];
+    }
+
+    if constexpr (LOAD_STATISTICS)
+    {
+      loadStatistics.update(i, LoadStates::LOAD_OFF != physicalLoadState[i]);
+    }
+  } while (i);
+
+  halWritePins(loadPinMasks.all, pinsON);
+}
+
+/**
+ * @brief This function provides the link between the logical and physical loads.
+ * @details The array, logicalLoadState[], contains the on/off state of all logical loads, with
+ *          element 0 being for the one with the highest priority. The array,
+ *          physicalLoadState[], contains the on/off state of all physical loads.
+ *
+ *          The lowest 7 bits of element is the load number as defined in 'physicalLoadState'.
+ *          The highest bit of each 'loadPrioritiesAndState' determines if the load is ON or OFF.
+ *          The order of each element in 'loadPrioritiesAndState' determines the load priority.
+ *          'loadPrioritiesAndState[i] & loadStateMask' will extract the load number at position 'i'
+ *          'loadPrioritiesAndState[i] & loadStateOnBit' will extract the load state at position 'i'
+ *
+ *          Any other mapping relationships could be configured here.
+ *
+ * @ingroup TimeCritical
+ */
+void updatePhysicalLoadStates()
+{
+  bool bReOrderLoads{ false };
+  bool bNewPriorities{ false };
+  const bool bDiversionOffBefore{ b_diversionOff };
+  const uint8_t overrideLoadsMaskBefore{ overrideLoadsMask };
+  const uint8_t enabledLoadsMaskBefore{ enabledLoadsMask };
+  const uint8_t calibrationLoadsMaskBefore{ calibrationLoadsMask };
+
+  Command command;
+  while (isrCommands.pop(command))
+  {
+    switch (command.type)
+    {
+      case Commands::ROTATE_LOADS:
+        bReOrderLoads = true;
+        absenceOfDivertedEnergyCount = 0;  // the ISR is its only writer
+        break;
+      case Commands::OVERRIDE:
+        overrideLoadsMask = command.data;
+        break;
+      case Commands::DIVERSION_OFF:
+        b_diversionOff = command.data;
+        break;
+      case Commands::ENABLE_LOADS:
+        enabledLoadsMask = command.data;
+        break;
+      case Commands::SET_PRIORITIES:
+        bNewPriorities = true;
+        absenceOfDivertedEnergyCount = 0;
+        break;
+      case Commands::CALIBRATION:
+        calibrationLoadsMask = command.data;
+        break;
+    }
+  }
+
+  if constexpr (EQUALISED_ROTATION)
+  {
+    if (bNewPriorities)
+    {
+      // each load keeps its state at its new priority
+      uint8_t onLoadsMask{ 0 };
+      for (const auto loadPrioAndState : loadPrioritiesAndState)
+      {
+        if (loadPrioAndState & loadStateOnBit)
+        {
+          onLoadsMask |= bit(loadPrioAndState & loadStateMask);
+        }
+      }
+      for (uint8_t index = 0; index < NO_OF_DUMPLOADS; ++index)
+      {
+        const auto load{ requestedPriorities[index] };
+        loadPrioritiesAndState[index] = load | ((onLoadsMask & bit(load)) ? loadStateOnBit : 0);
+      }
+      bReOrderLoads = false;  // at most one new order per mains cycle
+
+      isrEvents.push({ Events::LOADS_ROTATED, 0 });
+    }
+  }
+
+  if constexpr (TEMPERATURE_TARGETS)
+  {
+    if (enabledLoadsMask != enabledLoadsMaskBefore)
+    {
+      for (uint8_t index = 0; index < NO_OF_DUMPLOADS; ++index)
+      {
+        if (!(enabledLoadsMask & bit(loadPrioritiesAndState[index] & loadStateMask)))
+        {
+          loadPrioritiesAndState[index] &= loadStateMask;  // at target, the next priority takes over
+        }
+      }
+    }
+  }
+
+  if constexpr (PRIORITY_ROTATION != RotationModes::OFF)
+  {
+    if (bReOrderLoads)
+    {
+      uint8_t i{ NO_OF_DUMPLOADS - 1 };
+      const auto temp{ loadPrioritiesAndState[i] };
+      do
+      {
+        loadPrioritiesAndState[i] = loadPrioritiesAndState[i - 1];
+        --i;
+      } while (i);
+      loadPrioritiesAndState[0] = temp;
+
+      isrEvents.push({ Events::LOADS_ROTATED, 0 });
+    }
+
+    if constexpr (!DUAL_TARIFF)
+    {
+      if (0x00 == (loadPrioritiesAndState[0] & loadStateOnBit))
+      {
+        ++absenceOfDivertedEnergyCount;
+      }
+      else
+      {
+        absenceOfDivertedEnergyCount = 0;
+      }
+    }
+  }
+
+  uint8_t idx{ NO_OF_DUMPLOADS };
+  do
+  {
+    --idx;
+    const auto iLoad{ loadPrioritiesAndState[idx] & loadStateMask };
+    // during the auto-calibration, only the reference load is switched, by loop()
+    const bool bOn{ (AUTO_CALIBRATION && calibrationLoadsMask) ? ((calibrationLoadsMask & bit(iLoad)) != 0)
+                                                                : !b_diversionOff && ((overrideLoadsMask & bit(iLoad)) || (loadPrioritiesAndState[idx] & loadStateOnBit)) };
+    const auto newState{ bOn ? LoadStates::LOAD_ON : LoadStates::LOAD_OFF };
+
+    if (newState != physicalLoadState[iLoad])
+    {
+      physicalLoadState[iLoad] = newState;
+      if (LoadModes::BURST_FIRE == loadModes[iLoad])
+      {
+        continue;  // up to one transition per mains cycle, not worth an event
+      }
+      const auto load{ static_cast< uint8_t >(iLoad | (LoadStates::LOAD_ON == newState ? 0x80 : 0)) };
+      isrEvents.push({ Events::LOAD_TRANSITION, load });
+
+      if constexpr (TRANSITION_LOG)
+      {
+        auto reason{ controllerReason };
+        if (calibrationLoadsMask != calibrationLoadsMaskBefore)
+        {
+          reason = TransitionReasons::CALIBRATION;
+        }
+        else if (b_diversionOff != bDiversionOffBefore)
+        {
+          reason = TransitionReasons::DIVERSION_OFF;
+        }
+        else if ((overrideLoadsMask ^ overrideLoadsMaskBefore) & bit(iLoad))
+        {
+          reason = TransitionReasons::OVERRIDE;
+        }
+        else if ((enabledLoadsMask ^ enabledLoadsMaskBefore) & bit(iLoad))
+        {
+          reason = TransitionReasons::TEMPERATURE;
+        }
+        else if (bReOrderLoads || bNewPriorities)
+        {
+          reason = TransitionReasons::ROTATION;
+        }
+        loadTransitions.push({ n_mainsCycles, load, reason, PER_PHASE_BUCKETS ? energyInBucket_phase[loadPhase[iLoad]] : energyInBucket_main });
+      }
+    }
+  } while (idx);
+}
+
+/**
+ * @brief Process with the polarity for the actual voltage sample for the specific phase
+ *
+ * @param phase the phase number [0..NO_OF_PHASES[
+ * @param rawSample the current sample for the specified phase
+ *
+ * @ingroup TimeCritical
+ */
+void processPolarity(const uint8_t phase, const int16_t rawSample)
+{
+  auto &state{ phaseStates[phase] };
+
+  if constexpr (PHASE_CAL_INTERPOLATION)
+  {
+    state.lastSampleVminusDC = state.sampleVminusDC;
+  }
+
+  // remove DC offset from each raw voltage sample by subtracting the accurate value
+  // as determined by its associated LP filter.
+  state.sampleVminusDC = (static_cast< int32_t >(rawSample) << ADC_SAMPLE_SHIFT) - state.DCoffset_V;
+
+  // the sign bit of -V is set when V > 0 (V is far from INT32_MIN)
+  const uint8_t bPositive{ static_cast< uint8_t >(static_cast< uint32_t >(-state.sampleVminusDC) >> 31) };
+  state.polarity = (state.polarity & ~POLARITY_RECENT) | bPositive;
+}
+
+/**
+ * @brief Get the voltage sample shifted according to the phase calibration
+ * @details Interpolation between the 2 most recent voltage samples, at no cost when f_phaseCal is 1,
+ *          with a shift when it is a power-of-two fraction, and an integer multiply otherwise.
+ *
+ * @param phase the phase number [0..NO_OF_PHASES[
+ * @return int32_t the phase-shifted voltage sample, same scaling as 'sampleVminusDC'
+ *
+ * @ingroup TimeCritical
+ */
+inline int32_t phaseShiftedV(const uint8_t phase)
+{
+  const auto &state{ phaseStates[phase] };
+
+  if constexpr (!PHASE_CAL_INTERPOLATION)
+  {
+    return state.sampleVminusDC;
+  }
+  else if constexpr (0 == i_phaseCal)
+  {
+    return state.lastSampleVminusDC;
+  }
+  else if constexpr (PHASE_CAL_FRACTION_SHIFT)
+  {
+    return state.lastSampleVminusDC + ((state.sampleVminusDC - state.lastSampleVminusDC) >> PHASE_CAL_FRACTION_SHIFT);
+  }
+  else
+  {
+    return state.lastSampleVminusDC + (((state.sampleVminusDC - state.lastSampleVminusDC) * i_phaseCal) >> PHASE_CAL_SHIFT);
+  }
+}
+
+/**
+ * @brief Process the calculation for the actual current raw sample for the specific phase
+ *
+ * @tparam Phase the phase number [0..NO_OF_PHASES[
+ * @param rawSample the current sample for the specified phase
+ *
+ * @ingroup TimeCritical
+ */
+template< uint8_t Phase >
+void processCurrentRawSample(const int16_t rawSample)
+{
+  ProfiledScope< ProfiledStages::CURRENT > profile;
+
+  auto &state{ phaseStates[Phase] };
+
+  if constexpr (RAW_SAMPLES_CAPTURE)
+  {
+    rawSamplesCapture.store((Phase << 1) + 1, rawSample);
+  }
+
+  // remove most of the DC offset from the current sample (the precise value does not matter)
+  int32_t sampleIminusDC = (static_cast< int32_t >(rawSample - i_DCoffset_I_nom)) << ADC_SAMPLE_SHIFT;
+
+  if constexpr (LPF_COMPENSATION)
+  {
+    // extra filtering to offset the HPF effect of CTx
+    state.lpf_long += (sampleIminusDC - state.lpf_long) >> LPF_ALPHA_SHIFT;
+    sampleIminusDC += (state.lpf_long * i_lpfGain) >> LPF_GAIN_SHIFT;
+  }
+
+  // calculate the "real power" in this sample pair and add to the accumulated sum
+  const int32_t filtV_div4 = phaseShiftedV(Phase) >> 2;     // reduce to 16-bits (now x64, or 2^6)
+  const int32_t filtI_div4 = sampleIminusDC >> 2;           // reduce to 16-bits (now x64, or 2^6)
+  int32_t instP = filtV_div4 * filtI_div4;                  // 32-bits (now x4096, or 2^12)
+  instP >>= 12;                                             // scaling is now x1, as for Mk2 (V_ADC x I_ADC)
+
+  state.sumP += instP;                // cumulative power, scaling as for Mk2 (V_ADC x I_ADC)
+  state.sumP_atSupplyPoint += instP;  // cumulative power, scaling as for Mk2 (V_ADC x I_ADC)
+
+  // for the Irms calculation (for datalogging only)
+  int32_t inst_Isquared{ filtI_div4 * filtI_div4 };  // 32-bits (now x4096, or 2^12)
+  if constexpr (DATALOG_PERIOD_IN_SECONDS > 10)
+  {
+    inst_Isquared >>= 16;  // scaling is now x1/16 (I_ADC x I_ADC)
+  }
+  else
+  {
+    inst_Isquared >>= 12;  // scaling is now x1 (I_ADC x I_ADC)
+  }
+  state.sum_Isquared += inst_Isquared;  // cumulative I^2 (I_ADC x I_ADC)
+
+  if constexpr (REACTIVE_POWER)
+  {
+    // the voltage of a quarter of a mains cycle ago is in quadrature with the current one
+    auto &oldestV{ i_historyV[Phase][n_historyIndex] };
+    const int16_t filtI_div8{ static_cast< int16_t >(sampleIminusDC >> 3) };  // reduce to 16-bits (now x32, or 2^5)
+
+    state.sumQ_atSupplyPoint += (static_cast< int32_t >(oldestV) * filtI_div8) >> 10;  // scaling is now x1 (V_ADC x I_ADC)
+
+    oldestV = static_cast< int16_t >(phaseShiftedV(Phase) >> 3);  // reduce to 16-bits (now x32, or 2^5)
+    if constexpr (NO_OF_PHASES - 1 == Phase)
+    {
+      if (++n_historyIndex == QUADRATURE_DELAY)
+      {
+        n_historyIndex = 0;
+      }
+    }
+  }
+
+  if constexpr (HARMONIC_ANALYSIS)
+  {
+    fundamentalAnalysis.processSample(Phase, phaseShiftedV(Phase), sampleIminusDC, state.samplesDuringThisMainsCycle - 1);
+  }
+}
+
+/**
+ * @brief This routine prevents a zero-crossing point from being declared until a certain number
+ *        of consecutive samples in the 'other' half of the waveform have been encountered.
+ *
+ * @param phase the phase number [0..NO_OF_PHASES[
+ *
+ * @ingroup TimeCritical
+ */
+void confirmPolarity(const uint8_t phase)
+{
+  auto &state{ phaseStates[phase] };
+  const uint8_t polarity{ state.polarity };
+
+  // 0xFF while the most recent sample differs from the confirmed polarity, 0 otherwise
+  // (the confirmed polarity is the one of the previous sample until the change is confirmed)
+  const uint8_t differs{ static_cast< uint8_t >(-((polarity ^ (polarity >> 2)) & POLARITY_RECENT)) };
+  const uint8_t count{ static_cast< uint8_t >((((polarity >> POLARITY_COUNT_SHIFT) & POLARITY_COUNT_MASK) + 1) & differs) };
+
+  // 0xFF once the change has persisted long enough
+  const uint8_t confirmed{ static_cast< uint8_t >(-static_cast< uint8_t >(count > PERSISTENCE_FOR_POLARITY_CHANGE)) };
+
+  state.polarity = ((polarity & (POLARITY_RECENT | POLARITY_CONFIRMED | POLARITY_LAST_CONFIRMED)) ^ (confirmed & POLARITY_CONFIRMED))  // the confirmed polarity toggles
+                   | ((count & ~confirmed) << POLARITY_COUNT_SHIFT);                                                                    // the counter restarts
+}
+
+/**
+ * @brief Get the transition of the confirmed polarity at the last voltage sample
+ *
+ * @param phase the phase number [0..NO_OF_PHASES[
+ * @return PolarityTransitions the confirmed polarity and the one of the previous sample
+ *
+ * @ingroup TimeCritical
+ */
+PolarityTransitions polarityTransition(const uint8_t phase)
+{
+  return static_cast< PolarityTransitions >((phaseStates[phase].polarity >> 1) & 0b11);
+}
+
+/**
+ * @brief Process the calculation for the current voltage sample for the specific phase
+ *
+ * @param phase the phase number [0..NO_OF_PHASES[
+ *
+ * @ingroup TimeCritical
+ */
+void processVoltage(const uint8_t phase)
+{
+  auto &state{ phaseStates[phase] };
+
+  // for the Vrms calculation (for datalogging only)
+  const int32_t filtV_div4{ state.sampleVminusDC >> 2 };  // reduce to 16-bits (now x64, or 2^6)
+  int32_t inst_Vsquared{ filtV_div4 * filtV_div4 };       // 32-bits (now x4096, or 2^12)
+
+  if constexpr (DATALOG_PERIOD_IN_SECONDS > 10)
+  {
+    inst_Vsquared >>= 16;  // scaling is now x1/16 (V_ADC x I_ADC)
+  }
+  else
+  {
+    inst_Vsquared >>= 12;  // scaling is now x1 (V_ADC x I_ADC)
+  }
+
+  state.sum_Vsquared += inst_Vsquared;  // cumulative V^2 (V_ADC x I_ADC)
+  //
+  // store items for use during next loop
+  state.cumVdeltasThisCycle += state.sampleVminusDC;  // for use with LP filter
+  ++state.samplesDuringThisMainsCycle;                // for real power calculations
+
+  // for identification of half cycle boundaries
+  state.polarity = (state.polarity & ~POLARITY_LAST_CONFIRMED) | ((state.polarity & POLARITY_CONFIRMED) << 1);
+}
+
+/**
+ * @brief Check whether the DC-blocking filters of all phases have settled
+ * @details The mean offset of the voltage samples is checked over windows of startUpSettledCycles
+ *          mains cycles with confirmed zero-crossings. A single cycle is not enough: when it gets
+ *          one more sample set than the others, this sample, taken just after the zero-crossing,
+ *          is a large offset on its own.
+ *
+ * @return true if the last window of each phase was within startUpDCoffsetTolerance
+ *
+ * @ingroup TimeCritical
+ */
+bool isDCoffsetSettled()
+{
+  return settledPhasesMask == (1U << NO_OF_PHASES) - 1;
+}
+
+/**
+ * @brief Process the startup period for the router.
+ *
+ * @param phase the phase number [0..NO_OF_PHASES[
+ *
+ * @ingroup TimeCritical
+ */
+void processStartUp(const uint8_t phase)
+{
+  auto &state{ phaseStates[phase] };
+
+  // wait until the DC-blocking filters have settled, or at most until the end of the start-up period
+  if (millis() <= (initialDelay + startUpPeriod) && !isDCoffsetSettled())
+  {
+    return;  // still settling, do nothing
+  }
+
+  // the DC-blocking filters have had time to settle
+  beyondStartUpPeriod = true;
+  state.sumP = 0;
+  state.sumP_atSupplyPoint = 0;
+  l_sumP_atLastSecond[phase] = 0;
+  l_sumP_atLastFastRecord[phase] = 0;
+  l_sumP_atLastCoordination[phase] = 0;
+  state.sumQ_atSupplyPoint = 0;
+  state.sum_Isquared = 0;
+  state.samplesDuringThisMainsCycle = 0;
+  i_sampleSetsOfCompleteCycles[phase] = 0;
+  n_completeCycles[phase] = 0;
+  i_sampleSetsDuringThisDatalogPeriod = 0;
+  i_sampleSetsAtLastSecond = 0;
+  i_sampleSetsAtLastFastRecord = 0;
+  i_sampleSetsAtLastCoordination = 0;
+
+  n_lowestNoOfSampleSetsPerMainsCycle = UINT8_MAX;
+  // can't say "Go!" here 'cos we're in an ISR!
+}
+
+/**
+ * @brief Get the power balance of the last mains cycle, from the slope of the energy bucket
+ * @details With the energy scale in Joules * SUPPLY_FREQUENCY, the change over one cycle is in W.
+ *
+ * @return int32_t the power in W, surplus is positive
+ *
+ * @ingroup TimeCritical
+ */
+int32_t powerBalanceOfLastCycle()
+{
+  const auto delta{ energyInBucket_main - energyInBucket_lastCycle };
+
+  return FIXED_POINT_ENERGY_BUCKET ? static_cast< int32_t >(delta) >> ENERGY_BUCKET_SHIFT : static_cast< int32_t >(delta);
+}
+
+/**
+ * @brief Check if the load at a given priority must not be added
+ *
+ * @param index the priority of the load [0..NO_OF_DUMPLOADS[
+ * @return true if the load has been seen failed (LOAD_POWER_LEARNING), or is at its target temperature (TEMPERATURE_TARGETS)
+ *
+ * @ingroup TimeCritical
+ */
+bool isSkippedLoad(const uint8_t index)
+{
+  const auto load{ loadPrioritiesAndState[index] & loadStateMask };
+
+  return (TEMPERATURE_TARGETS && !(enabledLoadsMask & bit(load))) || (LOAD_POWER_LEARNING && loadPowerLearning.isSkipped(load));
+}
+
+/**
+ * @brief Detect the loads which are ON without drawing any power (thermostat open)
+ * @details A saturated load which is still ON is switched OFF, so that the next priority takes over.
+ *
+ *          While ON, the opening of a thermostat shows up as a sudden rise of the surplus,
+ *          close to the learned power of an ON load. Outside the post-transition period,
+ *          such a load is then switched OFF as a probe: if the surplus does not change,
+ *          the load is marked as saturated for SATURATED_LOAD_PERIOD_IN_MINUTES (see load_learning.h).
+ *          Otherwise, the rise came from the PV and the load is added back by the controller.
+ *
+ * @ingroup TimeCritical
+ */
+void proceedSaturatedLoads()
+{
+  static int32_t lastBalance{ 0 };
+
+  const int32_t balance{ powerBalanceOfLastCycle() };
+  const int32_t rise{ balance - lastBalance };
+  lastBalance = balance;
+
+  bool bProbe{ !b_recentTransition && !loadPowerLearning.isPending() && (rise > 0) };
+
+  for (uint8_t index = 0; index < NO_OF_DUMPLOADS; ++index)
+  {
+    if (isBurstFireLoad(index) || !(loadPrioritiesAndState[index] & loadStateOnBit))
+    {
+      continue;
+    }
+
+    if (isSkippedLoad(index))
+    {
+      loadPrioritiesAndState[index] &= loadStateMask;  // saturated, the next priority takes over
+      controllerReason = TransitionReasons::THERMOSTAT;
+      continue;
+    }
+
+    const auto power{ ratedPowerOfLogicalLoad(index) };
+    if (bProbe && (rise >= power - (power >> 2)) && (rise <= power + (power >> 2)))
+    {
+      loadPrioritiesAndState[index] &= loadStateMask;
+      loadPowerLearning.start(loadPrioritiesAndState[index] & loadStateMask, false, balance);
+      controllerReason = TransitionReasons::THERMOSTAT;
+      activeLoad = index;
+      postTransitionCount = 0;
+      b_recentTransition = true;
+      bProbe = false;
+    }
+  }
+}
+
+/**
+ * @brief Get the energy level to be compared to the thresholds, according to the controller strategy
+ * @details With ControllerStrategies::PREDICTIVE, the level is extrapolated over PREDICTION_HORIZON
+ *          cycles from the filtered slope of the bucket. As the bucket is the integral of the power
+ *          balance, this is a PI controller on the power: a threshold crossing is anticipated
+ *          by the time a decision takes effect, and a quickly rising level is not overshot.
+ *
+ * @return energy_t the controlled level
+ *
+ * @ingroup TimeCritical
+ */
+energy_t controlledEnergyLevel()
+{
+  if constexpr (ControllerStrategies::PREDICTIVE == controllerStrategy)
+  {
+    bucketSlope += (energyInBucket_main - energyInBucket_lastCycle - bucketSlope) / 4;  // first-order filter, ~4 cycles
+    return energyInBucket_main + PREDICTION_HORIZON * bucketSlope;
+  }
+  else
+  {
+    return energyInBucket_main;
+  }
+}
+
+/**
+ * @brief Get the rated power of the load at a given priority
+ *
+ * @param index the priority of the load [0..NO_OF_DUMPLOADS[
+ * @return int32_t the rated power in W, or the learned one with LOAD_POWER_LEARNING
+ *
+ * @ingroup TimeCritical
+ */
+int32_t ratedPowerOfLogicalLoad(const uint8_t index)
+{
+  const auto load{ loadPrioritiesAndState[index] & loadStateMask };
+
+  return LOAD_POWER_LEARNING ? loadPowerLearning.get_power(load) : loadRatedPower[load];
+}
+
+/**
+ * @brief Process the case of high energy level, some action may be required.
+ *
+ * @param level the controlled energy level (see controlledEnergyLevel)
+ *
+ * @ingroup TimeCritical
+ */
+void proceedHighEnergyLevel(const energy_t level)
+{
+  if constexpr (NO_OF_BURST_FIRE_LOADS)
+  {
+    if (energyInBucket_main < capacityOfEnergyBucket_main)
+    {
+      return;  // the burst-fire loads are not yet fully ON
+    }
+  }
+  if constexpr (PWM_OUTPUT)
+  {
+    if (pwmOutputDuty != PWM_OUTPUT_FULL_DUTY || energyInBucket_main < capacityOfEnergyBucket_main)
+    {
+      return;  // the PWM output is not yet fully ON
+    }
+  }
+
+  bool bOK_toAddLoad{ true };
+  const auto tempLoad{ loadToBeAdded(powerBalanceOfLastCycle()) };
+
+  if (tempLoad >= NO_OF_DUMPLOADS)
+  {
+    return;
+  }
+
+  // a load which is now OFF has been identified for potentially being switched ON
+  if (b_recentTransition)
+  {
+    // During the post-transition period, any increase in the energy level is noted.
+    upperEnergyThreshold = level;
+
+    // the energy thresholds must remain within range
+    if (upperEnergyThreshold > capacityOfEnergyBucket_main)
+    {
+      upperEnergyThreshold = capacityOfEnergyBucket_main;
+    }
+
+    // Only the active load may be switched during this period. All other loads must
+    // wait until the recent transition has had sufficient opportunity to take effect.
+    bOK_toAddLoad = (tempLoad == activeLoad);
+  }
+
+  if (bOK_toAddLoad)
+  {
+    loadPrioritiesAndState[tempLoad] |= loadStateOnBit;
+    activeLoad = tempLoad;
+
+    if constexpr (MULTI_LOAD_SWITCHING)
+    {
+      // Outside the post-transition period, the next loads are added in priority order
+      // as long as the surplus of the last cycle covers their rated power.
+      if (!b_recentTransition)
+      {
+        int32_t surplus{ powerBalanceOfLastCycle() - ratedPowerOfLogicalLoad(tempLoad) };
+        uint8_t nextLoad;
+        while (((nextLoad = loadToBeAdded(surplus)) < NO_OF_DUMPLOADS) && (surplus >= ratedPowerOfLogicalLoad(nextLoad)))
+        {
+          surplus -= ratedPowerOfLogicalLoad(nextLoad);
+          loadPrioritiesAndState[nextLoad] |= loadStateOnBit;
+          activeLoad = nextLoad;
+        }
+      }
+    }
+
+    if constexpr (LOAD_POWER_LEARNING)
+    {
+      if (activeLoad == tempLoad)
+      {
+        loadPowerLearning.start(loadPrioritiesAndState[tempLoad] & loadStateMask, true, powerBalanceOfLastCycle());
+      }
+      else
+      {
+        loadPowerLearning.abort();  // several loads have been switched
+      }
+    }
+
+    postTransitionCount = 0;
+    b_recentTransition = true;
+  }
+}
+
+/**
+ * @brief Process the case of low energy level, some action may be required.
+ *
+ * @param level the controlled energy level (see controlledEnergyLevel)
+ *
+ * @ingroup TimeCritical
+ */
+void proceedLowEnergyLevel(const energy_t level)
+{
+  if constexpr (NO_OF_BURST_FIRE_LOADS)
+  {
+    if (energyInBucket_main > 0)
+    {
+      return;  // the burst-fire loads are not yet fully OFF
+    }
+  }
+  if constexpr (PWM_OUTPUT)
+  {
+    if (pwmOutputDuty || energyInBucket_main > 0)
+    {
+      return;  // the PWM output is not yet fully OFF
+    }
+  }
+
   bool bOK_toRemoveLoad{ true };
-  const auto tempLoad{ nextLogicalLoadToBeRemoved() };
+  const auto tempLoad{ loadToBeRemoved(-powerBalanceOfLastCycle()) };
+
+  if (tempLoad >= NO_OF_DUMPLOADS)
+  {
+    return;
+  }
+
+  // a load which is now ON has been identified for potentially being switched OFF
+  if (b_recentTransition)
+  {
+    // During the post-transition period, any decrease in the energy level is noted.
+    lowerEnergyThreshold = level;
+
+    // the energy thresholds must remain within range
+    if (lowerEnergyThreshold < 0)
+    {
+      lowerEnergyThreshold = 0;
+    }
+
+    // Only the active load may be switched during this period. All other loads must
+    // wait until the recent transition has had sufficient opportunity to take effect.
+    bOK_toRemoveLoad = (tempLoad == activeLoad);
+  }
+
+  if (bOK_toRemoveLoad)
+  {
+    loadPrioritiesAndState[tempLoad] &= loadStateMask;
+    activeLoad = tempLoad;
+
+    if constexpr (MULTI_LOAD_SWITCHING)
+    {
+      // Outside the post-transition period, the next loads are removed in reverse priority order
+      // until the import of the last cycle is covered (import is worse than a short export).
+      if (!b_recentTransition)
+      {
+        int32_t deficit{ -powerBalanceOfLastCycle() - ratedPowerOfLogicalLoad(tempLoad) };
+        uint8_t nextLoad;
+        while ((deficit > 0) && ((nextLoad = loadToBeRemoved(deficit)) < NO_OF_DUMPLOADS))
+        {
+          deficit -= ratedPowerOfLogicalLoad(nextLoad);
+          loadPrioritiesAndState[nextLoad] &= loadStateMask;
+          activeLoad = nextLoad;
+        }
+      }
+    }
+
+    if constexpr (LOAD_POWER_LEARNING)
+    {
+      if (activeLoad == tempLoad)
+      {
+        loadPowerLearning.start(loadPrioritiesAndState[tempLoad] & loadStateMask, false, powerBalanceOfLastCycle());
+      }
+      else
+      {
+        loadPowerLearning.abort();  // several loads have been switched
+      }
+    }
+
+    postTransitionCount = 0;
+    b_recentTransition = true;
+  }
+}
+
+/**
+ * @brief Set the state of the burst-fire loads for the coming mains cycle
+ * @details The demand is proportional to the level of the energy bucket, which integrates
+ *          the surplus: the bucket settles where the diverted energy matches the surplus.
+ *          The demand is shared in priority order: the first burst-fire loads are fully ON,
+ *          the next one is ON for the fractional part of the demand, the others are OFF.
+ *          The fraction is spread evenly over the mains cycles by error diffusion (Bresenham),
+ *          e.g. 600 W of surplus on a 3 kW load gives 1 cycle ON out of 5.
+ *
+ *          The ON/OFF loads are only added once all burst-fire loads are fully ON (full bucket),
+ *          and only removed once they are all OFF (empty bucket).
+ *
+ * @ingroup TimeCritical
+ */
+void proceedBurstFireLoads()
+{
+  // an empty bucket means no demand, a full one means all burst-fire loads fully ON
+  const int32_t level{ FIXED_POINT_ENERGY_BUCKET ? static_cast< int32_t >(energyInBucket_main) >> ENERGY_BUCKET_SHIFT : static_cast< int32_t >(energyInBucket_main) };
+  const int32_t demand{ multiplyByFraction(level, burstFireGain) };
+
+  // the bucket is only clamped at the end of the mains cycle
+  uint16_t remaining{ static_cast< uint16_t >(demand < 0 ? 0 : (demand > BURST_FIRE_FULL_DEMAND ? BURST_FIRE_FULL_DEMAND : demand)) };
+
+  for (uint8_t index = 0; index < NO_OF_DUMPLOADS; ++index)
+  {
+    if (!isBurstFireLoad(index))
+    {
+      continue;
+    }
+    if (isSkippedLoad(index))
+    {
+      loadPrioritiesAndState[index] &= loadStateMask;  // the demand goes to the next burst-fire load
+      continue;
+    }
+
+    bool bOn{ false };
+    if (remaining >= 256)
+    {
+      bOn = true;
+      remaining -= 256;
+    }
+    else if (remaining)
+    {
+      burstFireAccumulator += remaining;
+      if (burstFireAccumulator >= 256)
+      {
+        bOn = true;
+        burstFireAccumulator -= 256;
+      }
+      remaining = 0;
+    }
+
+    if (bOn)
+    {
+      loadPrioritiesAndState[index] |= loadStateOnBit;
+    }
+    else
+    {
+      loadPrioritiesAndState[index] &= loadStateMask;
+    }
+  }
+}
+
+/**
+ * @brief Set the duty of the PWM output for the coming mains cycle
+ * @details As for the burst-fire loads, the duty is proportional to the level of the energy bucket:
+ *          the bucket settles where the power of the variable load matches the surplus.
+ *          The duty moves towards its target by PWM_OUTPUT_SLEW_RATE at most per mains cycle,
+ *          so that the load (or its 0-10 V converter) sees a smooth ramp.
+ *
+ *          The ON/OFF loads are only added once the PWM output is fully ON (full bucket),
+ *          and only removed once it is OFF (empty bucket).
+ *
+ * @ingroup TimeCritical
+ */
+void proceedPwmOutput()
+{
+  const int32_t level{ FIXED_POINT_ENERGY_BUCKET ? static_cast< int32_t >(energyInBucket_main) >> ENERGY_BUCKET_SHIFT : static_cast< int32_t >(energyInBucket_main) };
+  const int32_t demand{ (b_diversionOff || (AUTO_CALIBRATION && calibrationLoadsMask)) ? 0 : multiplyByFraction(level, pwmOutputGain) };
+
+  // the bucket is only clamped at the end of the mains cycle
+  const int16_t target{ static_cast< int16_t >(demand < 0 ? 0 : (demand > PWM_OUTPUT_FULL_DUTY ? PWM_OUTPUT_FULL_DUTY : demand)) };
+
+  if (target > pwmOutputDuty + PWM_OUTPUT_SLEW_RATE)
+  {
+    pwmOutputDuty += PWM_OUTPUT_SLEW_RATE;
+  }
+  else if (target < pwmOutputDuty - PWM_OUTPUT_SLEW_RATE)
+  {
+    pwmOutputDuty -= PWM_OUTPUT_SLEW_RATE;
+  }
+  else
+  {
+    pwmOutputDuty = target;
+  }
+
+  halPwmWrite(pwmOutputDuty);
+  l_sumPwmOutputDuty += pwmOutputDuty;
+}
+
+/**
+ * @brief Get the next load of a phase to be switched, in priority order
+ *
+ * @param phase the phase number [0..NO_OF_PHASES[
+ * @param bAdd true for the first OFF load, false for the last ON load
+ * @return uint8_t the priority of the load, NO_OF_DUMPLOADS if none
+ *
+ * @ingroup TimeCritical
+ */
+uint8_t loadOfPhaseToBeSwitched(const uint8_t phase, const bool bAdd)
+{
+  for (uint8_t i = 0; i < NO_OF_DUMPLOADS; ++i)
+  {
+    const uint8_t index{ bAdd ? i : static_cast< uint8_t >(NO_OF_DUMPLOADS - 1 - i) };
+    const auto loadState{ loadPrioritiesAndState[index] };
+
+    if (loadPhase[loadState & loadStateMask] == phase && bAdd != static_cast< bool >(loadState & loadStateOnBit) && !(bAdd && isSkippedLoad(index)))
+    {
+      return index;
+    }
+  }
+  return NO_OF_DUMPLOADS;
+}
+
+/**
+ * @brief Switch the loads of each phase according to the energy bucket of this phase (PER_PHASE_BUCKETS)
+ * @details Each phase is controlled on its own, as with a single-phase router: one load of the phase
+ *          is added (resp. removed) when its bucket is above (resp. below) the default thresholds,
+ *          then the loads of this phase are left alone for POST_TRANSITION_MAX_COUNT cycles.
+ *          The export on one phase thus never covers the import on another one.
+ *
+ * @ingroup TimeCritical
+ */
+void proceedPhaseBuckets()
+{
+  for (uint8_t phase = 0; phase < NO_OF_PHASES; ++phase)
+  {
+    auto &bucket{ energyInBucket_phase[phase] };
+
+    if (postTransitionCountOfPhase[phase] < POST_TRANSITION_MAX_COUNT)
+    {
+      ++postTransitionCountOfPhase[phase];
+    }
+    else if (bucket > upperThresholdDefault() || bucket < lowerThresholdDefault())
+    {
+      const bool bAdd{ bucket > upperThresholdDefault() };
+      const auto index{ loadOfPhaseToBeSwitched(phase, bAdd) };
+
+      if (index < NO_OF_DUMPLOADS)
+      {
+        if (bAdd)
+        {
+          loadPrioritiesAndState[index] |= loadStateOnBit;
+        }
+        else
+        {
+          loadPrioritiesAndState[index] &= loadStateMask;
+        }
+        postTransitionCountOfPhase[phase] = 0;
+      }
+    }
+
+    if (bucket > capacityOfEnergyBucket_main)
+    {
+      bucket = capacityOfEnergyBucket_main;
+    }
+    else if (bucket < 0)
+    {
+      bucket = 0;
+    }
+  }
+}
+
+/**
+ * @brief This code is executed once per 20mS, shortly after the start of each new
+ *        mains cycle on phase 0.
+ * @details Changing the state of the loads  is a 3-part process:
+ *          - change the LOGICAL load states as necessary to maintain the energy level
+ *          - update the PHYSICAL load states according to the logical -> physical mapping
+ *          - update the driver lines for each of the loads.
+ *
+ * @ingroup TimeCritical
+ */
+void processStartNewCycle()
+{
+  ProfiledScope< ProfiledStages::START_NEW_CYCLE > profile;
 
-  if (tempLoad >= NO_OF_DUMPLOADS)
+  // Restrictions apply for the period immediately after a load has been switched.
+  // Here the b_recentTransition flag is checked and updated as necessary.
+  // if (b_recentTransition)
+  //   b_recentTransition = (++postTransitionCount < POST_TRANSITION_MAX_COUNT);
+  // for optimization, the next line is equivalent to the two lines above
+  b_recentTransition &= (++postTransitionCount < POST_TRANSITION_MAX_COUNT);
+
+  if constexpr (TRANSITION_LOG)
+  {
+    ++n_mainsCycles;
+    controllerReason = TransitionReasons::THRESHOLD;
+  }
+
+  if constexpr (TRACK_BUCKET_SLOPE)
+  {
+    static bool bFirstCycle{ true };
+    if (bFirstCycle)
+    {
+      bFirstCycle = false;
+      energyInBucket_lastCycle = energyInBucket_main;  // the first cycle after the start-up period gives no slope
+    }
+  }
+
+  if constexpr (LOAD_POWER_LEARNING)
+  {
+    loadPowerLearning.proceed(powerBalanceOfLastCycle());
+  }
+
+  if constexpr (THERMOSTAT_DETECTION)
+  {
+    proceedSaturatedLoads();
+  }
+
+  if constexpr (NO_OF_BURST_FIRE_LOADS)
+  {
+    proceedBurstFireLoads();
+  }
+
+  if constexpr (PWM_OUTPUT)
+  {
+    proceedPwmOutput();
+  }
+
+  if constexpr (PER_PHASE_BUCKETS)
+  {
+    proceedPhaseBuckets();
+  }
+  else
+  {
+    const energy_t level{ controlledEnergyLevel() };
+
+    if (level > midPointOfEnergyBucket_main)
+    {
+      // the energy state is in the upper half of the working range
+      lowerEnergyThreshold = lowerThresholdDefault();  // reset the "opposite" threshold
+      if (level > upperEnergyThreshold)
+      {
+        // Because the energy level is high, some action may be required
+        proceedHighEnergyLevel(level);
+      }
+    }
+    else
+    {
+      // the energy state is in the lower half of the working range
+      upperEnergyThreshold = upperThresholdDefault();  // reset the "opposite" threshold
+      if (level < lowerEnergyThreshold)
+      {
+        // Because the energy level is low, some action may be required
+        proceedLowEnergyLevel(level);
+      }
+    }
+  }
+
+  updatePhysicalLoadStates();  // allows the logical-to-physical mapping to be changed
+
+  updatePortsStates();  // update the control ports for each of the physical loads
+
+  // Now that the energy-related decisions have been taken, min and max limits can now
+  // be applied  to the level of the energy bucket. This is to ensure correct operation
+  // when conditions change, i.e. when import changes to export, and vice versa.
+  //
+  if (energyInBucket_main > capacityOfEnergyBucket_main)
+  {
+    energyInBucket_main = capacityOfEnergyBucket_main;
+  }
+  else if (energyInBucket_main < 0)
+  {
+    energyInBucket_main = 0;
+  }
+
+  if constexpr (TRACK_BUCKET_SLOPE)
+  {
+    energyInBucket_lastCycle = energyInBucket_main;
+  }
+}
+
+/**
+ * @brief Process the start of a new -ve half cycle, for this phase, just after the zero-crossing point.
+ *
+ * @param phase the phase number [0..NO_OF_PHASES[
+ *
+ * @ingroup TimeCritical
+ */
+void processMinusHalfCycle(const uint8_t phase)
+{
+  auto &state{ phaseStates[phase] };
+
+  // This is a convenient point to update the Low Pass Filter for removing the DC
+  // component from the phase that is being processed.
+  // The portion which is fed back into the integrator is approximately one percent
+  // of the average offset of all the SampleVs in the previous mains cycle.
+  // During the start-up, or when the offset is far off, the gain is boosted to ~12%
+  // so that the filter settles within a few tens of cycles.
+  //
+  if (!(primedPhasesMask & bit(phase)))
   {
+    // the samples since the start do not cover a whole cycle, they would bias the filter
+    primedPhasesMask |= bit(phase);
+    state.cumVdeltasThisCycle = 0;
     return;
   }
 
-  // a load which is now ON has been identified for potentially being switched OFF
-  if (b_recentTransition)
+  if (!beyondStartUpPeriod || state.cumVdeltasThisCycle > l_largeCumVdeltas || state.cumVdeltasThisCycle < -l_largeCumVdeltas)
   {
-    // During the post-transition period, any decrease in the energy level is noted.
-    f_lowerEnergyThreshold = f_energyInBucket_main;
+    state.DCoffset_V += (state.cumVdeltasThisCycle >> DC_OFFSET_BOOST_SHIFT);
+  }
+  else
+  {
+    state.DCoffset_V += (state.cumVdeltasThisCycle >> DC_OFFSET_FILTER_SHIFT);
+  }
 
-    // the energy thresholds must remain within range
-    if (f_lowerEnergyThreshold < 0)
+  if (!beyondStartUpPeriod)
+  {
+    // the residual offset over the window tells whether the filter has settled
+    l_cumVdeltasStartUp[phase] += state.cumVdeltasThisCycle;
+
+    if (++n_startUpCycles[phase] == startUpSettledCycles)
     {
-      f_lowerEnergyThreshold = 0;
+      if (l_cumVdeltasStartUp[phase] > l_settledCumVdeltas || l_cumVdeltasStartUp[phase] < -l_settledCumVdeltas)
+      {
+        settledPhasesMask &= ~bit(phase);
+      }
+      else
+      {
+        settledPhasesMask |= bit(phase);
+      }
+      l_cumVdeltasStartUp[phase] = 0;
+      n_startUpCycles[phase] = 0;
     }
+  }
+  state.cumVdeltasThisCycle = 0;
 
-    // Only the active load may be switched during this period. All other loads must
-    // wait until the recent transition has had sufficient opportunity to take effect.
-    bOK_toRemoveLoad = (tempLoad == activeLoad);
+  // To ensure that this LP filter will always start up correctly when 240V AC is
+  // available, its output value needs to be prevented from drifting beyond the likely range
+  // of the voltage signal.
+  //
+  if (state.DCoffset_V < l_DCoffset_V_min)
+  {
+    state.DCoffset_V = l_DCoffset_V_min;
   }
+  else if (state.DCoffset_V > l_DCoffset_V_max)
+  {
+    state.DCoffset_V = l_DCoffset_V_max;
+  }
+}
 
-  if (bOK_toRemoveLoad)
+#if !defined(__DOXYGEN__)
+uint8_t nextLogicalLoadToBeAdded() __attribute__((optimize("-O3")));
+#endif
+/**
+ * @brief Retrieve the next load that could be added (be aware of the order)
+ *
+ * @return The load number if successful, NO_OF_DUMPLOADS in case of failure
+ *
+ * @ingroup TimeCritical
+ */
+uint8_t nextLogicalLoadToBeAdded()
+{
+  for (uint8_t index = 0; index < NO_OF_DUMPLOADS; ++index)
   {
-    loadPrioritiesAndState[tempLoad] &= loadStateMask;
-    activeLoad = tempLoad;
-    postTransitionCount = 0;
-    b_recentTransition = true;
+    if (isBurstFireLoad(index) || isSkippedLoad(index))
+    {
+      continue;  // driven by proceedBurstFireLoads(), or failed
+    }
+    if (0x00 == (loadPrioritiesAndState[index] & loadStateOnBit))
+    {
+      return (index);
+    }
   }
+
+  return (NO_OF_DUMPLOADS);
 }
 
+#if !defined(__DOXYGEN__)
+uint8_t nextLogicalLoadToBeRemoved() __attribute__((optimize("-O3")));
+#endif
 /**
- * @brief This code is executed once per 20mS, shortly after the start of each new
- *        mains cycle on phase 0.
- * @details Changing the state of the loads  is a 3-part process:
- *          - change the LOGICAL load states as necessary to maintain the energy level
- *          - update the PHYSICAL load states according to the logical -> physical mapping
- *          - update the driver lines for each of the loads.
+ * @brief Retrieve the next load that could be removed (be aware of the reverse-order)
+ *
+ * @return The load number if successful, NO_OF_DUMPLOADS in case of failure
+ *
+ * @ingroup TimeCritical
+ */
+uint8_t nextLogicalLoadToBeRemoved()
+{
+  uint8_t index{ NO_OF_DUMPLOADS };
+  do
+  {
+    --index;
+    if (isBurstFireLoad(index))
+    {
+      continue;  // driven by proceedBurstFireLoads()
+    }
+    if (loadPrioritiesAndState[index] & loadStateOnBit)
+    {
+      return (index);
+    }
+  } while (index);
+
+  return (NO_OF_DUMPLOADS);
+}
+
+/**
+ * @brief Retrieve the OFF load which best fits the surplus
+ * @details The largest load within the surplus, or the smallest one if none fits.
+ *          In case of equality, the highest priority wins.
+ *
+ * @param surplus the surplus in W
+ * @return The load number if successful, NO_OF_DUMPLOADS in case of failure
+ *
+ * @ingroup TimeCritical
+ */
+uint8_t bestFittingLoadToBeAdded(const int32_t surplus)
+{
+  uint8_t best{ NO_OF_DUMPLOADS };      // largest load within the surplus
+  uint8_t smallest{ NO_OF_DUMPLOADS };  // fallback
+
+  for (uint8_t index = 0; index < NO_OF_DUMPLOADS; ++index)
+  {
+    if (isBurstFireLoad(index) || isSkippedLoad(index) || (loadPrioritiesAndState[index] & loadStateOnBit))
+    {
+      continue;
+    }
+
+    const auto power{ ratedPowerOfLogicalLoad(index) };
+    if (power <= surplus)
+    {
+      if ((NO_OF_DUMPLOADS == best) || (power > ratedPowerOfLogicalLoad(best)))
+      {
+        best = index;
+      }
+    }
+    else if ((NO_OF_DUMPLOADS == smallest) || (power < ratedPowerOfLogicalLoad(smallest)))
+    {
+      smallest = index;
+    }
+  }
+
+  return (best != NO_OF_DUMPLOADS) ? best : smallest;
+}
+
+/**
+ * @brief Retrieve the ON load which best covers the import
+ * @details The smallest load covering the import, or the largest one if none does.
+ *          In case of equality, the lowest priority wins.
+ *
+ * @param deficit the import in W
+ * @return The load number if successful, NO_OF_DUMPLOADS in case of failure
+ *
+ * @ingroup TimeCritical
+ */
+uint8_t bestFittingLoadToBeRemoved(const int32_t deficit)
+{
+  uint8_t best{ NO_OF_DUMPLOADS };     // smallest load covering the import
+  uint8_t largest{ NO_OF_DUMPLOADS };  // fallback
+
+  uint8_t index{ NO_OF_DUMPLOADS };
+  do
+  {
+    --index;
+    if (isBurstFireLoad(index) || !(loadPrioritiesAndState[index] & loadStateOnBit))
+    {
+      continue;
+    }
+
+    const auto power{ ratedPowerOfLogicalLoad(index) };
+    if (power >= deficit)
+    {
+      if ((NO_OF_DUMPLOADS == best) || (power < ratedPowerOfLogicalLoad(best)))
+      {
+        best = index;
+      }
+    }
+    else if ((NO_OF_DUMPLOADS == largest) || (power > ratedPowerOfLogicalLoad(largest)))
+    {
+      largest = index;
+    }
+  } while (index);
+
+  return (best != NO_OF_DUMPLOADS) ? best : largest;
+}
+
+/**
+ * @brief Retrieve the next load to be added, according to BEST_FIT_LOADS
+ *
+ * @param surplus the surplus in W (BEST_FIT_LOADS only)
+ * @return The load number if successful, NO_OF_DUMPLOADS in case of failure
+ *
+ * @ingroup TimeCritical
+ */
+uint8_t loadToBeAdded(const int32_t surplus)
+{
+  if constexpr (BEST_FIT_LOADS)
+  {
+    return bestFittingLoadToBeAdded(surplus);
+  }
+  else
+  {
+    return nextLogicalLoadToBeAdded();
+  }
+}
+
+/**
+ * @brief Retrieve the next load to be removed, according to BEST_FIT_LOADS
+ *
+ * @param deficit the import in W (BEST_FIT_LOADS only)
+ * @return The load number if successful, NO_OF_DUMPLOADS in case of failure
+ *
+ * @ingroup TimeCritical
+ */
+uint8_t loadToBeRemoved(const int32_t deficit)
+{
+  if constexpr (BEST_FIT_LOADS)
+  {
+    return bestFittingLoadToBeRemoved(deficit);
+  }
+  else
+  {
+    return nextLogicalLoadToBeRemoved();
+  }
+}
+
+/**
+ * @brief Check whether the last mains cycle of a phase was in overvoltage
+ * @details The sum of V^2 over the cycle is the change of 'sum_Vsquared' since the end of the previous cycle,
+ *          it is compared with the thresholds times the sample sets of the cycle:
+ *          nothing is added to the per-sample processing, and there's no division nor square root.
+ *          The hysteresis keeps a voltage close to the limit from toggling the boost every cycle.
+ *
+ * @param phase the phase number [0..NO_OF_PHASES[
+ * @return true if the phase is in overvoltage
+ *
+ * @ingroup TimeCritical
+ */
+bool isOvervoltage(const uint8_t phase)
+{
+  auto &state{ phaseStates[phase] };
+
+  const uint32_t sumVsquared{ static_cast< uint32_t >(state.sum_Vsquared - l_sum_Vsquared_atLastCycle[phase]) };
+  l_sum_Vsquared_atLastCycle[phase] = state.sum_Vsquared;
+
+  const uint8_t phaseBit{ static_cast< uint8_t >(bit(phase)) };
+  if (overvoltageMask & phaseBit)
+  {
+    if (sumVsquared < overvoltageRelease(phase) * state.samplesDuringThisMainsCycle)
+    {
+      overvoltageMask &= ~phaseBit;
+    }
+  }
+  else if (sumVsquared > overvoltageLimit(phase) * state.samplesDuringThisMainsCycle)
+  {
+    overvoltageMask |= phaseBit;
+  }
+  return overvoltageMask & phaseBit;
+}
+
+/**
+ * @brief Process the latest contribution after each phase specific new cycle
+ *        additional processing is performed after each main cycle based on phase 0.
+ *
+ * @tparam Phase the phase number [0..NO_OF_PHASES[
  *
  * @ingroup TimeCritical
  */
-void processStartNewCycle()
+template< uint8_t Phase >
+void processLatestContribution()
 {
-  // Restrictions apply for the period immediately after a load has been switched.
-  // Here the b_recentTransition flag is checked and updated as necessary.
-  // if (b_recentTransition)
-  //   b_recentTransition = (++postTransitionCount < POST_TRANSITION_MAX_COUNT);
-  // for optimization, the next line is equivalent to the two lines above
-  b_recentTransition &= (++postTransitionCount < POST_TRANSITION_MAX_COUNT);
+  auto &state{ phaseStates[Phase] };
+
+  // for efficiency, the energy scale is Joules * SUPPLY_FREQUENCY
+  energy_t contribution;
 
-  if (f_energyInBucket_main > f_midPointOfEnergyBucket_main)
+  if constexpr (FREQUENCY_CORRECTION)
   {
-    // the energy state is in the upper half of the working range
-    f_lowerEnergyThreshold = f_lowerThreshold_default;  // reset the "opposite" threshold
-    if (f_energyInBucket_main > f_upperEnergyThreshold)
+    // the sum over the cycle divided by the NOMINAL count is the energy at the real mains frequency,
+    // ie the average power scaled by SUPPLY_FREQUENCY / measured frequency
+    if constexpr (FIXED_POINT_ENERGY_BUCKET)
     {
-      // Because the energy level is high, some action may be required
-      proceedHighEnergyLevel();
+      contribution = (multiplyByFraction(state.sumP, NOMINAL_SAMPLE_SETS_RECIPROCAL) * fixedPointPowerCal(Phase)) >> (POWER_CAL_SHIFT - ENERGY_BUCKET_SHIFT);
     }
+    else
+    {
+      contribution = state.sumP * floatPowerCal(Phase);
+    }
+  }
+  else if constexpr (FIXED_POINT_ENERGY_BUCKET)
+  {
+    contribution = (rg_sampleSetsReciprocal.divide(state.sumP, state.samplesDuringThisMainsCycle) * fixedPointPowerCal(Phase)) >> (POWER_CAL_SHIFT - ENERGY_BUCKET_SHIFT);
   }
   else
   {
-    // the energy state is in the lower half of the working range
-    f_upperEnergyThreshold = f_upperThreshold_default;  // reset the "opposite" threshold
-    if (f_energyInBucket_main < f_lowerEnergyThreshold)
-    {
-      // Because the energy level is low, some action may be required
-      proceedLowEnergyLevel();
-    }
+    contribution = rg_sampleSetsReciprocal.divide(state.sumP, state.samplesDuringThisMainsCycle) * floatPowerCal(Phase);
   }
 
-  updatePhysicalLoadStates();  // allows the logical-to-physical mapping to be changed
+  // add the latest energy contribution to the main energy accumulator
+  energyInBucket_main += contribution;
 
-  updatePortsStates();  // update the control ports for each of the physical loads
+  if constexpr (PER_PHASE_BUCKETS)
+  {
+    energyInBucket_phase[Phase] += contribution - requiredExportPerPhase();
+  }
 
-  // Now that the energy-related decisions have been taken, min and max limits can now
-  // be applied  to the level of the energy bucket. This is to ensure correct operation
-  // when conditions change, i.e. when import changes to export, and vice versa.
-  //
-  if (f_energyInBucket_main > f_capacityOfEnergyBucket_main)
+  if constexpr (OVERVOLTAGE_BOOST)
   {
-    f_energyInBucket_main = f_capacityOfEnergyBucket_main;
+    if (isOvervoltage(Phase))
+    {
+      // the phase sees a larger surplus, so that its loads take more of the PV
+      energyInBucket_main += overvoltageBoost;
+      if constexpr (PER_PHASE_BUCKETS)
+      {
+        energyInBucket_phase[Phase] += overvoltageBoost;
+      }
+      ++n_overvoltageCycles[Phase];
+    }
   }
-  else if (f_energyInBucket_main < 0)
+
+  // apply any adjustment that is required.
+  if constexpr (0 == Phase)
   {
-    f_energyInBucket_main = 0;
+    energyInBucket_main -= requiredExport();  // energy scale is Joules x 50
+    if constexpr (COORDINATION_SECONDARY)
+    {
+      energyInBucket_main -= coordinationOffset;  // the master takes this surplus first
+    }
+    isrSignals.notifyMainsCycle();  //  a 50 Hz 'tick' for use by the main code
   }
+  // Applying max and min limits to the main accumulator's level
+  // is deferred until after the energy related decisions have been taken
+  //
 }
 
 /**
- * @brief Process the start of a new -ve half cycle, for this phase, just after the zero-crossing point.
- *
- * @param phase the phase number [0..NO_OF_PHASES[
+ * @brief Publish the power of the last second, for the relay engine
+ * @details The power is the difference of the datalog sums with the ones of the previous second,
+ *          so that nothing is added to the per-sample processing.
  *
  * @ingroup TimeCritical
  */
-void processMinusHalfCycle(const uint8_t phase)
+void processPerSecondPower()
 {
-  // This is a convenient point to update the Low Pass Filter for removing the DC
-  // component from the phase that is being processed.
-  // The portion which is fed back into the integrator is approximately one percent
-  // of the average offset of all the SampleVs in the previous mains cycle.
-  //
-  l_DCoffset_V[phase] += (l_cumVdeltasThisCycle[phase] >> 12);
-  l_cumVdeltasThisCycle[phase] = 0;
+  if (++n_cycleCountForSecond < SUPPLY_FREQUENCY)
+  {
+    return;
+  }
 
-  // To ensure that this LP filter will always start up correctly when 240V AC is
-  // available, its output value needs to be prevented from drifting beyond the likely range
-  // of the voltage signal.
-  //
-  if (l_DCoffset_V[phase] < l_DCoffset_V_min)
+  n_cycleCountForSecond = 0;
+
+  auto &snapshot{ powerSnapshots.back() };
+
+  uint8_t phase{ NO_OF_PHASES };
+  do
+  {
+    --phase;
+    auto &state{ phaseStates[phase] };
+
+    snapshot.sumP_atSupplyPoint[phase] = state.sumP_atSupplyPoint - l_sumP_atLastSecond[phase];
+    l_sumP_atLastSecond[phase] = state.sumP_atSupplyPoint;
+  } while (phase);
+
+  snapshot.sampleSets = i_sampleSetsDuringThisDatalogPeriod - i_sampleSetsAtLastSecond;
+  i_sampleSetsAtLastSecond = i_sampleSetsDuringThisDatalogPeriod;
+
+  if constexpr (COORDINATED_DIVERSION)
   {
-    l_DCoffset_V[phase] = l_DCoffset_V_min;
+    uint8_t i{ NO_OF_DUMPLOADS };
+    do
+    {
+      --i;
+      snapshot.countLoadON[i] = countLoadON[i] - countLoadON_atLastSecond[i];
+      countLoadON_atLastSecond[i] = countLoadON[i];
+    } while (i);
   }
-  else if (l_DCoffset_V[phase] > l_DCoffset_V_max)
+
+  powerSnapshots.publish();
+
+  if (beyondStartUpPeriod)
   {
-    l_DCoffset_V[phase] = l_DCoffset_V_max;
+    isrEvents.push({ Events::POWER_READY, 0 });
   }
 }
 
-#if !defined(__DOXYGEN__)
-uint8_t nextLogicalLoadToBeAdded() __attribute__((optimize("-O3")));
-#endif
 /**
- * @brief Retrieve the next load that could be added (be aware of the order)
- *
- * @return The load number if successful, NO_OF_DUMPLOADS in case of failure
+ * @brief Queue the power of the last fast-stream period, for the binary output
+ * @details Same differences of the datalog sums as processPerSecondPower().
+ *          The record is dropped when loop() has not caught up, the ISR never waits.
  *
  * @ingroup TimeCritical
  */
-uint8_t nextLogicalLoadToBeAdded()
+void processFastStream()
 {
-  for (uint8_t index = 0; index < NO_OF_DUMPLOADS; ++index)
+  if (++n_cycleCountForFastStream < FAST_STREAM_PERIOD_IN_MAINS_CYCLES)
   {
-    if (0x00 == (loadPrioritiesAndState[index] & loadStateOnBit))
-    {
-      return (index);
-    }
+    return;
   }
 
-  return (NO_OF_DUMPLOADS);
+  n_cycleCountForFastStream = 0;
+
+  FastStreamRecord record;
+
+  uint8_t phase{ NO_OF_PHASES };
+  do
+  {
+    --phase;
+    auto &state{ phaseStates[phase] };
+
+    record.sumP_atSupplyPoint[phase] = state.sumP_atSupplyPoint - l_sumP_atLastFastRecord[phase];
+    l_sumP_atLastFastRecord[phase] = state.sumP_atSupplyPoint;
+  } while (phase);
+
+  record.sampleSets = i_sampleSetsDuringThisDatalogPeriod - i_sampleSetsAtLastFastRecord;
+  i_sampleSetsAtLastFastRecord = i_sampleSetsDuringThisDatalogPeriod;
+
+  record.energyInBucket_main = energyInBucket_main;
+  record.sequence = fastStreamSequence++;
+
+  if (beyondStartUpPeriod)
+  {
+    fastStreamRecords.push(record);
+  }
 }
 
-#if !defined(__DOXYGEN__)
-uint8_t nextLogicalLoadToBeRemoved() __attribute__((optimize("-O3")));
-#endif
 /**
- * @brief Retrieve the next load that could be removed (be aware of the reverse-order)
- *
- * @return The load number if successful, NO_OF_DUMPLOADS in case of failure
+ * @brief Publish the power and the diversion of the last coordination period, for the secondary routers
+ * @details Same differences of the datalog sums as processPerSecondPower().
+ *          The loads which currently take part in the diversion are published too,
+ *          so that loop() can compute the surplus the master can still absorb.
  *
  * @ingroup TimeCritical
  */
-uint8_t nextLogicalLoadToBeRemoved()
+void processCoordination()
 {
-  uint8_t index{ NO_OF_DUMPLOADS };
+  if (++n_cycleCountForCoordination < COORDINATION_PERIOD_IN_MAINS_CYCLES)
+  {
+    return;
+  }
+
+  n_cycleCountForCoordination = 0;
+
+  auto &snapshot{ coordinationSnapshots.back() };
+
+  uint8_t phase{ NO_OF_PHASES };
+  do
+  {
+    --phase;
+    auto &state{ phaseStates[phase] };
+
+    snapshot.sumP_atSupplyPoint[phase] = state.sumP_atSupplyPoint - l_sumP_atLastCoordination[phase];
+    l_sumP_atLastCoordination[phase] = state.sumP_atSupplyPoint;
+  } while (phase);
+
+  snapshot.sampleSets = i_sampleSetsDuringThisDatalogPeriod - i_sampleSetsAtLastCoordination;
+  i_sampleSetsAtLastCoordination = i_sampleSetsDuringThisDatalogPeriod;
+
+  uint8_t availableLoadsMask{ 0 };
+  uint8_t i{ NO_OF_DUMPLOADS };
   do
   {
-    if (loadPrioritiesAndState[--index] & loadStateOnBit)
+    --i;
+    snapshot.countLoadON[i] = countLoadON[i] - countLoadON_atLastCoordination[i];
+    countLoadON_atLastCoordination[i] = countLoadON[i];
+
+    if (!b_diversionOff && !isSkippedLoad(i))
     {
-      return (index);
+      availableLoadsMask |= bit(loadPrioritiesAndState[i] & loadStateMask);
     }
-  } while (index);
-
-  return (NO_OF_DUMPLOADS);
-}
+  } while (i);
+  snapshot.availableLoadsMask = availableLoadsMask;
 
-/**
- * @brief Process the latest contribution after each phase specific new cycle
- *        additional processing is performed after each main cycle based on phase 0.
- *
- * @param phase the phase number [0..NO_OF_PHASES[
- *
- * @ingroup TimeCritical
- */
-void processLatestContribution(const uint8_t phase)
-{
-  // for efficiency, the energy scale is Joules * SUPPLY_FREQUENCY
-  // add the latest energy contribution to the main energy accumulator
-  f_energyInBucket_main += (l_sumP[phase] / n_samplesDuringThisMainsCycle[phase]) * f_powerCal[phase];
+  coordinationSnapshots.publish();
 
-  // apply any adjustment that is required.
-  if (0 == phase)
+  if (beyondStartUpPeriod)
   {
-    f_energyInBucket_main -= REQUIRED_EXPORT_IN_WATTS;  // energy scale is Joules x 50
-    b_newMainsCycle = true;                             //  a 50 Hz 'tick' for use by the main code
+    isrEvents.push({ Events::COORDINATION_READY, 0 });
   }
-  // Applying max and min limits to the main accumulator's level
-  // is deferred until after the energy related decisions have been taken
-  //
 }
 
 #if !defined(__DOXYGEN__)
@@ -656,142 +2234,332 @@ void processDataLogging() __attribute__((optimize("-O3")));
  */
 void processDataLogging()
 {
+  if constexpr (PER_SECOND_POWER)
+  {
+    processPerSecondPower();  // the datalog period is a whole number of seconds
+  }
+  if constexpr (FAST_STREAM)
+  {
+    processFastStream();  // the datalog period is a whole number of fast-stream periods
+  }
+  if constexpr (COORDINATION_MASTER)
+  {
+    processCoordination();  // the datalog period is a whole number of coordination periods
+  }
+
   if (++n_cycleCountForDatalogging < DATALOG_PERIOD_IN_MAINS_CYCLES)
   {
     return;  // data logging period not yet reached
   }
 
+  ProfiledScope< ProfiledStages::DATALOGGING > profile;
+
   n_cycleCountForDatalogging = 0;
 
+  auto &snapshot{ datalogSnapshots.back() };
+
   uint8_t phase{ NO_OF_PHASES };
   do
   {
     --phase;
-    copyOf_sumP_atSupplyPoint[phase] = l_sumP_atSupplyPoint[phase];
-    l_sumP_atSupplyPoint[phase] = 0;
+    auto &state{ phaseStates[phase] };
+
+    snapshot.sumP_atSupplyPoint[phase] = state.sumP_atSupplyPoint;
+    state.sumP_atSupplyPoint = 0;
+    l_sumP_atLastSecond[phase] = 0;
+    l_sumP_atLastFastRecord[phase] = 0;
+    l_sumP_atLastCoordination[phase] = 0;
+
+    snapshot.sum_Vsquared[phase] = state.sum_Vsquared;
+    l_sum_Vsquared_atLastCycle[phase] -= state.sum_Vsquared;  // the cycle in progress keeps its part
+    state.sum_Vsquared = 0;
 
-    copyOf_sum_Vsquared[phase] = l_sum_Vsquared[phase];
-    l_sum_Vsquared[phase] = 0;
+    snapshot.sum_Isquared[phase] = state.sum_Isquared;
+    state.sum_Isquared = 0;
+
+    if constexpr (REACTIVE_POWER)
+    {
+      snapshot.sumQ_atSupplyPoint[phase] = state.sumQ_atSupplyPoint;
+      state.sumQ_atSupplyPoint = 0;
+    }
+
+    snapshot.sampleSetsOfCompleteCycles[phase] = i_sampleSetsOfCompleteCycles[phase];
+    i_sampleSetsOfCompleteCycles[phase] = 0;
+
+    snapshot.completeCycles[phase] = n_completeCycles[phase];
+    n_completeCycles[phase] = 0;
+
+    snapshot.overvoltageCycles[phase] = n_overvoltageCycles[phase];
+    n_overvoltageCycles[phase] = 0;
   } while (phase);
 
   uint8_t i{ NO_OF_DUMPLOADS };
   do
   {
     --i;
-    copyOf_countLoadON[i] = countLoadON[i];
+    snapshot.countLoadON[i] = countLoadON[i];
     countLoadON[i] = 0;
+    countLoadON_atLastSecond[i] = 0;
+    countLoadON_atLastCoordination[i] = 0;
   } while (i);
 
-  copyOf_sampleSetsDuringThisDatalogPeriod = i_sampleSetsDuringThisDatalogPeriod;  // (for diags only)
-  copyOf_lowestNoOfSampleSetsPerMainsCycle = n_lowestNoOfSampleSetsPerMainsCycle;  // (for diags only)
-  copyOf_energyInBucket_main = f_energyInBucket_main;                              // (for diags only)
+  if constexpr (LOAD_POWER_LEARNING)
+  {
+    for (uint8_t load = 0; load != NO_OF_DUMPLOADS; ++load)
+    {
+      snapshot.learnedLoadPower[load] = loadPowerLearning.get_power(load);
+    }
+  }
+
+  if constexpr (PWM_OUTPUT)
+  {
+    snapshot.sumPwmOutputDuty = l_sumPwmOutputDuty;
+    l_sumPwmOutputDuty = 0;
+  }
+
+  for (uint8_t extra = 0; extra != NO_OF_EXTRA_CHANNELS; ++extra)
+  {
+    snapshot.sumExtra[extra] = l_sumExtra[extra];
+    l_sumExtra[extra] = 0;
+  }
+
+  snapshot.sampleSetsDuringThisDatalogPeriod = i_sampleSetsDuringThisDatalogPeriod;  // (for diags only)
+  snapshot.lowestNoOfSampleSetsPerMainsCycle = n_lowestNoOfSampleSetsPerMainsCycle;  // (for diags only)
+  snapshot.energyInBucket_main = energyInBucket_main;                                // (for diags only)
+  if constexpr (HARMONIC_ANALYSIS)
+  {
+    fundamentalAnalysis.copyAndReset();
+  }
+  if constexpr (SOFTWARE_PLL)
+  {
+    snapshot.pllPeriod = pll.isLocked() ? pll.get_period() : 0;  // (for diags only)
+  }
+  if constexpr (METER_PULSE_INPUT)
+  {
+    const uint16_t pulses{ meterPulseCount };  // the pulse interrupt cannot fire within this ISR
+    snapshot.meterPulses = pulses - meterPulsesAtLastDatalog;
+    meterPulsesAtLastDatalog = pulses;
+  }
+  datalogSnapshots.publish();
 
   n_lowestNoOfSampleSetsPerMainsCycle = UINT8_MAX;
   i_sampleSetsDuringThisDatalogPeriod = 0;
+  i_sampleSetsAtLastSecond = 0;
+  i_sampleSetsAtLastFastRecord = 0;
+  i_sampleSetsAtLastCoordination = 0;
 
   // signal the main processor that logging data are available
   // we skip the period from start to running stable
-  b_datalogEventPending = beyondStartUpPeriod;
+  if (beyondStartUpPeriod)
+  {
+    isrSignals.notifyDatalog();
+  }
 }
 
 /**
  * @brief Process the start of a new +ve half cycle, for this phase, just after the zero-crossing point.
  *
- * @param phase the phase number [0..NO_OF_PHASES[
+ * @tparam Phase the phase number [0..NO_OF_PHASES[
  *
  * @ingroup TimeCritical
  */
-void processPlusHalfCycle(const uint8_t phase)
+template< uint8_t Phase >
+void processPlusHalfCycle()
 {
-  processLatestContribution(phase);  // runs at 6.6 ms intervals
+  auto &state{ phaseStates[Phase] };
+
+  processLatestContribution< Phase >();  // runs at 6.6 ms intervals
+
+  // the mains period of this phase, in sample sets, is accumulated for the frequency measurement
+  i_sampleSetsOfCompleteCycles[Phase] += state.samplesDuringThisMainsCycle;
+  ++n_completeCycles[Phase];
+
+  if constexpr (HARMONIC_ANALYSIS)
+  {
+    fundamentalAnalysis.processCycleEnd(Phase, state.samplesDuringThisMainsCycle);
+  }
+
+  // a cycle out of the range of the reciprocals is the sign of a disturbed zero-crossing detection
+  if ((state.samplesDuringThisMainsCycle < EXPECTED_SAMPLE_SETS_PER_MAINS_CYCLE - 4) || (state.samplesDuringThisMainsCycle > EXPECTED_SAMPLE_SETS_PER_MAINS_CYCLE + 4))
+  {
+    isrEvents.push({ Events::POLARITY_ANOMALY, Phase });
+  }
 
   // A performance check to monitor and display the minimum number of sets of
   // ADC samples per mains cycle, the expected number being 20ms / (104us * 6) = 32.05
+  // when free-running, SAMPLE_SETS_PER_MAINS_CYCLE when triggered by Timer1
   //
-  if (0 == phase)
+  if constexpr (0 == Phase)
   {
-    if (n_samplesDuringThisMainsCycle[phase] < n_lowestNoOfSampleSetsPerMainsCycle)
+    if (state.samplesDuringThisMainsCycle < n_lowestNoOfSampleSetsPerMainsCycle)
     {
-      n_lowestNoOfSampleSetsPerMainsCycle = n_samplesDuringThisMainsCycle[phase];
+      n_lowestNoOfSampleSetsPerMainsCycle = state.samplesDuringThisMainsCycle;
     }
 
     processDataLogging();
   }
 
-  l_sumP[phase] = 0;
-  n_samplesDuringThisMainsCycle[phase] = 0;
+  state.sumP = 0;
+  state.samplesDuringThisMainsCycle = 0;
 }
 
 /**
  * @brief This routine is called by the ISR when a pair of V & I sample becomes available.
  *
- * @param phase the phase number [0..NO_OF_PHASES[
+ * @tparam Phase the phase number [0..NO_OF_PHASES[
  *
  * @ingroup TimeCritical
  */
-void processRawSamples(const uint8_t phase)
+template< uint8_t Phase >
+void processRawSamples()
 {
   // The raw V and I samples are processed in "phase pairs"
-  const auto &lastPolarity{ polarityConfirmedOfLastSampleV[phase] };
-
-  if (Polarities::POSITIVE == polarityConfirmed[phase])
+  switch (polarityTransition(Phase))
   {
-    // the polarity of this sample is positive
-    if (Polarities::POSITIVE != lastPolarity)
-    {
+    case PolarityTransitions::START_POSITIVE:
+      if constexpr (SOFTWARE_PLL && 0 == Phase)
+      {
+        pll.confirmCrossing();
+      }
+
       // This is the start of a new +ve half cycle, for this phase, just after the zero-crossing point.
       if (beyondStartUpPeriod)
       {
-        processPlusHalfCycle(phase);
+        processPlusHalfCycle< Phase >();
       }
       else
       {
-        processStartUp(phase);
+        processStartUp(Phase);
       }
-    }
+      [[fallthrough]];
 
-    // still processing samples where the voltage is POSITIVE ...
-    // check to see whether the trigger device can now be reliably armed
-    if ((0 == phase) && beyondStartUpPeriod && (2 == n_samplesDuringThisMainsCycle[0]))  // lower value for larger sample set
-    {
-      // This code is executed once per 20mS, shortly after the start of each new mains cycle on phase 0.
-      processStartNewCycle();
-    }
-  }
-  else
-  {
-    // the polarity of this sample is negative
-    if (Polarities::NEGATIVE != lastPolarity)
-    {
+    case PolarityTransitions::STILL_POSITIVE:
+      // still processing samples where the voltage is POSITIVE ...
+      // check to see whether the trigger device can now be reliably armed
+      // (when locked, the PLL takes over, see processVoltageRawSample)
+      if constexpr (0 == Phase)
+      {
+        if (beyondStartUpPeriod && !(SOFTWARE_PLL && pll.isLocked()) && (2 == phaseStates[0].samplesDuringThisMainsCycle))  // lower value for larger sample set
+        {
+          // This code is executed once per 20mS, shortly after the start of each new mains cycle on phase 0.
+          processStartNewCycle();
+        }
+      }
+      break;
+
+    case PolarityTransitions::START_NEGATIVE:
       // This is the start of a new -ve half cycle (just after the zero-crossing point)
-      processMinusHalfCycle(phase);
-    }
+      processMinusHalfCycle(Phase);
+      break;
+
+    case PolarityTransitions::STILL_NEGATIVE:
+      break;
   }
 }
 
 /**
  * @brief Process the current voltage raw sample for the specific phase
  *
- * @param phase the phase number [0..NO_OF_PHASES[
+ * @tparam Phase the phase number [0..NO_OF_PHASES[
  * @param rawSample the current sample for the specified phase
  *
  * @ingroup TimeCritical
  */
-void processVoltageRawSample(const uint8_t phase, const int16_t rawSample)
+template< uint8_t Phase >
+void processVoltageRawSample(const int16_t rawSample)
 {
-  processPolarity(phase, rawSample);
-  confirmPolarity(phase);
+  ProfiledScope< ProfiledStages::VOLTAGE > profile;
+
+  if constexpr (RAW_SAMPLES_CAPTURE)
+  {
+    rawSamplesCapture.store(Phase << 1, rawSample);
+  }
+
+  if constexpr (SOFTWARE_PLL && 0 == Phase)
+  {
+    const int32_t previousV{ phaseStates[0].sampleVminusDC };
+    processPolarity(0, rawSample);
+    b_pllTrigger = pll.tick(previousV, phaseStates[0].sampleVminusDC);
+  }
+  else
+  {
+    processPolarity(Phase, rawSample);
+  }
+  confirmPolarity(Phase);
   //
-  processRawSamples(phase);  // deals with aspects that only occur at particular stages of each mains cycle
+  processRawSamples< Phase >();  // deals with aspects that only occur at particular stages of each mains cycle
   //
-  processVoltage(phase);
+  processVoltage(Phase);
 
-  if (phase == 0)
+  if constexpr (0 == Phase)
   {
+    if constexpr (SOFTWARE_PLL)
+    {
+      if (b_pllTrigger && beyondStartUpPeriod)
+      {
+        // This code is executed once per mains cycle, at a fixed point after the predicted crossing on phase 0.
+        b_pllTrigger = false;
+        processStartNewCycle();
+      }
+    }
+
     ++i_sampleSetsDuringThisDatalogPeriod;
   }
 }
 
+/**
+ * @brief Dispatch the sample of slot 'index' to its processing function
+ * @details The unrolled dispatch lives here, next to the handlers of each phase:
+ *          it instantiates exactly those the schedule needs, whatever NO_OF_PHASES.
+ *
+ * @param index The slot of the sample, updated with the next slot
+ * @param rawSample The raw sample
+ *
+ * @ingroup TimeCritical
+ */
+void dispatchAdcSample(uint8_t &index, const int16_t rawSample)
+{
+  dispatchSlotSample(index, rawSample);
+}
+
+/**
+ * @brief Process a block of sample sets
+ *
+ * @param samples The raw samples, interleaved in the order of the channels (V1, I1, V2, I2, ..., extra channels)
+ * @param noOfSampleSets The number of complete sample sets of the block (raw sets, before any decimation)
+ */
+void processAdcBlock(const int16_t *samples, uint16_t noOfSampleSets)
+{
+  while (noOfSampleSets--)
+  {
+    processAdcSampleSet(samples);
+    samples += adcSchedule.channels;
+  }
+}
+
+/**
+ * @brief Process the current raw sample of one extra channel
+ * @details The raw values are summed over the datalog period, the average is
+ *          sumExtra / sampleSetsDuringThisDatalogPeriod (ADC steps).
+ *
+ * @param extra the extra channel [0..NO_OF_EXTRA_CHANNELS[
+ * @param rawSample the current sample of this channel
+ *
+ * @ingroup TimeCritical
+ */
+void processExtraRawSample(const uint8_t extra, const int16_t rawSample)
+{
+  if constexpr (RAW_SAMPLES_CAPTURE)
+  {
+    rawSamplesCapture.store(2 * NO_OF_PHASES + extra, rawSample);
+  }
+
+  if constexpr (NO_OF_EXTRA_CHANNELS)
+  {
+    l_sumExtra[extra] += rawSample;
+  }
+}
+
 /**
  * @brief Print the settings used for the selected output mode.
  *
@@ -800,7 +2568,7 @@ void printParamsForSelectedOutputMode()
 {
   // display relevant settings for selected output mode
   DBUG(F("Output mode:    "));
-  if (OutputModes::NORMAL == outputMode)
+  if (OutputModes::NORMAL == currentOutputMode())
   {
     DBUGLN(F("normal"));
   }
@@ -810,10 +2578,29 @@ void printParamsForSelectedOutputMode()
     DBUG(F("\toffsetOfEnergyThresholds  = "));
     DBUGLN(f_offsetOfEnergyThresholdsInAFmode);
   }
-  DBUG(F("\tf_capacityOfEnergyBucket_main = "));
-  DBUGLN(f_capacityOfEnergyBucket_main);
-  DBUG(F("\tf_lowerEnergyThreshold   = "));
-  DBUGLN(f_lowerThreshold_default);
-  DBUG(F("\tf_upperEnergyThreshold   = "));
-  DBUGLN(f_upperThreshold_default);
+  if constexpr (ControllerStrategies::PREDICTIVE == controllerStrategy)
+  {
+    DBUG(F("\tpredictive controller, horizon = "));
+    DBUGLN(PREDICTION_HORIZON);
+  }
+  if constexpr (NO_OF_BURST_FIRE_LOADS)
+  {
+    DBUG(F("\tburst-fire loads = "));
+    DBUGLN(NO_OF_BURST_FIRE_LOADS);
+  }
+  if constexpr (PER_PHASE_BUCKETS)
+  {
+    DBUGLN(F("\tone energy bucket per phase"));
+  }
+  if constexpr (FIXED_POINT_ENERGY_BUCKET)
+  {
+    DBUG(F("\tfixed-point energy bucket, Q"));
+    DBUGLN(ENERGY_BUCKET_SHIFT);
+  }
+  DBUG(F("\tcapacityOfEnergyBucket_main = "));
+  DBUGLN(capacityOfEnergyBucket_main);
+  DBUG(F("\tlowerEnergyThreshold   = "));
+  DBUGLN(lowerThresholdDefault());
+  DBUG(F("\tupperEnergyThreshold   = "));
+  DBUGLN(upperThresholdDefault());
 }
@@ -13,36 +13,254 @@
 #define _PROCESSING_H
 
 #include "config.h"
+#include "hal.h"
+#include "utils_capture.h"
+#include "utils_events.h"
+
+/** type of the energy bucket, either float or fixed-point (see FIXED_POINT_ENERGY_BUCKET) */
+using energy_t = conditional< FIXED_POINT_ENERGY_BUCKET, int32_t, float >::type;
+
+inline constexpr uint8_t ENERGY_BUCKET_SHIFT{ 8 }; /**< Q-format of the fixed-point energy bucket (units of 1/256) */
+inline constexpr uint8_t POWER_CAL_SHIFT{ 15 };    /**< scaling of the pre-scaled power calibration */
+
+inline constexpr uint8_t POST_TRANSITION_MAX_COUNT{ 3 }; /**< mains cycles allowing each transition to take effect */
+// inline constexpr uint8_t POST_TRANSITION_MAX_COUNT{50}; /**< for testing only */
+
+inline constexpr uint8_t QUADRATURE_DELAY{ static_cast< uint8_t >(NOMINAL_SAMPLE_SETS_PER_MAINS_CYCLE / 4 + 0.5F) }; /**< delay of the voltage for the reactive power, in sample sets */
+inline constexpr float QUADRATURE_ANGLE{ 2 * PI * QUADRATURE_DELAY / NOMINAL_SAMPLE_SETS_PER_MAINS_CYCLE };      /**< actual phase shift of the delayed voltage, ~PI/2 */
+
+/** converts energy bucket values to Joules (for display only) */
+inline constexpr float f_energyBucketToJoules{ FIXED_POINT_ENERGY_BUCKET ? invSUPPLY_FREQUENCY / (1UL << ENERGY_BUCKET_SHIFT) : invSUPPLY_FREQUENCY };
+
+/**
+ * @brief Convert a value with units of Joules * SUPPLY_FREQUENCY into energy bucket units
+ *
+ * @param value The value to convert
+ * @return constexpr energy_t The value in energy bucket units
+ */
+inline constexpr energy_t toEnergyUnits(const float value)
+{
+  if constexpr (FIXED_POINT_ENERGY_BUCKET)
+  {
+    return static_cast< int32_t >(value * (1UL << ENERGY_BUCKET_SHIFT) + (value < 0 ? -0.5F : 0.5F));
+  }
+  else
+  {
+    return value;
+  }
+}
 
 // analogue input pins
 inline constexpr uint8_t sensorV[NO_OF_PHASES]{ 0, 2, 4 }; /**< for 3-phase PCB, voltage measurement for each phase */
 inline constexpr uint8_t sensorI[NO_OF_PHASES]{ 1, 3, 5 }; /**< for 3-phase PCB, current measurement for each phase */
+inline constexpr uint8_t sensorExtra[EXTRA_CHANNELS_SIZE]{};  /**< extra analog inputs (e.g. a 4th CT on A6), sampled after the phases */
 // ------------------------------------------
 
 inline uint8_t loadPrioritiesAndState[NO_OF_DUMPLOADS]; /**< load priorities */
 
+inline constexpr OutputModes outputMode{ OutputModes::NORMAL }; /**< Output mode to be used, the one at start-up with RUNTIME_PARAMETERS (see utils_params.h) */
+
 inline constexpr uint8_t PERSISTENCE_FOR_POLARITY_CHANGE{ 2 }; /**< allows polarity changes to be confirmed */
 
 inline constexpr uint16_t initialDelay{ 3000 };  /**< in milli-seconds, to allow time to open the Serial monitor */
-inline constexpr uint16_t startUpPeriod{ 3000 }; /**< in milli-seconds, to allow LP filter to settle */
+inline constexpr uint16_t startUpPeriod{ 3000 }; /**< in milli-seconds, upper bound for the LP filter to settle */
+
+inline constexpr uint8_t startUpDCoffsetTolerance{ 2 }; /**< in ADC counts, mean offset of the voltage samples for a settled LP filter */
+inline constexpr uint8_t startUpSettledCycles{ 10 };    /**< mains cycles of each window over which the mean offset is checked */
+
+/**
+ * @brief State of one phase, updated by the ISR on each sample
+ * @details The fields used on each sample are grouped, so that the ISR reaches them
+ *          from a single pointer with a displacement (LDD/STD on the AVR, at most 63 bytes),
+ *          instead of computing the address of each array entry.
+ *
+ */
+struct PhaseState
+{
+  int32_t sampleVminusDC;              /**< current raw voltage sample filtered */
+  int32_t lastSampleVminusDC;          /**< previous raw voltage sample filtered, for the phase calibration */
+  int32_t DCoffset_V;                  /**< output of the LPF which determines DC offset (voltage) */
+  int32_t cumVdeltasThisCycle;         /**< for the LPF which determines DC offset (voltage) */
+  int32_t sumP;                        /**< cumulative power during the mains cycle */
+  int32_t sumP_atSupplyPoint;          /**< for summation of 'real power' values during datalog period */
+  int32_t sum_Vsquared;                /**< for summation of V^2 values during datalog period */
+  int32_t sum_Isquared;                /**< for summation of I^2 values during datalog period */
+  int32_t sumQ_atSupplyPoint;          /**< for summation of 'quadrature power' values during datalog period (see REACTIVE_POWER) */
+  int32_t lpf_long;                    /**< LPF offsetting the behaviour of the CT as a HPF (see LPF_COMPENSATION) */
+  uint8_t samplesDuringThisMainsCycle; /**< number of sample sets during the mains cycle */
+  uint8_t polarity;                    /**< for zero-crossing detection, POLARITY_xxx bits and persistence counter */
+};
+
+static_assert(sizeof(PhaseState) <= 64, "PhaseState must stay within the reach of a pointer displacement");
 
 // for interaction between the main processor and the ISR
 inline volatile uint32_t absenceOfDivertedEnergyCount{ 0 }; /**< number of main cycles without diverted energy */
-inline volatile bool b_datalogEventPending{ false };        /**< async trigger to signal datalog is available */
-inline volatile bool b_newMainsCycle{ false };              /**< async trigger to signal start of new main cycle based on first phase */
-inline volatile bool b_overrideLoadOn[NO_OF_DUMPLOADS];     /**< async trigger to force specific load(s) to ON */
-inline volatile bool b_reOrderLoads{ false };               /**< async trigger for loads re-ordering */
-inline volatile bool b_diversionOff{ false };               /**< async trigger to stop diversion */
-
-// since there's no real locking feature for shared variables, a couple of data
-// generated from inside the ISR are copied from time to time to be passed to the
-// main processor. When the data are available, the ISR signals it to the main processor.
-inline volatile int32_t copyOf_sumP_atSupplyPoint[NO_OF_PHASES];   /**< copy of cumulative power per phase */
-inline volatile int32_t copyOf_sum_Vsquared[NO_OF_PHASES];         /**< copy of for summation of V^2 values during datalog period */
-inline volatile float copyOf_energyInBucket_main;                  /**< copy of main energy bucket (over all phases) */
-inline volatile uint8_t copyOf_lowestNoOfSampleSetsPerMainsCycle;  /**< copy of a mechanism to check the integrity of this code structure */
-inline volatile uint16_t copyOf_sampleSetsDuringThisDatalogPeriod; /**< copy of for counting the sample sets during each datalogging period */
-inline volatile uint16_t copyOf_countLoadON[NO_OF_DUMPLOADS];      /**< copy of number of cycle the load was ON (over 1 datalog period) */
+inline uint8_t requestedPriorities[NO_OF_DUMPLOADS];          /**< loads by decreasing priority, written by loop() in an ATOMIC_BLOCK before Commands::SET_PRIORITIES */
+// all the other events and commands go through 'isrEvents' and 'isrCommands' (see utils_events.h)
+
+/**
+ * @brief Data of one datalog period, passed by the ISR to the main processor
+ *
+ */
+struct DatalogSnapshot
+{
+  int32_t sumP_atSupplyPoint[NO_OF_PHASES];            /**< cumulative power per phase */
+  int32_t sum_Vsquared[NO_OF_PHASES];                  /**< summation of V^2 values during datalog period */
+  int32_t sum_Isquared[NO_OF_PHASES];                  /**< summation of I^2 values during datalog period */
+  int32_t sumQ_atSupplyPoint[NO_OF_PHASES];            /**< cumulative quadrature power per phase */
+  int32_t sumExtra[EXTRA_CHANNELS_SIZE];               /**< summation of the raw samples of each extra channel */
+  energy_t energyInBucket_main;                        /**< main energy bucket (over all phases) */
+  uint16_t sampleSetsDuringThisDatalogPeriod;          /**< number of sample sets during the datalogging period */
+  uint16_t countLoadON[NO_OF_DUMPLOADS];               /**< number of cycle the load was ON (over 1 datalog period) */
+  uint32_t sumPwmOutputDuty;                           /**< sum of the duty of the PWM output over the mains cycles of the datalog period (see PWM_OUTPUT) */
+  int16_t learnedLoadPower[NO_OF_DUMPLOADS];           /**< learned power of each load in W (see load_learning.h) */
+  uint16_t sampleSetsOfCompleteCycles[NO_OF_PHASES];   /**< sample sets of all complete mains cycles during datalog period */
+  uint16_t completeCycles[NO_OF_PHASES];               /**< number of complete mains cycles during datalog period */
+  uint16_t overvoltageCycles[NO_OF_PHASES];            /**< number of mains cycles with the diversion boosted during datalog period (see OVERVOLTAGE_BOOST) */
+  uint16_t pllPeriod;                                  /**< mains period from the PLL (1/256 sample set), 0 if not locked */
+  uint16_t meterPulses;                                /**< pulses of the utility meter during datalog period (see METER_PULSE_INPUT) */
+  uint8_t lowestNoOfSampleSetsPerMainsCycle;           /**< a mechanism to check the integrity of this code structure */
+};
+
+/**
+ * @brief Power at the supply point during the last second, passed by the ISR to the main processor
+ * @details Only used when the relay engine is fed every second (see PER_SECOND_POWER).
+ *
+ */
+struct PowerSnapshot
+{
+  int32_t sumP_atSupplyPoint[NO_OF_PHASES]; /**< cumulative power per phase */
+  uint16_t sampleSets;                      /**< number of sample sets during the last second */
+  uint16_t countLoadON[NO_OF_DUMPLOADS];    /**< number of cycle the load was ON during the last second (see COORDINATED_DIVERSION) */
+};
+
+/**
+ * @brief Power at the supply point and diversion during the last coordination period, passed by the ISR to the main processor
+ * @details Only used by the master of several routers (see utils_coordination.h).
+ *
+ */
+struct CoordinationSnapshot
+{
+  int32_t sumP_atSupplyPoint[NO_OF_PHASES]; /**< cumulative power per phase */
+  uint16_t sampleSets;                      /**< number of sample sets during the period */
+  uint16_t countLoadON[NO_OF_DUMPLOADS];    /**< number of cycle the load was ON during the period */
+  uint8_t availableLoadsMask;               /**< loads taking part in the diversion at the end of the period, one bit per load */
+};
+
+/**
+ * @brief Power at the supply point during the last fast-stream period, queued by the ISR for loop()
+ * @details Only used with FAST_STREAM_PERIOD_IN_MAINS_CYCLES (see utils_frame.h).
+ *
+ */
+struct FastStreamRecord
+{
+  int32_t sumP_atSupplyPoint[NO_OF_PHASES]; /**< cumulative power per phase */
+  uint16_t sampleSets;                      /**< number of sample sets during the period */
+  energy_t energyInBucket_main;             /**< main energy bucket at the end of the period */
+  uint8_t sequence;                         /**< incremented on each period, to detect the dropped records */
+};
+
+/** Reason of a load transition, see TRANSITION_LOG */
+enum class TransitionReasons : uint8_t
+{
+  THRESHOLD,     /**< the energy level has crossed a threshold */
+  THERMOSTAT,    /**< probe of an open thermostat (see THERMOSTAT_DETECTION) */
+  OVERRIDE,      /**< the override of the load has changed */
+  DIVERSION_OFF, /**< the diversion has been stopped or restarted */
+  ROTATION,      /**< the load priorities have been rotated */
+  TEMPERATURE,   /**< the load has reached its target temperature (see TEMPERATURE_TARGETS) */
+  CALIBRATION    /**< the load is switched by the auto-calibration (see AUTO_CALIBRATION) */
+};
+
+/**
+ * @brief One load transition, queued by the ISR for loop()
+ * @details Only used with TRANSITION_LOG.
+ *
+ */
+struct LoadTransitionRecord
+{
+  uint16_t cycle;            /**< mains cycle of the transition (free-running) */
+  uint8_t load;              /**< load number | (state << 7) */
+  TransitionReasons reason;  /**< why the load has been switched */
+  energy_t energyInBucket;   /**< bucket at the time of the decision (of the phase of the load with PER_PHASE_BUCKETS) */
+};
+
+/**
+ * @brief Double-buffered exchange of the snapshots, from the ISR to the main processor
+ * @details The ISR fills the back buffer then publishes it by incrementing the sequence,
+ *          the main processor copies the front buffer and retries if the sequence has changed meanwhile.
+ *          Only the sequence is volatile, the ISR writes the snapshot without any volatile overhead.
+ *
+ * @tparam T Type of the snapshot
+ */
+template< typename T >
+class Snapshots
+{
+public:
+  /**
+   * @brief Get the buffer to be filled by the ISR
+   *
+   * @return T& the back buffer
+   *
+   * @ingroup TimeCritical
+   */
+  T &back()
+  {
+    return buffers[(sequence + 1) & 1];
+  }
+
+  /**
+   * @brief Publish the back buffer
+   *
+   * @ingroup TimeCritical
+   */
+  void publish()
+  {
+    halMemoryBarrier();  // the snapshot must be complete before being published
+    ++sequence;
+  }
+
+  /**
+   * @brief Copy the latest published snapshot
+   *
+   * @param snapshot The destination
+   */
+  void read(T &snapshot) const
+  {
+    uint8_t seq;
+    do
+    {
+      seq = sequence;
+      halMemoryBarrier();
+      snapshot = buffers[seq & 1];
+      halMemoryBarrier();
+    } while (seq != sequence);
+  }
+
+private:
+  T buffers[2]{};                 /**< front and back buffers */
+  volatile uint8_t sequence{ 0 }; /**< the front buffer is buffers[sequence & 1] */
+};
+
+inline Snapshots< DatalogSnapshot > datalogSnapshots; /**< written by the ISR, read by the main processor */
+inline DatalogSnapshot datalogSnapshot;               /**< copy of the latest datalog period, owned by the main processor */
+
+inline constexpr bool PER_SECOND_POWER{ RELAY_DIVERSION && (1 == relays.get_input_period()) }; /**< the ISR aggregates the power of each second for the relay engine */
+
+inline Snapshots< PowerSnapshot > powerSnapshots; /**< written by the ISR every second, read by the main processor */
+
+inline constexpr bool COORDINATION_MASTER{ RouterRoles::MASTER == ROUTER_ROLE };       /**< the ISR aggregates the power and the diversion of each coordination period */
+inline constexpr bool COORDINATION_SECONDARY{ RouterRoles::SECONDARY == ROUTER_ROLE }; /**< the ISR offsets the energy bucket by the surplus left to the master */
+
+inline Snapshots< CoordinationSnapshot > coordinationSnapshots; /**< written by the ISR every coordination period, read by the main processor */
+
+inline constexpr bool FAST_STREAM{ FAST_STREAM_PERIOD_IN_MAINS_CYCLES != 0 }; /**< the ISR aggregates the power of each fast-stream period for the binary output */
+
+inline SpscQueue< FastStreamRecord, FAST_STREAM_QUEUE_SIZE > fastStreamRecords; /**< written by the ISR, dropped when full, read by loop() */
+
+inline SpscQueue< LoadTransitionRecord, TRANSITION_LOG_QUEUE_SIZE > loadTransitions; /**< written by the ISR, dropped when full, read by loop() (see TRANSITION_LOG) */
+
+inline RawSamplesCapture< RAW_CAPTURE_SAMPLE_SETS > rawSamplesCapture; /**< raw-sample capture, shared with the ISR */
 
 #ifdef TEMP_ENABLED
 inline PayloadTx_struct< NO_OF_PHASES, temperatureSensing.get_size() > tx_data; /**< logging data */
@@ -52,42 +270,90 @@ inline PayloadTx_struct< NO_OF_PHASES > tx_data; /**< logging data */
 
 void initializeProcessing();
 void initializeOptionalPins();
+void restartAdc();
+void updateIsrCalibration(const float (&powerCal)[NO_OF_PHASES], const float (&voltageCal)[NO_OF_PHASES], int16_t requiredExportInWatts, OutputModes mode);
+void setCoordinationOffset(int16_t offsetInWatts);
 void updatePhysicalLoadStates();
 void updatePortsStates();
 void printParamsForSelectedOutputMode();
 
-void processCurrentRawSample(uint8_t phase, int16_t rawSample);
-void processVoltageRawSample(uint8_t phase, int16_t rawSample);
-void processRawSamples(uint8_t phase);
+template< uint8_t Phase >
+void processCurrentRawSample(int16_t rawSample);
+template< uint8_t Phase >
+void processVoltageRawSample(int16_t rawSample);
+
+void processExtraRawSample(uint8_t extra, int16_t rawSample);
+template< uint8_t Phase >
+void processRawSamples();
 
 void processVoltage(uint8_t phase);
 
 #if defined(__DOXYGEN__)
+inline bool isDCoffsetSettled();
 inline void processStartUp(uint8_t phase);
 inline void processStartNewCycle();
-inline void processPlusHalfCycle(uint8_t phase);
+template< uint8_t Phase >
+inline void processPlusHalfCycle();
 inline void processMinusHalfCycle(uint8_t phase);
 inline void processVoltage(uint8_t phase);
 inline void processPolarity(uint8_t phase, int16_t rawSample);
 inline void confirmPolarity(uint8_t phase);
-inline void proceedLowEnergyLevel();
-inline void proceedHighEnergyLevel();
+inline PolarityTransitions polarityTransition(uint8_t phase);
+inline void proceedLowEnergyLevel(energy_t level);
+inline void proceedHighEnergyLevel(energy_t level);
+inline energy_t controlledEnergyLevel();
+inline bool isSkippedLoad(uint8_t index);
+inline void proceedSaturatedLoads();
+inline void proceedBurstFireLoads();
+inline void proceedPwmOutput();
+inline int32_t powerBalanceOfLastCycle();
+inline int32_t ratedPowerOfLogicalLoad(uint8_t index);
 inline uint8_t nextLogicalLoadToBeAdded();
 inline uint8_t nextLogicalLoadToBeRemoved();
-inline void processLatestContribution(uint8_t phase);
+inline uint8_t bestFittingLoadToBeAdded(int32_t surplus);
+inline uint8_t bestFittingLoadToBeRemoved(int32_t deficit);
+inline uint8_t loadToBeAdded(int32_t surplus);
+inline uint8_t loadToBeRemoved(int32_t deficit);
+inline uint8_t loadOfPhaseToBeSwitched(uint8_t phase, bool bAdd);
+inline void proceedPhaseBuckets();
+template< uint8_t Phase >
+inline void processLatestContribution();
+inline void processPerSecondPower();
+inline void processFastStream();
+inline void processCoordination();
 #else
+inline bool isDCoffsetSettled() __attribute__((always_inline));
 inline void processStartUp(uint8_t phase) __attribute__((always_inline));
 inline void processStartNewCycle() __attribute__((always_inline));
-inline void processPlusHalfCycle(uint8_t phase) __attribute__((always_inline));
+template< uint8_t Phase >
+inline void processPlusHalfCycle() __attribute__((always_inline));
 inline void processMinusHalfCycle(uint8_t phase) __attribute__((always_inline));
 inline void processVoltage(uint8_t phase) __attribute__((always_inline));
 inline void processPolarity(uint8_t phase, int16_t rawSample) __attribute__((always_inline));
 inline void confirmPolarity(uint8_t phase) __attribute__((always_inline));
-inline void proceedLowEnergyLevel() __attribute__((always_inline));
-inline void proceedHighEnergyLevel() __attribute__((always_inline));
+inline PolarityTransitions polarityTransition(uint8_t phase) __attribute__((always_inline));
+inline void proceedLowEnergyLevel(energy_t level) __attribute__((always_inline));
+inline void proceedHighEnergyLevel(energy_t level) __attribute__((always_inline));
+inline energy_t controlledEnergyLevel() __attribute__((always_inline));
+inline bool isSkippedLoad(uint8_t index) __attribute__((always_inline));
+inline void proceedSaturatedLoads() __attribute__((always_inline));
+inline void proceedBurstFireLoads() __attribute__((always_inline));
+inline void proceedPwmOutput() __attribute__((always_inline));
+inline int32_t powerBalanceOfLastCycle() __attribute__((always_inline));
+inline int32_t ratedPowerOfLogicalLoad(uint8_t index) __attribute__((always_inline));
 inline uint8_t nextLogicalLoadToBeAdded() __attribute__((always_inline));
 inline uint8_t nextLogicalLoadToBeRemoved() __attribute__((always_inline));
-inline void processLatestContribution(uint8_t phase) __attribute__((always_inline));
+inline uint8_t bestFittingLoadToBeAdded(int32_t surplus) __attribute__((always_inline));
+inline uint8_t bestFittingLoadToBeRemoved(int32_t deficit) __attribute__((always_inline));
+inline uint8_t loadToBeAdded(int32_t surplus) __attribute__((always_inline));
+inline uint8_t loadToBeRemoved(int32_t deficit) __attribute__((always_inline));
+inline uint8_t loadOfPhaseToBeSwitched(uint8_t phase, bool bAdd) __attribute__((always_inline));
+inline void proceedPhaseBuckets() __attribute__((always_inline));
+template< uint8_t Phase >
+inline void processLatestContribution() __attribute__((always_inline));
+inline void processPerSecondPower() __attribute__((always_inline));
+inline void processFastStream() __attribute__((always_inline));
+inline void processCoordination() __attribute__((always_inline));
 #endif
 
 void processDataLogging();
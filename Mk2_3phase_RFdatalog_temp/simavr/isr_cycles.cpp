@@ -0,0 +1,228 @@
+/**
+ * @file isr_cycles.cpp
+ * @author Frédéric Metrich (frederic.metrich@live.fr)
+ * @brief Cycle-exact measurement of the ADC interrupt of the real firmware, under simavr (env:simavr)
+ * @version 0.1
+ * @date 2024-06-10
+ *
+ * @details Build and run with:
+ *            pio run -e basic -e simavr
+ *            .pio/build/simavr/program [-s seconds] .pio/build/basic/firmware.elf
+ *
+ *          The firmware runs unchanged on a simulated ATmega328P @ 16 MHz. Each time the ADC starts
+ *          a conversion, the 6 analog inputs are set from synthetic mains waveforms at the simulated
+ *          time (V1 I1 V2 I2 V3 I3 on A0..A5, 230 V, a few amps of import).
+ *
+ *          Each invocation of ADC_vect is timed from its vector to the instruction after its RETI
+ *          (the 4 cycles of the interrupt response are not included, the RETI is). Are reported:
+ *          - the min/avg/max cycles per invocation,
+ *          - the worst total of the ISR over one mains cycle, and its share of the CPU,
+ *          - the invocations longer than the slot of one conversion (CPU_CYCLES_PER_CONVERSION),
+ *          - the flash and static RAM footprint of the ELF.
+ *
+ *          The first ones are printed as a table, then as one machine-readable line:
+ *            SIMAVR {"isr":[min,avg,max],"mainsCycleMax":n,"overSlot":n,"flash":n,"ram":n}
+ *          to be diffed with the line of a reference build (same format as the BENCH line of env:benchmark).
+ *          The exit code is 2 if any invocation has been longer than the slot, so that a CI job fails.
+ *
+ * @note The harness is a host program, linked with libsimavr (and libelf).
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <simavr/avr_adc.h>
+#include <simavr/avr_uart.h>
+#include <simavr/sim_avr.h>
+#include <simavr/sim_elf.h>
+#include <simavr/sim_irq.h>
+
+namespace
+{
+constexpr uint32_t F_CPU_HZ{ 16000000UL };        /**< clock of the Uno */
+constexpr uint8_t SUPPLY_HZ{ 50 };                /**< mains frequency of the synthetic waveforms */
+constexpr uint32_t CYCLES_PER_MAINS_CYCLE{ F_CPU_HZ / SUPPLY_HZ };
+constexpr uint16_t CONVERSION_SLOT{ 13U * 128 };  /**< CPU cycles of one conversion, free-running at clk/128 */
+constexpr avr_flashaddr_t ADC_VECTOR{ 21 * 4 };   /**< byte address of ADC_vect on the ATmega328P */
+constexpr uint8_t NO_OF_CHANNELS{ 6 };            /**< V1 I1 V2 I2 V3 I3 */
+constexpr float AREF_MV{ 5000 };                  /**< AVCC reference */
+
+/**
+ * @brief Statistics of the ISR, in CPU cycles
+ *
+ */
+struct IsrStats
+{
+  uint32_t minCycles{ UINT32_MAX }; /**< fastest invocation */
+  uint32_t maxCycles{ 0 };          /**< slowest invocation */
+  uint64_t sumCycles{ 0 };          /**< all invocations */
+  uint32_t count{ 0 };              /**< # of invocations */
+  uint32_t overSlot{ 0 };           /**< invocations longer than CONVERSION_SLOT */
+  uint32_t mainsCycleMax{ 0 };      /**< worst total over one mains cycle */
+};
+
+avr_irq_t *analogInputs[NO_OF_CHANNELS]; /**< inputs of the ADC */
+
+/**
+ * @brief Set the analog inputs at the time of the conversion which starts
+ * @details Called by simavr on ADC_IRQ_OUT_TRIGGER.
+ *
+ */
+void onConversionStart(avr_irq_t *, uint32_t, void *param)
+{
+  const avr_t *avr{ static_cast< const avr_t * >(param) };
+  const float t{ static_cast< float >(avr->cycle) / F_CPU_HZ };
+
+  for (uint8_t channel = 0; channel < NO_OF_CHANNELS; ++channel)
+  {
+    const uint8_t phase{ static_cast< uint8_t >(channel / 2) };
+    const float angle{ 2 * static_cast< float >(M_PI) * (SUPPLY_HZ * t - phase / 3.0F) };
+
+    // ~400 counts of voltage, ~100 counts of current in phase opposition (import)
+    const float counts{ (channel & 1) ? 512 - 100 * sinf(angle) : 512 + 400 * sinf(angle) };
+    avr_raise_irq(analogInputs[channel], static_cast< uint32_t >(counts * AREF_MV / 1024));
+  }
+}
+
+/**
+ * @brief Read the return address pushed by the interrupt
+ *
+ * @param avr the simulated MCU
+ * @return avr_flashaddr_t the byte address where the ISR returns
+ */
+avr_flashaddr_t returnAddress(const avr_t *avr)
+{
+  const uint16_t sp{ static_cast< uint16_t >(avr->data[R_SPL] | (avr->data[R_SPH] << 8)) };
+  return static_cast< avr_flashaddr_t >(((avr->data[sp + 1] << 8) | avr->data[sp + 2]) << 1);
+}
+}  // namespace
+
+int main(int argc, char *argv[])
+{
+  float seconds{ 12 };  // past the initial delay and the start-up of the firmware
+  const char *elf{ nullptr };
+
+  for (int i = 1; i < argc; ++i)
+  {
+    if (!strcmp(argv[i], "-s") && i + 1 < argc)
+    {
+      seconds = strtof(argv[++i], nullptr);
+    }
+    else
+    {
+      elf = argv[i];
+    }
+  }
+  if (!elf)
+  {
+    fprintf(stderr, "usage: %s [-s seconds] firmware.elf\n", argv[0]);
+    return 1;
+  }
+
+  elf_firmware_t firmware{};
+  if (elf_read_firmware(elf, &firmware))
+  {
+    fprintf(stderr, "cannot read %s\n", elf);
+    return 1;
+  }
+
+  avr_t *avr{ avr_make_mcu_by_name("atmega328p") };
+  if (!avr)
+  {
+    fprintf(stderr, "atmega328p not supported by this simavr\n");
+    return 1;
+  }
+  avr_init(avr);
+  firmware.frequency = F_CPU_HZ;
+  avr_load_firmware(avr, &firmware);
+  avr->avcc = avr->aref = static_cast< uint32_t >(AREF_MV);
+
+  // the output of the firmware is not needed
+  uint32_t uartFlags{ 0 };
+  avr_ioctl(avr, AVR_IOCTL_UART_GET_FLAGS('0'), &uartFlags);
+  uartFlags &= ~AVR_UART_FLAG_STDIO;
+  avr_ioctl(avr, AVR_IOCTL_UART_SET_FLAGS('0'), &uartFlags);
+
+  for (uint8_t channel = 0; channel < NO_OF_CHANNELS; ++channel)
+  {
+    analogInputs[channel] = avr_io_getirq(avr, AVR_IOCTL_ADC_GETIRQ, ADC_IRQ_ADC0 + channel);
+  }
+  avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_ADC_GETIRQ, ADC_IRQ_OUT_TRIGGER), onConversionStart, avr);
+
+  IsrStats stats;
+  const avr_cycle_count_t end{ static_cast< avr_cycle_count_t >(seconds * F_CPU_HZ) };
+
+  avr_cycle_count_t isrStart{ 0 };
+  avr_flashaddr_t isrReturn{ 0 };
+  bool bInIsr{ false };
+
+  avr_cycle_count_t mainsCycle{ 0 };
+  uint32_t mainsCycleTotal{ 0 };
+
+  while (avr->cycle < end)
+  {
+    const int state{ avr_run(avr) };
+    if (cpu_Done == state || cpu_Crashed == state)
+    {
+      fprintf(stderr, "the firmware has stopped (state %d)\n", state);
+      return 1;
+    }
+
+    if (!bInIsr && ADC_VECTOR == avr->pc)
+    {
+      bInIsr = true;
+      isrStart = avr->cycle;
+      isrReturn = returnAddress(avr);
+    }
+    else if (bInIsr && isrReturn == avr->pc)
+    {
+      bInIsr = false;
+
+      const uint32_t cycles{ static_cast< uint32_t >(avr->cycle - isrStart) };
+      stats.minCycles = cycles < stats.minCycles ? cycles : stats.minCycles;
+      stats.maxCycles = cycles > stats.maxCycles ? cycles : stats.maxCycles;
+      stats.sumCycles += cycles;
+      ++stats.count;
+      stats.overSlot += (cycles > CONVERSION_SLOT);
+
+      if (isrStart / CYCLES_PER_MAINS_CYCLE != mainsCycle)
+      {
+        mainsCycle = isrStart / CYCLES_PER_MAINS_CYCLE;
+        mainsCycleTotal = 0;
+      }
+      mainsCycleTotal += cycles;
+      stats.mainsCycleMax = mainsCycleTotal > stats.mainsCycleMax ? mainsCycleTotal : stats.mainsCycleMax;
+    }
+  }
+
+  if (!stats.count)
+  {
+    fprintf(stderr, "ADC_vect has never run\n");
+    return 1;
+  }
+
+  const uint32_t avgCycles{ static_cast< uint32_t >(stats.sumCycles / stats.count) };
+  const uint32_t ram{ firmware.datasize + firmware.bsssize };
+
+  printf("%s, %.1f s simulated\n", elf, seconds);
+  printf("ADC_vect     : %lu invocations, min %lu, avg %lu, max %lu cycles (slot %u)\n", static_cast< unsigned long >(stats.count),
+         static_cast< unsigned long >(stats.minCycles), static_cast< unsigned long >(avgCycles), static_cast< unsigned long >(stats.maxCycles), CONVERSION_SLOT);
+  printf("mains cycle  : worst %lu cycles in the ISR, %.1f%% of the CPU\n", static_cast< unsigned long >(stats.mainsCycleMax),
+         stats.mainsCycleMax * 100.0F / CYCLES_PER_MAINS_CYCLE);
+  printf("over the slot: %lu\n", static_cast< unsigned long >(stats.overSlot));
+  printf("footprint    : flash %lu bytes, static RAM %lu bytes\n", static_cast< unsigned long >(firmware.flashsize), static_cast< unsigned long >(ram));
+
+  printf("SIMAVR {\"isr\":[%lu,%lu,%lu],\"mainsCycleMax\":%lu,\"overSlot\":%lu,\"flash\":%lu,\"ram\":%lu}\n",
+         static_cast< unsigned long >(stats.minCycles), static_cast< unsigned long >(avgCycles), static_cast< unsigned long >(stats.maxCycles),
+         static_cast< unsigned long >(stats.mainsCycleMax), static_cast< unsigned long >(stats.overSlot),
+         static_cast< unsigned long >(firmware.flashsize), static_cast< unsigned long >(ram));
+
+  avr_terminate(avr);
+
+  return stats.overSlot ? 2 : 0;
+}
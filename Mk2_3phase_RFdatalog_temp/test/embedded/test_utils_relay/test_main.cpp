@@ -61,6 +61,16 @@ void test_get_importThreshold(void)
   TEST_ASSERT_EQUAL(20, relays.get_relay(1).get_importThreshold());
 }
 
+void test_set_thresholds(void)
+{
+  const relayOutput relay(4, 500, 100);
+  relay.set_thresholds(-800, -150);
+  TEST_ASSERT_EQUAL(800, relay.get_surplusThreshold());
+  TEST_ASSERT_EQUAL(150, relay.get_importThreshold());
+  TEST_ASSERT_EQUAL(500, relay.get_defaultSurplusThreshold());
+  TEST_ASSERT_EQUAL(100, relay.get_defaultImportThreshold());
+}
+
 void test_get_minON(void)
 {
   TEST_ASSERT_EQUAL(1 * 60, relays.get_relay(0).get_minON());
@@ -161,6 +171,7 @@ void loop()
 
   RUN_TEST(test_get_surplusThreshold);
   RUN_TEST(test_get_importThreshold);
+  RUN_TEST(test_set_thresholds);
 
   RUN_TEST(test_get_minON);
   RUN_TEST(test_get_minOFF);
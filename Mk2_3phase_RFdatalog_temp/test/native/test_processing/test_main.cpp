@@ -0,0 +1,436 @@
+/**
+ * @file test_main.cpp
+ * @author Frédéric Metrich (frederic.metrich@live.fr)
+ * @brief Unity tests of the processing engine, on the host
+ * @version 0.1
+ * @date 2024-06-08
+ *
+ * @details Run with: pio test -e native_test
+ *
+ *          The samples are synthetic sines, fed through the same dispatch as the ISR (see adc_sequencer.h),
+ *          the virtual time being advanced by one ADC conversion per sample (as in native/replay.cpp).
+ *          The engine keeps its state from one test to the next, like on the Uno: the tests run in order,
+ *          the start-up first.
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include <Arduino.h>
+
+#include <math.h>
+#include <unity.h>
+
+#include "adc_sequencer.h"
+#include "calibration.h"
+#include "processing.h"
+#include "utils_watchdog.h"
+#include "native/shims/native_time.h"
+
+extern PhaseState phaseStates[NO_OF_PHASES];
+extern bool beyondStartUpPeriod;
+extern LoadStates physicalLoadState[NO_OF_DUMPLOADS];
+
+namespace
+{
+inline constexpr unsigned long ADC_CONVERSION_TIME_US{ CPU_CYCLES_PER_CONVERSION / (F_CPU / 1000000UL) }; /**< 104 µs at clk/128 */
+inline constexpr float TWO_PI_F{ 2 * PI * SUPPLY_FREQUENCY };                                           /**< angular frequency of the mains */
+
+/**
+ * @brief Synthetic signals of the 3 phases, in ADC counts
+ *
+ */
+struct Signals
+{
+  float vAmplitude{ 400 };  /**< peak of the voltage */
+  float vMidPoint{ 512 };   /**< DC offset of the voltage */
+  float vBiasSlope{ 0 };    /**< rise of the DC offset of the voltage until it reaches 'vMidPoint' at 'vBiasSettled', in ADC counts per s */
+  float vBiasSettled{ 0 };  /**< time at which the DC offset of the voltage reaches 'vMidPoint', in s */
+  float iAmplitude{ 0 };    /**< peak of the current, in phase with the voltage: +ve for an export, -ve for an import */
+  uint8_t noise{ 0 };       /**< peak of the noise added to the voltage */
+};
+
+/**
+ * @brief What the emulated loop() has seen
+ *
+ */
+struct Observations
+{
+  uint32_t mainsCycles{ 0 };          /**< isrSignals.takeMainsCycles() */
+  uint16_t datalogs{ 0 };             /**< isrSignals.takeDatalog(), the last one is in 'datalogSnapshot' */
+  uint16_t loadsRotated{ 0 };         /**< Events::LOADS_ROTATED */
+  uint16_t transitions{ 0 };          /**< Events::LOAD_TRANSITION */
+  uint32_t lastTransitionCycle{ 0 };  /**< mains cycle of the last transition */
+  uint32_t shortestGap{ UINT32_MAX }; /**< fewest mains cycles between two transitions */
+  bool watchdogExpired{ false };      /**< the hardware watchdog would have reset the MCU */
+};
+
+uint8_t sampleIndex{ 0 };
+uint32_t noiseState{ 12345 };
+
+/**
+ * @brief Deterministic noise in [-peak..peak]
+ *
+ */
+int16_t noise(const uint8_t peak)
+{
+  if (!peak)
+  {
+    return 0;
+  }
+  noiseState = noiseState * 1103515245UL + 12345UL;
+  return static_cast< int16_t >((noiseState >> 16) % (2 * peak + 1)) - peak;
+}
+
+/**
+ * @brief Get the raw sample of a channel (V1 I1 V2 I2 V3 I3) at the current virtual time
+ *
+ */
+int16_t sampleOf(const Signals &signals, const uint8_t channel)
+{
+  const uint8_t phase{ static_cast< uint8_t >(channel / 2) };
+  const float angle{ TWO_PI_F * micros() * 1e-6F - phase * static_cast< float >(2 * PI / 3) };
+  const float wave{ sinf(angle) };
+
+  float value;
+  if (channel & 1)
+  {
+    value = 512 + signals.iAmplitude * wave;
+  }
+  else
+  {
+    const float biasDeficit{ signals.vBiasSlope * fmaxf(0, signals.vBiasSettled - micros() * 1e-6F) };
+    value = signals.vMidPoint - biasDeficit + signals.vAmplitude * wave + noise(signals.noise);
+  }
+  return static_cast< int16_t >(value < 0 ? 0 : (value > 1023 ? 1023 : lroundf(value)));
+}
+
+/**
+ * @brief Feed the engine for some mains cycles, and handle its events as loop() would
+ *
+ * @param signals The signals
+ * @param cycles # of mains cycles of phase 0
+ * @return Observations What has been seen meanwhile
+ */
+Observations run(const Signals &signals, const uint32_t cycles)
+{
+  Observations seen;
+
+  while (seen.mainsCycles < cycles)
+  {
+    for (uint8_t slot = 0; slot < adcSchedule.size; ++slot)
+    {
+      advanceMicros(ADC_CONVERSION_TIME_US);
+      ADC = sampleOf(signals, adcSchedule[slot].column);
+      dispatchAdcSample(sampleIndex, ADC);
+    }
+
+    const uint16_t mainsCycles{ isrSignals.takeMainsCycles() };
+    if (mainsCycles)
+    {
+      hardwareWatchdog.notifyMainsCycle();
+    }
+    seen.mainsCycles += mainsCycles;
+    if (isrSignals.takeDatalog())
+    {
+      datalogSnapshots.read(datalogSnapshot);
+      ++seen.datalogs;
+    }
+
+    Event event;
+    while (isrEvents.pop(event))
+    {
+      switch (event.type)
+      {
+        case Events::LOADS_ROTATED:
+          ++seen.loadsRotated;
+          break;
+        case Events::LOAD_TRANSITION:
+          if (seen.transitions && (seen.mainsCycles - seen.lastTransitionCycle < seen.shortestGap))
+          {
+            seen.shortestGap = seen.mainsCycles - seen.lastTransitionCycle;
+          }
+          seen.lastTransitionCycle = seen.mainsCycles;
+          ++seen.transitions;
+          break;
+        default:
+          break;
+      }
+    }
+
+    hardwareWatchdog.proceed();
+    seen.watchdogExpired |= nativeWdtExpired();
+  }
+  return seen;
+}
+
+/**
+ * @brief Count the loads ON
+ *
+ */
+uint8_t loadsON()
+{
+  uint8_t count{ 0 };
+  for (const auto state : physicalLoadState)
+  {
+    count += (LoadStates::LOAD_ON == state);
+  }
+  return count;
+}
+}  // namespace
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+/** A start-up which lasts until the bias of the voltage dividers has settled neither restarts the ADC nor trips the watchdog */
+void test_watchdog_through_slow_start_up(void)
+{
+  Signals signals;
+  signals.vMidPoint = 530;
+  signals.vBiasSlope = 40;  // the bias is still charging at power-up
+  signals.vBiasSettled = 5;
+
+  ADCSRA = 0;
+  hardwareWatchdog.begin();
+
+  const auto seen{ run(signals, 1) };
+
+  TEST_ASSERT_TRUE(beyondStartUpPeriod);
+  TEST_ASSERT_TRUE(millis() > 5000);  // far beyond the timeout of the watchdog
+  TEST_ASSERT_TRUE(hardwareWatchdog.isArmed());
+  TEST_ASSERT_FALSE(seen.watchdogExpired);
+  TEST_ASSERT_EQUAL_UINT8(0, ADCSRA);  // the ADC has not been restarted (see restartAdc())
+}
+
+/** The LPF of each phase converges towards the DC offset of its voltage */
+void test_dc_offset_convergence(void)
+{
+  Signals signals;
+  signals.vMidPoint = 530;
+
+  run(signals, SUPPLY_FREQUENCY * (startUpPeriod / 1000 + 2));
+
+  TEST_ASSERT_TRUE(beyondStartUpPeriod);
+  for (uint8_t phase = 0; phase < NO_OF_PHASES; ++phase)
+  {
+    TEST_ASSERT_INT32_WITHIN(256, 530L * 256, phaseStates[phase].DCoffset_V);
+  }
+}
+
+/** Noise around the zero-crossings does not add any mains cycle */
+void test_polarity_with_noisy_crossings(void)
+{
+  Signals signals;
+  signals.noise = 12;
+
+  run(signals, SUPPLY_FREQUENCY);  // back to 512, then some noise
+
+  const auto seen{ run(signals, DATALOG_PERIOD_IN_MAINS_CYCLES + 1) };
+
+  TEST_ASSERT_EQUAL_UINT16(1, seen.datalogs);
+  for (uint8_t phase = 0; phase < NO_OF_PHASES; ++phase)
+  {
+    TEST_ASSERT_UINT16_WITHIN(1, DATALOG_PERIOD_IN_MAINS_CYCLES, datalogSnapshot.completeCycles[phase]);
+  }
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT8(NOMINAL_SAMPLE_SETS_PER_MAINS_CYCLE - 2, datalogSnapshot.lowestNoOfSampleSetsPerMainsCycle);
+}
+
+/** The sums of a datalog period match the synthetic signals */
+void test_datalog_snapshot(void)
+{
+  Signals signals;
+  signals.iAmplitude = -100;  // import
+
+  run(signals, DATALOG_PERIOD_IN_MAINS_CYCLES);  // the loads are OFF now
+
+  const auto seen{ run(signals, DATALOG_PERIOD_IN_MAINS_CYCLES) };
+
+  TEST_ASSERT_EQUAL_UINT16(1, seen.datalogs);
+  TEST_ASSERT_EQUAL_UINT8(0, loadsON());
+
+  const auto sampleSets{ datalogSnapshot.sampleSetsDuringThisDatalogPeriod };
+  TEST_ASSERT_UINT16_WITHIN(sampleSets / 100, DATALOG_PERIOD_IN_SECONDS * SAMPLE_SETS_PER_SECOND, sampleSets);
+
+  const float rmsSumsScale{ DATALOG_PERIOD_IN_SECONDS > 10 ? 1.0F / 16 : 1.0F };
+  for (uint8_t phase = 0; phase < NO_OF_PHASES; ++phase)
+  {
+    TEST_ASSERT_TRUE(datalogSnapshot.sumP_atSupplyPoint[phase] < 0);  // export = +ve
+
+    const float vRms{ sqrtf(datalogSnapshot.sum_Vsquared[phase] / rmsSumsScale / sampleSets) };
+    const float iRms{ sqrtf(datalogSnapshot.sum_Isquared[phase] / rmsSumsScale / sampleSets) };
+    TEST_ASSERT_FLOAT_WITHIN(400 * 0.02F, 400 / sqrtf(2), vRms);
+    TEST_ASSERT_FLOAT_WITHIN(100 * 0.02F, 100 / sqrtf(2), iRms);
+  }
+}
+
+/** Without any power, the bucket does not move: no load is switched */
+void test_bucket_idle(void)
+{
+  Signals signals;
+
+  const auto seen{ run(signals, 5 * SUPPLY_FREQUENCY) };
+
+  TEST_ASSERT_EQUAL_UINT16(0, seen.transitions);
+  TEST_ASSERT_EQUAL_UINT8(0, loadsON());
+}
+
+/** A surplus switches the loads ON one by one, each transition is left to settle */
+void test_bucket_surplus_and_post_transition(void)
+{
+  Signals signals;
+  signals.iAmplitude = 200;  // export, way above the power of the loads (the loads do not change the signals)
+
+  const auto seen{ run(signals, 5 * SUPPLY_FREQUENCY) };
+
+  TEST_ASSERT_EQUAL_UINT8(NO_OF_DUMPLOADS, loadsON());
+  TEST_ASSERT_EQUAL_UINT16(NO_OF_DUMPLOADS, seen.transitions);
+  if constexpr (!MULTI_LOAD_SWITCHING)
+  {
+    TEST_ASSERT_TRUE(seen.shortestGap >= POST_TRANSITION_MAX_COUNT);
+  }
+
+  // the surplus is still there: the loads stay ON
+  const auto next{ run(signals, 5 * SUPPLY_FREQUENCY) };
+  TEST_ASSERT_EQUAL_UINT16(0, next.transitions);
+}
+
+/** An import switches the loads OFF, and they stay OFF */
+void test_bucket_import(void)
+{
+  Signals signals;
+  signals.iAmplitude = -200;
+
+  const auto seen{ run(signals, 5 * SUPPLY_FREQUENCY) };
+
+  TEST_ASSERT_EQUAL_UINT8(0, loadsON());
+  TEST_ASSERT_EQUAL_UINT16(NO_OF_DUMPLOADS, seen.transitions);
+}
+
+/** The priorities are rotated on request, and the rotation is reported */
+void test_rotation(void)
+{
+  if constexpr (PRIORITY_ROTATION == RotationModes::OFF)
+  {
+    TEST_IGNORE_MESSAGE("PRIORITY_ROTATION is OFF, see env:native_test_features");
+  }
+
+  uint8_t before[NO_OF_DUMPLOADS];
+  for (uint8_t i = 0; i < NO_OF_DUMPLOADS; ++i)
+  {
+    before[i] = loadPrioritiesAndState[i] & loadStateMask;
+  }
+
+  TEST_ASSERT_TRUE(isrCommands.push({ Commands::ROTATE_LOADS, 0 }));
+
+  Signals signals;
+  const auto seen{ run(signals, 2) };
+
+  TEST_ASSERT_EQUAL_UINT16(1, seen.loadsRotated);
+  for (uint8_t i = 0; i < NO_OF_DUMPLOADS; ++i)
+  {
+    TEST_ASSERT_EQUAL_UINT8(before[(i + NO_OF_DUMPLOADS - 1) % NO_OF_DUMPLOADS], loadPrioritiesAndState[i] & loadStateMask);
+  }
+}
+
+/** Above OVERVOLTAGE_LIMIT_IN_VOLTS, the phase is boosted: the loads are switched ON without any surplus */
+void test_overvoltage_boost(void)
+{
+  if constexpr (!OVERVOLTAGE_BOOST)
+  {
+    TEST_IGNORE_MESSAGE("OVERVOLTAGE_BOOST is OFF, see env:native_test_features");
+  }
+
+  Signals signals;
+  signals.vAmplitude = (OVERVOLTAGE_LIMIT_IN_VOLTS + 5) * sqrtf(2) / f_voltageCal[0];
+
+  run(signals, DATALOG_PERIOD_IN_MAINS_CYCLES);
+  const auto seen{ run(signals, DATALOG_PERIOD_IN_MAINS_CYCLES) };
+
+  TEST_ASSERT_EQUAL_UINT16(1, seen.datalogs);
+  TEST_ASSERT_TRUE(loadsON() > 0);
+  TEST_ASSERT_UINT16_WITHIN(1, DATALOG_PERIOD_IN_MAINS_CYCLES, datalogSnapshot.overvoltageCycles[0]);
+
+  // back to the nominal voltage: the boost stops
+  signals.vAmplitude = 400;
+  run(signals, DATALOG_PERIOD_IN_MAINS_CYCLES);
+  run(signals, DATALOG_PERIOD_IN_MAINS_CYCLES);
+
+  TEST_ASSERT_EQUAL_UINT16(0, datalogSnapshot.overvoltageCycles[0]);
+}
+
+/** A busy loop() loses neither the mains cycles nor the datalog, however many are pending */
+void test_signals_never_lost(void)
+{
+  isrSignals.takeMainsCycles();
+  isrSignals.takeDatalog();
+
+  for (uint16_t cycle = 0; cycle < 4 * EVENT_QUEUE_SIZE; ++cycle)
+  {
+    isrSignals.notifyMainsCycle();
+  }
+  isrSignals.notifyDatalog();
+  isrSignals.notifyDatalog();
+
+  TEST_ASSERT_EQUAL_UINT16(4 * EVENT_QUEUE_SIZE, isrSignals.takeMainsCycles());
+  TEST_ASSERT_EQUAL_UINT16(0, isrSignals.takeMainsCycles());
+  TEST_ASSERT_TRUE(isrSignals.takeDatalog());
+  TEST_ASSERT_FALSE(isrSignals.takeDatalog());
+}
+
+/** The pulses of the utility meter are latched with the datalog period in which they come */
+void test_meter_pulses(void)
+{
+  if constexpr (!METER_PULSE_INPUT)
+  {
+    TEST_IGNORE_MESSAGE("METER_PULSE_INPUT is OFF, see env:native_test_features");
+  }
+
+  initializeOptionalPins();
+  TEST_ASSERT_TRUE(externalInterrupts[digitalPinToInterrupt(meterPulsePin)] != nullptr);
+
+  Signals signals;
+  signals.iAmplitude = -100;  // import
+
+  run(signals, DATALOG_PERIOD_IN_MAINS_CYCLES);
+  for (uint8_t pulse = 0; pulse < 7; ++pulse)
+  {
+    externalInterrupts[digitalPinToInterrupt(meterPulsePin)]();
+  }
+  run(signals, DATALOG_PERIOD_IN_MAINS_CYCLES);
+
+  TEST_ASSERT_EQUAL_UINT16(7, datalogSnapshot.meterPulses);
+
+  run(signals, DATALOG_PERIOD_IN_MAINS_CYCLES);
+
+  TEST_ASSERT_EQUAL_UINT16(0, datalogSnapshot.meterPulses);
+}
+
+int main()
+{
+  if constexpr (RUNTIME_PARAMETERS)
+  {
+    updateIsrCalibration(f_powerCal, f_voltageCal, REQUIRED_EXPORT_IN_WATTS, outputMode);  // no EEPROM on the host
+  }
+  initializeProcessing();
+
+  UNITY_BEGIN();
+
+  RUN_TEST(test_watchdog_through_slow_start_up);
+  RUN_TEST(test_dc_offset_convergence);
+  RUN_TEST(test_polarity_with_noisy_crossings);
+  RUN_TEST(test_datalog_snapshot);
+  RUN_TEST(test_bucket_idle);
+  RUN_TEST(test_bucket_surplus_and_post_transition);
+  RUN_TEST(test_bucket_import);
+  RUN_TEST(test_rotation);
+  RUN_TEST(test_overvoltage_boost);
+  RUN_TEST(test_signals_never_lost);
+  RUN_TEST(test_meter_pulses);
+
+  return UNITY_END();
+}
@@ -21,11 +21,13 @@
 // -------------------------------
 // definitions of enumerated types
 
-/** Polarities */
-enum class Polarities : uint8_t
+/** Confirmed polarity of the last voltage sample of a phase, compared with the one of the sample before (see polarityTransition()) */
+enum class PolarityTransitions : uint8_t
 {
-  NEGATIVE, /**< polarity is negative */
-  POSITIVE  /**< polarity is positive */
+  STILL_NEGATIVE = 0b00, /**< negative, as before */
+  START_POSITIVE = 0b01, /**< positive, the start of a new +ve half cycle */
+  START_NEGATIVE = 0b10, /**< negative, the start of a new -ve half cycle */
+  STILL_POSITIVE = 0b11  /**< positive, as before */
 };
 
 /** Output modes */
@@ -35,6 +37,28 @@ enum class OutputModes : uint8_t
   NORMAL        /**< Normal mode */
 };
 
+/** Strategy of the energy controller */
+enum class ControllerStrategies : uint8_t
+{
+  THRESHOLDS, /**< the level of the energy bucket is compared to the thresholds */
+  PREDICTIVE  /**< the level expected when a decision takes effect is compared to the thresholds */
+};
+
+/** Control mode of each load */
+enum class LoadModes : uint8_t
+{
+  ON_OFF,    /**< the load is switched ON or OFF as a whole, with a settling period after each transition */
+  BURST_FIRE /**< the load is ON for a fraction of the mains cycles, spread evenly (sigma-delta) */
+};
+
+/** Role of the router on a site with several routers (see utils_coordination.h) */
+enum class RouterRoles : uint8_t
+{
+  STANDALONE, /**< the only router of the site */
+  MASTER,     /**< publishes its diversion through RF */
+  SECONDARY   /**< leaves to the master the surplus it can still absorb */
+};
+
 /** Load state (for use if loads are active high (Rev 2 PCB)) */
 enum class LoadStates : uint8_t
 {
@@ -66,6 +90,8 @@ public:
   int16_t power;               /**< main power, import = +ve, to match OEM convention */
   int16_t power_L[N];          /**< power for phase #, import = +ve, to match OEM convention */
   int16_t Vrms_L_x100[N];      /**< average voltage over datalogging period (in 100th of Volt)*/
+  int16_t Irms_L_x100[N];      /**< average current over datalogging period (in 100th of Ampere)*/
+  int16_t frequency_L_x100[N]; /**< average mains frequency over datalogging period (in 100th of Hz), 0 if unknown */
   int16_t temperature_x100[S]; /**< temperature in 100th of °C */
 };
 
@@ -90,11 +116,11 @@ template< typename _Tp > constexpr size_t size(const _Tp (& /*__array*/)[0]) noe
   return 0;
 }
 
-template< class... Ts >
-constexpr uint8_t ival(Ts... Vs)
+template< typename T = uint8_t, class... Ts >
+constexpr T ival(Ts... Vs)
 {
   char vals[sizeof...(Vs)] = { Vs... };
-  uint8_t result = 0;
+  T result = 0;
   for (uint8_t i = 0; i < sizeof...(Vs); i++)
   {
     result *= 10;
@@ -109,4 +135,14 @@ constexpr integral_constant< uint8_t, ival(Vs...) > operator""_i()
   return {};
 }
 
+/**
+ * @brief Duration in seconds (ie '60_s')
+ *
+ */
+template< char... Vs >
+constexpr integral_constant< uint16_t, ival< uint16_t >(Vs...) > operator""_s()
+{
+  return {};
+}
+
 #endif  // TYPES_H
@@ -15,10 +15,23 @@
 #include "calibration.h"
 #include "constants.h"
 #include "dualtariff.h"
+#include "fundamental.h"
+#include "hal.h"
+#include "pll.h"
 #include "processing.h"
 
+#include "utils_commands.h"
+#include "utils_energy.h"
+#include "utils_frame.h"
+#include "utils_meter.h"
+#include "utils_modbus.h"
+#include "utils_params.h"
+#include "utils_print.h"
 #include "utils_rf.h"
 #include "utils_temp.h"
+#include "utils_txqueue.h"
+#include "utils_watchdog.h"
+#include "utils_wiring.h"
 
 /**
  * @brief Print the configuration during start
@@ -64,19 +77,19 @@ inline void printConfiguration()
     DBUG(F("\tf_powerCal for L"));
     DBUG(phase + 1);
     DBUG(F(" =    "));
-    DBUGLN(f_powerCal[phase], 6);
+    DBUGLN(getPowerCal(phase), 6);
 
     DBUG(F("\tf_voltageCal, for Vrms_L"));
     DBUG(phase + 1);
     DBUG(F(" =    "));
-    DBUGLN(f_voltageCal[phase], 5);
+    DBUGLN(getVoltageCal(phase), 5);
   }
 
   DBUG(F("\tf_phaseCal for all phases =     "));
   DBUGLN(f_phaseCal);
 
   DBUG(F("\tExport rate (Watts) = "));
-  DBUGLN(REQUIRED_EXPORT_IN_WATTS);
+  DBUGLN(getRequiredExport());
 
   DBUG(F("\tzero-crossing persistence (sample sets) = "));
   DBUGLN(PERSISTENCE_FOR_POLARITY_CHANGE);
@@ -84,47 +97,42 @@ inline void printConfiguration()
   printParamsForSelectedOutputMode();
 
   DBUG(F("Temperature capability "));
-  if constexpr (TEMP_SENSOR_PRESENT)
-  {
-    DBUGLN(F("is present"));
-  }
-  else
-  {
-    DBUGLN(F("is NOT present"));
-  }
+  printPresence(TEMP_SENSOR_PRESENT);
 
   DBUG(F("Dual-tariff capability "));
+  printPresence(DUAL_TARIFF);
   if constexpr (DUAL_TARIFF)
   {
-    DBUGLN(F("is present"));
-    printDualTariffConfiguration();
-  }
-  else
-  {
-    DBUGLN(F("is NOT present"));
+    printDualTariffConfiguration(getForceLoads());
   }
 
+  DBUG(F("Real-time clock "));
+  printPresence(RTC_PRESENT);
+
   DBUG(F("Load rotation feature "));
-  if constexpr (PRIORITY_ROTATION != RotationModes::OFF)
-  {
-    DBUGLN(F("is present"));
-  }
-  else
-  {
-    DBUGLN(F("is NOT present"));
-  }
+  printPresence(PRIORITY_ROTATION != RotationModes::OFF);
+
+  DBUG(F("PWM output "));
+  printPresence(PWM_OUTPUT);
+
+  DBUG(F("Overvoltage boost "));
+  printPresence(OVERVOLTAGE_BOOST);
+
+  DBUG(F("Wiring check "));
+  printPresence(WIRING_CHECK);
+
+  DBUG(F("Meter pulse input "));
+  printPresence(METER_PULSE_INPUT);
+
+  DBUG(F("Auto-calibration "));
+  printPresence(AUTO_CALIBRATION);
 
   DBUG(F("Relay diversion feature "));
+  printPresence(RELAY_DIVERSION);
   if constexpr (RELAY_DIVERSION)
   {
-    DBUGLN(F("is present"));
-
     relays.printConfiguration();
   }
-  else
-  {
-    DBUGLN(F("is NOT present"));
-  }
 
   DBUG(F("RF capability "));
 #ifdef RF_PRESENT
@@ -134,15 +142,24 @@ inline void printConfiguration()
   else if (FREQ == RF12_868MHZ)
     DBUGLN(F("868 MHz"));
   rf12_initialize(nodeID, FREQ, networkGroup);  // initialize RF
+  if constexpr (COORDINATION_MASTER)
+  {
+    DBUGLN(F("\tMaster router"));
+  }
+  else if constexpr (COORDINATION_SECONDARY)
+  {
+    DBUG(F("\tSecondary router of node "));
+    DBUGLN(masterNodeID);
+  }
 #else
-  DBUGLN(F("is NOT present"));
+  printPresence(false);
 #endif
 
   DBUG(F("Datalogging capability "));
 #ifdef SERIALPRINT
-  DBUGLN(F("is present"));
+  printPresence(true);
 #else
-  DBUGLN(F("is NOT present"));
+  printPresence(false);
 #endif
 }
 
@@ -156,24 +173,19 @@ inline void printForEmonESP(const bool bOffPeak)
   uint8_t idx{ 0 };
 
   // Total mean power over a data logging period
-  Serial.print(F("P:"));
-  Serial.print(tx_data.power);
+  serialTxQueue.print(F("P:"));
+  printDecimal(serialTxQueue, tx_data.power);
 
   // Mean power for each phase over a data logging period
   for (idx = 0; idx < NO_OF_PHASES; ++idx)
   {
-    Serial.print(F(",P"));
-    Serial.print(idx + 1);
-    Serial.print(F(":"));
-    Serial.print(tx_data.power_L[idx]);
+    printField(serialTxQueue, STR_P, idx, tx_data.power_L[idx], true);
   }
   // Mean power for each load over a data logging period (in %)
   for (idx = 0; idx < NO_OF_DUMPLOADS; ++idx)
   {
-    Serial.print(F(",L"));
-    Serial.print(idx + 1);
-    Serial.print(F(":"));
-    Serial.print((copyOf_countLoadON[idx] * 100) * invDATALOG_PERIOD_IN_MAINS_CYCLES);
+    printFieldLabel(serialTxQueue, STR_L, idx, true);
+    printFixed(serialTxQueue, (datalogSnapshot.countLoadON[idx] * 10000UL + DATALOG_PERIOD_IN_MAINS_CYCLES / 2) / DATALOG_PERIOD_IN_MAINS_CYCLES, 2);
   }
 
   if constexpr (TEMP_SENSOR_PRESENT)
@@ -186,20 +198,202 @@ inline void printForEmonESP(const bool bOffPeak)
         continue;
       }
 
-      Serial.print(F(",T"));
-      Serial.print(idx + 1);
-      Serial.print(F(":"));
-      Serial.print(tx_data.temperature_x100[idx] * 0.01F);
+      printField_x100(serialTxQueue, STR_T, idx, tx_data.temperature_x100[idx], true);
     }
   }
 
   if constexpr (DUAL_TARIFF)
   {
     // Current tariff
-    Serial.print(F(",T:"));
-    Serial.print(bOffPeak ? "low" : "high");
+    serialTxQueue.print(F(",T:"));
+    serialTxQueue.print(bOffPeak ? "low" : "high");
+  }
+  serialTxQueue.println(F(""));
+}
+
+/**
+ * @brief Get the reactive power of one phase over the last datalog period
+ * @details Away from the nominal frequency, the delayed voltage is not exactly in quadrature.
+ *          Its in-phase part is removed with the help of the real power.
+ *
+ * @param phase the phase number [0..NO_OF_PHASES[
+ * @return float reactive power in var, import = +ve, inductive = +ve
+ */
+inline float getReactivePower(const uint8_t phase)
+{
+  const float sumQ{ datalogSnapshot.sumQ_atSupplyPoint[phase] - datalogSnapshot.sumP_atSupplyPoint[phase] * cos(QUADRATURE_ANGLE) };
+
+  return -sumQ / sin(QUADRATURE_ANGLE) / datalogSnapshot.sampleSetsDuringThisDatalogPeriod * getPowerCal(phase);
+}
+
+/**
+ * @brief Get the apparent power of one phase over the last datalog period
+ *
+ * @param phase the phase number [0..NO_OF_PHASES[
+ * @return float apparent power in VA
+ */
+inline float getApparentPower(const uint8_t phase)
+{
+  const float vrmsTimesIrms{ sqrt(static_cast< float >(datalogSnapshot.sum_Vsquared[phase]) * datalogSnapshot.sum_Isquared[phase]) / datalogSnapshot.sampleSetsDuringThisDatalogPeriod };
+
+  return (DATALOG_PERIOD_IN_SECONDS > 10 ? 16 : 1) * getPowerCal(phase) * vrmsTimesIrms;
+}
+
+/**
+ * @brief Print the mean duty of the PWM output over the last datalog period, in %
+ *
+ */
+inline void printPwmOutputDuty()
+{
+  serialTxQueue.print(F(", PWM:"));
+  printScaled(serialTxQueue, datalogSnapshot.sumPwmOutputDuty * (100.0F / 255) * invDATALOG_PERIOD_IN_MAINS_CYCLES, 1);
+}
+
+/**
+ * @brief Print the share of the mains cycles with the overvoltage boost in %, only for the boosted phases
+ * @details e.g. ", OV2:35".
+ *
+ */
+inline void printOvervoltageBoost()
+{
+  for (uint8_t phase = 0; phase < NO_OF_PHASES; ++phase)
+  {
+    if (datalogSnapshot.overvoltageCycles[phase])
+    {
+      printField(serialTxQueue, STR_OV, phase, datalogSnapshot.overvoltageCycles[phase] * 100UL / DATALOG_PERIOD_IN_MAINS_CYCLES);
+    }
+  }
+}
+
+/**
+ * @brief Print the power metered by the utility meter during the datalog period in W
+ * @details e.g. ", M:1250", to be compared with the measured power.
+ *
+ */
+inline void printMeteredPower()
+{
+  serialTxQueue.print(F(", M:"));
+  printDecimal(serialTxQueue, meterCheck.get_meteredPower());
+}
+
+/**
+ * @brief Print the wiring faults, only for the phases with a fault
+ * @details 'V' for no voltage reference, 'I' for no CT, 'R' for a reversed CT, e.g. ", W2:R".
+ *
+ */
+inline void printWiringFaults()
+{
+  for (uint8_t phase = 0; phase < NO_OF_PHASES; ++phase)
+  {
+    const auto faults{ wiringCheck.get_faults(phase) };
+    if (!faults)
+    {
+      continue;
+    }
+
+    printFieldLabel(serialTxQueue, STR_W, phase);
+    if (faults & WIRING_NO_VOLTAGE)
+    {
+      serialTxQueue.print('V');
+    }
+    if (faults & WIRING_NO_CT)
+    {
+      serialTxQueue.print('I');
+    }
+    if (faults & WIRING_CT_REVERSED)
+    {
+      serialTxQueue.print('R');
+    }
+  }
+}
+
+/**
+ * @brief Print the learned power of each load
+ *
+ */
+inline void printLearnedLoadPowers()
+{
+  for (uint8_t idx = 0; idx < NO_OF_DUMPLOADS; ++idx)
+  {
+    printField(serialTxQueue, STR_PL, idx, datalogSnapshot.learnedLoadPower[idx]);
+  }
+}
+
+/**
+ * @brief Print the persistent energy counters, in Wh
+ *
+ */
+inline void printEnergyCounters()
+{
+  const auto &counters{ energyCounters.get() };
+
+  uint32_t importWh{ 0 };
+  uint32_t exportWh{ 0 };
+  for (uint8_t phase = 0; phase < NO_OF_PHASES; ++phase)
+  {
+    importWh += counters.importWh[phase];
+    exportWh += counters.exportWh[phase];
+  }
+
+  serialTxQueue.print(F(", EI:"));
+  printDecimal(serialTxQueue, importWh);
+  serialTxQueue.print(F(", EE:"));
+  printDecimal(serialTxQueue, exportWh);
+
+  for (uint8_t idx = 0; idx < NO_OF_DUMPLOADS; ++idx)
+  {
+    printFieldLabel(serialTxQueue, STR_ED, idx);
+    printDecimal(serialTxQueue, counters.divertedWh[idx]);
+  }
+}
+
+/**
+ * @brief Print the events which could not be queued by the ISR since startup, only if any
+ * @details e.g. ", EQ:3". The mains cycles and the datalogs are never lost (see IsrSignals).
+ *
+ */
+inline void printEventOverflows()
+{
+  const auto overflows{ isrEvents.get_overflows() };
+  if (overflows)
+  {
+    serialTxQueue.print(F(", EQ:"));
+    printDecimal(serialTxQueue, overflows);
+  }
+}
+
+/**
+ * @brief Print the bytes of the text output dropped since startup, only if any
+ * @details e.g. ", TQ:42". SERIAL_TX_QUEUE_SIZE is then too small for the selected outputs.
+ *
+ */
+inline void printTxQueueOverflows()
+{
+  const auto overflows{ serialTxQueue.get_overflows() };
+  if (overflows)
+  {
+    serialTxQueue.print(F(", TQ:"));
+    printDecimal(serialTxQueue, overflows);
+  }
+}
+
+/**
+ * @brief Print the apparent/reactive power and the power factor of each phase
+ *
+ */
+inline void printPowerFactors()
+{
+  for (uint8_t phase = 0; phase < NO_OF_PHASES; ++phase)
+  {
+    const float apparentPower{ getApparentPower(phase) };
+
+    printFieldLabel(serialTxQueue, STR_S, phase);
+    printScaled(serialTxQueue, apparentPower, 0);
+    printFieldLabel(serialTxQueue, STR_Q, phase);
+    printScaled(serialTxQueue, getReactivePower(phase), 0);
+    printFieldLabel(serialTxQueue, STR_PF, phase);
+    printScaled(serialTxQueue, apparentPower > 0 ? tx_data.power_L[phase] / apparentPower : 0.0F, 2);
   }
-  Serial.println(F(""));
 }
 
 /**
@@ -210,23 +404,67 @@ inline void printForSerialJson()
 {
   uint8_t phase{ 0 };
 
-  Serial.print(copyOf_energyInBucket_main * invSUPPLY_FREQUENCY);
-  Serial.print(F(", P:"));
-  Serial.print(tx_data.power);
+  printScaled(serialTxQueue, datalogSnapshot.energyInBucket_main * f_energyBucketToJoules, 2);
+  serialTxQueue.print(F(", P:"));
+  printDecimal(serialTxQueue, tx_data.power);
 
   for (phase = 0; phase < NO_OF_PHASES; ++phase)
   {
-    Serial.print(F(", P"));
-    Serial.print(phase + 1);
-    Serial.print(F(":"));
-    Serial.print(tx_data.power_L[phase]);
+    printField(serialTxQueue, STR_P, phase, tx_data.power_L[phase]);
   }
   for (phase = 0; phase < NO_OF_PHASES; ++phase)
   {
-    Serial.print(F(", V"));
-    Serial.print(phase + 1);
-    Serial.print(F(":"));
-    Serial.print((float)tx_data.Vrms_L_x100[phase] * 0.01F);
+    printField_x100(serialTxQueue, STR_V, phase, tx_data.Vrms_L_x100[phase]);
+  }
+  for (phase = 0; phase < NO_OF_PHASES; ++phase)
+  {
+    printField_x100(serialTxQueue, STR_I, phase, tx_data.Irms_L_x100[phase]);
+  }
+  for (phase = 0; phase < NO_OF_PHASES; ++phase)
+  {
+    printField_x100(serialTxQueue, STR_F, phase, tx_data.frequency_L_x100[phase]);
+  }
+  if constexpr (REACTIVE_POWER)
+  {
+    printPowerFactors();
+  }
+  if constexpr (PWM_OUTPUT)
+  {
+    printPwmOutputDuty();
+  }
+  if constexpr (OVERVOLTAGE_BOOST)
+  {
+    printOvervoltageBoost();
+  }
+  if constexpr (METER_PULSE_INPUT)
+  {
+    printMeteredPower();
+  }
+  if constexpr (WIRING_CHECK)
+  {
+    printWiringFaults();
+  }
+  if constexpr (LOAD_POWER_LEARNING)
+  {
+    printLearnedLoadPowers();
+  }
+  if constexpr (ENERGY_COUNTERS)
+  {
+    printEnergyCounters();
+  }
+  printEventOverflows();
+  printTxQueueOverflows();
+  if constexpr (HARMONIC_ANALYSIS)
+  {
+    for (phase = 0; phase < NO_OF_PHASES; ++phase)
+    {
+      printFieldLabel(serialTxQueue, STR_P1F, phase);
+      printScaled(serialTxQueue, fundamentalAnalysis.get_activePower(phase, getPowerCal(phase)), 0);
+      printFieldLabel(serialTxQueue, STR_Q1F, phase);
+      printScaled(serialTxQueue, fundamentalAnalysis.get_reactivePower(phase, getPowerCal(phase)), 0);
+      printFieldLabel(serialTxQueue, STR_THD, phase);
+      printScaled(serialTxQueue, fundamentalAnalysis.get_currentThd(phase), 1);
+    }
   }
 
   if constexpr (TEMP_SENSOR_PRESENT)
@@ -239,14 +477,11 @@ inline void printForSerialJson()
         continue;
       }
 
-      Serial.print(F(", T"));
-      Serial.print(idx + 1);
-      Serial.print(F(":"));
-      Serial.print((float)tx_data.temperature_x100[idx] * 0.01F);
+      printField_x100(serialTxQueue, STR_T, idx, tx_data.temperature_x100[idx]);
     }
   }
 
-  Serial.println(F(")"));
+  serialTxQueue.println(F(")"));
 }
 
 /**
@@ -257,29 +492,73 @@ inline void printForSerialText()
 {
   uint8_t phase{ 0 };
 
-  Serial.print(copyOf_energyInBucket_main * invSUPPLY_FREQUENCY);
-  Serial.print(F(", P:"));
-  Serial.print(tx_data.power);
+  printScaled(serialTxQueue, datalogSnapshot.energyInBucket_main * f_energyBucketToJoules, 2);
+  serialTxQueue.print(F(", P:"));
+  printDecimal(serialTxQueue, tx_data.power);
 
   if constexpr (RELAY_DIVERSION)
   {
-    Serial.print(F("/"));
-    Serial.print(relays.get_average());
+    serialTxQueue.print(F("/"));
+    printDecimal(serialTxQueue, relays.get_average());
   }
 
   for (phase = 0; phase < NO_OF_PHASES; ++phase)
   {
-    Serial.print(F(", P"));
-    Serial.print(phase + 1);
-    Serial.print(F(":"));
-    Serial.print(tx_data.power_L[phase]);
+    printField(serialTxQueue, STR_P, phase, tx_data.power_L[phase]);
+  }
+  for (phase = 0; phase < NO_OF_PHASES; ++phase)
+  {
+    printField_x100(serialTxQueue, STR_V, phase, tx_data.Vrms_L_x100[phase]);
+  }
+  for (phase = 0; phase < NO_OF_PHASES; ++phase)
+  {
+    printField_x100(serialTxQueue, STR_I, phase, tx_data.Irms_L_x100[phase]);
   }
   for (phase = 0; phase < NO_OF_PHASES; ++phase)
   {
-    Serial.print(F(", V"));
-    Serial.print(phase + 1);
-    Serial.print(F(":"));
-    Serial.print((float)tx_data.Vrms_L_x100[phase] * 0.01F);
+    printField_x100(serialTxQueue, STR_F, phase, tx_data.frequency_L_x100[phase]);
+  }
+  if constexpr (REACTIVE_POWER)
+  {
+    printPowerFactors();
+  }
+  if constexpr (PWM_OUTPUT)
+  {
+    printPwmOutputDuty();
+  }
+  if constexpr (OVERVOLTAGE_BOOST)
+  {
+    printOvervoltageBoost();
+  }
+  if constexpr (METER_PULSE_INPUT)
+  {
+    printMeteredPower();
+  }
+  if constexpr (WIRING_CHECK)
+  {
+    printWiringFaults();
+  }
+  if constexpr (LOAD_POWER_LEARNING)
+  {
+    printLearnedLoadPowers();
+  }
+  if constexpr (ENERGY_COUNTERS)
+  {
+    printEnergyCounters();
+  }
+  printEventOverflows();
+  printTxQueueOverflows();
+  if constexpr (HARMONIC_ANALYSIS)
+  {
+    for (phase = 0; phase < NO_OF_PHASES; ++phase)
+    {
+      printFieldLabel(serialTxQueue, STR_P1F, phase);
+      printScaled(serialTxQueue, fundamentalAnalysis.get_activePower(phase, getPowerCal(phase)), 0);
+      printFieldLabel(serialTxQueue, STR_Q1F, phase);
+      printScaled(serialTxQueue, fundamentalAnalysis.get_reactivePower(phase, getPowerCal(phase)), 0);
+      printFieldLabel(serialTxQueue, STR_THD, phase);
+      printScaled(serialTxQueue, fundamentalAnalysis.get_currentThd(phase), 1);
+    }
   }
 
   if constexpr (TEMP_SENSOR_PRESENT)
@@ -292,25 +571,228 @@ inline void printForSerialText()
         continue;
       }
 
-      Serial.print(F(", T"));
-      Serial.print(idx + 1);
-      Serial.print(F(":"));
-      Serial.print((float)tx_data.temperature_x100[idx] * 0.01F);
+      printField_x100(serialTxQueue, STR_T, idx, tx_data.temperature_x100[idx]);
     }
   }
 
-  Serial.print(F(", (minSampleSets/MC "));
-  Serial.print(copyOf_lowestNoOfSampleSetsPerMainsCycle);
-  Serial.print(F(", #ofSampleSets "));
-  Serial.print(copyOf_sampleSetsDuringThisDatalogPeriod);
+  serialTxQueue.print(F(", (minSampleSets/MC "));
+  printDecimal(serialTxQueue, datalogSnapshot.lowestNoOfSampleSetsPerMainsCycle);
+  serialTxQueue.print(F(", #ofSampleSets "));
+  printDecimal(serialTxQueue, datalogSnapshot.sampleSetsDuringThisDatalogPeriod);
+  serialTxQueue.print(F(", free stack "));
+  printDecimal(serialTxQueue, halStackUnused());
+  if constexpr (TEMP_SENSOR_PRESENT)
+  {
+    serialTxQueue.print(F(", OneWire max µs "));
+    printDecimal(serialTxQueue, temperatureSensing.get_and_reset_maxStepDuration());
+  }
+  if constexpr (ISR_LATENCY_MONITOR)
+  {
+    printIsrLatency(serialTxQueue);
+  }
+  if constexpr (ISR_STACK_MONITOR)
+  {
+    printIsrStack(serialTxQueue);
+  }
+  if constexpr (SOFTWARE_PLL)
+  {
+    serialTxQueue.print(F(", PLL "));
+    if (datalogSnapshot.pllPeriod)
+    {
+      printFixed(serialTxQueue, SoftwarePll::toFrequency_x100(datalogSnapshot.pllPeriod), 2);
+      serialTxQueue.print(F(" Hz"));
+    }
+    else
+    {
+      serialTxQueue.print(F("unlocked"));
+    }
+  }
 #ifndef DUAL_TARIFF
   if constexpr (PRIORITY_ROTATION != RotationModes::OFF)
   {
-    Serial.print(F(", NoED "));
-    Serial.print(absenceOfDivertedEnergyCount);
+    serialTxQueue.print(F(", NoED "));
+    printDecimal(serialTxQueue, absenceOfDivertedEnergyCount);
   }
 #endif  // DUAL_TARIFF
-  Serial.println(F(")"));
+  serialTxQueue.println(F(")"));
+}
+
+/**
+ * @brief Payload of the binary datalog frame
+ * @details All fields are little-endian, in this order:
+ *          | field                          | type   | content                                     |
+ *          |--------------------------------|--------|---------------------------------------------|
+ *          | power                          | int16  | total power in W, import = +ve              |
+ *          | power_L[NO_OF_PHASES]          | int16  | power per phase in W                        |
+ *          | Vrms_L_x100[NO_OF_PHASES]      | int16  | Vrms per phase in 1/100 V                   |
+ *          | Irms_L_x100[NO_OF_PHASES]      | int16  | Irms per phase in 1/100 A                   |
+ *          | frequency_L_x100[NO_OF_PHASES] | int16  | mains frequency per phase in 1/100 Hz       |
+ *          | temperature_x100[sensors]      | int16  | temperature in 1/100 °C (none if no sensor) |
+ *          | countLoadON[NO_OF_DUMPLOADS]   | uint16 | mains cycles ON of each load in the period  |
+ *          | sampleSets                     | uint16 | # of sample sets during the period          |
+ *          | lowestNoOfSampleSets           | uint8  | min # of sample sets per mains cycle        |
+ *          | energyInBucket                 | int16  | level of the energy bucket in J             |
+ *          | flags                          | uint8  | bit 0: off-peak period                      |
+ *
+ *          The first fields are the RF payload (tx_data), unchanged.
+ *          A reference decoder is available in 'extras/decode_frames.py'.
+ */
+struct DatalogFramePayload
+{
+  decltype(tx_data) data;                  /**< same content as the RF payload */
+  uint16_t countLoadON[NO_OF_DUMPLOADS];   /**< # of mains cycles each load was ON */
+  uint16_t sampleSets;                     /**< # of sample sets during the datalog period */
+  uint8_t lowestNoOfSampleSets;            /**< lowest # of sample sets per mains cycle */
+  int16_t energyInBucket;                  /**< energy bucket level in J */
+  uint8_t flags;                           /**< bit 0: off-peak */
+} __attribute__((packed));
+
+inline bool datalogFramePending{ false }; /**< the datalog frame is waiting for the end of a fast-stream frame */
+
+/**
+ * @brief Sends the data logs to the Serial output as a binary frame
+ * @details The frame itself is streamed from loop(), without blocking.
+ *
+ * @param bOffPeak true if off-peak tariff is active
+ */
+inline void sendBinaryFrame(const bool bOffPeak)
+{
+  static DatalogFramePayload payload;
+
+  if (frameStreamer.isBusy())
+  {
+    // previous frame still being sent, skip this record
+    // or, with the fast stream, send it right after the current fast-stream frame
+    datalogFramePending = FAST_STREAM;
+    return;
+  }
+  datalogFramePending = false;
+
+  payload.data = tx_data;
+  for (uint8_t idx = 0; idx < NO_OF_DUMPLOADS; ++idx)
+  {
+    payload.countLoadON[idx] = datalogSnapshot.countLoadON[idx];
+  }
+  payload.sampleSets = datalogSnapshot.sampleSetsDuringThisDatalogPeriod;
+  payload.lowestNoOfSampleSets = datalogSnapshot.lowestNoOfSampleSetsPerMainsCycle;
+  payload.energyInBucket = static_cast< int16_t >(datalogSnapshot.energyInBucket_main * f_energyBucketToJoules);
+  payload.flags = bOffPeak ? 0x01 : 0x00;
+
+  frameStreamer.start(FrameTypes::DATALOG, &payload, sizeof(payload));
+}
+
+/**
+ * @brief Payload of the binary fast-stream frame
+ * @details All fields are little-endian, in this order:
+ *          | field                 | type   | content                                          |
+ *          |-----------------------|--------|--------------------------------------------------|
+ *          | sequence              | uint8  | incremented on each period, a gap = dropped ones |
+ *          | power_L[NO_OF_PHASES] | int16  | power per phase in W, import = +ve               |
+ *          | energyInBucket        | int16  | level of the energy bucket in J                  |
+ *          | dropped               | uint8  | # of records dropped since startup (saturating)  |
+ *
+ *          One frame is sent every FAST_STREAM_PERIOD_IN_MAINS_CYCLES.
+ */
+struct FastStreamFramePayload
+{
+  uint8_t sequence;              /**< sequence number of the record */
+  int16_t power_L[NO_OF_PHASES]; /**< power per phase in W */
+  int16_t energyInBucket;        /**< energy bucket level in J */
+  uint8_t dropped;               /**< # of records dropped by the ISR */
+} __attribute__((packed));
+
+/**
+ * @brief Sends the oldest fast-stream record to the Serial output as a binary frame
+ * @details Called on each loop() pass. A pending datalog frame goes first.
+ *          While a frame is being sent, the records wait in the queue, and the ISR drops
+ *          the newer ones once the queue is full.
+ *
+ * @param bOffPeak true if off-peak tariff is active
+ */
+inline void sendFastStreamFrame(const bool bOffPeak)
+{
+  static FastStreamFramePayload payload;
+
+  if (frameStreamer.isBusy())
+  {
+    return;
+  }
+
+  if (datalogFramePending)
+  {
+    sendBinaryFrame(bOffPeak);
+    return;
+  }
+
+  FastStreamRecord record;
+  if (!fastStreamRecords.pop(record) || !record.sampleSets)
+  {
+    return;
+  }
+
+  payload.sequence = record.sequence;
+  for (uint8_t phase = 0; phase < NO_OF_PHASES; ++phase)
+  {
+    payload.power_L[phase] = static_cast< int16_t >(-record.sumP_atSupplyPoint[phase] * getPowerCal(phase) / record.sampleSets);
+  }
+  payload.energyInBucket = static_cast< int16_t >(record.energyInBucket_main * f_energyBucketToJoules);
+  payload.dropped = fastStreamRecords.get_overflows();
+
+  frameStreamer.start(FrameTypes::FAST_STREAM, &payload, sizeof(payload));
+}
+
+/**
+ * @brief Get the name of the reason of a load transition
+ *
+ * @param reason The reason
+ * @return const __FlashStringHelper* The name
+ */
+inline const __FlashStringHelper *transitionReasonName(const TransitionReasons reason)
+{
+  switch (reason)
+  {
+    case TransitionReasons::THRESHOLD:
+      return F("threshold");
+    case TransitionReasons::THERMOSTAT:
+      return F("thermostat");
+    case TransitionReasons::OVERRIDE:
+      return F("override");
+    case TransitionReasons::DIVERSION_OFF:
+      return F("diversion-off");
+    case TransitionReasons::ROTATION:
+      return F("rotation");
+    case TransitionReasons::TEMPERATURE:
+      return F("temperature");
+    case TransitionReasons::CALIBRATION:
+      return F("calibration");
+  }
+  return F("?");
+}
+
+/**
+ * @brief Prints the load transitions logged by the ISR to the Serial output (see TRANSITION_LOG)
+ * @details Called on each loop() pass, one line per transition, e.g.
+ *          "Load #2 ON, cycle: 12345, reason: threshold, bucket: 2345.12 J".
+ *          The records wait in the queue while a binary frame is being sent.
+ *
+ */
+inline void printLoadTransitions()
+{
+  LoadTransitionRecord record;
+
+  while (!frameStreamer.isBusy() && loadTransitions.pop(record))
+  {
+    serialTxQueue.print(F("Load #"));
+    printDecimal(serialTxQueue, (record.load & 0x7F) + 1);
+    serialTxQueue.print((record.load & 0x80) ? F(" ON") : F(" OFF"));
+    serialTxQueue.print(F(", cycle: "));
+    printDecimal(serialTxQueue, record.cycle);
+    serialTxQueue.print(F(", reason: "));
+    serialTxQueue.print(transitionReasonName(record.reason));
+    serialTxQueue.print(F(", bucket: "));
+    printScaled(serialTxQueue, record.energyInBucket * f_energyBucketToJoules, 2);
+    serialTxQueue.println(F(" J"));
+  }
 }
 
 /**
@@ -332,6 +814,15 @@ inline void sendResults(bool bOffPeak)
   send_rf_data();  // *SEND RF DATA*
 #endif
 
+  if (frameStreamer.isBusy())
+  {
+    return;  // a binary frame is being sent, text output would corrupt it
+  }
+
+#if defined SERIALBINARY
+  sendBinaryFrame(bOffPeak);
+#endif  // if defined SERIALBINARY
+
 #if defined SERIALOUT
   printForSerialJson();
 #endif  // if defined SERIALOUT
@@ -364,16 +855,4 @@ inline void logLoadPriorities()
 #endif
 }
 
-/**
- * @brief Get the available RAM during setup
- *
- * @return int The amount of free RAM
- */
-inline int freeRam()
-{
-  extern int __heap_start, *__brkval;
-  int v;
-  return (int)&v - (__brkval == 0 ? (int)&__heap_start : (int)__brkval);
-}
-
 #endif  // UTILS_H
@@ -0,0 +1,209 @@
+/**
+ * @file utils_autocal.h
+ * @author Frédéric Metrich (frederic.metrich@live.fr)
+ * @brief Auto-calibration of a phase with a load of known power
+ * @version 0.1
+ * @date 2024-06-07
+ *
+ * @details With AUTO_CALIBRATION, the 'K load watts [volts]' command through the Serial calibrates
+ *          the phase of the load (see 'loadPhase'), without the external sketches and without reflashing:
+ *          - all the loads are switched OFF, then the reference load is switched OFF and ON
+ *            AUTOCAL_PAIRS times, one datalog period each, after one datalog period to settle,
+ *          - the power calibration is the power of the load divided by the mean step of the raw power,
+ *          - with the voltage measured by an external meter, the voltage calibration is rescaled too.
+ *
+ *          'watts' is the power drawn by the load at the current voltage, not its rated power.
+ *          The alternation cancels the slow changes of the PV and of the consumption,
+ *          a calibration at night (or with the PV off) is still the most accurate.
+ *          The relays are not stopped, they should be left OFF during the calibration.
+ *
+ *          The new calibration is applied at once and saved to EEPROM (see utils_params.h):
+ *          the ISR only gets it pre-scaled, as for the 'S' command. 'K' alone aborts a calibration.
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef UTILS_AUTOCAL_H
+#define UTILS_AUTOCAL_H
+
+#include <Arduino.h>
+
+#include "config.h"
+#include "processing.h"
+#include "utils_events.h"
+#include "utils_params.h"
+#include "utils_txqueue.h"
+
+inline constexpr uint8_t AUTOCAL_PAIRS{ 4 };         /**< # of OFF/ON pairs of the reference load */
+inline constexpr int16_t AUTOCAL_MIN_POWER{ 100 };   /**< smallest reference load in W */
+inline constexpr float AUTOCAL_MIN_RAW_STEP{ 10.0F }; /**< smallest step of the raw power, below it the load is not seen on the phase */
+
+/**
+ * @brief Auto-calibration with a reference load, one step per datalog period
+ *
+ */
+class AutoCalibration
+{
+public:
+  /**
+   * @brief Start a calibration
+   *
+   * @param _load the reference load [0..NO_OF_DUMPLOADS[
+   * @param _watts the power drawn by the load in W
+   * @param _volts the voltage measured by a meter in V, 0 to keep the voltage calibration
+   * @return true if the calibration has started
+   */
+  bool start(const uint8_t _load, const int16_t _watts, const float _volts)
+  {
+    if (step || _load >= NO_OF_DUMPLOADS || _watts < AUTOCAL_MIN_POWER || _volts < 0)
+    {
+      return false;
+    }
+
+    load = _load;
+    watts = _watts;
+    volts = _volts;
+    sumRawPowerOFF = 0;
+    sumRawPowerON = 0;
+    sumVsquared = 0;
+
+    step = 1;
+    bSettling = true;
+    sendMask(CALIBRATION_RUNNING);
+
+    return true;
+  }
+
+  /**
+   * @brief Abort the running calibration, the calibration in use is kept
+   *
+   * @return true if a calibration was running
+   */
+  bool abort()
+  {
+    if (!step)
+    {
+      return false;
+    }
+    step = 0;
+    sendMask(0);
+
+    return true;
+  }
+
+  /**
+   * @brief Proceed with the datalog of the last period
+   * @details Called once 'datalogSnapshot' has been read.
+   *
+   */
+  void proceed()
+  {
+    if (bPending)
+    {
+      bPending = !isrCommands.push({ Commands::CALIBRATION, pendingMask });
+      return;  // this period has been measured with the former state
+    }
+
+    if (!step)
+    {
+      return;
+    }
+
+    if (bSettling)
+    {
+      bSettling = false;  // the load has been switched during this period
+      return;
+    }
+
+    const auto phase{ loadPhase[load] };
+    const float rawPower{ static_cast< float >(datalogSnapshot.sumP_atSupplyPoint[phase]) / datalogSnapshot.sampleSetsDuringThisDatalogPeriod };
+
+    if (isLoadON())
+    {
+      sumRawPowerON += rawPower;
+    }
+    else
+    {
+      sumRawPowerOFF += rawPower;
+    }
+    sumVsquared += static_cast< float >(datalogSnapshot.sum_Vsquared[phase]) / datalogSnapshot.sampleSetsDuringThisDatalogPeriod;
+
+    if (++step > 2 * AUTOCAL_PAIRS)
+    {
+      step = 0;
+      sendMask(0);
+      finish(phase);
+      return;
+    }
+
+    bSettling = true;
+    sendMask(CALIBRATION_RUNNING | (isLoadON() ? bit(load) : 0));
+  }
+
+private:
+  /**
+   * @brief State of the reference load during the current step
+   *
+   * @return true during the even steps
+   */
+  bool isLoadON() const
+  {
+    return !(step & 1);
+  }
+
+  /**
+   * @brief Send the state of the loads to the ISR, again on the next datalog if the queue is full
+   *
+   * @param mask CALIBRATION_RUNNING | loads ON, or 0 at the end
+   */
+  void sendMask(const uint8_t mask)
+  {
+    pendingMask = mask;
+    bPending = !isrCommands.push({ Commands::CALIBRATION, mask });
+  }
+
+  /**
+   * @brief Compute, apply and save the new calibration, and print it
+   *
+   * @param phase the phase of the reference load
+   */
+  void finish(const uint8_t phase) const
+  {
+    // the import is -ve, the load makes the raw power go down
+    const float rawStep{ (sumRawPowerOFF - sumRawPowerON) / AUTOCAL_PAIRS };
+
+    const float powerCal{ rawStep < AUTOCAL_MIN_RAW_STEP ? 0 : watts / rawStep };
+    const float voltageCal{ volts > 0 ? volts / (RMS_SUMS_FACTOR * sqrt(sumVsquared / (2 * AUTOCAL_PAIRS))) : getVoltageCal(phase) };
+
+    serialTxQueue.print(F("Calibration of phase #"));
+    serialTxQueue.print(phase + 1);
+
+    if (!runtimeParameters.setCalibration(phase, powerCal, voltageCal))
+    {
+      serialTxQueue.println(F(" failed"));
+      return;
+    }
+    runtimeParameters.save();
+
+    serialTxQueue.print(F(": PC "));
+    serialTxQueue.print(powerCal, 6);
+    serialTxQueue.print(F(", VC "));
+    serialTxQueue.println(voltageCal, 5);
+  }
+
+  float sumRawPowerOFF{ 0 }; /**< sum of the raw power of the phase with the reference load OFF */
+  float sumRawPowerON{ 0 };  /**< sum of the raw power of the phase with the reference load ON */
+  float sumVsquared{ 0 };    /**< sum of the raw mean V^2 of the phase */
+  float volts{ 0 };          /**< voltage measured by the meter in V, 0 if none */
+  int16_t watts{ 0 };        /**< power of the reference load in W */
+  uint8_t load{ 0 };         /**< the reference load */
+  uint8_t step{ 0 };         /**< current step [1..2 x AUTOCAL_PAIRS], 0 when idle */
+  uint8_t pendingMask{ 0 };  /**< last state sent (or to be sent) to the ISR */
+  bool bSettling{ false };   /**< the current period is discarded */
+  bool bPending{ false };    /**< the last state could not be sent to the ISR */
+};
+
+inline AutoCalibration autoCalibration; /**< calibration with a reference load, through the Serial */
+
+#endif  // UTILS_AUTOCAL_H
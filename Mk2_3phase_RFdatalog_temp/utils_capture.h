@@ -0,0 +1,148 @@
+/**
+ * @file utils_capture.h
+ * @author Frédéric Metrich (frederic.metrich@live.fr)
+ * @brief Raw-sample capture for field waveform dumps
+ * @version 0.1
+ * @date 2024-05-06
+ *
+ * @details On request (character 'C' received on the Serial), the ISR copies the raw samples
+ *          of all channels into a fixed buffer, starting with the next V1 sample. Once the buffer
+ *          is full, loop() streams it out as a binary frame (see utils_frame.h) of type RAW_SAMPLES.
+ *          Diversion goes on during the whole process.
+ *
+ *          To save RAM, the 10-bit samples of one set (V1, I1, V2, I2, V3, I3) are packed in 8 bytes:
+ *            - bytes 0..5: low byte of each sample, in the order above
+ *            - bytes 6..7: high 2 bits of each sample, little-endian, channel 'c' at bits [2c..2c+1]
+ *
+ *          When idle, the cost inside the ISR is one test per sample.
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef UTILS_CAPTURE_H
+#define UTILS_CAPTURE_H
+
+#include <Arduino.h>
+
+#include "config.h"
+#include "utils_frame.h"
+
+inline constexpr uint8_t NO_OF_CHANNELS{ NO_OF_ADC_CHANNELS }; /**< number of sampled channels */
+
+/** State of the capture */
+enum class CaptureStates : uint8_t
+{
+  IDLE,      /**< nothing to do */
+  ARMED,     /**< waiting for the next V1 sample */
+  CAPTURING, /**< the ISR is filling the buffer */
+  READY      /**< the buffer is full, loop() may stream it out */
+};
+
+/**
+ * @brief One packed set of samples
+ *
+ */
+struct PackedSampleSet
+{
+  uint8_t low[NO_OF_CHANNELS]; /**< low byte of each sample */
+  uint16_t high;               /**< high 2 bits of each sample */
+};
+
+static_assert(NO_OF_CHANNELS <= 8, "The high bits of all channels must fit in 16 bits");
+
+/**
+ * @brief Ring of raw samples filled by the ISR and drained by loop()
+ *
+ * @tparam N Number of sample sets (~32 per mains cycle @ 50 Hz)
+ */
+template< uint8_t N >
+class RawSamplesCapture
+{
+public:
+  /**
+   * @brief Request a new capture, ignored if one is already pending
+   *
+   */
+  void arm()
+  {
+    if (CaptureStates::IDLE == state)
+    {
+      index = 0;
+      state = CaptureStates::ARMED;
+    }
+  }
+
+  /**
+   * @brief Store one raw sample
+   *
+   * @param channel The channel [0..NO_OF_CHANNELS[ (2 * phase for V, 2 * phase + 1 for I, then the extra channels)
+   * @param rawSample The raw ADC value
+   *
+   * @ingroup TimeCritical
+   */
+  void store(const uint8_t channel, const int16_t rawSample)
+  {
+    if (CaptureStates::CAPTURING != state)
+    {
+      if (CaptureStates::ARMED != state || channel)
+      {
+        return;
+      }
+      state = CaptureStates::CAPTURING;  // start synchronized with V1
+    }
+
+    auto &set{ buffer[index] };
+    if (!channel)
+    {
+      set.high = 0;
+    }
+    const int16_t sample{ static_cast< int16_t >(rawSample >> ADC_OVERSAMPLING_BITS) };  // always captured @ 10 bits
+
+    set.low[channel] = lowByte(sample);
+    set.high |= static_cast< uint16_t >(highByte(sample) & 0x03) << (channel << 1);
+
+    if ((NO_OF_CHANNELS - 1 == channel) && (++index == N))
+    {
+      state = CaptureStates::READY;
+    }
+  }
+
+  /**
+   * @brief Check for a capture request and stream out a completed capture
+   * @details Must be called on each loop() pass.
+   *
+   * @param bReadSerial true to read the request ('C') from the Serial, false when the Serial
+   *                    input is handled by the command interpreter (see utils_commands.h)
+   */
+  void proceed(const bool bReadSerial = true)
+  {
+    if (CaptureStates::READY == state)
+    {
+      if (!frameStreamer.isBusy())
+      {
+        if (bStreaming)
+        {
+          bStreaming = false;
+          state = CaptureStates::IDLE;  // the previous frame has been fully sent
+          return;
+        }
+        bStreaming = frameStreamer.start(FrameTypes::RAW_SAMPLES, buffer, sizeof(buffer));
+      }
+      return;
+    }
+
+    if (bReadSerial && Serial.available() && 'C' == Serial.read())
+    {
+      arm();
+    }
+  }
+
+private:
+  PackedSampleSet buffer[N];                          /**< the captured samples */
+  uint8_t index{ 0 };                                 /**< next set to be written */
+  bool bStreaming{ false };                           /**< the buffer is being streamed out */
+  volatile CaptureStates state{ CaptureStates::IDLE }; /**< state, shared with the ISR */
+};
+
+#endif  // UTILS_CAPTURE_H
@@ -0,0 +1,320 @@
+/**
+ * @file utils_commands.h
+ * @author Frédéric Metrich (frederic.metrich@live.fr)
+ * @brief Line-based command interpreter on the Serial
+ * @version 0.1
+ * @date 2024-05-25
+ *
+ * @details The characters received on the Serial are buffered without blocking on each loop() pass,
+ *          the command is executed when the end of the line is received ('\n' or '\r').
+ *          Each command is answered with "OK" or "ERR" through the text queue.
+ *
+ *          With RUNTIME_PARAMETERS (see utils_params.h):
+ *          - G           : print all the parameters
+ *          - S name value: set a parameter (PC1..PC3, VC1..VC3, EX, AF, RS1.., RI1.., FO1.., FD1..), effective immediately
+ *          - W           : write the parameters to EEPROM
+ *          - D           : restore the defaults (the EEPROM is not modified until 'W')
+ *
+ *          With AUTO_CALIBRATION, 'K load watts [volts]' calibrates the phase of the load #load (from 1),
+ *          'K' alone aborts the calibration (see utils_autocal.h).
+ *
+ *          With SERIAL_CONTROL, in place of the rotation/override/diversion pins:
+ *          - R           : rotate the load priorities
+ *          - O mask      : force the loads of the bit mask to ON, 'O 0' ends the override
+ *          - X 0|1       : stop (1) or resume (0) the diversion
+ *
+ *          With RAW_SAMPLES_CAPTURE, 'C' requests a capture (see utils_capture.h).
+ *
+ *          With LOAD_STATISTICS, 'H' prints the switching statistics of the loads (see utils_loadstats.h).
+ *
+ *          With RTC_PRESENT, 'T hh:mm:ss' sets the real-time clock (see utils_rtc.h).
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef UTILS_COMMANDS_H
+#define UTILS_COMMANDS_H
+
+#include <Arduino.h>
+
+#include "config.h"
+#include "processing.h"
+#include "utils_autocal.h"
+#include "utils_events.h"
+#include "utils_loadstats.h"
+#include "utils_params.h"
+#include "utils_rtc.h"
+#include "utils_txqueue.h"
+
+/**
+ * @brief Line-based command interpreter
+ *
+ * @tparam N Size of the line buffer, the longer lines are discarded (and answered with "ERR")
+ */
+template< uint8_t N >
+class SerialCommands
+{
+public:
+  /**
+   * @brief Read the received characters, and execute the command once a line is complete
+   * @details Must be called on each loop() pass, never blocks.
+   *
+   */
+  void proceed()
+  {
+    while (Serial.available())
+    {
+      const char c = Serial.read();
+
+      if ('\n' == c || '\r' == c)
+      {
+        if (bOverflow)
+        {
+          serialTxQueue.println(F("ERR"));
+        }
+        else if (length)
+        {
+          line[length] = '\0';
+          execute();
+        }
+        length = 0;
+        bOverflow = false;
+      }
+      else if (length < N - 1)
+      {
+        line[length++] = c;
+      }
+      else
+      {
+        bOverflow = true;
+      }
+    }
+  }
+
+  /**
+   * @brief Get the loads forced through the Serial
+   *
+   * @return uint8_t bit mask of the loads to be forced to ON
+   */
+  uint8_t get_overrideMask() const
+  {
+    return overrideMask;
+  }
+
+private:
+  /**
+   * @brief Execute the command of the line
+   *
+   */
+  void execute()
+  {
+    bool bDone{ false };
+
+    if constexpr (RAW_SAMPLES_CAPTURE)
+    {
+      if ('C' == line[0] && '\0' == line[1])
+      {
+        rawSamplesCapture.arm();
+        bDone = true;
+      }
+    }
+
+    if constexpr (LOAD_STATISTICS)
+    {
+      if ('H' == line[0] && '\0' == line[1])
+      {
+        loadStatistics.print(serialTxQueue);
+        bDone = true;
+      }
+    }
+
+    if constexpr (RTC_PRESENT)
+    {
+      if ('T' == line[0] && ' ' == line[1])
+      {
+        bDone = setTime(line + 2);
+      }
+    }
+
+    if constexpr (RUNTIME_PARAMETERS)
+    {
+      if ('\0' == line[1])
+      {
+        switch (line[0])
+        {
+          case 'G':
+            runtimeParameters.print(serialTxQueue);
+            bDone = true;
+            break;
+          case 'W':
+            runtimeParameters.save();
+            bDone = true;
+            break;
+          case 'D':
+            runtimeParameters.restoreDefaults();
+            bDone = true;
+            break;
+          default:
+            break;
+        }
+      }
+      else if ('S' == line[0] && ' ' == line[1])
+      {
+        bDone = setParameter(line + 2);
+      }
+    }
+
+    if constexpr (AUTO_CALIBRATION)
+    {
+      if ('K' == line[0] && '\0' == line[1])
+      {
+        bDone = autoCalibration.abort();
+      }
+      else if ('K' == line[0] && ' ' == line[1])
+      {
+        bDone = calibrate(line + 2);
+      }
+    }
+
+    if constexpr (SERIAL_CONTROL)
+    {
+      if ('R' == line[0] && '\0' == line[1])
+      {
+        bDone = isrCommands.push({ Commands::ROTATE_LOADS, 0 });
+      }
+      else if (('O' == line[0] || 'X' == line[0]) && ' ' == line[1])
+      {
+        bDone = control(line[0], line + 2);
+      }
+    }
+
+    serialTxQueue.println(bDone ? F("OK") : F("ERR"));
+  }
+
+  /**
+   * @brief Set one parameter
+   *
+   * @param args the arguments of the command, "name value"
+   * @return true if the parameter has been set
+   */
+  static bool setParameter(char *args)
+  {
+    char *value{ strchr(args, ' ') };
+    if (!value)
+    {
+      return false;
+    }
+    *value++ = '\0';
+
+    char *end;
+    const float f_value{ static_cast< float >(strtod(value, &end)) };
+    if (end == value || '\0' != *end)
+    {
+      return false;
+    }
+
+    return runtimeParameters.set(args, f_value);
+  }
+
+  /**
+   * @brief Start a calibration with a reference load
+   *
+   * @param args the arguments of the command, "load watts [volts]"
+   * @return true if the calibration has started
+   */
+  static bool calibrate(const char *args)
+  {
+    char *end;
+    const long load{ strtol(args, &end, 10) };
+    if (end == args || ' ' != *end || load < 1 || load > NO_OF_DUMPLOADS)
+    {
+      return false;
+    }
+
+    args = end + 1;
+    const long watts{ strtol(args, &end, 10) };
+    if (end == args || watts > INT16_MAX || (' ' != *end && '\0' != *end))
+    {
+      return false;
+    }
+
+    float volts{ 0 };
+    if (' ' == *end)
+    {
+      args = end + 1;
+      volts = static_cast< float >(strtod(args, &end));
+      if (end == args || '\0' != *end)
+      {
+        return false;
+      }
+    }
+
+    return autoCalibration.start(load - 1, watts, volts);
+  }
+
+  /**
+   * @brief Set the real-time clock
+   *
+   * @param arg the argument of the command, "hh:mm:ss"
+   * @return true if the clock has been set
+   */
+  static bool setTime(const char *arg)
+  {
+    uint32_t seconds{ 0 };
+
+    for (uint8_t field = 0; field != 3; ++field)
+    {
+      char *end;
+      const long value{ strtol(arg, &end, 10) };
+      if (end == arg || value < 0 || value > (field ? 59 : 23) || *end != (2 == field ? '\0' : ':'))
+      {
+        return false;
+      }
+      seconds = seconds * 60 + value;
+      arg = end + 1;
+    }
+
+    return dailyScheduler.set(seconds);
+  }
+
+  /**
+   * @brief Execute an override or diversion command
+   * @details The override is sent to the ISR by loop(), merged with the one of the dual tariff.
+   *
+   * @param command the command, 'O' or 'X'
+   * @param arg the argument of the command
+   * @return true if the command has been executed
+   */
+  bool control(const char command, const char *arg)
+  {
+    char *end;
+    const long value{ strtol(arg, &end, 10) };
+    if (end == arg || '\0' != *end || value < 0)
+    {
+      return false;
+    }
+
+    if ('O' == command && value < (1L << NO_OF_DUMPLOADS))
+    {
+      overrideMask = value;
+      return true;
+    }
+    if ('X' == command && value <= 1)
+    {
+      return isrCommands.push({ Commands::DIVERSION_OFF, static_cast< uint8_t >(value) });
+    }
+    return false;
+  }
+
+  char line[N];              /**< the line being received */
+  uint8_t length{ 0 };       /**< # of characters in the line */
+  bool bOverflow{ false };   /**< the line is too long, it will be discarded */
+  uint8_t overrideMask{ 0 }; /**< loads forced to ON through the Serial (see SERIAL_CONTROL) */
+};
+
+inline constexpr bool SERIAL_COMMANDS{ RUNTIME_PARAMETERS || SERIAL_CONTROL || LOAD_STATISTICS || RTC_PRESENT }; /**< the Serial input is handled by the command interpreter */
+
+inline SerialCommands< 24 > serialCommands; /**< commands received through the Serial */
+
+#endif  // UTILS_COMMANDS_H
@@ -0,0 +1,172 @@
+/**
+ * @file utils_coordination.h
+ * @author Frédéric Metrich (frederic.metrich@live.fr)
+ * @brief Coordination of several routers sharing the same supply point, through RF
+ * @version 0.1
+ * @date 2024-06-05
+ *
+ * @details On a site with more loads than one router can drive, each router sees the same surplus
+ *          through its own CTs. Without coordination, they all add (or remove) loads at the same time
+ *          and over-divert together.
+ *
+ *          With ROUTER_ROLE == MASTER, the router publishes every COORDINATION_PERIOD_IN_MAINS_CYCLES
+ *          a small message (8 bytes): the surplus at the supply point, its diverted power, and its headroom,
+ *          ie the power of its loads taking part in the diversion which were not ON during the period.
+ *
+ *          With ROUTER_ROLE == SECONDARY, the router offsets its energy bucket by the headroom of the master,
+ *          as an extra required export (see setCoordinationOffset()). The surplus thus goes to the master first,
+ *          the secondary only diverts what the master cannot absorb, and sheds its loads when the master
+ *          has some room left. Without any message during COORDINATION_TIMEOUT_MS, the offset is cleared
+ *          and the secondary diverts on its own.
+ *
+ *          The ISR only aggregates the sums of the period (see processCoordination()), the messages are
+ *          built, sent and received from loop(), never blocking. A message lost in the air is simply
+ *          replaced by the next one.
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef UTILS_COORDINATION_H
+#define UTILS_COORDINATION_H
+
+#include <Arduino.h>
+
+#include "config.h"
+#include "debug.h"
+#include "processing.h"
+
+#ifdef RF_PRESENT
+#include <JeeLib.h>
+
+#include "isr_latency.h"
+
+inline constexpr uint8_t COORDINATION_MAGIC{ 0xC5 }; /**< first byte of a coordination message */
+
+/**
+ * @brief Message of the master router
+ *
+ */
+struct CoordinationMessage
+{
+  uint8_t magic;         /**< COORDINATION_MAGIC, to tell it from the datalog of the same node */
+  uint8_t sequence;      /**< incremented on each message */
+  int16_t surplus;       /**< surplus at the supply point in W, export = +ve */
+  int16_t divertedPower; /**< power diverted by the master in W */
+  int16_t headroom;      /**< power the master can still divert in W */
+};
+
+/**
+ * @brief Non-blocking RF link between the master and the secondary routers
+ *
+ */
+class CoordinationLink
+{
+public:
+  /**
+   * @brief Request the sending of a message, see proceed()
+   * @details Master only. A message still pending is replaced by the newer one.
+   *
+   * @param surplus the surplus at the supply point in W
+   * @param divertedPower the power diverted by the master in W
+   * @param headroom the power the master can still divert in W
+   */
+  void publish(const int16_t surplus, const int16_t divertedPower, const int16_t headroom)
+  {
+    message.magic = COORDINATION_MAGIC;
+    ++message.sequence;
+    message.surplus = surplus;
+    message.divertedPower = divertedPower;
+    message.headroom = headroom;
+    bPending = true;
+  }
+
+  /**
+   * @brief Send the pending message (master), or receive the messages of the master (secondary)
+   * @details Must be called on each loop() pass, before the RF datalog sender.
+   *
+   */
+  void proceed()
+  {
+    if constexpr (COORDINATION_MASTER)
+    {
+      proceedMaster();
+    }
+    else if constexpr (COORDINATION_SECONDARY)
+    {
+      proceedSecondary();
+    }
+  }
+
+private:
+  /**
+   * @brief Send the pending message if the RFM12B is ready
+   *
+   */
+  void proceedMaster()
+  {
+    if (!bPending)
+    {
+      return;
+    }
+
+    LatencySourceScope< LatencySources::RF > latencySource;
+
+    rf12_recvDone();
+    if (!rf12_canSend())
+    {
+      return;  // retry on the next pass
+    }
+    bPending = false;
+
+    rf12_sendStart(0, &message, sizeof(CoordinationMessage));
+  }
+
+  /**
+   * @brief Apply the messages of the master, clear the offset once the master is lost
+   *
+   */
+  void proceedSecondary()
+  {
+    if (rf12_recvDone() && isFromMaster())
+    {
+      memcpy(&message, const_cast< const uint8_t * >(rf12_data), sizeof(CoordinationMessage));
+      lastMessage = millis();
+      bMasterPresent = true;
+
+      setCoordinationOffset(message.headroom);
+      return;
+    }
+
+    if (bMasterPresent && (millis() - lastMessage > COORDINATION_TIMEOUT_MS))
+    {
+      bMasterPresent = false;
+      setCoordinationOffset(0);
+
+      DBUGLN(F("Master router lost!"));
+    }
+  }
+
+  /**
+   * @brief Check the packet just received
+   *
+   * @return true if it is a valid coordination message of the master
+   */
+  static bool isFromMaster()
+  {
+    return (0 == rf12_crc)
+           && ((rf12_hdr & RF12_HDR_MASK) == masterNodeID)
+           && (rf12_len == sizeof(CoordinationMessage))
+           && (COORDINATION_MAGIC == rf12_data[0]);
+  }
+
+  CoordinationMessage message{}; /**< last message sent (master) or received (secondary) */
+  uint32_t lastMessage{ 0 };     /**< time of the last message of the master in ms */
+  bool bPending{ false };        /**< message waiting to be sent */
+  bool bMasterPresent{ false };  /**< a message of the master has been received within COORDINATION_TIMEOUT_MS */
+};
+
+inline CoordinationLink coordinationLink; /**< the one and only coordination link */
+#endif  // RF_PRESENT
+
+#endif  // UTILS_COORDINATION_H
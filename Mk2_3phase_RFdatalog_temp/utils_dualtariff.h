@@ -51,4 +51,30 @@ private:
   uint16_t uiDuration{ UINT16_MAX }; /**< the duration for overriding the load in hours or minutes */
 };
 
+/** @brief Time of the day, for the daily schedule of the real-time clock
+ *  @details Only used with RTC_PRESENT (see utils_rtc.h).
+ */
+class TimeOfDay
+{
+public:
+  constexpr TimeOfDay() = default;
+  constexpr TimeOfDay(uint8_t _hours, uint8_t _minutes)
+    : hours(_hours), minutes(_minutes)
+  {
+  }
+
+  [[nodiscard]] constexpr bool isValid() const
+  {
+    return hours < 24 && minutes < 60;
+  }
+  [[nodiscard]] constexpr uint32_t getSeconds() const
+  {
+    return hours * 3600UL + minutes * 60UL;
+  }
+
+private:
+  uint8_t hours{ 0 };   /**< hours [0..23] */
+  uint8_t minutes{ 0 }; /**< minutes [0..59] */
+};
+
 #endif  // UTILS_DUALTARIFF_H
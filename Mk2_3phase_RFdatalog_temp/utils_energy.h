@@ -0,0 +1,209 @@
+/**
+ * @file utils_energy.h
+ * @author Frédéric Metrich (frederic.metrich@live.fr)
+ * @brief Persistent energy counters, stored in EEPROM
+ * @version 0.1
+ * @date 2024-05-24
+ *
+ * @details The imported/exported energy of each phase and the diverted energy of each load
+ *          are accumulated in RAM, in Joules, and flushed to EEPROM every ENERGY_FLUSH_PERIOD_IN_MINUTES.
+ *
+ *          The EEPROM area is split into slots, each flush writes the next slot (wear levelling).
+ *          Each record holds a sequence number and a CRC, at start-up the valid record with
+ *          the highest sequence number is loaded.
+ *          With 13 slots of 38 bytes and one flush per hour, each slot is written about
+ *          700 times a year: the 100k-cycle endurance lasts for more than a century.
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef UTILS_ENERGY_H
+#define UTILS_ENERGY_H
+
+#include <Arduino.h>
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+
+#include "config.h"
+
+/**
+ * @brief One record of the energy counters, as stored in EEPROM
+ *
+ */
+struct EnergyRecord
+{
+  uint32_t sequence;                    /**< incremented at each flush, 0xFFFFFFFF when erased */
+  uint32_t importWh[NO_OF_PHASES];      /**< imported energy of each phase in Wh */
+  uint32_t exportWh[NO_OF_PHASES];      /**< exported energy of each phase in Wh */
+  uint32_t divertedWh[NO_OF_DUMPLOADS]; /**< diverted energy of each load in Wh */
+  uint16_t crc;                         /**< CRC16 of all the other fields */
+};
+
+/**
+ * @brief Energy counters with a wear-levelled circular log in EEPROM
+ *
+ * @tparam BASE Address of the EEPROM area
+ * @tparam SIZE Size in bytes of the EEPROM area
+ */
+template< uint16_t BASE, uint16_t SIZE >
+class EnergyCounters
+{
+  static_assert(SIZE >= 2 * sizeof(EnergyRecord), "The EEPROM area must hold at least 2 records");
+
+public:
+  /**
+   * @brief Load the latest valid record from EEPROM
+   *
+   */
+  void begin()
+  {
+    EnergyRecord record;
+
+    for (uint8_t slot = 0; slot != NO_OF_SLOTS; ++slot)
+    {
+      read(slot, record);
+
+      if ((UINT32_MAX == record.sequence) || (record.crc != crc(record)))
+      {
+        continue;
+      }
+
+      if (!bValid || (record.sequence > counters.sequence))
+      {
+        counters = record;
+        currentSlot = slot;
+        bValid = true;
+      }
+    }
+  }
+
+  /**
+   * @brief Add the grid energy of one phase
+   *
+   * @param phase the phase number [0..NO_OF_PHASES[
+   * @param joules the energy in J, imported if positive
+   */
+  void addGrid(const uint8_t phase, const int32_t joules)
+  {
+    if (joules > 0)
+    {
+      accumulate(counters.importWh[phase], importJ[phase], joules);
+    }
+    else
+    {
+      accumulate(counters.exportWh[phase], exportJ[phase], -joules);
+    }
+  }
+
+  /**
+   * @brief Add the diverted energy of one load
+   *
+   * @param load the physical load number [0..NO_OF_DUMPLOADS[
+   * @param joules the energy in J
+   */
+  void addDiverted(const uint8_t load, const int32_t joules)
+  {
+    accumulate(counters.divertedWh[load], divertedJ[load], joules);
+  }
+
+  /**
+   * @brief Flush the counters to EEPROM, when due
+   * @details This function must be called every datalog period.
+   *
+   */
+  void proceed()
+  {
+    if (++datalogCount < FLUSH_PERIOD_IN_DATALOGS)
+    {
+      return;
+    }
+    datalogCount = 0;
+
+    flush();
+  }
+
+  /**
+   * @brief Write the counters to the next slot
+   *
+   */
+  void flush()
+  {
+    currentSlot = bValid && (currentSlot + 1 != NO_OF_SLOTS) ? currentSlot + 1 : 0;
+    bValid = true;
+
+    ++counters.sequence;
+    counters.crc = crc(counters);
+
+    eeprom_update_block(&counters, reinterpret_cast< void * >(BASE + currentSlot * sizeof(EnergyRecord)), sizeof(EnergyRecord));
+  }
+
+  /**
+   * @brief Get the counters
+   *
+   * @return const EnergyRecord& the counters in Wh
+   */
+  const EnergyRecord &get() const
+  {
+    return counters;
+  }
+
+private:
+  static constexpr uint8_t NO_OF_SLOTS{ SIZE / sizeof(EnergyRecord) };                                                  /**< # of records in the EEPROM area */
+  static constexpr uint16_t FLUSH_PERIOD_IN_DATALOGS{ ENERGY_FLUSH_PERIOD_IN_MINUTES * 60U / DATALOG_PERIOD_IN_SECONDS }; /**< datalog periods between two flushes */
+
+  /**
+   * @brief Add some energy to a counter, keeping the remainder below 1 Wh
+   *
+   * @param wh the counter in Wh
+   * @param remainder the remainder in J
+   * @param joules the energy to be added in J
+   */
+  static void accumulate(uint32_t &wh, uint16_t &remainder, const int32_t joules)
+  {
+    const uint32_t total{ remainder + static_cast< uint32_t >(joules) };
+
+    wh += total / 3600;
+    remainder = total % 3600;
+  }
+
+  /**
+   * @brief Read one slot
+   *
+   * @param slot the slot number
+   * @param record the destination
+   */
+  static void read(const uint8_t slot, EnergyRecord &record)
+  {
+    eeprom_read_block(&record, reinterpret_cast< const void * >(BASE + slot * sizeof(EnergyRecord)), sizeof(EnergyRecord));
+  }
+
+  /**
+   * @brief Compute the CRC of a record
+   *
+   * @param record the record
+   * @return uint16_t the CRC16 of all the fields but the CRC
+   */
+  static uint16_t crc(const EnergyRecord &record)
+  {
+    uint16_t crc{ 0xFFFF };
+    const uint8_t *data{ reinterpret_cast< const uint8_t * >(&record) };
+    for (uint8_t i = 0; i != offsetof(EnergyRecord, crc); ++i)
+    {
+      crc = _crc16_update(crc, data[i]);
+    }
+    return crc;
+  }
+
+  EnergyRecord counters{};               /**< the counters in Wh */
+  uint16_t importJ[NO_OF_PHASES]{};      /**< remainder of the imported energy in J */
+  uint16_t exportJ[NO_OF_PHASES]{};      /**< remainder of the exported energy in J */
+  uint16_t divertedJ[NO_OF_DUMPLOADS]{}; /**< remainder of the diverted energy in J */
+  uint16_t datalogCount{ 0 };            /**< datalog periods since the last flush */
+  uint8_t currentSlot{ 0 };              /**< slot of the latest record */
+  bool bValid{ false };                  /**< a valid record has been found or written */
+};
+
+inline EnergyCounters< EEPROM_ENERGY_COUNTERS_ADDRESS, EEPROM_ENERGY_COUNTERS_SIZE > energyCounters; /**< persistent energy counters */
+
+#endif  // UTILS_ENERGY_H
@@ -0,0 +1,235 @@
+/**
+ * @file utils_events.h
+ * @author Frédéric Metrich (frederic.metrich@live.fr)
+ * @brief Lock-free queues between the ISR and the main processor
+ * @version 0.1
+ * @date 2024-05-20
+ *
+ * @details Two single-producer/single-consumer rings:
+ *            - events, from the ISR to loop() (load transition, rotation, snapshots ready, ...)
+ *            - commands, from loop() to the ISR (rotation, override, diversion off)
+ *
+ *          Each index is a single byte, written by one side only, so no critical section is needed.
+ *          Back-to-back events are queued instead of being merged into a single flag.
+ *
+ *          The mains cycles and the datalogs must never be lost, whatever the time spent in loop()
+ *          (long print, temperature reading): they do not go through the ring, but through counters
+ *          (see IsrSignals). The items lost by the ring are printed with the datalog.
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef UTILS_EVENTS_H
+#define UTILS_EVENTS_H
+
+#include <Arduino.h>
+#include <util/atomic.h>
+
+#include "config.h"
+#include "hal.h"
+
+inline constexpr uint8_t EVENT_QUEUE_SIZE{ 16 };  /**< must be a power of 2 */
+inline constexpr uint8_t COMMAND_QUEUE_SIZE{ 4 }; /**< must be a power of 2 */
+
+inline constexpr uint8_t CALIBRATION_RUNNING{ 0x80 }; /**< flag of Commands::CALIBRATION, set during the whole auto-calibration */
+
+/** Events from the ISR to loop() */
+enum class Events : uint8_t
+{
+  LOAD_TRANSITION,   /**< a load has been switched, data = load number | (state << 7) */
+  POLARITY_ANOMALY,  /**< a mains cycle out of the expected range, data = phase */
+  LOADS_ROTATED,     /**< the load priorities have been rotated */
+  POWER_READY,       /**< a power snapshot of the last second has been published (see PER_SECOND_POWER) */
+  COORDINATION_READY /**< a coordination snapshot has been published (see RouterRoles::MASTER) */
+};
+
+/** Commands from loop() to the ISR */
+enum class Commands : uint8_t
+{
+  ROTATE_LOADS,   /**< rotate the load priorities */
+  OVERRIDE,       /**< force the loads to ON, data = bit mask of the loads */
+  DIVERSION_OFF,  /**< stop the diversion, data = 0/1 */
+  ENABLE_LOADS,   /**< loads taking part in the diversion, data = bit mask of the loads (see TEMPERATURE_TARGETS) */
+  SET_PRIORITIES, /**< apply the priorities of 'requestedPriorities' (see EQUALISED_ROTATION) */
+  CALIBRATION     /**< force the loads during the auto-calibration, data = CALIBRATION_RUNNING | bit mask of the loads ON, 0 at the end (see AUTO_CALIBRATION) */
+};
+
+/**
+ * @brief One event, with its optional data
+ *
+ */
+struct Event
+{
+  Events type;  /**< type of event */
+  uint8_t data; /**< event specific data */
+};
+
+/**
+ * @brief One command, with its optional data
+ *
+ */
+struct Command
+{
+  Commands type; /**< type of command */
+  uint8_t data;  /**< command specific data */
+};
+
+/**
+ * @brief Single-producer/single-consumer ring
+ * @details The indexes run freely and are masked on access, so that all N slots are usable.
+ *
+ * @tparam T Type of the items
+ * @tparam N Number of items, power of 2
+ */
+template< typename T, uint8_t N >
+class SpscQueue
+{
+  static_assert((N != 0) && ((N & (N - 1)) == 0) && (N <= 128), "The size of the queue must be a power of 2, up to 128");
+
+public:
+  /**
+   * @brief Add an item, called by the producer only
+   *
+   * @param item The item
+   * @return true if the item has been queued, false if the queue is full
+   *
+   * @ingroup TimeCritical
+   */
+  bool push(const T &item)
+  {
+    const uint8_t h{ head };
+    if (static_cast< uint8_t >(h - tail) == N)
+    {
+      if (overflows < UINT8_MAX)
+      {
+        ++overflows;
+      }
+      return false;
+    }
+
+    buffer[h & (N - 1)] = item;
+    halMemoryBarrier();  // the item must be stored before being published
+    head = h + 1;
+    return true;
+  }
+
+  /**
+   * @brief Remove the oldest item, called by the consumer only
+   *
+   * @param item The item
+   * @return true if an item was available
+   *
+   * @ingroup TimeCritical
+   */
+  bool pop(T &item)
+  {
+    const uint8_t t{ tail };
+    if (t == head)
+    {
+      return false;
+    }
+
+    item = buffer[t & (N - 1)];
+    halMemoryBarrier();  // the item must be read before its slot is released
+    tail = t + 1;
+    return true;
+  }
+
+  /**
+   * @brief Get the number of items which could not be queued since startup (saturating)
+   *
+   * @return uint8_t # of lost items
+   */
+  uint8_t get_overflows() const
+  {
+    return overflows;
+  }
+
+private:
+  T buffer[N];                    /**< the items */
+  volatile uint8_t head{ 0 };     /**< next slot to be written, owned by the producer */
+  volatile uint8_t tail{ 0 };     /**< next slot to be read, owned by the consumer */
+  volatile uint8_t overflows{ 0 }; /**< # of rejected items, owned by the producer */
+};
+
+/**
+ * @brief Mains cycles and datalogs from the ISR to loop(), which cannot overflow
+ * @details The ISR only increments its counters, loop() keeps the values it has seen:
+ *          the difference is what is pending, however long loop() has been busy.
+ *          The counters are read in an ATOMIC_BLOCK, as they are 16 bits wide.
+ *
+ */
+class IsrSignals
+{
+public:
+  /**
+   * @brief Signal the start of a new mains cycle of phase 0, called by the ISR only
+   *
+   * @ingroup TimeCritical
+   */
+  void notifyMainsCycle()
+  {
+    mainsCycles = mainsCycles + 1;
+  }
+
+  /**
+   * @brief Signal that a datalog snapshot has been published, called by the ISR only
+   *
+   * @ingroup TimeCritical
+   */
+  void notifyDatalog()
+  {
+    datalogs = datalogs + 1;
+  }
+
+  /**
+   * @brief Get the mains cycles since the last call, called by loop() only
+   *
+   * @return uint16_t # of pending mains cycles
+   */
+  uint16_t takeMainsCycles()
+  {
+    uint16_t count;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      count = mainsCycles;
+    }
+    const uint16_t pending{ static_cast< uint16_t >(count - mainsCyclesSeen) };
+    mainsCyclesSeen = count;
+    return pending;
+  }
+
+  /**
+   * @brief Check for a new datalog since the last call, called by loop() only
+   * @details Only the last snapshot is kept (see datalogSnapshots), so several datalogs
+   *          published meanwhile give a single one.
+   *
+   * @return true if a datalog snapshot is ready
+   */
+  bool takeDatalog()
+  {
+    uint16_t count;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      count = datalogs;
+    }
+    const bool bReady{ count != datalogsSeen };
+    datalogsSeen = count;
+    return bReady;
+  }
+
+private:
+  volatile uint16_t mainsCycles{ 0 }; /**< # of mains cycles since startup, owned by the ISR */
+  volatile uint16_t datalogs{ 0 };    /**< # of datalogs since startup, owned by the ISR */
+  uint16_t mainsCyclesSeen{ 0 };      /**< 'mainsCycles' at the last call, owned by loop() */
+  uint16_t datalogsSeen{ 0 };         /**< 'datalogs' at the last call, owned by loop() */
+};
+
+inline SpscQueue< Event, EVENT_QUEUE_SIZE > isrEvents;       /**< events from the ISR to loop() */
+inline SpscQueue< Command, COMMAND_QUEUE_SIZE > isrCommands; /**< commands from loop() to the ISR */
+inline IsrSignals isrSignals;                                /**< mains cycles and datalogs from the ISR to loop() */
+
+static_assert(NO_OF_DUMPLOADS <= 8, "The override command holds one bit per load");
+
+#endif  // UTILS_EVENTS_H
@@ -0,0 +1,161 @@
+/**
+ * @file utils_frame.h
+ * @author Frédéric Metrich (frederic.metrich@live.fr)
+ * @brief Compact binary framing for the Serial output
+ * @version 0.1
+ * @date 2024-05-06
+ *
+ * @details Each frame is made of:
+ *          | offset | size | content                                     |
+ *          |--------|------|---------------------------------------------|
+ *          | 0      | 1    | sync byte 0xA5                              |
+ *          | 1      | 1    | sync byte 0x5A                              |
+ *          | 2      | 1    | frame type (see FrameTypes)                 |
+ *          | 3      | 2    | payload length N, little-endian             |
+ *          | 5      | N    | payload                                     |
+ *          | 5 + N  | 2    | CRC over bytes [2..5+N[, little-endian      |
+ *
+ *          The CRC is the one of avr-libc '_crc_ccitt_update', aka CRC-16/MCRF4XX
+ *          (polynomial 0x1021 reflected, init 0xFFFF, no final xor).
+ *
+ *          Frames are streamed incrementally from loop(): never more bytes are written
+ *          than the free space in the TX buffer, so loop() is never blocked by the Serial.
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef UTILS_FRAME_H
+#define UTILS_FRAME_H
+
+#include <Arduino.h>
+#include <util/crc16.h>
+
+#include "utils_txqueue.h"
+
+inline constexpr uint8_t FRAME_SYNC_1{ 0xA5 }; /**< first sync byte of each frame */
+inline constexpr uint8_t FRAME_SYNC_2{ 0x5A }; /**< second sync byte of each frame */
+
+inline constexpr uint8_t FRAME_HEADER_SIZE{ 5 }; /**< sync bytes, type and length */
+inline constexpr uint8_t FRAME_CRC_SIZE{ 2 };    /**< size of the trailing CRC */
+
+/** Frame types */
+enum class FrameTypes : uint8_t
+{
+  RAW_SAMPLES = 0x01, /**< raw V/I samples of all channels */
+  DATALOG = 0x02,     /**< datalog record, see DatalogFramePayload in utils.h */
+  FAST_STREAM = 0x03, /**< power per phase and bucket level, see FastStreamFramePayload in utils.h */
+};
+
+/**
+ * @brief Stream one binary frame over several loop() passes
+ * @details The payload is NOT copied, it must remain unchanged until the frame has been sent.
+ *
+ */
+class FrameStreamer
+{
+public:
+  /**
+   * @brief Check if a frame is currently being sent
+   *
+   * @return true if busy
+   */
+  bool isBusy() const
+  {
+    return remaining != 0;
+  }
+
+  /**
+   * @brief Start a new frame
+   *
+   * @param type The frame type
+   * @param payload The payload
+   * @param size The size of the payload in bytes
+   * @return true if the frame has been accepted
+   */
+  bool start(const FrameTypes type, const void *payload, const uint16_t size)
+  {
+    if (isBusy())
+    {
+      return false;
+    }
+
+    header[0] = FRAME_SYNC_1;
+    header[1] = FRAME_SYNC_2;
+    header[2] = static_cast< uint8_t >(type);
+    header[3] = lowByte(size);
+    header[4] = highByte(size);
+
+    data = static_cast< const uint8_t * >(payload);
+    payloadSize = size;
+    position = 0;
+    remaining = FRAME_HEADER_SIZE + size + FRAME_CRC_SIZE;
+    crc = 0xFFFF;
+
+    return true;
+  }
+
+  /**
+   * @brief Write as many bytes as the TX buffer can take without blocking
+   *
+   */
+  void proceed()
+  {
+    if (!remaining)
+    {
+      return;
+    }
+
+    auto room{ serialTxRoom() };
+
+    while (remaining && room > 0)
+    {
+      const auto byte{ nextByte() };
+      serialTxWrite(byte);
+      ++position;
+      --remaining;
+      room = POLLED_SERIAL_TX ? serialTxRoom() : room - 1;
+    }
+  }
+
+private:
+  /**
+   * @brief Get the byte at the current position, and update the CRC
+   *
+   * @return uint8_t The byte to send
+   */
+  uint8_t nextByte()
+  {
+    uint8_t byte;
+
+    if (position < FRAME_HEADER_SIZE)
+    {
+      byte = header[position];
+    }
+    else if (position < FRAME_HEADER_SIZE + payloadSize)
+    {
+      byte = data[position - FRAME_HEADER_SIZE];
+    }
+    else
+    {
+      return (position == FRAME_HEADER_SIZE + payloadSize) ? lowByte(crc) : highByte(crc);
+    }
+
+    if (position >= 2)
+    {
+      crc = _crc_ccitt_update(crc, byte);
+    }
+    return byte;
+  }
+
+  uint8_t header[FRAME_HEADER_SIZE]{}; /**< header of the current frame */
+  const uint8_t *data{ nullptr };      /**< payload of the current frame */
+  uint16_t payloadSize{ 0 };           /**< size of the payload */
+  uint16_t position{ 0 };              /**< position of the next byte to send */
+  uint16_t remaining{ 0 };             /**< number of bytes still to be sent */
+  uint16_t crc{ 0xFFFF };              /**< running CRC */
+};
+
+inline FrameStreamer frameStreamer; /**< the one and only frame streamer */
+
+#endif  // UTILS_FRAME_H
@@ -0,0 +1,199 @@
+/**
+ * @file utils_loadstats.h
+ * @author Frédéric Metrich (frederic.metrich@live.fr)
+ * @brief Switching statistics of the loads
+ * @version 0.1
+ * @date 2024-05-30
+ *
+ * @details With LOAD_STATISTICS, the ISR follows the ON/OFF runs of each load, once per mains cycle
+ *          (see updatePortsStates()). At the end of each run, its length in mains cycles is added
+ *          to the histogram of the ON or OFF runs of the load. The bins grow by a factor of 4:
+ *          1..3, 4..15, 16..63, ... cycles, up to 16384+ cycles (5.5 min @ 50 Hz).
+ *          The switch-on count and the mean length of the ON runs are kept along.
+ *
+ *          All the counters are saturating, they are never reset (until the next start).
+ *          A short switching rate shows up in the first bins: this is what heats the triacs
+ *          and makes the lights flicker.
+ *
+ *          The statistics are printed with the 'H' command through the Serial (see utils_commands.h).
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef UTILS_LOADSTATS_H
+#define UTILS_LOADSTATS_H
+
+#include <Arduino.h>
+#include <util/atomic.h>
+
+#include "config.h"
+#include "utils_print.h"
+
+inline constexpr uint8_t LOAD_STATISTICS_BINS{ 8 }; /**< bins of the histograms, the run lengths grow by a factor of 4 from one bin to the next */
+
+/**
+ * @brief Switching statistics of a set of loads
+ *
+ * @tparam N Number of loads
+ */
+template< uint8_t N >
+class LoadStatistics
+{
+public:
+  /**
+   * @brief Follow the state of one load, called once per mains cycle
+   *
+   * @param load The load [0..N[
+   * @param bOn The state of the load during this cycle
+   *
+   * @ingroup TimeCritical
+   */
+  void update(const uint8_t load, const bool bOn)
+  {
+    auto &stats{ loads[load] };
+
+    if (bOn == stats.bOn)
+    {
+      if (stats.runLength != UINT16_MAX)
+      {
+        ++stats.runLength;
+      }
+      return;
+    }
+
+    // the current run ends
+    if (stats.runLength)
+    {
+      increment((stats.bOn ? stats.histogramOn : stats.histogramOff)[binOf(stats.runLength)]);
+
+      if (stats.bOn && stats.onRuns != UINT16_MAX)
+      {
+        ++stats.onRuns;
+        stats.onCycles += stats.runLength;
+      }
+    }
+
+    if (bOn)
+    {
+      increment(stats.switchOnCount);
+    }
+
+    stats.bOn = bOn;
+    stats.runLength = 1;
+  }
+
+  /**
+   * @brief Print the statistics of all loads
+   * @details The counters are copied with the interrupts disabled, then printed.
+   *
+   * @param out Where to print
+   */
+  void print(Print &out) const
+  {
+    LoadStatistics copy;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      copy = *this;
+    }
+
+    for (uint8_t load = 0; load < N; ++load)
+    {
+      const auto &stats{ copy.loads[load] };
+
+      out.print(F("Load #"));
+      printDecimal(out, load + 1);
+      out.print(F(": switch-on "));
+      printDecimal(out, stats.switchOnCount);
+      out.print(F(", mean ON run "));
+      printDecimal(out, stats.onRuns ? stats.onCycles / stats.onRuns : 0);
+      out.println(F(" cycles"));
+
+      printHistogram(out, F("\tON runs: "), stats.histogramOn);
+      printHistogram(out, F("\tOFF runs:"), stats.histogramOff);
+    }
+  }
+
+  /**
+   * @brief Get the size of the statistics
+   *
+   * @return constexpr uint16_t The size in bytes
+   */
+  static constexpr uint16_t get_ram_size()
+  {
+    return sizeof(LoadStatistics);
+  }
+
+private:
+  /**
+   * @brief Statistics of one load
+   *
+   */
+  struct Stats
+  {
+    uint16_t histogramOn[LOAD_STATISTICS_BINS]{};  /**< # of ON runs per length bin */
+    uint16_t histogramOff[LOAD_STATISTICS_BINS]{}; /**< # of OFF runs per length bin */
+    uint32_t onCycles{ 0 };                        /**< total length of the counted ON runs */
+    uint16_t onRuns{ 0 };                          /**< # of counted ON runs */
+    uint16_t switchOnCount{ 0 };                   /**< # of OFF -> ON transitions */
+    uint16_t runLength{ 0 };                       /**< length of the current run */
+    bool bOn{ false };                             /**< state of the current run */
+  };
+
+  /**
+   * @brief Get the bin of a run length
+   *
+   * @param runLength The length in mains cycles
+   * @return uint8_t The bin [0..LOAD_STATISTICS_BINS[
+   */
+  static uint8_t binOf(uint16_t runLength)
+  {
+    uint8_t bin{ 0 };
+    while (runLength >= 4 && bin < LOAD_STATISTICS_BINS - 1)
+    {
+      runLength >>= 2;
+      ++bin;
+    }
+    return bin;
+  }
+
+  /**
+   * @brief Saturating increment
+   *
+   * @param counter The counter
+   */
+  static void increment(uint16_t &counter)
+  {
+    if (counter != UINT16_MAX)
+    {
+      ++counter;
+    }
+  }
+
+  /**
+   * @brief Print one histogram, e.g. "ON runs:   1+:12  4+:3  16+:0 ..."
+   *
+   * @param out Where to print
+   * @param label The label of the histogram
+   * @param histogram The bins
+   */
+  static void printHistogram(Print &out, const __FlashStringHelper *label, const uint16_t (&histogram)[LOAD_STATISTICS_BINS])
+  {
+    out.print(label);
+    for (uint8_t bin = 0; bin < LOAD_STATISTICS_BINS; ++bin)
+    {
+      out.print(F("  "));
+      printDecimal(out, 1L << (2 * bin));
+      out.print(F("+:"));
+      printDecimal(out, histogram[bin]);
+    }
+    out.println();
+  }
+
+  Stats loads[N]; /**< statistics of each load */
+};
+
+inline LoadStatistics< NO_OF_DUMPLOADS > loadStatistics; /**< written by the ISR, printed by loop() (see LOAD_STATISTICS) */
+
+#endif  // UTILS_LOADSTATS_H
@@ -0,0 +1,157 @@
+/**
+ * @file utils_meter.h
+ * @author Frédéric Metrich (frederic.metrich@live.fr)
+ * @brief Cross-check of the measured power against the pulses of the utility meter
+ * @version 0.1
+ * @date 2024-06-12
+ *
+ * @details With METER_PULSE_INPUT, the S0 (or LED-sensor) output of the utility meter is wired
+ *          to 'meterPulsePin'. Its pulses are counted by an external interrupt, and latched by the ADC ISR
+ *          at the end of each datalog period, so that they cover the same mains cycles as the measurements:
+ *          - the metered power of each period is printed next to the measured one (", M:"),
+ *          - over the periods of steady import, the energy of both is summed. Each METER_TRIM_PULSES pulses,
+ *            the meter/router ratio is printed through the debug port.
+ *
+ *          Only the periods importing at least METER_MIN_IMPORT_IN_WATTS with all the loads OFF are kept:
+ *          the meter does not count the export, while the router nets the import and the export of a period.
+ *
+ *          With METER_CALIBRATION_TRIM, the power calibration of all phases is moved by METER_TRIM_GAIN
+ *          of the deviation at the end of each window, unless the deviation is above METER_TRIM_MAX_ERROR
+ *          (wrong METER_PULSES_PER_KWH, missing pulses, wiring fault). The meter only sees the total,
+ *          so the balance between the phases is kept as calibrated. The trim is applied at once,
+ *          and saved to EEPROM with the 'W' command (see utils_commands.h).
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef UTILS_METER_H
+#define UTILS_METER_H
+
+#include <Arduino.h>
+
+#include "config.h"
+#include "debug.h"
+#include "processing.h"
+#include "utils_params.h"
+
+inline constexpr int16_t METER_MIN_IMPORT_IN_WATTS{ 300 }; /**< smallest import of a period for the ratio, so that there's no export within the period */
+inline constexpr uint16_t METER_TRIM_PULSES{ 200 };        /**< pulses of a window, ie a resolution of 0.5 % */
+inline constexpr float METER_TRIM_MAX_ERROR{ 0.1F };       /**< above 10 % of deviation, the calibration is not trimmed */
+inline constexpr float METER_TRIM_GAIN{ 0.25F };           /**< share of the deviation corrected at each window */
+
+inline constexpr float METER_WATTS_PER_PULSE{ 3600000.0F / (static_cast< float >(METER_PULSES_PER_KWH) * DATALOG_PERIOD_IN_SECONDS) }; /**< power of one pulse per datalog period in W */
+
+/**
+ * @brief Cross-check with the utility meter, one step per datalog period
+ *
+ */
+class MeterCheck
+{
+public:
+  /**
+   * @brief Check the last datalog period
+   * @details Called after the measurements of tx_data have been computed.
+   *
+   */
+  void proceed()
+  {
+    meteredPower = static_cast< int16_t >(datalogSnapshot.meterPulses * METER_WATTS_PER_PULSE + 0.5F);
+
+    if (!isSteadyImport())
+    {
+      return;
+    }
+
+    windowPulses += datalogSnapshot.meterPulses;
+    windowRouterPulses += tx_data.power / METER_WATTS_PER_PULSE;
+
+    if (windowPulses < METER_TRIM_PULSES)
+    {
+      return;
+    }
+
+    ratio = windowPulses / windowRouterPulses;
+    windowPulses = 0;
+    windowRouterPulses = 0;
+
+    DBUG(F("Meter/router: "));
+    DBUGLN(ratio, 4);
+
+    if constexpr (METER_CALIBRATION_TRIM)
+    {
+      trim();
+    }
+  }
+
+  /**
+   * @brief Get the metered power of the last datalog period
+   *
+   * @return int16_t the power in W, from the pulses of the period
+   */
+  int16_t get_meteredPower() const
+  {
+    return meteredPower;
+  }
+
+  /**
+   * @brief Get the meter/router ratio of the last window
+   *
+   * @return float the ratio, 0 until the first window is complete
+   */
+  float get_ratio() const
+  {
+    return ratio;
+  }
+
+private:
+  /**
+   * @brief Check if the last period can be compared with the meter
+   *
+   * @return true if the period has imported steadily, with all the loads OFF
+   */
+  bool isSteadyImport() const
+  {
+    if (tx_data.power < METER_MIN_IMPORT_IN_WATTS)
+    {
+      return false;
+    }
+
+    for (const auto &count : datalogSnapshot.countLoadON)
+    {
+      if (count)
+      {
+        return false;  // the burst-fired loads make the power hover around 0, and export now and then
+      }
+    }
+    return true;
+  }
+
+  /**
+   * @brief Move the power calibration of all phases towards the meter
+   *
+   */
+  void trim() const
+  {
+    if (fabs(ratio - 1) > METER_TRIM_MAX_ERROR)
+    {
+      DBUGLN(F("Meter deviation too large, calibration not trimmed"));
+      return;
+    }
+
+    const float factor{ 1 + METER_TRIM_GAIN * (ratio - 1) };
+    for (uint8_t phase = 0; phase < NO_OF_PHASES; ++phase)
+    {
+      runtimeParameters.setCalibration(phase, getPowerCal(phase) * factor, getVoltageCal(phase));
+    }
+  }
+
+  float windowRouterPulses{ 0 }; /**< energy measured by the router during the window, in pulses */
+  float ratio{ 0 };              /**< meter/router ratio of the last window */
+  uint16_t windowPulses{ 0 };    /**< pulses of the meter during the window */
+  int16_t meteredPower{ 0 };     /**< metered power of the last datalog period in W */
+};
+
+inline MeterCheck meterCheck; /**< cross-check with the utility meter */
+
+#endif  // UTILS_METER_H
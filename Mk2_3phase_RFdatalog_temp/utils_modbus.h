@@ -0,0 +1,392 @@
+/**
+ * @file utils_modbus.h
+ * @author Frédéric Metrich (frederic.metrich@live.fr)
+ * @brief Modbus RTU slave on the Serial
+ * @version 0.1
+ * @date 2024-05-26
+ *
+ * @details With MODBUS_SLAVE, the router answers as a Modbus RTU slave (SERIAL_BAUD_RATE, 8N1) at MODBUS_SLAVE_ADDRESS.
+ *
+ *          The bytes are received by the RX interrupt of the Serial, which only stores them in its buffer.
+ *          loop() moves them into the frame buffer on each pass and timestamps each of them, the end
+ *          of the frame is detected by a silence of 3.5 characters since the last one. The answer is
+ *          at most 63 bytes long, it fits in the TX buffer of the Serial and is sent without blocking.
+ *          The ADC ISR is never delayed by more than the two short UART interrupts.
+ *
+ *          Supported functions:
+ *          - 0x01 Read Coils
+ *          - 0x04 Read Input Registers (29 registers max per request)
+ *          - 0x05 Write Single Coil
+ *
+ *          Input registers, updated every datalog period (see ModbusInputRegisters):
+ *          | address        | content                                          |
+ *          |----------------|--------------------------------------------------|
+ *          | 0              | total power in W, import = +ve                   |
+ *          | 1 + phase      | power per phase in W                             |
+ *          | 4 + phase      | Vrms per phase in 1/100 V                        |
+ *          | 7 + phase      | Irms per phase in 1/100 A                        |
+ *          | 10 + phase     | mains frequency per phase in 1/100 Hz            |
+ *          | 13 + sensor    | temperature in 1/100 °C (none if no sensor)      |
+ *          | then, per load | mains cycles ON of each load in the period       |
+ *          | then           | relay states, one bit per relay                  |
+ *          | then           | level of the energy bucket in J                  |
+ *          | then           | # of sample sets during the period               |
+ *          | then           | lowest # of sample sets per mains cycle          |
+ *          | then           | # of mains cycles without diverted energy        |
+ *          | then           | bit 0: off-peak period                           |
+ *
+ *          Coils:
+ *          | address              | content                                       |
+ *          |----------------------|-----------------------------------------------|
+ *          | 0..NO_OF_DUMPLOADS-1 | the load is forced to ON (override)           |
+ *          | NO_OF_DUMPLOADS      | the diversion is stopped                      |
+ *          | NO_OF_DUMPLOADS + 1  | write ON to rotate the priorities, reads OFF  |
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef UTILS_MODBUS_H
+#define UTILS_MODBUS_H
+
+#include <Arduino.h>
+#include <util/crc16.h>
+
+#include "config.h"
+#include "processing.h"
+#include "utils_events.h"
+
+/**
+ * @brief Input registers of the Modbus slave
+ *
+ */
+struct ModbusInputRegisters
+{
+  decltype(tx_data) data;                /**< same content as the RF payload */
+  uint16_t countLoadON[NO_OF_DUMPLOADS]; /**< # of mains cycles each load was ON */
+  uint16_t relayStates;                  /**< one bit per relay */
+  int16_t energyInBucket;                /**< energy bucket level in J */
+  uint16_t sampleSets;                   /**< # of sample sets during the datalog period */
+  uint16_t lowestNoOfSampleSets;         /**< lowest # of sample sets per mains cycle */
+  uint16_t absenceOfDivertedEnergy;      /**< # of mains cycles without diverted energy (saturated) */
+  uint16_t flags;                        /**< bit 0: off-peak */
+};
+
+/**
+ * @brief Modbus RTU slave
+ *
+ * @tparam ADDRESS Address of the slave [1..247]
+ */
+template< uint8_t ADDRESS >
+class ModbusSlave
+{
+  static_assert(ADDRESS && ADDRESS <= 247, "The address of the Modbus slave must be in [1..247]");
+  static_assert(sizeof(ModbusInputRegisters) % 2 == 0, "The input registers must be 16-bit wide");
+  static_assert(NO_OF_DUMPLOADS + 2 <= 16, "The coils must fit in 2 bytes");
+
+public:
+  /**
+   * @brief Update the input registers
+   * @details Must be called every datalog period, once tx_data is up to date.
+   *
+   * @param bOffPeak true if off-peak tariff is active
+   */
+  void update(const bool bOffPeak)
+  {
+    registers.data = tx_data;
+    for (uint8_t idx = 0; idx < NO_OF_DUMPLOADS; ++idx)
+    {
+      registers.countLoadON[idx] = datalogSnapshot.countLoadON[idx];
+    }
+
+    registers.relayStates = 0;
+    if constexpr (RELAY_DIVERSION)
+    {
+      for (uint8_t idx = 0; idx < relays.get_size(); ++idx)
+      {
+        registers.relayStates |= relays.get_relay(idx).isRelayON() ? bit(idx) : 0;
+      }
+    }
+
+    registers.energyInBucket = static_cast< int16_t >(datalogSnapshot.energyInBucket_main * f_energyBucketToJoules);
+    registers.sampleSets = datalogSnapshot.sampleSetsDuringThisDatalogPeriod;
+    registers.lowestNoOfSampleSets = datalogSnapshot.lowestNoOfSampleSetsPerMainsCycle;
+
+    const uint32_t count{ absenceOfDivertedEnergyCount };
+    registers.absenceOfDivertedEnergy = count > UINT16_MAX ? UINT16_MAX : count;
+
+    registers.flags = bOffPeak ? 0x01 : 0x00;
+  }
+
+  /**
+   * @brief Receive the request and send the answer
+   * @details Must be called on each loop() pass, never blocks.
+   *
+   */
+  void proceed()
+  {
+    while (Serial.available())
+    {
+      const uint8_t byte = Serial.read();
+      if (length < sizeof(frame))
+      {
+        frame[length] = byte;
+      }
+      if (length != UINT8_MAX)
+      {
+        ++length;
+      }
+      lastByteTime = static_cast< uint32_t >(micros());  // when loop() reads it, the RX interrupt keeps no time
+    }
+
+    if (!length || (static_cast< uint32_t >(micros()) - lastByteTime < FRAME_SILENCE_IN_US))
+    {
+      return;
+    }
+
+    if (length <= sizeof(frame))
+    {
+      processFrame();
+    }
+    length = 0;
+  }
+
+  /**
+   * @brief Get the loads forced through the coils
+   *
+   * @return uint8_t bit mask of the loads to be forced to ON
+   */
+  uint8_t get_overrideMask() const
+  {
+    return overrideMask;
+  }
+
+private:
+  static constexpr uint8_t NO_OF_INPUT_REGISTERS{ sizeof(ModbusInputRegisters) / 2 }; /**< # of input registers */
+  static constexpr uint8_t NO_OF_COILS{ NO_OF_DUMPLOADS + 2 };                        /**< # of coils */
+  static constexpr uint8_t COIL_DIVERSION_OFF{ NO_OF_DUMPLOADS };                     /**< the diversion is stopped */
+  static constexpr uint8_t COIL_ROTATION{ NO_OF_DUMPLOADS + 1 };                      /**< rotate the priorities */
+  static constexpr uint8_t MAX_REGISTERS_PER_REQUEST{ 29 };                           /**< the answer must fit in the TX buffer */
+  static constexpr uint16_t FRAME_SILENCE_IN_US{ SERIAL_BAUD_RATE > 19200 ? 1750 : 35UL * 11 * 1000000 / SERIAL_BAUD_RATE / 10 }; /**< 3.5 characters of 11 bits, 1.75 ms above 19200 baud */
+
+  /**
+   * @brief Modbus exception codes
+   *
+   */
+  enum class Exceptions : uint8_t
+  {
+    ILLEGAL_FUNCTION = 1,
+    ILLEGAL_DATA_ADDRESS = 2,
+    ILLEGAL_DATA_VALUE = 3,
+    SLAVE_DEVICE_FAILURE = 4
+  };
+
+  /**
+   * @brief Check then execute a complete frame
+   *
+   */
+  void processFrame()
+  {
+    if (length < 4)
+    {
+      return;
+    }
+
+    const bool bBroadcast{ 0 == frame[0] };
+    if (!bBroadcast && ADDRESS != frame[0])
+    {
+      return;
+    }
+
+    if (crc(frame, length - 2) != word(frame[length - 1], frame[length - 2]))
+    {
+      return;
+    }
+
+    if (8 != length)  // all the supported requests are 8 bytes long
+    {
+      reply(bBroadcast, exception(Exceptions::ILLEGAL_FUNCTION));
+      return;
+    }
+
+    const uint16_t start{ word(frame[2], frame[3]) };
+    const uint16_t value{ word(frame[4], frame[5]) };
+
+    switch (frame[1])
+    {
+      case 0x01:
+        reply(bBroadcast, readCoils(start, value));
+        break;
+      case 0x04:
+        reply(bBroadcast, readInputRegisters(start, value));
+        break;
+      case 0x05:
+        reply(bBroadcast, writeSingleCoil(start, value));
+        break;
+      default:
+        reply(bBroadcast, exception(Exceptions::ILLEGAL_FUNCTION));
+        break;
+    }
+  }
+
+  /**
+   * @brief Read Coils (0x01)
+   *
+   * @param start address of the first coil
+   * @param count # of coils
+   * @return uint8_t the length of the answer without the CRC
+   */
+  uint8_t readCoils(const uint16_t start, const uint16_t count)
+  {
+    if (!count || count > NO_OF_COILS)
+    {
+      return exception(Exceptions::ILLEGAL_DATA_VALUE);
+    }
+    if (start + count > NO_OF_COILS)
+    {
+      return exception(Exceptions::ILLEGAL_DATA_ADDRESS);
+    }
+
+    const uint16_t coils{ static_cast< uint16_t >(overrideMask | (bDiversionOff ? bit(COIL_DIVERSION_OFF) : 0)) };
+    const uint16_t states = (coils >> start) & (bit(count) - 1);
+    const uint8_t bytes = (count + 7) >> 3;
+
+    frame[2] = bytes;
+    frame[3] = lowByte(states);
+    frame[4] = highByte(states);  // only sent with more than 8 coils
+
+    return 3 + bytes;
+  }
+
+  /**
+   * @brief Read Input Registers (0x04)
+   *
+   * @param start address of the first register
+   * @param count # of registers
+   * @return uint8_t the length of the answer without the CRC
+   */
+  uint8_t readInputRegisters(const uint16_t start, const uint16_t count)
+  {
+    if (!count || count > MAX_REGISTERS_PER_REQUEST)
+    {
+      return exception(Exceptions::ILLEGAL_DATA_VALUE);
+    }
+    if (start + count > NO_OF_INPUT_REGISTERS)
+    {
+      return exception(Exceptions::ILLEGAL_DATA_ADDRESS);
+    }
+
+    frame[2] = count << 1;
+
+    const uint16_t *data{ reinterpret_cast< const uint16_t * >(&registers) + start };
+    for (uint8_t i = 0; i != count; ++i)
+    {
+      frame[3 + (i << 1)] = highByte(data[i]);  // big-endian
+      frame[4 + (i << 1)] = lowByte(data[i]);
+    }
+
+    return 3 + (count << 1);
+  }
+
+  /**
+   * @brief Write Single Coil (0x05)
+   *
+   * @param address address of the coil
+   * @param value 0xFF00 for ON, 0x0000 for OFF
+   * @return uint8_t the length of the answer without the CRC (echo of the request)
+   */
+  uint8_t writeSingleCoil(const uint16_t address, const uint16_t value)
+  {
+    if (0xFF00 != value && 0x0000 != value)
+    {
+      return exception(Exceptions::ILLEGAL_DATA_VALUE);
+    }
+    if (address >= NO_OF_COILS)
+    {
+      return exception(Exceptions::ILLEGAL_DATA_ADDRESS);
+    }
+
+    const bool bOn{ 0xFF00 == value };
+
+    if (address < NO_OF_DUMPLOADS)
+    {
+      overrideMask = bOn ? overrideMask | bit(address) : overrideMask & ~bit(address);
+    }
+    else if (COIL_DIVERSION_OFF == address)
+    {
+      if (!isrCommands.push({ Commands::DIVERSION_OFF, bOn }))
+      {
+        return exception(Exceptions::SLAVE_DEVICE_FAILURE);
+      }
+      bDiversionOff = bOn;
+    }
+    else if (bOn && !isrCommands.push({ Commands::ROTATE_LOADS, 0 }))
+    {
+      return exception(Exceptions::SLAVE_DEVICE_FAILURE);
+    }
+
+    return 6;
+  }
+
+  /**
+   * @brief Build an exception answer
+   *
+   * @param code the exception code
+   * @return uint8_t the length of the answer without the CRC
+   */
+  uint8_t exception(const Exceptions code)
+  {
+    frame[1] |= 0x80;
+    frame[2] = static_cast< uint8_t >(code);
+    return 3;
+  }
+
+  /**
+   * @brief Send the answer, if any
+   * @details The answer to a broadcast request is never sent.
+   *
+   * @param bBroadcast true if the request was a broadcast
+   * @param size the length of the answer without the CRC
+   */
+  void reply(const bool bBroadcast, const uint8_t size)
+  {
+    if (bBroadcast)
+    {
+      return;
+    }
+
+    const uint16_t check{ crc(frame, size) };
+    frame[size] = lowByte(check);
+    frame[size + 1] = highByte(check);
+
+    Serial.write(frame, size + 2);
+  }
+
+  /**
+   * @brief Compute the Modbus CRC
+   *
+   * @param data the bytes
+   * @param size # of bytes
+   * @return uint16_t the CRC16 (polynomial 0xA001, init 0xFFFF)
+   */
+  static uint16_t crc(const uint8_t *data, const uint8_t size)
+  {
+    uint16_t crc{ 0xFFFF };
+    for (uint8_t i = 0; i != size; ++i)
+    {
+      crc = _crc16_update(crc, data[i]);
+    }
+    return crc;
+  }
+
+  ModbusInputRegisters registers{};                 /**< the input registers */
+  uint8_t frame[5 + 2 * MAX_REGISTERS_PER_REQUEST]; /**< the request being received, then the answer */
+  uint32_t lastByteTime{ 0 };                       /**< time of the last received byte in µs */
+  uint8_t length{ 0 };                              /**< # of bytes received, saturated */
+  uint8_t overrideMask{ 0 };                        /**< loads forced to ON through the coils */
+  bool bDiversionOff{ false };                      /**< the diversion has been stopped through the coils */
+};
+
+inline ModbusSlave< MODBUS_SLAVE_ADDRESS > modbusSlave; /**< Modbus RTU slave on the Serial */
+
+#endif  // UTILS_MODBUS_H
@@ -0,0 +1,581 @@
+/**
+ * @file utils_params.h
+ * @author Frédéric Metrich (frederic.metrich@live.fr)
+ * @brief Runtime parameters, stored in EEPROM
+ * @version 0.1
+ * @date 2024-05-25
+ *
+ * @details With RUNTIME_PARAMETERS, the power/voltage calibration of each phase, the export rate,
+ *          the output mode, the thresholds of the relays and the force windows of the loads
+ *          can be changed through the Serial (see utils_commands.h) without reflashing.
+ *          The parameters are loaded from EEPROM at start-up, the values of calibration.h, config.h and
+ *          config_system.h are used when the EEPROM does not hold a valid block.
+ *
+ *          The ISR never reads this block: each change is pre-scaled into its own calibration
+ *          (see updateIsrCalibration()). The relays and the force windows, handled in loop(),
+ *          get their own copy (see relayOutput::set_thresholds(), rg_OffsetForce and dailySchedule).
+ *          Without RUNTIME_PARAMETERS, the accessors return the constexpr values, which are folded
+ *          at compile time as before.
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef UTILS_PARAMS_H
+#define UTILS_PARAMS_H
+
+#include <Arduino.h>
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+
+#include "calibration.h"
+#include "config.h"
+#include "dualtariff.h"
+#include "processing.h"
+#include "utils_rtc.h"
+
+/**
+ * @brief Runtime parameters, as stored in EEPROM
+ *
+ */
+struct RuntimeParameters
+{
+  uint8_t size;                                       /**< size of the block, to discard the block of another build */
+  float powerCal[NO_OF_PHASES];                       /**< see f_powerCal */
+  float voltageCal[NO_OF_PHASES];                     /**< see f_voltageCal */
+  int16_t requiredExportInWatts;                      /**< see REQUIRED_EXPORT_IN_WATTS */
+  OutputModes outputMode;                             /**< see outputMode */
+  int16_t relaySurplusThreshold[relays.get_size()];   /**< see relays */
+  int16_t relayImportThreshold[relays.get_size()];    /**< see relays */
+  pairForceLoad forceLoad[NO_OF_DUMPLOADS];           /**< see rg_ForceLoad */
+  uint16_t crc;                                       /**< CRC16 of all the other fields */
+};
+
+/**
+ * @brief Runtime parameters, with their copy in EEPROM
+ *
+ * @tparam BASE Address of the block in EEPROM
+ */
+template< uint16_t BASE >
+class RuntimeParametersBlock
+{
+  static_assert((BASE >= EEPROM_ENERGY_COUNTERS_ADDRESS + EEPROM_ENERGY_COUNTERS_SIZE) || (BASE + sizeof(RuntimeParameters) <= EEPROM_ENERGY_COUNTERS_ADDRESS),
+                "The runtime parameters must not overlap the energy counters");
+
+public:
+  /**
+   * @brief Load the parameters from EEPROM, or the defaults if the EEPROM does not hold a valid block
+   *
+   */
+  void begin()
+  {
+    RuntimeParameters stored;
+    eeprom_read_block(&stored, reinterpret_cast< const void * >(BASE), sizeof(RuntimeParameters));
+
+    if (sizeof(RuntimeParameters) == stored.size && stored.crc == crc(stored) && isValid(stored))
+    {
+      params = stored;
+    }
+    else
+    {
+      params = defaults();
+    }
+    apply();
+  }
+
+  /**
+   * @brief Write the parameters to EEPROM (only the modified bytes are written)
+   *
+   */
+  void save()
+  {
+    params.crc = crc(params);
+    eeprom_update_block(&params, reinterpret_cast< void * >(BASE), sizeof(RuntimeParameters));
+  }
+
+  /**
+   * @brief Restore the defaults of calibration.h, config.h and config_system.h (the EEPROM is not modified)
+   *
+   */
+  void restoreDefaults()
+  {
+    params = defaults();
+    apply();
+  }
+
+  /**
+   * @brief Set one parameter
+   * @details The names are PC1..PC3 (power calibration), VC1..VC3 (voltage calibration), EX (export rate in W),
+   *          AF (1 for the anti-flicker mode, 0 for the normal mode) and:
+   *          - with RELAY_DIVERSION, RS1..RSn and RI1..RIn (surplus and import thresholds of each relay in W),
+   *          - with DUAL_TARIFF or RTC_PRESENT, FO1..FOn and FD1..FDn (start offset and duration
+   *            of the force window of each load, see rg_ForceLoad).
+   *
+   * @param name the name of the parameter
+   * @param value the new value
+   * @return true if the name is known and the value is valid
+   */
+  bool set(const char *name, const float value)
+  {
+    RuntimeParameters updated{ params };
+
+    if ('E' == name[0] && 'X' == name[1] && '\0' == name[2])
+    {
+      if (value < INT16_MIN || value > INT16_MAX)
+      {
+        return false;
+      }
+      updated.requiredExportInWatts = static_cast< int16_t >(value);
+    }
+    else if ('A' == name[0] && 'F' == name[1] && '\0' == name[2])
+    {
+      if (0.0F != value && 1.0F != value)
+      {
+        return false;
+      }
+      updated.outputMode = (1.0F == value) ? OutputModes::ANTI_FLICKER : OutputModes::NORMAL;
+    }
+    else if (!setIndexed(updated, name, value))
+    {
+      return false;
+    }
+
+    if (!isValid(updated))
+    {
+      return false;
+    }
+
+    params = updated;
+    apply();
+
+    return true;
+  }
+
+  /**
+   * @brief Set the calibration of one phase (see utils_autocal.h)
+   *
+   * @param phase the phase number [0..NO_OF_PHASES[
+   * @param powerCal the new power calibration
+   * @param voltageCal the new voltage calibration
+   * @return true if the values are valid
+   */
+  bool setCalibration(const uint8_t phase, const float powerCal, const float voltageCal)
+  {
+    RuntimeParameters updated{ params };
+    updated.powerCal[phase] = powerCal;
+    updated.voltageCal[phase] = voltageCal;
+
+    if (!isValid(updated))
+    {
+      return false;
+    }
+
+    params = updated;
+    apply();
+
+    return true;
+  }
+
+  /**
+   * @brief Print all the parameters
+   *
+   * @param out the destination
+   */
+  void print(Print &out) const
+  {
+    for (uint8_t phase = 0; phase != NO_OF_PHASES; ++phase)
+    {
+      out.print(F("PC"));
+      out.print(phase + 1);
+      out.print(' ');
+      out.println(params.powerCal[phase], 6);
+    }
+    for (uint8_t phase = 0; phase != NO_OF_PHASES; ++phase)
+    {
+      out.print(F("VC"));
+      out.print(phase + 1);
+      out.print(' ');
+      out.println(params.voltageCal[phase], 5);
+    }
+    out.print(F("EX "));
+    out.println(params.requiredExportInWatts);
+    out.print(F("AF "));
+    out.println(OutputModes::ANTI_FLICKER == params.outputMode ? 1 : 0);
+
+    if constexpr (RELAY_DIVERSION)
+    {
+      for (uint8_t idx = 0; idx != relays.get_size(); ++idx)
+      {
+        out.print(F("RS"));
+        out.print(idx + 1);
+        out.print(' ');
+        out.println(params.relaySurplusThreshold[idx]);
+      }
+      for (uint8_t idx = 0; idx != relays.get_size(); ++idx)
+      {
+        out.print(F("RI"));
+        out.print(idx + 1);
+        out.print(' ');
+        out.println(params.relayImportThreshold[idx]);
+      }
+    }
+    if constexpr (DUAL_TARIFF || RTC_PRESENT)
+    {
+      for (uint8_t idx = 0; idx != NO_OF_DUMPLOADS; ++idx)
+      {
+        out.print(F("FO"));
+        out.print(idx + 1);
+        out.print(' ');
+        out.println(params.forceLoad[idx].getStartOffset());
+      }
+      for (uint8_t idx = 0; idx != NO_OF_DUMPLOADS; ++idx)
+      {
+        out.print(F("FD"));
+        out.print(idx + 1);
+        out.print(' ');
+        out.println(params.forceLoad[idx].getDuration());
+      }
+    }
+  }
+
+  /**
+   * @brief Get the parameters
+   *
+   * @return const RuntimeParameters& the parameters in use
+   */
+  const RuntimeParameters &get() const
+  {
+    return params;
+  }
+
+private:
+  /**
+   * @brief Get the defaults
+   *
+   * @return RuntimeParameters the values of calibration.h, config.h and config_system.h
+   */
+  static RuntimeParameters defaults()
+  {
+    RuntimeParameters values;
+
+    values.size = sizeof(RuntimeParameters);
+    for (uint8_t phase = 0; phase != NO_OF_PHASES; ++phase)
+    {
+      values.powerCal[phase] = f_powerCal[phase];
+      values.voltageCal[phase] = f_voltageCal[phase];
+    }
+    values.requiredExportInWatts = REQUIRED_EXPORT_IN_WATTS;
+    values.outputMode = outputMode;
+    for (uint8_t idx = 0; idx != relays.get_size(); ++idx)
+    {
+      values.relaySurplusThreshold[idx] = relays.get_relay(idx).get_defaultSurplusThreshold();
+      values.relayImportThreshold[idx] = relays.get_relay(idx).get_defaultImportThreshold();
+    }
+    for (uint8_t idx = 0; idx != NO_OF_DUMPLOADS; ++idx)
+    {
+      values.forceLoad[idx] = rg_ForceLoad[idx];
+    }
+
+    return values;
+  }
+
+  /**
+   * @brief Set one of the parameters of a phase, a relay or a load, e.g. PC1
+   *
+   * @param values the parameters to be updated
+   * @param name the name of the parameter
+   * @param value the new value
+   * @return true if the name is known and the value is in range
+   */
+  static bool setIndexed(RuntimeParameters &values, const char *name, const float value)
+  {
+    if ('\0' == name[2] || '\0' != name[3])
+    {
+      return false;
+    }
+    const uint8_t idx = name[2] - '1';
+
+    if ('C' == name[1] && idx < NO_OF_PHASES)
+    {
+      if ('P' == name[0])
+      {
+        values.powerCal[idx] = value;
+        return true;
+      }
+      if ('V' == name[0])
+      {
+        values.voltageCal[idx] = value;
+        return true;
+      }
+      return false;
+    }
+
+    if (RELAY_DIVERSION && 'R' == name[0] && idx < relays.get_size())
+    {
+      if (value < 0 || value > INT16_MAX)
+      {
+        return false;
+      }
+      if ('S' == name[1])
+      {
+        values.relaySurplusThreshold[idx] = static_cast< int16_t >(value);
+        return true;
+      }
+      if ('I' == name[1])
+      {
+        values.relayImportThreshold[idx] = static_cast< int16_t >(value);
+        return true;
+      }
+      return false;
+    }
+
+    if ((DUAL_TARIFF || RTC_PRESENT) && 'F' == name[0] && idx < NO_OF_DUMPLOADS)
+    {
+      const auto &force{ values.forceLoad[idx] };
+      if ('O' == name[1] && value >= INT16_MIN && value <= INT16_MAX)
+      {
+        values.forceLoad[idx] = pairForceLoad(static_cast< int16_t >(value), force.getDuration());
+        return true;
+      }
+      if ('D' == name[1] && value >= 0 && value <= UINT16_MAX)
+      {
+        values.forceLoad[idx] = pairForceLoad(force.getStartOffset(), static_cast< uint16_t >(value));
+        return true;
+      }
+      return false;
+    }
+
+    return false;
+  }
+
+  /**
+   * @brief Check the range of each parameter
+   * @details Same range as the checks of validation.h for the constexpr values.
+   *
+   * @param values the parameters to be checked
+   * @return true if all the parameters can be used
+   */
+  static bool isValid(const RuntimeParameters &values)
+  {
+    for (uint8_t phase = 0; phase != NO_OF_PHASES; ++phase)
+    {
+      // written to reject NaN too
+      if (!(values.powerCal[phase] > 0) || !(values.voltageCal[phase] > 0))
+      {
+        return false;
+      }
+      if (FIXED_POINT_ENERGY_BUCKET && !(values.powerCal[phase] < 0.25F))
+      {
+        return false;
+      }
+    }
+    return OutputModes::NORMAL == values.outputMode || OutputModes::ANTI_FLICKER == values.outputMode;
+  }
+
+  /**
+   * @brief Pass the parameters to the ISR, the relays and the force windows
+   *
+   */
+  void apply() const
+  {
+    updateIsrCalibration(params.powerCal, params.voltageCal, params.requiredExportInWatts, params.outputMode);
+
+    if constexpr (RELAY_DIVERSION)
+    {
+      for (uint8_t idx = 0; idx != relays.get_size(); ++idx)
+      {
+        relays.get_relay(idx).set_thresholds(params.relaySurplusThreshold[idx], params.relayImportThreshold[idx]);
+      }
+    }
+    if constexpr (DUAL_TARIFF)
+    {
+      rg_OffsetForce.set(params.forceLoad);
+    }
+    if constexpr (RTC_PRESENT)
+    {
+      dailySchedule.set(params.forceLoad);
+      dailyScheduler.reschedule();
+    }
+  }
+
+  /**
+   * @brief Compute the CRC of a block
+   *
+   * @param values the block
+   * @return uint16_t the CRC16 of all the fields but the CRC
+   */
+  static uint16_t crc(const RuntimeParameters &values)
+  {
+    uint16_t crc{ 0xFFFF };
+    const uint8_t *data{ reinterpret_cast< const uint8_t * >(&values) };
+    for (uint8_t i = 0; i != offsetof(RuntimeParameters, crc); ++i)
+    {
+      crc = _crc16_update(crc, data[i]);
+    }
+    return crc;
+  }
+
+  RuntimeParameters params{ defaults() }; /**< the parameters in use */
+};
+
+inline RuntimeParametersBlock< EEPROM_PARAMETERS_ADDRESS > runtimeParameters; /**< calibration, export rate, relay thresholds and force windows, tunable through the Serial */
+
+/**
+ * @brief Get the power calibration of a phase
+ *
+ * @param phase the phase number [0..NO_OF_PHASES[
+ * @return float the runtime value with RUNTIME_PARAMETERS, f_powerCal otherwise
+ */
+inline float getPowerCal(const uint8_t phase)
+{
+  if constexpr (RUNTIME_PARAMETERS)
+  {
+    return runtimeParameters.get().powerCal[phase];
+  }
+  else
+  {
+    return f_powerCal[phase];
+  }
+}
+
+/**
+ * @brief Get the voltage calibration of a phase
+ *
+ * @param phase the phase number [0..NO_OF_PHASES[
+ * @return float the runtime value with RUNTIME_PARAMETERS, f_voltageCal otherwise
+ */
+inline float getVoltageCal(const uint8_t phase)
+{
+  if constexpr (RUNTIME_PARAMETERS)
+  {
+    return runtimeParameters.get().voltageCal[phase];
+  }
+  else
+  {
+    return f_voltageCal[phase];
+  }
+}
+
+/**
+ * @brief Get the force config of the loads
+ *
+ * @return the runtime values with RUNTIME_PARAMETERS, rg_ForceLoad otherwise
+ */
+inline const pairForceLoad (&getForceLoads())[NO_OF_DUMPLOADS]
+{
+  if constexpr (RUNTIME_PARAMETERS)
+  {
+    return runtimeParameters.get().forceLoad;
+  }
+  else
+  {
+    return rg_ForceLoad;
+  }
+}
+
+/**
+ * @brief Get the current calibration of a phase
+ *
+ * @param phase the phase number [0..NO_OF_PHASES[
+ * @return float the current calibration, deduced from the power and voltage calibrations
+ */
+inline float getCurrentCal(const uint8_t phase)
+{
+  if constexpr (RUNTIME_PARAMETERS)
+  {
+    return getPowerCal(phase) / getVoltageCal(phase);
+  }
+  else
+  {
+    return currentCal(phase);
+  }
+}
+
+inline constexpr uint8_t RMS_SUMS_FACTOR{ DATALOG_PERIOD_IN_SECONDS > 10 ? 4 : 1 }; /**< sqrt(16), the sums of V^2 and I^2 are x1/16 for the long datalog periods */
+
+/**
+ * @brief Turn a calibration into the fixed-point scale of the Vrms/Irms x100 (see scaledSqrt())
+ *
+ * @param cal The calibration, in V or A per ADC-step
+ * @return constexpr uint32_t 100 x cal x RMS_SUMS_FACTOR, x 2^16
+ */
+constexpr uint32_t toRmsScale(const float cal)
+{
+  return static_cast< uint32_t >(cal * (100.0F * RMS_SUMS_FACTOR * 65536.0F) + 0.5F);
+}
+
+/**
+ * @brief Fixed-point scales of the Vrms/Irms of each phase, for the compile-time calibration
+ *
+ */
+struct RmsScales
+{
+  constexpr RmsScales()
+  {
+    for (uint8_t phase = 0; phase < NO_OF_PHASES; ++phase)
+    {
+      voltage[phase] = toRmsScale(f_voltageCal[phase]);
+      current[phase] = toRmsScale(currentCal(phase));
+    }
+  }
+
+  uint32_t voltage[NO_OF_PHASES]{}; /**< scale of the Vrms x100 */
+  uint32_t current[NO_OF_PHASES]{}; /**< scale of the Irms x100 */
+};
+
+inline constexpr RmsScales rmsScales; /**< scales for the calibration of calibration.h */
+
+/**
+ * @brief Get the fixed-point scale of the Vrms x100 of a phase
+ *
+ * @param phase the phase number [0..NO_OF_PHASES[
+ * @return uint32_t the scale, for scaledSqrt()
+ */
+inline uint32_t getVoltageRmsScale(const uint8_t phase)
+{
+  if constexpr (RUNTIME_PARAMETERS)
+  {
+    return toRmsScale(getVoltageCal(phase));
+  }
+  else
+  {
+    return rmsScales.voltage[phase];
+  }
+}
+
+/**
+ * @brief Get the fixed-point scale of the Irms x100 of a phase
+ *
+ * @param phase the phase number [0..NO_OF_PHASES[
+ * @return uint32_t the scale, for scaledSqrt()
+ */
+inline uint32_t getCurrentRmsScale(const uint8_t phase)
+{
+  if constexpr (RUNTIME_PARAMETERS)
+  {
+    return toRmsScale(getCurrentCal(phase));
+  }
+  else
+  {
+    return rmsScales.current[phase];
+  }
+}
+
+/**
+ * @brief Get the required export
+ *
+ * @return int16_t the runtime value with RUNTIME_PARAMETERS, REQUIRED_EXPORT_IN_WATTS otherwise
+ */
+inline int16_t getRequiredExport()
+{
+  if constexpr (RUNTIME_PARAMETERS)
+  {
+    return runtimeParameters.get().requiredExportInWatts;
+  }
+  else
+  {
+    return REQUIRED_EXPORT_IN_WATTS;
+  }
+}
+
+#endif  // UTILS_PARAMS_H
@@ -4,6 +4,9 @@
  * @brief Some utility functions for pins manipulation
  * @version 0.1
  * @date 2023-05-05
+ *
+ * @details Only the output ports of the backend are included, not the whole hardware abstraction layer:
+ *          the dev sketches use this file without the configuration of the router (see library.json).
  * 
  * @copyright Copyright (c) 2023
  * 
@@ -14,26 +17,10 @@
 
 #include <Arduino.h>
 
-#if defined(__DOXYGEN__)
-inline constexpr void togglePin(const uint8_t pin);
-
-inline constexpr void setPinON(const uint8_t pin);
-inline void setPinsON(const uint16_t pins);
-
-inline constexpr void setPinOFF(const uint8_t pin);
-inline void setPinsOFF(const uint16_t pins);
-
-inline constexpr bool getPinState(const uint8_t pin);
+#if defined(__AVR__) || defined(NATIVE_ARDUINO_H)  // see hal.h
+#include "hal_avr_pins.h"
 #else
-inline constexpr void togglePin(const uint8_t pin) __attribute__((always_inline));
-
-inline constexpr void setPinON(const uint8_t pin) __attribute__((always_inline));
-inline void setPinsON(const uint16_t pins) __attribute__((always_inline));
-
-inline constexpr void setPinOFF(const uint8_t pin) __attribute__((always_inline));
-inline void setPinsOFF(const uint16_t pins) __attribute__((always_inline));
-
-inline constexpr bool getPinState(const uint8_t pin) __attribute__((always_inline));
+#error "No hardware abstraction backend for this MCU, please see hal.h"
 #endif
 
 /**
@@ -74,29 +61,13 @@ template< typename T > constexpr uint8_t bit_clear(T& _dest, const uint8_t bit)
   return _dest &= ~((T)0x01 << bit);
 }
 
-/**
- * @brief Toggle the specified pin
- *
- */
-void constexpr togglePin(const uint8_t pin)
-{
-  if (pin < 8)
-  {
-    bit_set(PIND, pin);
-  }
-  else
-  {
-    bit_set(PINB, pin - 8);
-  }
-}
-
 /**
  * @brief Set the Pin state for the specified pin
  *
  * @param pin pin to change [2..13]
  * @param bState state to be set
  */
-inline constexpr void setPinState(const uint8_t pin, const bool bState)
+inline void setPinState(const uint8_t pin, const bool bState)
 {
   if (bState)
   {
@@ -108,72 +79,4 @@ inline constexpr void setPinState(const uint8_t pin, const bool bState)
   }
 }
 
-/**
- * @brief Set the Pin state to ON for the specified pin
- *
- * @param pin pin to change [2..13]
- */
-inline constexpr void setPinON(const uint8_t pin)
-{
-  if (pin < 8)
-  {
-    bit_set(PORTD, pin);
-  }
-  else
-  {
-    bit_set(PORTB, pin - 8);
-  }
-}
-
-/**
- * @brief Set the Pins state to ON
- *
- * @param pins The pins to change
- */
-inline void setPinsON(const uint16_t pins)
-{
-  PORTD |= lowByte(pins);
-  PORTB |= highByte(pins);
-}
-
-/**
- * @brief Set the Pin state to OFF for the specified pin
- *
- * @param pin pin to change [2..13]
- */
-inline constexpr void setPinOFF(const uint8_t pin)
-{
-  if (pin < 8)
-  {
-    bit_clear(PORTD, pin);
-  }
-  else
-  {
-    bit_clear(PORTB, pin - 8);
-  }
-}
-
-/**
- * @brief Set the Pins state to OFF
- *
- * @param pins The pins to change
- */
-inline void setPinsOFF(const uint16_t pins)
-{
-  PORTD &= ~lowByte(pins);
-  PORTB &= ~highByte(pins);
-}
-
-/**
- * @brief Get the Pin State
- *
- * @param pin The pin to read
- * @return true if HIGH
- * @return false if LOW
- */
-inline constexpr bool getPinState(const uint8_t pin)
-{
-  return (pin < 8) ? bit_read(PIND, pin) : bit_read(PINB, pin - 8);
-}
-
 #endif  // UTILS_PINS_H
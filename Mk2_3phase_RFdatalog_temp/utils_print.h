@@ -0,0 +1,188 @@
+/**
+ * @file utils_print.h
+ * @author Frédéric Metrich (frederic.metrich@live.fr)
+ * @brief Shared flash strings and print helpers
+ * @version 0.1
+ * @date 2024-05-29
+ *
+ * @details Each F("...") literal gets its own copy in flash, even when the same text appears
+ *          in several places. The labels of the datalogs and the recurring texts of the
+ *          configuration are stored once here, the printouts use them through the helpers below.
+ *
+ *          The numbers are printed with integer maths only (see divmod10()): the integer and
+ *          fixed-point (x100) values without any float conversion, the few float results
+ *          (power factor, THD, ...) after a single rounding to a scaled integer.
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef UTILS_PRINT_H
+#define UTILS_PRINT_H
+
+#include <Arduino.h>
+
+#include "FastDivision.h"
+#include "debug.h"
+
+inline const char STR_IS_PRESENT[] PROGMEM = "is present";         /**< state of a feature */
+inline const char STR_IS_NOT_PRESENT[] PROGMEM = "is NOT present"; /**< state of a feature */
+
+inline const char STR_P[] PROGMEM = "P";     /**< power of a phase */
+inline const char STR_V[] PROGMEM = "V";     /**< voltage of a phase */
+inline const char STR_I[] PROGMEM = "I";     /**< current of a phase */
+inline const char STR_F[] PROGMEM = "F";     /**< frequency of a phase */
+inline const char STR_T[] PROGMEM = "T";     /**< temperature of a sensor */
+inline const char STR_L[] PROGMEM = "L";     /**< duty of a load */
+inline const char STR_S[] PROGMEM = "S";     /**< apparent power of a phase */
+inline const char STR_Q[] PROGMEM = "Q";     /**< reactive power of a phase */
+inline const char STR_PF[] PROGMEM = "PF";   /**< power factor of a phase */
+inline const char STR_PL[] PROGMEM = "PL";   /**< learned power of a load */
+inline const char STR_ED[] PROGMEM = "ED";   /**< energy diverted to a load */
+inline const char STR_P1F[] PROGMEM = "P1f"; /**< fundamental active power of a phase */
+inline const char STR_Q1F[] PROGMEM = "Q1f"; /**< fundamental reactive power of a phase */
+inline const char STR_THD[] PROGMEM = "THD"; /**< current THD of a phase */
+inline const char STR_W[] PROGMEM = "W";     /**< wiring faults of a phase */
+inline const char STR_OV[] PROGMEM = "OV";   /**< share of the overvoltage boost of a phase */
+
+/**
+ * @brief Get a string of the table as a flash string
+ *
+ * @param str The string, in PROGMEM
+ * @return const __FlashStringHelper* The flash string, for Print
+ */
+inline const __FlashStringHelper *fstr(const char *str)
+{
+  return reinterpret_cast< const __FlashStringHelper * >(str);
+}
+
+/**
+ * @brief Print a fixed-point value, e.g. 23015 with 2 decimals as "230.15"
+ * @details Digit by digit with divmod10(), much faster than the float path of Print.
+ *
+ * @param out Where to print
+ * @param value The value, x 10^decimals
+ * @param decimals The number of decimals
+ */
+inline void printFixed(Print &out, const int32_t value, const uint8_t decimals)
+{
+  char buffer[13];  // sign, 10 digits, decimal point and terminator
+  uint8_t pos{ sizeof(buffer) - 1 };
+  uint32_t absValue{ value < 0 ? -static_cast< uint32_t >(value) : static_cast< uint32_t >(value) };
+  uint8_t noOfDigits{ 0 };
+
+  buffer[pos] = '\0';
+  do
+  {
+    uint32_t quotient;
+    uint8_t digit;
+    divmod10(absValue, quotient, digit);
+    buffer[--pos] = '0' + digit;
+    absValue = quotient;
+
+    if (++noOfDigits == decimals)
+    {
+      buffer[--pos] = '.';
+    }
+  } while (absValue || noOfDigits <= decimals);
+
+  if (value < 0)
+  {
+    buffer[--pos] = '-';
+  }
+  out.print(buffer + pos);
+}
+
+/**
+ * @brief Print an integer, digit by digit with divmod10()
+ *
+ * @param out Where to print
+ * @param value The value
+ */
+inline void printDecimal(Print &out, const int32_t value)
+{
+  printFixed(out, value, 0);
+}
+
+/**
+ * @brief Round a float to the nearest integer, halves away from zero (as Print does)
+ *
+ * @param value The value
+ * @return int32_t The rounded value
+ */
+inline int32_t roundToInt32(const float value)
+{
+  return static_cast< int32_t >(value < 0 ? value - 0.5F : value + 0.5F);
+}
+
+/**
+ * @brief Print a float with a given number of decimals, without the float path of Print
+ *
+ * @param out Where to print
+ * @param value The value
+ * @param decimals The number of decimals [0..3]
+ */
+inline void printScaled(Print &out, const float value, const uint8_t decimals)
+{
+  constexpr float scales[]{ 1.0F, 10.0F, 100.0F, 1000.0F };
+
+  printFixed(out, roundToInt32(value * scales[decimals]), decimals);
+}
+
+/**
+ * @brief Print the label of an indexed field, e.g. ", V2:"
+ *
+ * @param out Where to print
+ * @param label The label, from the table above
+ * @param index The index [0..], printed from 1
+ * @param bCompact true to omit the space after the comma
+ */
+inline void printFieldLabel(Print &out, const char *label, const uint8_t index, const bool bCompact = false)
+{
+  out.print(bCompact ? F(",") : F(", "));
+  out.print(fstr(label));
+  printDecimal(out, index + 1);
+  out.print(':');
+}
+
+/**
+ * @brief Print an indexed integer field, e.g. ", P2:1234"
+ *
+ * @param out Where to print
+ * @param label The label, from the table above
+ * @param index The index [0..], printed from 1
+ * @param value The value
+ * @param bCompact true to omit the space after the comma
+ */
+inline void printField(Print &out, const char *label, const uint8_t index, const int32_t value, const bool bCompact = false)
+{
+  printFieldLabel(out, label, index, bCompact);
+  printDecimal(out, value);
+}
+
+/**
+ * @brief Print an indexed x100 field, e.g. ", V2:230.15"
+ *
+ * @param out Where to print
+ * @param label The label, from the table above
+ * @param index The index [0..], printed from 1
+ * @param value_x100 The value x 100
+ * @param bCompact true to omit the space after the comma
+ */
+inline void printField_x100(Print &out, const char *label, const uint8_t index, const int16_t value_x100, const bool bCompact = false)
+{
+  printFieldLabel(out, label, index, bCompact);
+  printFixed(out, value_x100, 2);
+}
+
+/**
+ * @brief Print the state of a feature during start, e.g. "is NOT present"
+ *
+ * @param bPresent true if the feature is present
+ */
+inline void printPresence([[maybe_unused]] const bool bPresent)
+{
+  DBUGLN(fstr(bPresent ? STR_IS_PRESENT : STR_IS_NOT_PRESENT));
+}
+
+#endif  // UTILS_PRINT_H
@@ -0,0 +1,137 @@
+/**
+ * @file utils_ram.h
+ * @author Frédéric Metrich (frederic.metrich@live.fr)
+ * @brief Static RAM budget and stack usage
+ * @version 0.1
+ * @date 2024-05-28
+ *
+ * @details The static objects of the enabled features are summed at compile time, and the total
+ *          is checked against the SRAM of the ATmega328P (see validation.h), so that a combination
+ *          of features which leaves too little room for the stack does not even build.
+ *          The state of the processing engine, private to processing.cpp, and the state of the
+ *          Arduino core are not visible here, they are covered by RAM_ENGINE_ESTIMATE.
+ *
+ *          At startup, the free RAM between the heap and the stack is painted (see halStackPaint()).
+ *          The painted bytes which are left show how deep the stack has ever been, this free stack
+ *          is printed with the diagnostics of each datalog.
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef UTILS_RAM_H
+#define UTILS_RAM_H
+
+#include <Arduino.h>
+
+#include "adc_sequencer.h"
+#include "config.h"
+#include "fundamental.h"
+#include "hal.h"
+#include "processing.h"
+#include "utils_autocal.h"
+#include "utils_coordination.h"
+#include "utils_energy.h"
+#include "utils_events.h"
+#include "utils_frame.h"
+#include "utils_loadstats.h"
+#include "utils_modbus.h"
+#include "utils_params.h"
+#include "utils_rf.h"
+#include "utils_meter.h"
+#include "utils_rtc.h"
+#include "utils_txqueue.h"
+#include "utils_watchdog.h"
+#include "utils_wiring.h"
+
+inline constexpr uint16_t RAM_SIZE{ 2048 };           /**< SRAM of the ATmega328P */
+inline constexpr uint16_t RAM_ENGINE_ESTIMATE{ 384 }; /**< state of processing.cpp (~320 bytes by default) and of the Arduino core (millis, malloc) */
+inline constexpr uint16_t RAM_STACK_RESERVE{ 320 };   /**< minimum room for the stack of loop() and of the ISR, on top of it */
+
+inline constexpr uint16_t RAM_SERIAL{ sizeof(Serial) };                                                                                   /**< HardwareSerial with its RX/TX buffers */
+inline constexpr uint16_t RAM_SERIAL_TX_QUEUE{ sizeof(serialTxQueue) };                                                                   /**< text output queue */
+inline constexpr uint16_t RAM_TX_DATA{ sizeof(tx_data) };                                                                                 /**< logging data */
+inline constexpr uint16_t RAM_SNAPSHOTS{ sizeof(datalogSnapshots) + sizeof(datalogSnapshot) + sizeof(powerSnapshots) + (COORDINATION_MASTER ? sizeof(coordinationSnapshots) : 0) };                  /**< snapshots shared with the ISR */
+inline constexpr uint16_t RAM_QUEUES{ sizeof(isrEvents) + sizeof(isrCommands) + (FAST_STREAM ? sizeof(fastStreamRecords) : 0) + (TRANSITION_LOG ? sizeof(loadTransitions) : 0) };         /**< lock-free queues shared with the ISR */
+inline constexpr uint16_t RAM_FRAMES{ sizeof(frameStreamer) + (RAW_SAMPLES_CAPTURE ? sizeof(rawSamplesCapture) : 0) };                   /**< binary frames and raw-sample capture */
+inline constexpr uint16_t RAM_ADC{ ADC_OVERSAMPLING_BITS ? sizeof(adcDecimator) : 0 };                                                    /**< oversampling of the ADC */
+inline constexpr uint16_t RAM_HARMONICS{ HARMONIC_ANALYSIS ? sizeof(fundamentalAnalysis) : 0 };                                           /**< fundamental analysis */
+inline constexpr uint16_t RAM_RELAYS{ RELAY_DIVERSION ? relays.get_ram_size() : 0 };                                                      /**< relays and their sliding average */
+inline constexpr uint16_t RAM_TEMPERATURE{ TEMP_SENSOR_PRESENT ? temperatureSensing.get_ram_size() : 0 };                                 /**< sensors and their scratchpad */
+inline constexpr uint16_t RAM_EEPROM{ (ENERGY_COUNTERS ? sizeof(energyCounters) : 0) + (RUNTIME_PARAMETERS ? sizeof(runtimeParameters) : 0) + (HARDWARE_WATCHDOG ? sizeof(hardwareWatchdog) : 0) }; /**< energy counters, runtime parameters and watchdog */
+inline constexpr uint16_t RAM_LOAD_STATISTICS{ LOAD_STATISTICS ? loadStatistics.get_ram_size() : 0 };                               /**< switching statistics of the loads */
+inline constexpr uint16_t RAM_AUTOCAL{ AUTO_CALIBRATION ? sizeof(autoCalibration) : 0 };                                                /**< auto-calibration */
+inline constexpr uint16_t RAM_WIRING{ WIRING_CHECK ? sizeof(wiringCheck) : 0 };                                                       /**< wiring check */
+inline constexpr uint16_t RAM_METER{ METER_PULSE_INPUT ? sizeof(meterCheck) : 0 };                                                     /**< cross-check with the utility meter */
+inline constexpr uint16_t RAM_RTC{ RTC_PRESENT ? sizeof(dailyScheduler) + sizeof(dailySchedule) : 0 };                                   /**< daily schedule and its state */
+inline constexpr uint16_t RAM_MODBUS{ MODBUS_SLAVE ? sizeof(modbusSlave) : 0 };                                                           /**< Modbus slave */
+#ifdef RF_PRESENT
+inline constexpr uint16_t RAM_RF{ sizeof(rfSender) + (ROUTER_ROLE != RouterRoles::STANDALONE ? sizeof(coordinationLink) : 0) + RF12_MAXDATA + 5 + 16 }; /**< RF sender, coordination link, rf12_buf (header, data, CRC) and the state of the JeeLib driver (approx.) */
+#else
+inline constexpr uint16_t RAM_RF{ 0 }; /**< RF sender and JeeLib */
+#endif
+#ifdef EMONESP
+inline constexpr uint16_t RAM_DEBUG_PORT{ sizeof(mySerial) + _SS_MAX_RX_BUFF }; /**< SoftwareSerial with its (static) RX buffer */
+#else
+inline constexpr uint16_t RAM_DEBUG_PORT{ 0 }; /**< SoftwareSerial with its (static) RX buffer */
+#endif
+
+/** total RAM of the static objects, with the estimate for the engine and the core */
+inline constexpr uint16_t STATIC_RAM_USAGE{ RAM_SERIAL + RAM_SERIAL_TX_QUEUE + RAM_TX_DATA + RAM_SNAPSHOTS + RAM_QUEUES + RAM_FRAMES + RAM_ADC
+                                            + RAM_HARMONICS + RAM_RELAYS + RAM_TEMPERATURE + RAM_EEPROM + RAM_LOAD_STATISTICS + RAM_AUTOCAL + RAM_WIRING + RAM_METER + RAM_RTC + RAM_MODBUS + RAM_RF + RAM_DEBUG_PORT
+                                            + RAM_ENGINE_ESTIMATE };
+
+/**
+ * @brief Print one entry of the RAM budget
+ *
+ * @param name The name of the entry
+ * @param size The size in bytes
+ */
+inline void printRamEntry(const __FlashStringHelper *name, const uint16_t size)
+{
+  if (!size)
+  {
+    return;
+  }
+  DBUG(F("\t\t"));
+  DBUG(name);
+  DBUG(F(": "));
+  DBUGLN(size);
+}
+
+/**
+ * @brief Print the RAM budget of the static objects during start
+ *
+ */
+inline void printRamBudget()
+{
+  DBUGLN(F("\t*** RAM budget (bytes) ***"));
+  printRamEntry(F("Serial"), RAM_SERIAL);
+  printRamEntry(F("Text output queue"), RAM_SERIAL_TX_QUEUE);
+  printRamEntry(F("tx_data"), RAM_TX_DATA);
+  printRamEntry(F("Snapshots"), RAM_SNAPSHOTS);
+  printRamEntry(F("ISR queues"), RAM_QUEUES);
+  printRamEntry(F("Frames/capture"), RAM_FRAMES);
+  printRamEntry(F("ADC oversampling"), RAM_ADC);
+  printRamEntry(F("Harmonics"), RAM_HARMONICS);
+  printRamEntry(F("Relays"), RAM_RELAYS);
+  printRamEntry(F("Temperature"), RAM_TEMPERATURE);
+  printRamEntry(F("EEPROM data"), RAM_EEPROM);
+  printRamEntry(F("Load statistics"), RAM_LOAD_STATISTICS);
+  printRamEntry(F("Auto-calibration"), RAM_AUTOCAL);
+  printRamEntry(F("Wiring check"), RAM_WIRING);
+  printRamEntry(F("Meter pulse input"), RAM_METER);
+  printRamEntry(F("Real-time clock"), RAM_RTC);
+  printRamEntry(F("Modbus"), RAM_MODBUS);
+  printRamEntry(F("RF"), RAM_RF);
+  printRamEntry(F("Debug port"), RAM_DEBUG_PORT);
+  printRamEntry(F("Engine/core (estimate)"), RAM_ENGINE_ESTIMATE);
+  DBUG(F("\t\tTotal: "));
+  DBUG(STATIC_RAM_USAGE);
+  DBUG(F(" of "));
+  DBUG(RAM_SIZE);
+  DBUG(F(", free stack so far: "));
+  DBUGLN(halStackUnused());
+}
+
+#endif  // UTILS_RAM_H
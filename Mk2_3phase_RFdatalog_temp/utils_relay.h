@@ -49,7 +49,7 @@ public:
    * @param _importThreshold Import threshold to turn relay OFF
    */
   constexpr relayOutput(uint8_t _relay_pin, int16_t _surplusThreshold, int16_t _importThreshold)
-    : relay_pin{ _relay_pin }, surplusThreshold{ -abs(_surplusThreshold) }, importThreshold{ abs(_importThreshold) }
+    : relay_pin{ _relay_pin }, surplusThreshold{ static_cast< int16_t >(-abs(_surplusThreshold)) }, importThreshold{ static_cast< int16_t >(abs(_importThreshold)) }
   {
   }
 
@@ -63,7 +63,7 @@ public:
    * @param _minOFF Minimum duration in minutes to leave relay OFF
    */
   constexpr relayOutput(uint8_t _relay_pin, int16_t _surplusThreshold, int16_t _importThreshold, uint16_t _minON, uint16_t _minOFF)
-    : relay_pin{ _relay_pin }, surplusThreshold{ -abs(_surplusThreshold) }, importThreshold{ abs(_importThreshold) }, minON{ _minON * 60 }, minOFF{ _minOFF * 60 }
+    : relay_pin{ _relay_pin }, surplusThreshold{ static_cast< int16_t >(-abs(_surplusThreshold)) }, importThreshold{ static_cast< int16_t >(abs(_importThreshold)) }, minON{ static_cast< uint16_t >(_minON * 60) }, minOFF{ static_cast< uint16_t >(_minOFF * 60) }
   {
   }
 
@@ -80,23 +80,55 @@ public:
   /**
    * @brief Get the surplus threshold which will turns ON the relay
    * 
+   * @return auto 
+   */
+  auto get_surplusThreshold() const
+  {
+    return -activeSurplusThreshold;
+  }
+
+  /**
+   * @brief Get the import threshold which will turns OFF the relay
+   * 
+   * @return auto 
+   */
+  auto get_importThreshold() const
+  {
+    return activeImportThreshold;
+  }
+
+  /**
+   * @brief Get the surplus threshold of the configuration
+   * 
    * @return constexpr auto 
    */
-  constexpr auto get_surplusThreshold() const
+  constexpr auto get_defaultSurplusThreshold() const
   {
     return -surplusThreshold;
   }
 
   /**
-   * @brief Get the import threshold which will turns OFF the relay
+   * @brief Get the import threshold of the configuration
    * 
    * @return constexpr auto 
    */
-  constexpr auto get_importThreshold() const
+  constexpr auto get_defaultImportThreshold() const
   {
     return importThreshold;
   }
 
+  /**
+   * @brief Change the thresholds at run time (see utils_params.h)
+   *
+   * @param _surplusThreshold Surplus threshold to turn relay ON
+   * @param _importThreshold Import threshold to turn relay OFF
+   */
+  void set_thresholds(const int16_t _surplusThreshold, const int16_t _importThreshold) const
+  {
+    activeSurplusThreshold = static_cast< int16_t >(-abs(_surplusThreshold));
+    activeImportThreshold = static_cast< int16_t >(abs(_importThreshold));
+  }
+
   /**
    * @brief Get the minimum ON-time in seconds
    * 
@@ -117,6 +149,16 @@ public:
     return minOFF;
   }
 
+  /**
+   * @brief Get the duration of the current state in seconds
+   * 
+   * @return auto 
+   */
+  auto get_duration() const
+  {
+    return duration;
+  }
+
   /**
    * @brief Return the state
    * 
@@ -148,11 +190,11 @@ public:
   bool proceed_relay(const int32_t currentAvgPower) const
   {
     // To avoid changing sign, surplus is a negative value
-    if (currentAvgPower < surplusThreshold)
+    if (currentAvgPower < activeSurplusThreshold)
     {
       return try_turnON();
     }
-    if (currentAvgPower > importThreshold)
+    if (currentAvgPower > activeImportThreshold)
     {
       return try_turnOFF();
     }
@@ -236,21 +278,37 @@ private:
   const uint16_t minON{ 5 * 60 };          /**< Minimum duration in seconds the relay is turned ON */
   const uint16_t minOFF{ 5 * 60 };         /**< Minimum duration in seconds the relay is turned OFF */
 
-  mutable uint16_t duration{ 0 };  /**< Duration of the current state */
-  mutable bool relayIsON{ false }; /**< True if the relay is ON */
+  mutable int16_t activeSurplusThreshold{ surplusThreshold }; /**< Surplus threshold in use, see set_thresholds() */
+  mutable int16_t activeImportThreshold{ importThreshold };   /**< Import threshold in use, see set_thresholds() */
+  mutable uint16_t duration{ 0 };                             /**< Duration of the current state */
+  mutable bool relayIsON{ false };                            /**< True if the relay is ON */
 };
 
 /**
  * @brief This class implements the relay management engine
  * 
- * @tparam D The duration in minutes of the sliding average
+ * @details The relays are evaluated each time a new value is added to the sliding average,
+ *          their timers are driven by the per-second tick (see inc_duration()).
+ *
+ *          With a duration in minutes (ie '15_i'), the average is fed once per datalog period.
+ *          With a duration in seconds (ie '60_s'), it is fed every second with the power
+ *          aggregated by the ISR (see PER_SECOND_POWER), for a faster response to clouds.
+ *
+ *          The single EMA is used by default, a lower-lag DEMA or TEMA can be selected
+ *          with the tags DOUBLE_EMA/TRIPLE_EMA (ie '{ 15_i, TRIPLE_EMA, { ... } }').
+ * 
  * @tparam N The number of relays to be used. This parameter is deduced automatically.
+ * @tparam T The duration in seconds of the sliding average
+ * @tparam P The period in seconds between two updates of the sliding average
+ * @tparam O The order of the sliding average
  * 
  * @ingroup RelayDiversion
  */
-template< uint8_t N, uint8_t D = 10 >
+template< uint8_t N, uint16_t T = 10 * 60, uint8_t P = DATALOG_PERIOD_IN_SECONDS, EwmaOrders O = EwmaOrders::EMA >
 class RelayEngine
 {
+  static_assert(T >= 4 * P, "The sliding average must cover at least 4 updates");
+
 public:
   /**
    * @brief Construct a list of relays
@@ -262,11 +320,51 @@ public:
   }
 
   /**
-   * @brief Construct a list of relays with a custom sliding average
+   * @brief Construct a list of relays with a custom sliding average in minutes
    * 
    */
+  template< uint8_t D >
   constexpr RelayEngine(integral_constant< uint8_t, D > ic, const relayOutput (&ref)[N])
     : relay(ref)
+  {
+    static_assert(D * 60U == T, "Wrong duration of the sliding average");
+  }
+
+  /**
+   * @brief Construct a list of relays with a custom sliding average in seconds, fed every second
+   * 
+   */
+  constexpr RelayEngine(integral_constant< uint16_t, T > ic, const relayOutput (&ref)[N])
+    : relay(ref)
+  {
+  }
+
+  /**
+   * @brief Construct a list of relays with a custom order of the sliding average
+   * 
+   */
+  constexpr RelayEngine(integral_constant< EwmaOrders, O > order, const relayOutput (&ref)[N])
+    : relay(ref)
+  {
+  }
+
+  /**
+   * @brief Construct a list of relays with a custom sliding average in minutes and a custom order
+   * 
+   */
+  template< uint8_t D >
+  constexpr RelayEngine(integral_constant< uint8_t, D > ic, integral_constant< EwmaOrders, O > order, const relayOutput (&ref)[N])
+    : relay(ref)
+  {
+    static_assert(D * 60U == T, "Wrong duration of the sliding average");
+  }
+
+  /**
+   * @brief Construct a list of relays with a custom sliding average in seconds and a custom order
+   * 
+   */
+  constexpr RelayEngine(integral_constant< uint16_t, T > ic, integral_constant< EwmaOrders, O > order, const relayOutput (&ref)[N])
+    : relay(ref)
   {
   }
 
@@ -280,6 +378,16 @@ public:
     return N;
   }
 
+  /**
+   * @brief Get the period between two updates of the sliding average
+   * 
+   * @return constexpr auto The period in seconds
+   */
+  static constexpr auto get_input_period()
+  {
+    return P;
+  }
+
   /**
    * @brief Get the relay object
    * 
@@ -298,17 +406,19 @@ public:
    */
   inline static auto get_average()
   {
-    return ewma_average.getAverageS();
+    return ewma_average.getAverage();
   }
 
   /**
-   * @brief Update the sliding average
+   * @brief Update the sliding average and proceed with the relays
+   * @details Called every P seconds, the relays are only evaluated when the average has changed.
    * 
    * @param currentPower Current power at the grid
    */
-  inline static void update_average(int16_t currentPower)
+  void update_average(int16_t currentPower) const
   {
     ewma_average.addValue(currentPower);
+    proceed_relays();
   }
 
 /**
@@ -323,40 +433,73 @@ public:
 
   /**
    * @brief Proceed all relays in increasing order (surplus) or decreasing order (import)
+   * @details Called on each update of the sliding average (see update_average()).
+   *          Several relays can be switched at once when the average covers all of them,
+   *          the power of each relay being its surplus threshold.
+   *          A relay switched less than SETTLE_TIME ago is not yet fully seen by the average:
+   *          - its power is deducted from the average for further switchings in the same way
+   *          - no switching in the opposite way occurs until it has settled
    * 
    */
   void proceed_relays() const
   {
-    if (settle_change != 0)
+    int32_t recentlyON{ 0 };   // power of the relays turned ON less than SETTLE_TIME ago
+    int32_t recentlyOFF{ 0 };  // power of the relays turned OFF less than SETTLE_TIME ago
+
+    uint8_t idx{ N };
+    do
     {
-      // A relay has been toggle less than a minute ago, wait until changes take effect
-      return;
-    }
+      const auto &r{ relay[--idx] };
+      if (r.get_duration() < SETTLE_TIME)
+      {
+        (r.isRelayON() ? recentlyON : recentlyOFF) += r.get_surplusThreshold();
+      }
+    } while (idx);
+
+    const int32_t average{ ewma_average.getAverage() };
 
-    if (ewma_average.getAverageS() > 0)
+    if (average > 0)
     {
+      if (recentlyON)
+      {
+        return;  // wait until the relays turned ON are seen by the average
+      }
+
       // Currently importing, try to turn OFF some relays
-      uint8_t idx{ N };
+      int32_t power{ average - recentlyOFF };
+      idx = N;
       do
       {
-        if (relay[--idx].proceed_relay(ewma_average.getAverageS()))
+        if (power <= 0)
         {
-          settle_change = 60;
           return;
         }
+        if (relay[--idx].proceed_relay(power))
+        {
+          power -= relay[idx].get_surplusThreshold();
+        }
       } while (idx);
     }
     else
     {
+      if (recentlyOFF)
+      {
+        return;  // wait until the relays turned OFF are seen by the average
+      }
+
       // Remaining surplus, try to turn ON more relays
-      uint8_t idx{ 0 };
+      int32_t power{ average + recentlyON };
+      idx = 0;
       do
       {
-        if (relay[idx].proceed_relay(ewma_average.getAverageS()))
+        if (power >= 0)
         {
-          settle_change = 60;
           return;
         }
+        if (relay[idx].proceed_relay(power))
+        {
+          power += relay[idx].get_surplusThreshold();
+        }
       } while (++idx < N);
     }
   }
@@ -375,6 +518,16 @@ public:
     } while (idx);
   }
 
+  /**
+   * @brief Get the RAM used by the relays and the sliding average
+   *
+   * @return constexpr uint16_t The size in bytes
+   */
+  static constexpr uint16_t get_ram_size()
+  {
+    return sizeof(RelayEngine) + sizeof(ewma_average);
+  }
+
   /**
    * @brief Print the configuration of each relay
    * 
@@ -382,8 +535,10 @@ public:
   void printConfiguration() const
   {
     Serial.println(F("\t*** Relay(s) configuration ***"));
-    Serial.print(F("\t\tSliding average: "));
-    Serial.println(D);
+    Serial.print(F("\t\tSliding average in seconds: "));
+    Serial.println(T);
+    Serial.print(F("\t\tOrder of the average: "));
+    Serial.println(static_cast< uint8_t >(O));
 
     for (uint8_t i = 0; i < N; ++i)
     {
@@ -394,23 +549,38 @@ public:
 private:
   const relayOutput relay[N]; /**< Array of relays */
 
-  mutable uint8_t settle_change{ 60 }; /**< Delay in seconds until next change occurs */
+  static constexpr uint8_t SETTLE_TIME{ T < 60 ? T : 60 }; /**< Delay in seconds until a change is seen by the average */
 
-  static inline EWMA_average< D * 60 / DATALOG_PERIOD_IN_SECONDS > ewma_average; /**< EWMA average */
+  static inline EWMA_average< T / P, O > ewma_average; /**< EWMA average */
 };
 
-template< uint8_t N, uint8_t D > void RelayEngine< N, D >::inc_duration() const
+template< uint8_t N, uint16_t T, uint8_t P, EwmaOrders O > void RelayEngine< N, T, P, O >::inc_duration() const
 {
   uint8_t idx{ N };
   do
   {
     relay[--idx].inc_duration();
   } while (idx);
-
-  if (settle_change)
-  {
-    --settle_change;
-  }
 }
 
+/** a duration in minutes, the average is fed once per datalog period */
+template< uint8_t N, uint8_t D >
+RelayEngine(integral_constant< uint8_t, D >, const relayOutput (&)[N]) -> RelayEngine< N, D * 60U >;
+
+/** a duration in seconds, the average is fed every second */
+template< uint8_t N, uint16_t T >
+RelayEngine(integral_constant< uint16_t, T >, const relayOutput (&)[N]) -> RelayEngine< N, T, 1 >;
+
+/** a custom order, the average is fed once per datalog period */
+template< uint8_t N, EwmaOrders O >
+RelayEngine(integral_constant< EwmaOrders, O >, const relayOutput (&)[N]) -> RelayEngine< N, 10 * 60, DATALOG_PERIOD_IN_SECONDS, O >;
+
+/** a duration in minutes and a custom order */
+template< uint8_t N, uint8_t D, EwmaOrders O >
+RelayEngine(integral_constant< uint8_t, D >, integral_constant< EwmaOrders, O >, const relayOutput (&)[N]) -> RelayEngine< N, D * 60U, DATALOG_PERIOD_IN_SECONDS, O >;
+
+/** a duration in seconds and a custom order */
+template< uint8_t N, uint16_t T, EwmaOrders O >
+RelayEngine(integral_constant< uint16_t, T >, integral_constant< EwmaOrders, O >, const relayOutput (&)[N]) -> RelayEngine< N, T, 1, O >;
+
 #endif /* UTILS_RELAY_H */
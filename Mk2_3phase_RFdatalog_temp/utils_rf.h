@@ -15,24 +15,141 @@
 #ifdef RF_PRESENT
 #include <JeeLib.h>
 
+#include "config.h"
+#include "isr_latency.h"
+#include "processing.h"
+
 inline constexpr bool RF_CHIP_PRESENT{ true };
 
+inline constexpr uint8_t RF_PACKED_KEYFRAME{ 0x80 }; /**< flag of a packed keyframe, in the first byte */
+
+/**
+ * @brief Non-blocking sender of the logging data
+ * @details The data is handed to the RFM12B from loop() as soon as it can send, the pending
+ *          data is replaced by the newer one if the chip has remained busy meanwhile.
+ *
+ *          With RF_PACKED_PAYLOAD, the payload is made of:
+ *          - 1 byte: bit 7 set for a keyframe, bits 0-6 = sequence number (modulo 128)
+ *          - each int16 field of tx_data, in order, as a zigzag varint (LEB128, 1 to 3 bytes):
+ *            the value itself in a keyframe, the difference with the previous packet otherwise.
+ *
+ *          A keyframe is sent every RF_KEYFRAME_PERIOD packets. A receiver which has missed
+ *          a packet (gap in the sequence) must wait for the next keyframe.
+ *
+ * @tparam T The type of the logging data (int16 fields only)
+ */
+template< typename T >
+class RfSender
+{
+  static_assert(sizeof(T) % sizeof(int16_t) == 0, "The payload must be made of int16 fields");
+
+  static constexpr uint8_t NO_OF_FIELDS{ sizeof(T) / sizeof(int16_t) }; /**< # of int16 fields of the payload */
+
+public:
+  /**
+   * @brief Request the sending of the data, see proceed()
+   *
+   */
+  void send()
+  {
+    bPending = true;
+  }
+
+  /**
+   * @brief Send the pending data if the RFM12B is ready, never blocks
+   * @details Must be called on each loop() pass.
+   *
+   * @param data The logging data
+   */
+  void proceed(const T &data)
+  {
+    if (!bPending)
+    {
+      return;
+    }
+
+    LatencySourceScope< LatencySources::RF > latencySource;
+
+    rf12_recvDone();
+    if (!rf12_canSend())
+    {
+      return;  // retry on the next pass
+    }
+    bPending = false;
+
+    if constexpr (RF_PACKED_PAYLOAD)
+    {
+      rf12_sendStart(0, buffer, pack(data));
+    }
+    else
+    {
+      rf12_sendStart(0, &data, sizeof(T));
+    }
+  }
+
+private:
+  /**
+   * @brief Pack the data against the previous packet
+   *
+   * @param data The logging data
+   * @return uint8_t the size of the packed payload
+   */
+  uint8_t pack(const T &data)
+  {
+    const int16_t *fields{ reinterpret_cast< const int16_t * >(&data) };
+    const bool bKeyframe{ 0 == sequence % RF_KEYFRAME_PERIOD };
+
+    uint8_t size{ 0 };
+    buffer[size++] = (sequence & 0x7F) | (bKeyframe ? RF_PACKED_KEYFRAME : 0);
+
+    for (uint8_t idx = 0; idx != NO_OF_FIELDS; ++idx)
+    {
+      const uint16_t delta{ static_cast< uint16_t >(bKeyframe ? fields[idx] : fields[idx] - previous[idx]) };
+      size += putVarint(buffer + size, (delta << 1) ^ (0 - (delta >> 15)));  // zigzag
+      previous[idx] = fields[idx];
+    }
+
+    ++sequence;
+    return size;
+  }
+
+  /**
+   * @brief Write a varint, 7 bits per byte, least significant first
+   *
+   * @param dst The destination
+   * @param value The value
+   * @return uint8_t the # of bytes written
+   */
+  static uint8_t putVarint(uint8_t *dst, uint16_t value)
+  {
+    uint8_t size{ 0 };
+    while (value > 0x7F)
+    {
+      dst[size++] = (value & 0x7F) | 0x80;
+      value >>= 7;
+    }
+    dst[size++] = value;
+    return size;
+  }
+
+  bool bPending{ false };               /**< data waiting to be sent */
+  uint8_t sequence{ 0 };                /**< sequence number of the next packed payload */
+  int16_t previous[NO_OF_FIELDS]{};     /**< fields of the previous packed payload */
+  uint8_t buffer[1 + 3 * NO_OF_FIELDS]; /**< packed payload, 3 bytes max per field */
+};
+
+inline RfSender< decltype(tx_data) > rfSender; /**< the one and only RF sender */
+
 /**
  * @brief Send the logging data through RF.
  * @details For better performance, the RFM12B needs to remain in its
  *          active state rather than being periodically put to sleep.
+ *          The data is actually sent from loop(), see RfSender.
  *
  */
 inline void send_rf_data()
 {
-  // check whether it's ready to send, and an exit route if it gets stuck
-  uint32_t i = 0;
-  while (!rf12_canSend() && i < 10)
-  {
-    rf12_recvDone();
-    ++i;
-  }
-  rf12_sendNow(0, &tx_data, sizeof tx_data);
+  rfSender.send();
 }
 #else
 inline constexpr bool RF_CHIP_PRESENT{ false };
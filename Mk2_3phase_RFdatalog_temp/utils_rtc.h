@@ -0,0 +1,397 @@
+/**
+ * @file utils_rtc.h
+ * @author Frédéric Metrich (frederic.metrich@live.fr)
+ * @brief Real-time clock (DS3231) and daily schedule
+ * @version 0.1
+ * @date 2024-06-01
+ *
+ * @details With RTC_PRESENT, the time of the day is read from a DS3231 and the dual tariff and the
+ *          rotation follow the daily schedule computed at compile time (see dualtariff.h),
+ *          or from the runtime parameters with RUNTIME_PARAMETERS:
+ *          - the off-peak period starts at OFF_PEAK_START for ul_OFF_PEAK_DURATION hours,
+ *            in place of the dual tariff pin,
+ *          - the force windows of rg_ForceLoad are placed within the off-peak period,
+ *          - with PRIORITY_ROTATION == AUTO, the priorities rotate at ROTATION_TIME,
+ *            in place of the rotation after ROTATION_AFTER_CYCLES of inactivity.
+ *
+ *          The clock is read once per hour, the seconds are counted in between. Each second,
+ *          the time is only compared with the next entry of the schedule. After each read,
+ *          if the time has moved, the states are recomputed from the whole schedule.
+ *
+ *          A4/A5 (the I2C of the ATmega328P) are used by the ADC for the third phase, so the
+ *          DS3231 is driven by a software I2C on two digital pins (rtcSdaPin, rtcSclPin),
+ *          with the pull-ups of the module. The clock must run in 24-hour mode.
+ *
+ *          The clock is set with the 'T hh:mm:ss' command through the Serial (see utils_commands.h).
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef UTILS_RTC_H
+#define UTILS_RTC_H
+
+#include <Arduino.h>
+
+#include "config.h"
+#include "dualtariff.h"
+
+inline constexpr uint16_t RTC_SYNC_PERIOD_IN_SECONDS{ 3600 }; /**< period of the reads of the clock */
+inline constexpr uint8_t RTC_RETRY_PERIOD_IN_SECONDS{ 60 };   /**< period of the reads while the clock has never been read */
+
+/**
+ * @brief DS3231 real-time clock on a software I2C
+ *
+ * @tparam SDA The data pin
+ * @tparam SCL The clock pin
+ */
+template< uint8_t SDA, uint8_t SCL >
+class RealTimeClock
+{
+public:
+  /**
+   * @brief Read the time of the day
+   *
+   * @param seconds the second of the day [0..SECONDS_PER_DAY[
+   * @return true if the clock has answered with a valid time
+   */
+  bool read(uint32_t &seconds) const
+  {
+    start();
+    bool bAck{ writeByte(ADDRESS << 1) && writeByte(0x00) };  // from the 'seconds' register
+    start();
+    bAck = bAck && writeByte((ADDRESS << 1) | 1);
+
+    uint8_t bcd[3]{};
+    if (bAck)
+    {
+      bcd[0] = readByte(true);
+      bcd[1] = readByte(true);
+      bcd[2] = readByte(false);
+    }
+    stop();
+
+    const uint8_t s{ fromBcd(bcd[0] & 0x7F) };
+    const uint8_t m{ fromBcd(bcd[1] & 0x7F) };
+    const uint8_t h{ fromBcd(bcd[2] & 0x3F) };
+
+    if (!bAck || s > 59 || m > 59 || h > 23)
+    {
+      return false;
+    }
+    seconds = h * 3600UL + m * 60U + s;
+    return true;
+  }
+
+  /**
+   * @brief Set the time of the day, in 24-hour mode
+   *
+   * @param seconds the second of the day [0..SECONDS_PER_DAY[
+   * @return true if the clock has acknowledged
+   */
+  bool write(const uint32_t seconds) const
+  {
+    const uint8_t h{ static_cast< uint8_t >(seconds / 3600) };
+    const uint8_t m{ static_cast< uint8_t >(seconds / 60 % 60) };
+    const uint8_t s{ static_cast< uint8_t >(seconds % 60) };
+
+    start();
+    const bool bAck{ writeByte(ADDRESS << 1) && writeByte(0x00) && writeByte(toBcd(s)) && writeByte(toBcd(m)) && writeByte(toBcd(h)) };
+    stop();
+
+    return bAck;
+  }
+
+private:
+  static constexpr uint8_t ADDRESS{ 0x68 };    /**< I2C address of the DS3231 */
+  static constexpr uint8_t HALF_PERIOD_US{ 5 }; /**< ~100 kHz */
+
+  static uint8_t fromBcd(const uint8_t value)
+  {
+    return (value >> 4) * 10 + (value & 0x0F);
+  }
+  static uint8_t toBcd(const uint8_t value)
+  {
+    return ((value / 10) << 4) | (value % 10);
+  }
+
+  /**
+   * @brief Release a line, pulled up by the module (open drain)
+   *
+   * @param pin The pin
+   */
+  static void release(const uint8_t pin)
+  {
+    pinMode(pin, INPUT);
+    delayMicroseconds(HALF_PERIOD_US);
+  }
+
+  /**
+   * @brief Pull a line down
+   *
+   * @param pin The pin
+   */
+  static void pullDown(const uint8_t pin)
+  {
+    digitalWrite(pin, LOW);
+    pinMode(pin, OUTPUT);
+    delayMicroseconds(HALF_PERIOD_US);
+  }
+
+  static void start()
+  {
+    release(SDA);
+    release(SCL);
+    pullDown(SDA);
+    pullDown(SCL);
+  }
+
+  static void stop()
+  {
+    pullDown(SDA);
+    release(SCL);
+    release(SDA);
+  }
+
+  /**
+   * @brief Send one byte, MSB first
+   *
+   * @param value The byte
+   * @return true if acknowledged
+   */
+  static bool writeByte(uint8_t value)
+  {
+    for (uint8_t i = 0; i != 8; ++i, value <<= 1)
+    {
+      if (value & 0x80)
+      {
+        release(SDA);
+      }
+      else
+      {
+        pullDown(SDA);
+      }
+      release(SCL);
+      pullDown(SCL);
+    }
+    release(SDA);
+    release(SCL);
+    const bool bAck{ LOW == digitalRead(SDA) };
+    pullDown(SCL);
+
+    return bAck;
+  }
+
+  /**
+   * @brief Receive one byte, MSB first
+   *
+   * @param bAck true to acknowledge (more bytes to come)
+   * @return uint8_t The byte
+   */
+  static uint8_t readByte(const bool bAck)
+  {
+    uint8_t value{ 0 };
+
+    release(SDA);
+    for (uint8_t i = 0; i != 8; ++i)
+    {
+      release(SCL);
+      value = (value << 1) | digitalRead(SDA);
+      pullDown(SCL);
+    }
+    if (bAck)
+    {
+      pullDown(SDA);
+    }
+    release(SCL);
+    pullDown(SCL);
+    release(SDA);
+
+    return value;
+  }
+};
+
+/**
+ * @brief Daily schedule driven by the real-time clock
+ *
+ */
+class DailyScheduler
+{
+public:
+  /**
+   * @brief Count one second, read the clock when due
+   * @details Called once per second from loop().
+   *
+   * @return true if the load priorities must be rotated
+   */
+  bool proceed()
+  {
+    const bool bRotation{ bSynced && tick() };
+
+    if (secondsToSync)
+    {
+      --secondsToSync;
+      return bRotation;
+    }
+
+    uint32_t now;
+    if (rtc.read(now))
+    {
+      if (!bSynced || now != seconds)
+      {
+        sync(now);
+      }
+    }
+    secondsToSync = bSynced ? RTC_SYNC_PERIOD_IN_SECONDS : RTC_RETRY_PERIOD_IN_SECONDS;
+
+    return bRotation;
+  }
+
+  /**
+   * @brief Set the clock
+   *
+   * @param now the second of the day [0..SECONDS_PER_DAY[
+   * @return true if the clock has been set
+   */
+  bool set(const uint32_t now)
+  {
+    if (now >= SECONDS_PER_DAY || !rtc.write(now))
+    {
+      return false;
+    }
+    sync(now);
+    secondsToSync = RTC_SYNC_PERIOD_IN_SECONDS;
+
+    return true;
+  }
+
+  /**
+   * @brief Recompute the states after a change of the schedule (see utils_params.h)
+   *
+   */
+  void reschedule()
+  {
+    if (bSynced)
+    {
+      sync(seconds);
+    }
+  }
+
+  /**
+   * @brief Get the state of the tariff
+   *
+   * @return true during the off-peak period
+   */
+  bool is_offPeak() const
+  {
+    return bOffPeak;
+  }
+
+  /**
+   * @brief Get the loads within their force window
+   *
+   * @return uint8_t bit mask of the loads
+   */
+  uint8_t get_forceMask() const
+  {
+    return forceMask;
+  }
+
+  /**
+   * @brief Get the time of the day
+   *
+   * @return uint32_t the second of the day, or UINT32_MAX if the clock has never been read
+   */
+  uint32_t get_seconds() const
+  {
+    return bSynced ? seconds : UINT32_MAX;
+  }
+
+private:
+  /**
+   * @brief Count one second, and apply the entries of the schedule which are due
+   *
+   * @return true if the load priorities must be rotated
+   */
+  bool tick()
+  {
+    if (++seconds == SECONDS_PER_DAY)
+    {
+      seconds = 0;
+    }
+
+    bool bRotation{ false };
+    for (uint8_t n = dailySchedule.size; n && (seconds == dailySchedule[next].time); --n)
+    {
+      bRotation |= apply(dailySchedule[next]);
+      next = (next + 1 == dailySchedule.size) ? 0 : next + 1;
+    }
+    return bRotation;
+  }
+
+  /**
+   * @brief Set the time, and recompute the states and the next entry
+   * @details The whole day is applied first, so that the windows across midnight are in place.
+   *
+   * @param now the second of the day
+   */
+  void sync(const uint32_t now)
+  {
+    seconds = now;
+    next = 0;
+
+    for (uint8_t i = 0; i != dailySchedule.size; ++i)
+    {
+      apply(dailySchedule[i]);
+    }
+    while (next != dailySchedule.size && dailySchedule[next].time <= now)
+    {
+      apply(dailySchedule[next++]);
+    }
+    if (next == dailySchedule.size)
+    {
+      next = 0;
+    }
+    bSynced = true;
+  }
+
+  /**
+   * @brief Apply one entry of the schedule
+   *
+   * @param entry The entry
+   * @return true for a rotation
+   */
+  bool apply(const ScheduleEntry &entry)
+  {
+    switch (entry.action)
+    {
+      case ScheduleActions::OFF_PEAK_START:
+        bOffPeak = true;
+        break;
+      case ScheduleActions::PEAK_START:
+        bOffPeak = false;
+        break;
+      case ScheduleActions::FORCE_START:
+        forceMask |= bit(entry.load);
+        break;
+      case ScheduleActions::FORCE_END:
+        forceMask &= ~bit(entry.load);
+        break;
+      case ScheduleActions::ROTATION:
+        return true;
+    }
+    return false;
+  }
+
+  RealTimeClock< rtcSdaPin, rtcSclPin > rtc; /**< the clock */
+  uint32_t seconds{ 0 };                     /**< second of the day */
+  uint16_t secondsToSync{ 0 };               /**< seconds before the next read of the clock */
+  uint8_t next{ 0 };                         /**< next entry of the schedule */
+  uint8_t forceMask{ 0 };                    /**< loads within their force window */
+  bool bOffPeak{ false };                    /**< off-peak period */
+  bool bSynced{ false };                     /**< the clock has been read at least once */
+};
+
+inline DailyScheduler dailyScheduler; /**< daily schedule of the dual tariff and the rotation */
+
+#endif  // UTILS_RTC_H
@@ -0,0 +1,108 @@
+/**
+ * @file utils_tasks.h
+ * @author Frédéric Metrich (frederic.metrich@live.fr)
+ * @brief Next-deadline scheduler of the periodic tasks of loop()
+ * @version 0.1
+ * @date 2024-06-02
+ *
+ * @details The periodic tasks of loop() are listed in a table, with their period and their offset
+ *          in mains cycles. The scheduler is ticked on each new mains cycle (see IsrSignals):
+ *          on most ticks, it only compares the cycle count with the next deadline.
+ *
+ *          With different offsets, the tasks of the same period run on different mains cycles,
+ *          instead of all in the same pass of loop() once per second.
+ *          A task with a period of 0 is disabled (ie the feature is not configured).
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef UTILS_TASKS_H
+#define UTILS_TASKS_H
+
+#include <Arduino.h>
+
+/**
+ * @brief One periodic task
+ *
+ */
+struct PeriodicTask
+{
+  uint16_t period; /**< period in mains cycles, 0 to disable the task (max 32767) */
+  uint16_t offset; /**< first run after this # of mains cycles, to spread the tasks of the same period [0..period[ */
+  void (*run)();   /**< the task */
+};
+
+/**
+ * @brief Next-deadline scheduler of a table of periodic tasks
+ *
+ * @tparam N Number of tasks
+ */
+template< uint8_t N >
+class PeriodicTasks
+{
+public:
+  /**
+   * @brief Construct the scheduler of a table of tasks
+   *
+   * @param _tasks The tasks
+   */
+  explicit PeriodicTasks(const PeriodicTask (&_tasks)[N])
+    : tasks(_tasks)
+  {
+    uint16_t delay{ UINT16_MAX };
+
+    for (uint8_t i = 0; i != N; ++i)
+    {
+      deadline[i] = tasks[i].offset ? tasks[i].offset : tasks[i].period;
+      if (tasks[i].period && deadline[i] < delay)
+      {
+        delay = deadline[i];
+      }
+    }
+    nextDeadline = delay;
+  }
+
+  /**
+   * @brief Count one mains cycle, and run the tasks which are due
+   *
+   */
+  void tick()
+  {
+    if (++cycle != nextDeadline)
+    {
+      return;
+    }
+
+    uint16_t delay{ UINT16_MAX };
+
+    for (uint8_t i = 0; i != N; ++i)
+    {
+      if (!tasks[i].period)
+      {
+        continue;
+      }
+
+      if (deadline[i] == cycle)
+      {
+        deadline[i] += tasks[i].period;
+        tasks[i].run();
+      }
+
+      const uint16_t remaining{ static_cast< uint16_t >(deadline[i] - cycle) };  // wraps around with the cycle count
+      if (remaining < delay)
+      {
+        delay = remaining;
+      }
+    }
+    nextDeadline = cycle + delay;
+  }
+
+private:
+  const PeriodicTask (&tasks)[N]; /**< the tasks */
+  uint16_t deadline[N]{};         /**< next run of each task, in mains cycles */
+  uint16_t cycle{ 0 };            /**< mains cycle count */
+  uint16_t nextDeadline{ 0 };     /**< earliest deadline of all the tasks */
+};
+
+#endif  // UTILS_TASKS_H
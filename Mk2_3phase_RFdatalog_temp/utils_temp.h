@@ -15,6 +15,7 @@
 #include <Arduino.h>
 
 #include "constants.h"
+#include "isr_latency.h"
 
 #ifdef TEMP_ENABLED
 inline constexpr bool TEMP_SENSOR_PRESENT{ true }; /**< set it to 'true' if temperature sensing is needed */
@@ -35,8 +36,72 @@ struct DeviceAddress
   uint8_t addr[8]; /**< The address of the device as an array of 8 bytes. */
 };
 
+/**
+ * @brief Target temperature of a load
+ * @details Used with TEMPERATURE_TARGETS: once the sensor of the load reaches the target,
+ *          the load is left out of the diversion until the temperature has dropped by the hysteresis.
+ *
+ * @ingroup TemperatureSensing
+ */
+class TemperatureTarget
+{
+public:
+  constexpr TemperatureTarget() = default;
+  constexpr TemperatureTarget(uint8_t _sensor, int16_t _target, uint8_t _hysteresis)
+    : sensor(_sensor), target(_target), hysteresis(_hysteresis)
+  {
+  }
+
+  /**
+   * @brief Get the sensor of the load
+   *
+   * @return constexpr uint8_t the index of the sensor in 'temperatureSensing', 0xff without target
+   */
+  [[nodiscard]] constexpr uint8_t getSensor() const
+  {
+    return sensor;
+  }
+  [[nodiscard]] constexpr int16_t getTarget_x100() const
+  {
+    return target * 100;
+  }
+  [[nodiscard]] constexpr int16_t getRestart_x100() const
+  {
+    return (target - hysteresis) * 100;
+  }
+
+private:
+  uint8_t sensor{ 0xff };   /**< index of the sensor in 'temperatureSensing', 0xff without target */
+  int16_t target{ 0 };      /**< target temperature in °C */
+  uint8_t hysteresis{ 0 };  /**< drop in °C before the load takes part again */
+};
+
+/** Steps of the OneWire sequence, one OneWire byte each */
+enum class OneWireSteps : uint8_t
+{
+  IDLE,           /**< nothing to do */
+  RESET,          /**< reset pulse before addressing the current sensor */
+  MATCH_ROM,      /**< MATCH ROM command */
+  ADDRESS,        /**< one byte of the address of the current sensor */
+  READ_COMMAND,   /**< READ SCRATCHPAD command */
+  READ_DATA,      /**< one byte of the scratchpad */
+  CHECK,          /**< final reset and CRC check, then publish the temperature */
+  RESET_CONVERT,  /**< reset pulse before the conversion request */
+  SKIP_ROM,       /**< SKIP ROM command (all sensors) */
+  CONVERT         /**< CONVERT T command */
+};
+
 /**
  * @brief This class implements the temperature sensing feature
+ * @details The sensors are read with a cooperative state machine: each call to proceed()
+ *          performs at most one OneWire byte (or reset pulse). Since the OneWire library masks
+ *          the interrupts during each bit slot, this bounds the delay imposed on the ADC ISR
+ *          to one bit slot, instead of the whole read-out of all sensors.
+ *          The duration of the longest step is recorded, as an upper bound of the masked time.
+ *
+ *          A read-out of all sensors is started by startReading(), and is followed by a new
+ *          conversion request. The published values are thus the ones converted one datalog
+ *          period before.
  * 
  * @tparam N Number of sensors, automatically deduced
  * 
@@ -62,12 +127,14 @@ public:
   }
 
   /**
-   * @brief Request temperature for all sensors
+   * @brief Request temperature for all sensors (blocking)
    *
    */
   void requestTemperatures() const
   {
 #ifdef TEMP_ENABLED
+    LatencySourceScope< LatencySources::ONEWIRE > latencySource;
+
     oneWire.reset();
     oneWire.skip();
     oneWire.write(CONVERT_TEMPERATURE);
@@ -76,10 +143,16 @@ public:
 
   /**
    * @brief Initialize the Dallas sensors
+   * @details Until its first read-out, each sensor is reported as disconnected.
    *
    */
   void initTemperatureSensors() const
   {
+    for (auto &temperature : temperatures)
+    {
+      temperature = DEVICE_DISCONNECTED_RAW;
+    }
+
 #ifdef TEMP_ENABLED
     oneWire.begin(sensorPin);
     requestTemperatures();
@@ -107,40 +180,176 @@ public:
   }
 
   /**
-   * @brief Read temperature of a specific device
+   * @brief Start reading all sensors, ignored if a read-out is still running
    *
-   * @param idx The index of the device
-   * @return int16_t Temperature * 100
    */
-  int16_t readTemperature(const uint8_t idx) const
+  void startReading() const
   {
-    static ScratchPad buf;
-
-#ifdef TEMP_ENABLED
-    if (!oneWire.reset())
+    if (OneWireSteps::IDLE == step)
     {
-      return DEVICE_DISCONNECTED_RAW;
+      sensorIdx = 0;
+      step = OneWireSteps::RESET;
     }
-    oneWire.select(sensorAddrs[idx].addr);
-    oneWire.write(READ_SCRATCHPAD);
+  }
+
+  /**
+   * @brief Check if a read-out is running
+   *
+   * @return true if busy
+   */
+  bool isBusy() const
+  {
+    return OneWireSteps::IDLE != step;
+  }
 
-    for (auto &buf_elem : buf)
+  /**
+   * @brief Perform the next step of the read-out
+   * @details Must be called on each loop() pass.
+   *
+   */
+  void proceed() const
+  {
+#ifdef TEMP_ENABLED
+    if (OneWireSteps::IDLE == step)
     {
-      buf_elem = oneWire.read();
+      return;
     }
 
-    if (!oneWire.reset())
+    LatencySourceScope< LatencySources::ONEWIRE > latencySource;
+    const auto start{ micros() };
+
+    switch (step)
     {
-      return DEVICE_DISCONNECTED_RAW;
+      case OneWireSteps::RESET:
+        if (oneWire.reset())
+        {
+          step = OneWireSteps::MATCH_ROM;
+        }
+        else
+        {
+          publish(DEVICE_DISCONNECTED_RAW);
+        }
+        break;
+      case OneWireSteps::MATCH_ROM:
+        oneWire.write(MATCH_ROM);
+        byteIdx = 0;
+        step = OneWireSteps::ADDRESS;
+        break;
+      case OneWireSteps::ADDRESS:
+        oneWire.write(sensorAddrs[sensorIdx].addr[byteIdx]);
+        if (++byteIdx == sizeof(DeviceAddress::addr))
+        {
+          step = OneWireSteps::READ_COMMAND;
+        }
+        break;
+      case OneWireSteps::READ_COMMAND:
+        oneWire.write(READ_SCRATCHPAD);
+        byteIdx = 0;
+        step = OneWireSteps::READ_DATA;
+        break;
+      case OneWireSteps::READ_DATA:
+        buf[byteIdx] = oneWire.read();
+        if (++byteIdx == sizeof(ScratchPad))
+        {
+          step = OneWireSteps::CHECK;
+        }
+        break;
+      case OneWireSteps::CHECK:
+        if (!oneWire.reset() || oneWire.crc8(buf, 8) != buf[8])
+        {
+          publish(DEVICE_DISCONNECTED_RAW);
+        }
+        else
+        {
+          publish(convert(buf));
+        }
+        break;
+      case OneWireSteps::RESET_CONVERT:
+        oneWire.reset();
+        step = OneWireSteps::SKIP_ROM;
+        break;
+      case OneWireSteps::SKIP_ROM:
+        oneWire.skip();
+        step = OneWireSteps::CONVERT;
+        break;
+      case OneWireSteps::CONVERT:
+        oneWire.write(CONVERT_TEMPERATURE);
+        step = OneWireSteps::IDLE;
+        break;
+      default:
+        step = OneWireSteps::IDLE;
+        break;
     }
-    if (oneWire.crc8(buf, 8) != buf[8])
+
+    const uint16_t duration{ static_cast< uint16_t >(micros() - start) };
+    if (duration > maxStepDuration)
     {
-      return DEVICE_DISCONNECTED_RAW;
+      maxStepDuration = duration;
     }
 #endif
+  }
+
+  /**
+   * @brief Get the last published temperature of a specific device
+   *
+   * @param idx The index of the device
+   * @return int16_t Temperature * 100
+   */
+  int16_t get_temperature(const uint8_t idx) const
+  {
+    return temperatures[idx];
+  }
 
+  /**
+   * @brief Get the duration of the longest OneWire step since the last call, and reset it
+   * @details This is an upper bound of the time the interrupts have been masked at once.
+   *
+   * @return uint16_t Duration in µs
+   */
+  uint16_t get_and_reset_maxStepDuration() const
+  {
+    const auto duration{ maxStepDuration };
+    maxStepDuration = 0;
+    return duration;
+  }
+
+  /**
+   * @brief Get the RAM used by the sensors, the published temperatures and the read-out
+   *
+   * @return constexpr uint16_t The size in bytes
+   */
+  static constexpr uint16_t get_ram_size()
+  {
+    constexpr uint16_t size{ sizeof(TemperatureSensing) + sizeof(temperatures) + sizeof(buf) + sizeof(step) + sizeof(sensorIdx) + sizeof(byteIdx) + sizeof(maxStepDuration) };
+#ifdef TEMP_ENABLED
+    return size + sizeof(oneWire);
+#else
+    return size;
+#endif
+  }
+
+private:
+  /**
+   * @brief Publish the temperature of the current sensor and go to the next one
+   *
+   * @param temperature Temperature * 100
+   */
+  void publish(const int16_t temperature) const
+  {
+    temperatures[sensorIdx] = temperature;
+    step = (++sensorIdx < N) ? OneWireSteps::RESET : OneWireSteps::RESET_CONVERT;
+  }
+
+  /**
+   * @brief Convert the content of the scratchpad
+   *
+   * @param scratchPad The scratchpad
+   * @return int16_t Temperature * 100
+   */
+  static int16_t convert(const ScratchPad &scratchPad)
+  {
     // result is temperature x16, multiply by 6.25 to convert to temperature x100
-    int16_t result = (buf[1] << 8) | buf[0];
+    int16_t result = (scratchPad[1] << 8) | scratchPad[0];
     result = (result * 6) + (result >> 2);
     if (result <= TEMP_RANGE_LOW || result >= TEMP_RANGE_HIGH)
     {
@@ -150,11 +359,17 @@ public:
     return result;
   }
 
-private:
   const uint8_t sensorPin; /**< The pin of the sensor(s) */
 
   const DeviceAddress sensorAddrs[N]; /**< Array of sensors */
 
+  static inline int16_t temperatures[N]{};              /**< last published temperatures */
+  static inline ScratchPad buf{};                       /**< scratchpad being read */
+  static inline OneWireSteps step{ OneWireSteps::IDLE }; /**< next step of the read-out */
+  static inline uint8_t sensorIdx{ 0 };                 /**< sensor being read */
+  static inline uint8_t byteIdx{ 0 };                   /**< byte being written/read */
+  static inline uint16_t maxStepDuration{ 0 };          /**< longest step in µs */
+
 #ifdef TEMP_ENABLED
   static inline OneWire oneWire; /**< For temperature sensing */
 #endif
@@ -0,0 +1,178 @@
+/**
+ * @file utils_txqueue.h
+ * @author Frédéric Metrich (frederic.metrich@live.fr)
+ * @brief Queue for the Serial text output
+ * @version 0.1
+ * @date 2024-05-08
+ *
+ * @details The datalog printouts are written into a RAM queue instead of the Serial.
+ *          loop() then drains it, never writing more bytes than the free space in the
+ *          TX buffer of the Serial, so that the per-second tasks are never delayed
+ *          by a long printout.
+ *
+ *          The queue must hold a whole printout: should it be full, the new bytes are dropped
+ *          and counted (see get_overflows()) rather than waiting for the Serial.
+ *          Without any text output, the queue is reduced to a single byte.
+ *
+ *          With POLLED_SERIAL_TX, the bytes are written straight into the data register of the UART
+ *          from loop(), so that the TX interrupt of the Serial never delays the ADC ISR, whatever
+ *          the baud rate. The debug output, written through the Serial, is sent first.
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef UTILS_TXQUEUE_H
+#define UTILS_TXQUEUE_H
+
+#include <Arduino.h>
+
+#include "config.h"
+#include "isr_profile.h"
+
+#if defined(SERIALPRINT) || defined(SERIALOUT) || defined(EMONESP)
+inline constexpr bool SERIAL_TEXT_OUTPUT{ true }; /**< the datalogs are printed as text */
+#else
+inline constexpr bool SERIAL_TEXT_OUTPUT{ RUNTIME_PARAMETERS || SERIAL_CONTROL || LOAD_STATISTICS || RTC_PRESENT || TRANSITION_LOG || ISR_PROFILING }; /**< the commands are answered, the transitions logged or the ISR profiled, as text */
+#endif
+
+/**
+ * @brief Get the number of bytes which can be written to the Serial without blocking
+ *
+ * @return int the free space of the TX buffer, 0 or 1 with POLLED_SERIAL_TX
+ */
+inline int serialTxRoom()
+{
+  if constexpr (POLLED_SERIAL_TX)
+  {
+    // the data register is free, and the Serial has nothing left to send
+    return (UCSR0A & bit(UDRE0)) && (Serial.availableForWrite() == SERIAL_TX_BUFFER_SIZE - 1);
+  }
+  else
+  {
+    return Serial.availableForWrite();
+  }
+}
+
+/**
+ * @brief Write one byte to the Serial
+ * @details Blocks if there's no room, see serialTxRoom().
+ *
+ * @param byte The byte to send
+ */
+inline void serialTxWrite(const uint8_t byte)
+{
+  if constexpr (POLLED_SERIAL_TX)
+  {
+    while (!serialTxRoom())
+    {
+    }
+    UDR0 = byte;
+  }
+  else
+  {
+    Serial.write(byte);
+  }
+}
+
+/**
+ * @brief Ring buffer of bytes waiting to be sent through the Serial
+ *
+ * @tparam N Size of the queue, must be a power of 2
+ */
+template< uint16_t N >
+class SerialTxQueue : public Print
+{
+  static_assert(N && !(N & (N - 1)), "The size of the queue must be a power of 2");
+  static_assert(N <= 256, "The size of the queue must fit in 8 bits indices");
+
+public:
+  /**
+   * @brief Queue one byte
+   *
+   * @param byte The byte to send
+   * @return size_t 1, or 0 if the queue is full and the byte has been dropped
+   */
+  size_t write(uint8_t byte) override
+  {
+    if (count == N)
+    {
+      if (overflows != UINT16_MAX)
+      {
+        ++overflows;
+      }
+      return 0;
+    }
+
+    buffer[head] = byte;
+    head = (head + 1) & (N - 1);
+    ++count;
+
+    return 1;
+  }
+
+  using Print::write;
+
+  /**
+   * @brief Check if some bytes are still waiting
+   *
+   * @return true if the queue is empty
+   */
+  bool isEmpty() const
+  {
+    return !count;
+  }
+
+  /**
+   * @brief Get the number of bytes dropped since startup, the queue being full
+   *
+   * @return uint16_t # of dropped bytes, saturated at UINT16_MAX
+   */
+  uint16_t get_overflows() const
+  {
+    return overflows;
+  }
+
+  /**
+   * @brief Write as many bytes as the TX buffer can take without blocking
+   * @details Must be called on each loop() pass.
+   *
+   */
+  void proceed()
+  {
+    if (!count)
+    {
+      return;
+    }
+
+    auto room{ serialTxRoom() };
+
+    while (count && room > 0)
+    {
+      writeOne();
+      room = POLLED_SERIAL_TX ? serialTxRoom() : room - 1;  // the shift register may take a 2nd byte
+    }
+  }
+
+private:
+  /**
+   * @brief Write the oldest byte to the Serial
+   *
+   */
+  void writeOne()
+  {
+    serialTxWrite(buffer[tail]);
+    tail = (tail + 1) & (N - 1);
+    --count;
+  }
+
+  uint8_t buffer[N];       /**< the queued bytes */
+  uint8_t head{ 0 };       /**< position of the next byte to write */
+  uint8_t tail{ 0 };       /**< position of the next byte to send */
+  uint16_t count{ 0 };     /**< number of bytes in the queue */
+  uint16_t overflows{ 0 }; /**< number of bytes dropped, the queue being full */
+};
+
+inline SerialTxQueue< SERIAL_TEXT_OUTPUT ? SERIAL_TX_QUEUE_SIZE : 1 > serialTxQueue; /**< queue for the text output */
+
+#endif  // UTILS_TXQUEUE_H
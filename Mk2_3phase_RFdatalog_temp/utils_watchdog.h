@@ -0,0 +1,194 @@
+/**
+ * @file utils_watchdog.h
+ * @author Frédéric Metrich (frederic.metrich@live.fr)
+ * @brief Hardware watchdog, kicked only while the ISR is alive
+ * @version 0.1
+ * @date 2024-05-31
+ *
+ * @details With HARDWARE_WATCHDOG, the watchdog timer of the AVR is armed with the first mains cycle
+ *          reported by the ISR. loop() then kicks it only when a new mains cycle has been reported
+ *          during the last WATCHDOG_STALL_TIMEOUT_MS (see IsrSignals). A stalled ISR, or a loop()
+ *          stuck somewhere, thus ends in a reset instead of leaving the loads frozen in their last state.
+ *
+ *          The ISR only reports the mains cycles once the DC-offset filters have settled, which may take
+ *          until the end of the start-up period (see processStartUp()). Until then, neither the watchdog
+ *          nor the stall check is armed. Without any mains cycle by WATCHDOG_ARMING_DEADLINE_MS,
+ *          they are armed anyway, so that an ISR which never starts still ends in a reset.
+ *
+ *          When the mains cycles stop, the ADC is first restarted (see restartAdc()).
+ *          If the cycles come back before the watchdog fires, nothing else happens.
+ *
+ *          The reset flags are saved before main() and the watchdog is disabled right away, otherwise
+ *          it would fire again during the initial delay of setup(). Each watchdog reset is counted
+ *          in EEPROM. A bootloader which clears MCUSR itself (old Optiboot) hides these resets.
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef UTILS_WATCHDOG_H
+#define UTILS_WATCHDOG_H
+
+#include <Arduino.h>
+#include <avr/eeprom.h>
+#include <avr/wdt.h>
+
+#include "config.h"
+#include "debug.h"
+#include "processing.h"
+#include "utils_params.h"
+
+inline constexpr uint16_t WATCHDOG_STALL_TIMEOUT_MS{ 200 };                                                   /**< no mains cycle during this time means the ISR has stalled (10 cycles @ 50 Hz) */
+inline constexpr uint16_t WATCHDOG_ARMING_DEADLINE_MS{ initialDelay + startUpPeriod + WATCHDOG_STALL_TIMEOUT_MS }; /**< the watchdog is armed at the latest at this time after boot */
+
+inline uint8_t resetFlags __attribute__((section(".noinit"))); /**< copy of MCUSR, saved before main() */
+
+/**
+ * @brief Save the reset flags and disable the watchdog, before main()
+ * @details After a watchdog reset, the watchdog stays enabled with its shortest timeout.
+ *
+ */
+static void saveResetFlags() __attribute__((naked, used, section(".init3")));
+static void saveResetFlags()
+{
+  if constexpr (HARDWARE_WATCHDOG)
+  {
+    resetFlags = MCUSR;
+    MCUSR = 0;
+    wdt_disable();
+  }
+}
+
+/**
+ * @brief Count of the watchdog resets, as stored in EEPROM
+ *
+ */
+struct WatchdogRecord
+{
+  uint16_t resets;     /**< number of watchdog resets */
+  uint16_t complement; /**< ~resets, to detect an erased or corrupted record */
+};
+
+/**
+ * @brief Hardware watchdog with a liveness check of the ISR
+ *
+ * @tparam BASE Address of the record in EEPROM
+ */
+template< uint16_t BASE >
+class HardwareWatchdog
+{
+  static_assert((BASE >= EEPROM_PARAMETERS_ADDRESS + sizeof(RuntimeParameters)) && (BASE + sizeof(WatchdogRecord) <= E2END + 1),
+                "The watchdog record must be after the runtime parameters, inside the EEPROM");
+
+public:
+  /**
+   * @brief Count the last reset if caused by the watchdog
+   * @details Called at the end of setup(), once the ISR is running.
+   *          The watchdog is armed later, once the start-up is over (see arm()).
+   *
+   */
+  void begin()
+  {
+    WatchdogRecord record;
+    eeprom_read_block(&record, reinterpret_cast< const void * >(BASE), sizeof(WatchdogRecord));
+
+    resets = (static_cast< uint16_t >(~record.complement) == record.resets) ? record.resets : 0;
+
+    if ((resetFlags & bit(WDRF)) && (resets != UINT16_MAX))
+    {
+      ++resets;
+      record.resets = resets;
+      record.complement = ~resets;
+      eeprom_update_block(&record, reinterpret_cast< void * >(BASE), sizeof(WatchdogRecord));
+    }
+
+    DBUG(F("Watchdog resets: "));
+    DBUGLN(resets);
+  }
+
+  /**
+   * @brief Record a new mains cycle, reported by the ISR
+   * @details The first one arms the watchdog.
+   *
+   */
+  void notifyMainsCycle()
+  {
+    if (!bArmed)
+    {
+      arm();
+    }
+    lastMainsCycle = millis();
+    bAdcRestarted = false;
+  }
+
+  /**
+   * @brief Kick the watchdog if the ISR is alive, restart the ADC otherwise
+   * @details Called at each loop().
+   *
+   */
+  void proceed()
+  {
+    if (!bArmed)
+    {
+      if (millis() < WATCHDOG_ARMING_DEADLINE_MS)
+      {
+        return;  // the start-up may still be running
+      }
+      arm();
+    }
+
+    if (millis() - lastMainsCycle < WATCHDOG_STALL_TIMEOUT_MS)
+    {
+      wdt_reset();
+      return;
+    }
+
+    if (!bAdcRestarted)
+    {
+      bAdcRestarted = true;
+      restartAdc();
+      DBUGLN(F("No mains cycle, ADC restarted!"));
+    }
+  }
+
+  /**
+   * @brief Get the number of watchdog resets
+   *
+   * @return uint16_t the count stored in EEPROM, including the last reset
+   */
+  uint16_t get_resets() const
+  {
+    return resets;
+  }
+
+  /**
+   * @brief Check if the watchdog has been armed
+   *
+   * @return true once the first mains cycle has been reported, or after WATCHDOG_ARMING_DEADLINE_MS
+   */
+  bool isArmed() const
+  {
+    return bArmed;
+  }
+
+private:
+  /**
+   * @brief Enable the watchdog and start the stall check
+   *
+   */
+  void arm()
+  {
+    bArmed = true;
+    lastMainsCycle = millis();
+    wdt_enable(WDTO_2S);
+  }
+
+  uint32_t lastMainsCycle{ 0 }; /**< time of the last mains cycle in ms */
+  uint16_t resets{ 0 };         /**< number of watchdog resets */
+  bool bArmed{ false };         /**< the watchdog and the stall check are running */
+  bool bAdcRestarted{ false };  /**< the ADC has been restarted since the last mains cycle */
+};
+
+inline HardwareWatchdog< EEPROM_WATCHDOG_ADDRESS > hardwareWatchdog; /**< watchdog, kicked while the ISR is alive */
+
+#endif  // UTILS_WATCHDOG_H
@@ -0,0 +1,149 @@
+/**
+ * @file utils_wiring.h
+ * @author Frédéric Metrich (frederic.metrich@live.fr)
+ * @brief Detection of the wiring faults of the CTs and of the voltage references
+ * @version 0.1
+ * @date 2024-06-06
+ *
+ * @details With WIRING_CHECK, the datalog of each period is checked for:
+ *          - a missing voltage reference: no complete mains cycle on the phase (its polarity never changes),
+ *          - a missing CT: a current close to zero on the phase, while one of its loads was ON
+ *            for most of the period,
+ *          - a reversed CT: when the power diverted on the phase steps up (or down), the import
+ *            of the phase must follow in the same direction. A reversed CT moves it the other way.
+ *            Each significant step is a vote, the phase is flagged after WIRING_REVERSAL_VOTES
+ *            votes more for a reversal than for a correct CT.
+ *
+ *          Only the sums of the datalog period are used, nothing is added to the ISR.
+ *          The first datalog after the start-up already gives the voltage and CT checks.
+ *          The faults are printed with the datalog (see printWiringFaults()),
+ *          and once through the debug port when they show up.
+ *
+ *          The phase of each load is given by 'loadPhase'.
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef UTILS_WIRING_H
+#define UTILS_WIRING_H
+
+#include <Arduino.h>
+
+#include "config.h"
+#include "debug.h"
+#include "processing.h"
+
+inline constexpr int16_t WIRING_MIN_CURRENT_x100{ 5 }; /**< below 0.05 A, there's no CT on the phase */
+inline constexpr int16_t WIRING_MIN_POWER_STEP{ 500 }; /**< smallest step of the diverted power of a phase in W, for a vote */
+inline constexpr int8_t WIRING_REVERSAL_VOTES{ 3 };    /**< votes needed to flag a reversed CT */
+
+inline constexpr uint8_t WIRING_NO_VOLTAGE{ 0x01 };  /**< fault: no voltage reference */
+inline constexpr uint8_t WIRING_NO_CT{ 0x02 };       /**< fault: no current while a load of the phase was ON */
+inline constexpr uint8_t WIRING_CT_REVERSED{ 0x04 }; /**< fault: the import goes down when the diversion goes up */
+
+/**
+ * @brief Checks of the wiring, from the datalogs
+ *
+ */
+class WiringCheck
+{
+public:
+  /**
+   * @brief Check the last datalog period
+   * @details Called after the measurements of tx_data have been computed.
+   *
+   * @param divertedPower power diverted on each phase during the period in W
+   */
+  void proceed(const int16_t (&divertedPower)[NO_OF_PHASES])
+  {
+    for (uint8_t phase = 0; phase < NO_OF_PHASES; ++phase)
+    {
+      uint8_t newFaults{ 0 };
+
+      if (!datalogSnapshot.completeCycles[phase])
+      {
+        newFaults |= WIRING_NO_VOLTAGE;
+      }
+
+      // with a load of the phase ON for a large part of the period, some current must flow through the CT
+      if ((divertedPower[phase] >= WIRING_MIN_POWER_STEP) && (tx_data.Irms_L_x100[phase] < WIRING_MIN_CURRENT_x100))
+      {
+        newFaults |= WIRING_NO_CT;
+      }
+
+      if (bPrevious)
+      {
+        vote(phase, divertedPower[phase] - previousDiverted[phase], tx_data.power_L[phase] - previousPower[phase]);
+      }
+      previousDiverted[phase] = divertedPower[phase];
+      previousPower[phase] = tx_data.power_L[phase];
+
+      if (score[phase] <= -WIRING_REVERSAL_VOTES)
+      {
+        newFaults |= WIRING_CT_REVERSED;
+      }
+
+      if (newFaults & ~faults[phase])
+      {
+        DBUG(F("Wiring fault on phase #"));
+        DBUG(phase + 1);
+        DBUG(F(": "));
+        DBUGLN(newFaults, HEX);
+      }
+      faults[phase] = newFaults;
+    }
+    bPrevious = true;
+  }
+
+  /**
+   * @brief Get the faults of a phase
+   *
+   * @param phase the phase number [0..NO_OF_PHASES[
+   * @return uint8_t the faults, one bit per fault (WIRING_xxx)
+   */
+  uint8_t get_faults(const uint8_t phase) const
+  {
+    return faults[phase];
+  }
+
+private:
+  /**
+   * @brief Vote for a correct or a reversed CT, from a step of the diverted power
+   * @details A step of the import smaller than half of the step of the diversion
+   *          is left out (PV or consumption changing meanwhile).
+   *
+   * @param phase the phase number [0..NO_OF_PHASES[
+   * @param divertedStep change of the diverted power in W
+   * @param importStep change of the import in W
+   */
+  void vote(const uint8_t phase, const int16_t divertedStep, const int16_t importStep)
+  {
+    if (abs(divertedStep) < WIRING_MIN_POWER_STEP || abs(importStep) < abs(divertedStep) / 2)
+    {
+      return;
+    }
+
+    if ((divertedStep > 0) == (importStep > 0))
+    {
+      if (score[phase] < WIRING_REVERSAL_VOTES)
+      {
+        ++score[phase];
+      }
+    }
+    else if (score[phase] > -WIRING_REVERSAL_VOTES)
+    {
+      --score[phase];
+    }
+  }
+
+  int16_t previousDiverted[NO_OF_PHASES]{}; /**< diverted power of the previous period */
+  int16_t previousPower[NO_OF_PHASES]{};    /**< import of the previous period */
+  int8_t score[NO_OF_PHASES]{};             /**< votes for a correct CT (+ve) or a reversed one (-ve) */
+  uint8_t faults[NO_OF_PHASES]{};           /**< faults of each phase, one bit per fault (WIRING_xxx) */
+  bool bPrevious{ false };                  /**< a previous period is available */
+};
+
+inline WiringCheck wiringCheck; /**< checks of the wiring */
+
+#endif  // UTILS_WIRING_H
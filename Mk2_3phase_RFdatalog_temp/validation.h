@@ -12,8 +12,13 @@
 #ifndef VALIDATION_H
 #define VALIDATION_H
 
+#include "calibration.h"
 #include "config_system.h"
+#include "isr_profile.h"
+#include "processing.h"
+#include "utils.h"
 #include "utils_pins.h"
+#include "utils_ram.h"
 #include "utils_rf.h"
 
 #include "config.h"
@@ -26,6 +31,21 @@
  * 
  */
 
+static_assert(NO_OF_ADC_CHANNELS <= 8, "**** The ATmega328P has only 8 analog inputs, please reduce NO_OF_EXTRA_CHANNELS ! ****");
+static_assert((ADC_PRESCALER == 32) || (ADC_PRESCALER == 64) || (ADC_PRESCALER == 128), "**** ADC_PRESCALER must be 32, 64 or 128 ! ****");
+static_assert(NOMINAL_SAMPLE_SETS_PER_MAINS_CYCLE * 1.1F + 4 <= UINT8_MAX, "**** Too many sample sets per mains cycle, please use a slower ADC_PRESCALER ! ****");
+static_assert(NOMINAL_SAMPLE_SETS_PER_MAINS_CYCLE * DATALOG_PERIOD_IN_MAINS_CYCLES <= UINT16_MAX, "**** Too many sample sets per datalog period, please reduce DATALOG_PERIOD_IN_SECONDS ! ****");
+static_assert(ADC_TRIGGER_MODE != AdcTriggerModes::TIMER1 || ADC_TIMER_PERIOD >= ADC_CONVERSION_CYCLES, "**** Too many sample sets per mains cycle for the ADC, please reduce SAMPLE_SETS_PER_MAINS_CYCLE ! ****");
+static_assert(ADC_OVERSAMPLING_BITS <= 3, "**** ADC_OVERSAMPLING_BITS must be in [0..3] ! ****");
+static_assert(!ADC_OVERSAMPLING_BITS || NOMINAL_SAMPLE_SETS_PER_MAINS_CYCLE >= 20, "**** Too few decimated sample sets per mains cycle, the oversampling needs a faster ADC ! ****");
+static_assert(ADC_TRIGGER_MODE != AdcTriggerModes::TIMER1 || !(ISR_PROFILING || ISR_LATENCY_MONITOR), "**** Timer1 cannot trigger the ADC while profiling or monitoring the ISR ! ****");
+
+static_assert((f_phaseCal >= 0) && (f_phaseCal <= 2), "**** f_phaseCal must be in [0..2] ! ****");
+static_assert((alpha > 0) && (alpha < 1), "**** alpha must be in ]0..1[ ! ****");
+static_assert((lpf_gain >= -8) && (lpf_gain <= 8), "**** lpf_gain must be in [-8..8] ! ****");
+
+static_assert(STATIC_RAM_USAGE + RAM_STACK_RESERVE <= RAM_SIZE, "**** Not enough RAM left for the stack, please disable some features (see printRamBudget()) ! ****");
+
 static_assert(DATALOG_PERIOD_IN_SECONDS <= 40, "**** Data log duration is too long and will lead to overflow ! ****");
 
 static_assert(TEMP_SENSOR_PRESENT ^ (temperatureSensing.get_pin() == 0xff), "******** Wrong pin value for temperature sensor(s). Please check your config.h ! ********");
@@ -34,17 +54,59 @@ static_assert((PRIORITY_ROTATION == RotationModes::PIN) ^ (rotationPin == 0xff),
 static_assert(OVERRIDE_PIN_PRESENT ^ (forcePin == 0xff), "******** Wrong pin value for override command. Please check your config.h ! ********");
 static_assert(WATCHDOG_PIN_PRESENT ^ (watchDogPin == 0xff), "******** Wrong pin value for watchdog. Please check your config.h ! ********");
 
-static_assert(DUAL_TARIFF ^ (dualTariffPin == 0xff), "******** Wrong pin value for dual tariff. Please check your config.h ! ********");
+static_assert((DUAL_TARIFF && !RTC_PRESENT) ^ (dualTariffPin == 0xff), "******** Wrong pin value for dual tariff (not used with RTC_PRESENT). Please check your config.h ! ********");
 static_assert(!DUAL_TARIFF | (ul_OFF_PEAK_DURATION == 0), "******** Off-peak duration cannot be zero. Please check your config.h ! ********");
 static_assert(!(DUAL_TARIFF & (ul_OFF_PEAK_DURATION > 12)), "******** Off-peak duration cannot last more than 12 hours. Please check your config.h ! ********");
+static_assert(RTC_PRESENT ^ ((rtcSdaPin == 0xff) && (rtcSclPin == 0xff)), "******** Wrong pin values for the real-time clock. Please check your config.h ! ********");
+static_assert(!RTC_PRESENT || (OFF_PEAK_START.isValid() && ROTATION_TIME.isValid()), "******** OFF_PEAK_START and ROTATION_TIME must be in [00:00..23:59]. Please check your config.h ! ********");
 
 static_assert(!EMONESP_CONTROL || (DIVERSION_PIN_PRESENT && DIVERSION_PIN_PRESENT && (PRIORITY_ROTATION == RotationModes::PIN) && OVERRIDE_PIN_PRESENT), "******** Wrong configuration. Please check your config.h ! ********");
+static_assert(!SERIAL_CONTROL || !(EMONESP_CONTROL || DIVERSION_PIN_PRESENT || (PRIORITY_ROTATION == RotationModes::PIN) || OVERRIDE_PIN_PRESENT), "******** SERIAL_CONTROL replaces the diversion, rotation and override pins ! Please check your config.h ! ********");
+
+#if defined(SERIALPRINT) || defined(SERIALOUT) || defined(SERIALBINARY) || (defined(ENABLE_DEBUG) && !defined(EMONESP))
+static_assert(!MODBUS_SLAVE, "******** MODBUS_SLAVE needs the Serial for itself, please comment out SERIALPRINT, SERIALOUT, SERIALBINARY and ENABLE_DEBUG ! ********");
+#endif
+static_assert(!MODBUS_SLAVE || !(EMONESP_CONTROL || RUNTIME_PARAMETERS || SERIAL_CONTROL || RAW_SAMPLES_CAPTURE || RTC_PRESENT), "******** MODBUS_SLAVE needs the Serial for itself ! Please check your config.h ! ********");
+static_assert(!(MODBUS_SLAVE && TRANSITION_LOG), "******** MODBUS_SLAVE needs the Serial for itself, TRANSITION_LOG cannot be used with it ! Please check your config.h ! ********");
+static_assert(!(MODBUS_SLAVE && LOAD_STATISTICS), "******** MODBUS_SLAVE needs the Serial for itself, LOAD_STATISTICS cannot be used with it ! Please check your config.h ! ********");
+static_assert(!(MODBUS_SLAVE && POLLED_SERIAL_TX), "******** The Modbus answers must be sent without gaps, POLLED_SERIAL_TX cannot be used with MODBUS_SLAVE ! ********");
+
+static_assert((SERIAL_BAUD_RATE == 9600) || (SERIAL_BAUD_RATE == 19200) || (SERIAL_BAUD_RATE == 38400) || (SERIAL_BAUD_RATE == 57600) || (SERIAL_BAUD_RATE == 115200), "******** Unsupported baud rate for the Serial ! Please check your config_system.h ! ********");
+
+#if !defined(SERIALBINARY)
+static_assert(!FAST_STREAM, "******** FAST_STREAM_PERIOD_IN_MAINS_CYCLES needs the binary frames, please uncomment SERIALBINARY ! ********");
+#endif
+static_assert(!FAST_STREAM || (DATALOG_PERIOD_IN_MAINS_CYCLES % FAST_STREAM_PERIOD_IN_MAINS_CYCLES == 0), "******** FAST_STREAM_PERIOD_IN_MAINS_CYCLES must be a divider of the datalog period ! ********");
+static_assert(!FAST_STREAM || ((FRAME_HEADER_SIZE + sizeof(FastStreamFramePayload) + FRAME_CRC_SIZE) * 10UL * SUPPLY_FREQUENCY / FAST_STREAM_PERIOD_IN_MAINS_CYCLES < SERIAL_BAUD_RATE), "******** The fast stream exceeds the baud rate ! Please check FAST_STREAM_PERIOD_IN_MAINS_CYCLES and SERIAL_BAUD_RATE ! ********");
+
+static_assert(!COORDINATION_MASTER || (DATALOG_PERIOD_IN_MAINS_CYCLES % COORDINATION_PERIOD_IN_MAINS_CYCLES == 0), "******** COORDINATION_PERIOD_IN_MAINS_CYCLES must be a divider of the datalog period ! ********");
+static_assert(!COORDINATION_SECONDARY || !PER_PHASE_BUCKETS, "******** A secondary router offsets the main energy bucket, PER_PHASE_BUCKETS cannot be used with it ! Please check your config ! ********");
+#ifdef RF_PRESENT
+static_assert(!COORDINATION_SECONDARY || (masterNodeID != nodeID), "******** A secondary router cannot be its own master, please check masterNodeID ! ********");
+#endif
 
 static_assert(!RELAY_DIVERSION | (60 / DATALOG_PERIOD_IN_SECONDS * DATALOG_PERIOD_IN_SECONDS == 60), "******** Wrong configuration. DATALOG_PERIOD_IN_SECONDS must be a divider of 60 ! ********");
 
-constexpr uint16_t check_pins()
+constexpr bool check_fixed_point_power_cal()
+{
+  if constexpr (FIXED_POINT_ENERGY_BUCKET)
+  {
+    for (const auto &powerCal : f_powerCal)
+    {
+      // the product with the average power per sample (max 2^17) must fit in 32 bits
+      if (powerCal <= 0 || powerCal * (1UL << POWER_CAL_SHIFT) >= 8192)
+        return false;
+    }
+  }
+
+  return true;
+}
+
+static_assert(check_fixed_point_power_cal(), "******** f_powerCal must be in ]0, 0.25[ with the fixed-point energy bucket. Please check your calibration.h ! ********");
+
+constexpr uint32_t check_pins()
 {
-  uint16_t used_pins{ 0 };
+  uint32_t used_pins{ 0 };
 
   if constexpr (TEMP_SENSOR_PRESENT)
   {
@@ -84,6 +146,34 @@ constexpr uint16_t check_pins()
     bit_set(used_pins, watchDogPin);
   }
 
+  if (pwmOutputPin != 0xff)
+  {
+    if (bit_read(used_pins, pwmOutputPin))
+      return 0;
+
+    bit_set(used_pins, pwmOutputPin);
+  }
+
+  if (meterPulsePin != 0xff)
+  {
+    if (bit_read(used_pins, meterPulsePin))
+      return 0;
+
+    bit_set(used_pins, meterPulsePin);
+  }
+
+  constexpr uint8_t rtcPins[]{ rtcSdaPin, rtcSclPin };
+  for (const auto &rtcPin : rtcPins)
+  {
+    if (rtcPin != 0xff)
+    {
+      if (bit_read(used_pins, rtcPin))
+        return 0;
+
+      bit_set(used_pins, rtcPin);
+    }
+  }
+
   //physicalLoadPin for the TRIACS
   for (const auto &loadPin : physicalLoadPin)
   {
@@ -115,6 +205,30 @@ constexpr uint16_t check_pins()
   return used_pins;
 }
 
+constexpr bool check_analog_pins()
+{
+  // A0..A5 are the digital pins 14..19, A6 and A7 are analog only
+  constexpr uint8_t FIRST_ANALOG_PIN{ 14 };
+  const uint32_t used_pins{ check_pins() };
+
+  for (const auto &sensor : sensorV)
+  {
+    if (sensor < 6 && bit_read(used_pins, FIRST_ANALOG_PIN + sensor))
+      return false;
+  }
+  for (const auto &sensor : sensorI)
+  {
+    if (sensor < 6 && bit_read(used_pins, FIRST_ANALOG_PIN + sensor))
+      return false;
+  }
+  for (uint8_t extra = 0; extra < NO_OF_EXTRA_CHANNELS; ++extra)
+  {
+    if (sensorExtra[extra] < 6 && bit_read(used_pins, FIRST_ANALOG_PIN + sensorExtra[extra]))
+      return false;
+  }
+  return true;
+}
+
 constexpr uint16_t check_relay_pins()
 {
   bool pins_ok{ true };
@@ -156,11 +270,66 @@ constexpr bool check_load_priorities()
   return _sum == ((NO_OF_DUMPLOADS * (NO_OF_DUMPLOADS - 1)) >> 1);
 }
 
+constexpr bool check_load_phases()
+{
+  for (const auto &phase : loadPhase)
+  {
+    if (phase >= NO_OF_PHASES)
+      return false;
+  }
+  return true;
+}
+
+constexpr bool check_temperature_targets()
+{
+  if constexpr (TEMPERATURE_TARGETS)
+  {
+    for (const auto &target : loadTemperatureTargets)
+    {
+      if ((target.getSensor() != 0xff) && (target.getSensor() >= temperatureSensing.get_size()))
+        return false;
+    }
+  }
+  return true;
+}
+
+constexpr bool check_load_rated_power()
+{
+  for (const auto &ratedPower : loadRatedPower)
+  {
+    if (!ratedPower)
+      return false;
+  }
+  return true;
+}
+
 static_assert(check_load_priorities(), "******** Load Priorities wrong ! Please check your config ! ********");
+static_assert(!THERMOSTAT_DETECTION || LOAD_POWER_LEARNING, "******** THERMOSTAT_DETECTION needs LOAD_POWER_LEARNING ! Please check your config ! ********");
+static_assert(!(MULTI_LOAD_SWITCHING || BEST_FIT_LOADS || LOAD_POWER_LEARNING || COORDINATED_DIVERSION || ENERGY_COUNTERS || EQUALISED_ROTATION) || check_load_rated_power(), "******** The rated power of each load must be set with MULTI_LOAD_SWITCHING, BEST_FIT_LOADS, LOAD_POWER_LEARNING, COORDINATED_DIVERSION, ENERGY_COUNTERS or EQUALISED_ROTATION ! Please check your config ! ********");
+static_assert(!EQUALISED_ROTATION || (PRIORITY_ROTATION != RotationModes::OFF), "******** EQUALISED_ROTATION needs PRIORITY_ROTATION ! Please check your config ! ********");
+static_assert((ENERGY_FLUSH_PERIOD_IN_MINUTES * 60U) % DATALOG_PERIOD_IN_SECONDS == 0, "******** ENERGY_FLUSH_PERIOD_IN_MINUTES must be a multiple of the datalog period ! Please check your config ! ********");
+static_assert(check_load_phases(), "******** The phase of each load must be in [0..NO_OF_PHASES[ ! Please check your config ! ********");
+static_assert(!TEMPERATURE_TARGETS || TEMP_SENSOR_PRESENT, "******** TEMPERATURE_TARGETS needs the temperature sensors ! Please check your config ! ********");
+static_assert(check_temperature_targets(), "******** The sensor of each load must be in 'temperatureSensing' (or 0xff) ! Please check your config ! ********");
+static_assert(!AUTO_CALIBRATION || RUNTIME_PARAMETERS, "******** AUTO_CALIBRATION needs RUNTIME_PARAMETERS ! Please check your config ! ********");
+static_assert(!PWM_OUTPUT || (3 == pwmOutputPin), "******** PWM_OUTPUT needs 'pwmOutputPin' on D3 (Timer2, OC2B) ! Please check your config ! ********");
+static_assert((PWM_OUTPUT_SLEW_RATE != 0) && (PWM_OUTPUT_SLEW_RATE <= 255), "******** PWM_OUTPUT_SLEW_RATE must be in [1..255] ! Please check your config ! ********");
+static_assert(!METER_PULSE_INPUT || (2 == meterPulsePin) || (3 == meterPulsePin), "******** METER_PULSE_INPUT needs 'meterPulsePin' on D2 (INT0) or D3 (INT1) ! Please check your config ! ********");
+static_assert(!METER_CALIBRATION_TRIM || (METER_PULSE_INPUT && RUNTIME_PARAMETERS), "******** METER_CALIBRATION_TRIM needs METER_PULSE_INPUT and RUNTIME_PARAMETERS ! Please check your config ! ********");
+static_assert(METER_PULSES_PER_KWH != 0, "******** METER_PULSES_PER_KWH must be > 0 ! Please check your config ! ********");
+
+static_assert(!OVERVOLTAGE_BOOST || ((OVERVOLTAGE_HYSTERESIS_IN_VOLTS != 0) && (OVERVOLTAGE_HYSTERESIS_IN_VOLTS < OVERVOLTAGE_LIMIT_IN_VOLTS)), "******** OVERVOLTAGE_HYSTERESIS_IN_VOLTS must be in [1..OVERVOLTAGE_LIMIT_IN_VOLTS[ ! Please check your config ! ********");
+static_assert(!OVERVOLTAGE_BOOST || (OVERVOLTAGE_BOOST_IN_WATTS > 0), "******** OVERVOLTAGE_BOOST_IN_WATTS must be > 0 ! Please check your config ! ********");
+static_assert(!COORDINATED_DIVERSION || RELAY_DIVERSION, "******** COORDINATED_DIVERSION needs RELAY_DIVERSION ! Please check your config ! ********");
 static_assert(check_pins(), "******** Duplicate pin definition ! Please check your config ! ********");
 static_assert((check_pins() & B00000011) == 0, "******** Pins 0 & 1 are reserved for RX/TX ! Please check your config ! ********");
-static_assert((check_pins() & 0xC000) == 0, "******** Pins 14 and/or 15 do not exist ! Please check your config ! ********");
+static_assert((check_pins() >> 20) == 0, "******** Pins above 19 (A5) do not exist ! Please check your config ! ********");
+static_assert(check_analog_pins(), "******** Pins 14..19 (A0..A5) used by the ADC cannot be used as digital pins ! Please check your config ! ********");
 static_assert(!(RF_CHIP_PRESENT && ((check_pins() & 0x3C04) != 0)), "******** Pins from RF chip are reserved ! Please check your config ! ********");
+#ifdef RF_PRESENT
+static_assert(RF_KEYFRAME_PERIOD != 0, "******** RF_KEYFRAME_PERIOD cannot be zero ! Please check your config ! ********");
+#endif
 static_assert(check_relay_pins(), "******** Wrong pin(s) configuration for relay(s) ********");
+static_assert((1 == relays.get_input_period()) || (DATALOG_PERIOD_IN_SECONDS == relays.get_input_period()), "******** The relays must be fed every second or every datalog period ********");
 
 #endif /* VALIDATION_H */
@@ -1,6 +1,7 @@
 
 #include <Arduino.h>
 
+#include "ewma_avg.hpp"
 #include "movingAvg.h"
 
 const int nb_of_interation_per_pass = 30000;
@@ -38,56 +39,6 @@ volatile boolean bool_1 = 0;
 volatile boolean bool_2 = 0;
 volatile boolean bool_3 = 0;
 
-constexpr uint8_t round_up_to_power_of_2(uint16_t v) {
-  if (__builtin_popcount(v) == 1) { return __builtin_ctz(v) - 1; }
-
-  uint8_t next_pow_of_2{ 0 };
-
-  while (v) {
-    v >>= 1;
-    ++next_pow_of_2;
-  }
-
-  return --next_pow_of_2;
-}
-
-template< uint8_t A = 10 >
-class EWMA_average {
-public:
-  void addValue(int32_t input) __attribute__((optimize("-Os")));
-
-  auto getAverageS() const {
-    return ema;
-  }
-
-  auto getAverageD() const {
-    return (ema << 1) - ema_ema;
-  }
-
-  auto getAverageT() const {
-    return 3 * (ema - ema_ema) + ema_ema_ema;
-  }
-
-private:
-  int32_t ema_ema_ema_raw{ 0 };
-  int32_t ema_ema_ema{ 0 };
-  int32_t ema_ema_raw{ 0 };
-  int32_t ema_ema{ 0 };
-  int32_t ema_raw{ 0 };
-  int32_t ema{ 0 };
-};
-
-template< uint8_t A> void EWMA_average<A>::addValue(int32_t input) {
-  ema_raw = ema_raw - ema + input;
-  ema = ema_raw >> (round_up_to_power_of_2(A));
-
-  ema_ema_raw = ema_ema_raw - ema_ema + ema;
-  ema_ema = ema_ema_raw >> (round_up_to_power_of_2(A) - 1);
-
-  ema_ema_ema_raw = ema_ema_ema_raw - ema_ema_ema + ema_ema;
-  ema_ema_ema = ema_ema_ema_raw >> (round_up_to_power_of_2(A) - 2);
-}
-
 movingAvg< int32_t, 10, 12 > sliding_Average;
 EWMA_average< 120 > ewma_average;
 constexpr uint8_t alpha{ round_up_to_power_of_2(120) };
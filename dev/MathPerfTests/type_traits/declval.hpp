@@ -1,8 +0,0 @@
-// ArduinoJson - https://arduinojson.org
-// Copyright © 2014-2023, Benoit BLANCHON
-// MIT License
-
-#pragma once
-
-template< typename T >
-T&& declval();
\ No newline at end of file
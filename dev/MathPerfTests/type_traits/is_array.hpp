@@ -1,22 +0,0 @@
-// ArduinoJson - https://arduinojson.org
-// Copyright © 2014-2023, Benoit BLANCHON
-// MIT License
-
-#pragma once
-#include <stddef.h>
-
-// size_t
-template< typename T >
-struct is_array : false_type
-{
-};
-
-template< typename T >
-struct is_array< T[] > : true_type
-{
-};
-
-template< typename T, size_t N >
-struct is_array< T[N] > : true_type
-{
-};
\ No newline at end of file
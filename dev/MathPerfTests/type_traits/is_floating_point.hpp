@@ -1,17 +0,0 @@
-// ArduinoJson - https://arduinojson.org
-// Copyright © 2014-2023, Benoit BLANCHON
-// MIT License
-
-#pragma once
-
-#include "integral_constant.hpp"
-#include "is_same.hpp"
-#include "remove_cv.hpp"
-
-template< class T >
-struct is_floating_point
-  : integral_constant<
-      bool,  //
-      is_same< float, typename remove_cv< T >::type >::value || is_same< double, typename remove_cv< T >::type >::value >
-{
-};
\ No newline at end of file
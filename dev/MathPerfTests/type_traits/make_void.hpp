@@ -1,11 +0,0 @@
-// ArduinoJson - https://arduinojson.org
-// Copyright © 2014-2023, Benoit BLANCHON
-// MIT License
-
-#pragma once
-
-template< class = void >
-struct make_void
-{
-  typedef void type;
-};
\ No newline at end of file
@@ -1,17 +0,0 @@
-// ArduinoJson - https://arduinojson.org
-// Copyright © 2014-2023, Benoit BLANCHON
-// MIT License
-
-#pragma once
-
-// A meta-function that return the type T without the const modifier
-template< typename T >
-struct remove_const
-{
-  typedef T type;
-};
-template< typename T >
-struct remove_const< const T >
-{
-  typedef T type;
-};
\ No newline at end of file
@@ -1,13 +0,0 @@
-// ArduinoJson - https://arduinojson.org
-// Copyright © 2014-2023, Benoit BLANCHON
-// MIT License
-
-#pragma once
-
-#include "integral_constant.hpp"
-
-template< typename T >
-struct type_identity
-{
-  typedef T type;
-};
\ No newline at end of file
@@ -0,0 +1,118 @@
+#!/usr/bin/env python3
+"""Decode the binary frames sent by the router on its Serial output.
+
+Frame layout (see utils_frame.h):
+    A5 5A | type (1) | length N (2, LE) | payload (N) | CRC-16/MCRF4XX over type..payload (2, LE)
+
+Usage:
+    decode_frames.py /dev/ttyUSB0 [--baud 9600] [--phases 3] [--sensors 0] [--loads 2]
+"""
+
+import argparse
+import struct
+import sys
+
+FRAME_RAW_SAMPLES = 0x01
+FRAME_DATALOG = 0x02
+FRAME_FAST_STREAM = 0x03
+
+
+def crc_ccitt_update(crc, data):
+    """Same as avr-libc '_crc_ccitt_update'."""
+    data ^= crc & 0xFF
+    data ^= (data << 4) & 0xFF
+    return (((data << 8) | (crc >> 8)) ^ (data >> 4) ^ (data << 3)) & 0xFFFF
+
+
+def read_frames(stream):
+    """Yield (type, payload) for each valid frame, resynchronizing on errors."""
+    previous = b''
+    while True:
+        byte = stream.read(1)
+        if not byte:
+            return
+        if previous + byte != b'\xA5\x5A':
+            previous = byte
+            continue
+        previous = b''
+        header = stream.read(3)
+        if len(header) < 3:
+            return
+        length = header[1] | (header[2] << 8)
+        payload = stream.read(length)
+        trailer = stream.read(2)
+        if len(payload) < length or len(trailer) < 2:
+            return
+        crc = 0xFFFF
+        for byte in header + payload:
+            crc = crc_ccitt_update(crc, byte)
+        if crc != (trailer[0] | (trailer[1] << 8)):
+            print('CRC error, frame dropped', file=sys.stderr)
+            continue
+        yield header[0], payload
+
+
+def decode_datalog(payload, phases, sensors, loads):
+    fmt = '<h{0}h{0}h{0}h{0}h{1}h{2}HHBhB'.format(phases, sensors, loads)
+    values = list(struct.unpack(fmt, payload))
+    record = {'power': values.pop(0)}
+    record['power_L'] = [values.pop(0) for _ in range(phases)]
+    record['Vrms_L'] = [values.pop(0) / 100 for _ in range(phases)]
+    record['Irms_L'] = [values.pop(0) / 100 for _ in range(phases)]
+    record['frequency_L'] = [values.pop(0) / 100 for _ in range(phases)]
+    record['temperature'] = [values.pop(0) / 100 for _ in range(sensors)]
+    record['countLoadON'] = [values.pop(0) for _ in range(loads)]
+    record['sampleSets'], record['lowestNoOfSampleSets'], record['energyInBucket'], flags = values
+    record['offPeak'] = bool(flags & 0x01)
+    return record
+
+
+def decode_fast_stream(payload, phases):
+    fmt = '<B{0}hhB'.format(phases)
+    values = list(struct.unpack(fmt, payload))
+    record = {'sequence': values.pop(0)}
+    record['power_L'] = [values.pop(0) for _ in range(phases)]
+    record['energyInBucket'], record['dropped'] = values
+    return record
+
+
+def decode_raw_samples(payload, phases):
+    channels = 2 * phases
+    set_size = channels + 2
+    sets = []
+    for offset in range(0, len(payload) - set_size + 1, set_size):
+        low = payload[offset:offset + channels]
+        high = payload[offset + channels] | (payload[offset + channels + 1] << 8)
+        sets.append([low[c] | (((high >> (2 * c)) & 0x03) << 8) for c in range(channels)])
+    return sets
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('port', help="serial port, or '-' for stdin")
+    parser.add_argument('--baud', type=int, default=9600)
+    parser.add_argument('--phases', type=int, default=3)
+    parser.add_argument('--sensors', type=int, default=0, help='number of temperature sensors')
+    parser.add_argument('--loads', type=int, default=2, help='number of dump loads')
+    args = parser.parse_args()
+
+    if args.port == '-':
+        stream = sys.stdin.buffer
+    else:
+        import serial  # pyserial
+        stream = serial.Serial(args.port, args.baud)
+
+    for frame_type, payload in read_frames(stream):
+        if frame_type == FRAME_DATALOG:
+            print(decode_datalog(payload, args.phases, args.sensors, args.loads))
+        elif frame_type == FRAME_FAST_STREAM:
+            print(decode_fast_stream(payload, args.phases))
+        elif frame_type == FRAME_RAW_SAMPLES:
+            for sample_set in decode_raw_samples(payload, args.phases):
+                print(*sample_set, sep='\t')
+        else:
+            print('unknown frame type 0x{:02X}'.format(frame_type), file=sys.stderr)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,97 @@
+#!/usr/bin/env python3
+"""Unpack the compact RF payloads sent by the router with RF_PACKED_PAYLOAD.
+
+Payload layout (see utils_rf.h):
+    flags/sequence (1) | each int16 field of tx_data as a zigzag varint (1 to 3 bytes)
+
+    The first byte has bit 7 set for a keyframe, bits 0-6 hold the sequence number.
+    A keyframe holds the values, the other payloads the differences with the previous one.
+
+Usage:
+    decode_rf_packed.py [--phases 3] [--sensors 0] < payloads.txt
+
+    Each input line holds one payload as hex bytes (spaces allowed), as logged by the receiver.
+"""
+
+import argparse
+import sys
+
+
+def read_varint(payload, offset):
+    value = 0
+    shift = 0
+    while True:
+        byte = payload[offset]
+        offset += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            return value, offset
+
+
+def to_int16(value):
+    value &= 0xFFFF
+    return value - 0x10000 if value & 0x8000 else value
+
+
+class Unpacker:
+    """Keep the previous fields, to apply the differences."""
+
+    def __init__(self, phases, sensors):
+        self.phases = phases
+        self.sensors = sensors
+        self.fields = None
+        self.sequence = None
+
+    def unpack(self, payload):
+        """Return the fields of tx_data, or None until the next keyframe after a gap."""
+        keyframe = bool(payload[0] & 0x80)
+        sequence = payload[0] & 0x7F
+        in_sequence = self.sequence is not None and sequence == (self.sequence + 1) & 0x7F
+        self.sequence = sequence
+
+        if not keyframe and (self.fields is None or not in_sequence):
+            self.fields = None
+            return None
+
+        count = 1 + 4 * self.phases + self.sensors
+        fields = []
+        offset = 1
+        for idx in range(count):
+            zigzag, offset = read_varint(payload, offset)
+            delta = (zigzag >> 1) ^ -(zigzag & 1)
+            fields.append(to_int16(delta if keyframe else self.fields[idx] + delta))
+        self.fields = fields
+        return self.record(fields)
+
+    def record(self, fields):
+        values = list(fields)
+        record = {'power': values.pop(0)}
+        record['power_L'] = [values.pop(0) for _ in range(self.phases)]
+        record['Vrms_L'] = [values.pop(0) / 100 for _ in range(self.phases)]
+        record['Irms_L'] = [values.pop(0) / 100 for _ in range(self.phases)]
+        record['frequency_L'] = [values.pop(0) / 100 for _ in range(self.phases)]
+        record['temperature'] = [values.pop(0) / 100 for _ in range(self.sensors)]
+        return record
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--phases', type=int, default=3)
+    parser.add_argument('--sensors', type=int, default=0, help='number of temperature sensors')
+    args = parser.parse_args()
+
+    unpacker = Unpacker(args.phases, args.sensors)
+    for line in sys.stdin:
+        line = line.strip()
+        if not line:
+            continue
+        record = unpacker.unpack(bytes.fromhex(line))
+        if record is None:
+            print('waiting for a keyframe', file=sys.stderr)
+        else:
+            print(record)
+
+
+if __name__ == '__main__':
+    main()